@@ -0,0 +1,86 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_EXEC_ITERATIONORDER_H
+#define SALUS_EXEC_ITERATIONORDER_H
+
+#include "execution/scheduler/sessionitem.h"
+
+#include <string_view>
+
+/**
+ * @file
+ * Session orderings used by ExecutionEngine to pick the next iteration to run on a lane.
+ * Kept separate from the engine so they can be reused, e.g. by the simulator.
+ */
+namespace salus::iterorder {
+
+/**
+ * @brief fairness (equalize time)
+ */
+inline bool fair(const SessionItem &a, const SessionItem &b)
+{
+    return a.usedRunningTime.load() < b.usedRunningTime.load();
+}
+
+/**
+ * @brief weighted fairness (equalize time normalized by weight)
+ */
+inline bool weighted(const SessionItem &a, const SessionItem &b)
+{
+    return a.usedRunningTime.load() / a.weight < b.usedRunningTime.load() / b.weight;
+}
+
+/**
+ * @brief round robin (equalize number of finished iterations)
+ */
+inline bool roundRobin(const SessionItem &a, const SessionItem &b)
+{
+    return a.numFinishedIters < b.numFinishedIters;
+}
+
+using Comparator = bool (*)(const SessionItem &, const SessionItem &);
+
+/**
+ * @brief The ordering for policy, or nullptr if the policy doesn't sort iterations
+ * (i.e. pack, fifo and preempt)
+ */
+inline Comparator comparatorFor(std::string_view policy)
+{
+    if (policy == "fair") {
+        return &fair;
+    } else if (policy == "drf") {
+        return &weighted;
+    } else if (policy == "rr") {
+        return &roundRobin;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Remaining time of a session. Preempt runs the session with the least remaining time exclusively.
+ */
+inline int64_t remainingTime(const SessionItem &s)
+{
+    return static_cast<int64_t>(s.totalRunningTime) - static_cast<int64_t>(s.usedRunningTime);
+}
+
+} // namespace salus::iterorder
+
+#endif // SALUS_EXEC_ITERATIONORDER_H
@@ -64,7 +64,7 @@ ResourceContext::~ResourceContext()
 
 ResourceContext::OperationScope ResourceContext::alloc(ResourceType type) const
 {
-    OperationScope scope(*this, resMon.lock());
+    OperationScope scope(*this, resMon.lock(m_ticket));
 
     auto staging = scope.proxy.queryStaging(m_ticket);
     auto num = sstl::optionalGet(staging, {type, m_spec});
@@ -80,7 +80,7 @@ ResourceContext::OperationScope ResourceContext::alloc(ResourceType type) const
 
 ResourceContext::OperationScope ResourceContext::alloc(ResourceType type, size_t num) const
 {
-    OperationScope scope(*this, resMon.lock());
+    OperationScope scope(*this, resMon.lock(m_ticket));
 
     scope.res[{type, m_spec}] = num;
     scope.valid = scope.proxy.allocate(m_ticket, scope.res);
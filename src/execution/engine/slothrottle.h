@@ -0,0 +1,66 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_EXEC_SLOTHROTTLE_H
+#define SALUS_EXEC_SLOTHROTTLE_H
+
+#include "execution/scheduler/schedulingparam.h"
+#include "execution/scheduler/sessionitem.h"
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * @file
+ * Service class handling of a scheduling round, shared by TaskExecutor and the simulator.
+ */
+namespace salus::slo {
+
+/**
+ * @brief Put latency sensitive candidates first, keeping the scheduler's order within each class.
+ * @returns whether any latency sensitive step in `sessions` is at risk of missing its target
+ */
+template<typename Candidates>
+bool prepareRound(const SessionList &sessions, Candidates &candidates, const SchedulingParam &param, int64_t nowMs)
+{
+    std::stable_partition(candidates.begin(), candidates.end(),
+                          [](const auto &item) { return item->isLatencySensitive(); });
+    return std::any_of(sessions.begin(), sessions.end(),
+                       [&](const auto &item) { return item->sloAtRisk(param.sloRiskThreshold, nowMs); });
+}
+
+/**
+ * @brief Whether to skip `item` in this round.
+ *
+ * Best effort sessions are skipped while `atRisk`, but at most `param.maxBestEffortSkip` rounds in a row.
+ */
+inline bool shouldThrottle(SessionItem &item, bool atRisk, const SchedulingParam &param)
+{
+    if (!atRisk || item.isLatencySensitive() || item.bgQueue.empty()
+        || item.numThrottledRounds >= param.maxBestEffortSkip) {
+        item.numThrottledRounds = 0;
+        return false;
+    }
+    ++item.numThrottledRounds;
+    return true;
+}
+
+} // namespace salus::slo
+
+#endif // SALUS_EXEC_SLOTHROTTLE_H
@@ -21,6 +21,7 @@
 
 #include "execution/engine/resourcecontext.h"
 #include "execution/engine/iterationcontext.h"
+#include "execution/engine/slothrottle.h"
 #include "execution/operationtask.h"
 #include "resources/resources.h"
 #include "execution/threadpool/threadpool.h"
@@ -29,6 +30,9 @@
 #include "utils/date.h"
 #include "platform/thread_annotations.h"
 
+#include <algorithm>
+#include <array>
+
 using std::chrono::duration_cast;
 using std::chrono::microseconds;
 using std::chrono::milliseconds;
@@ -198,6 +202,15 @@ void TaskExecutor::scheduleLoop()
             bool deleted = changeset.deletedSessions.count(sess) > 0;
             if (deleted) {
                 LOG(INFO) << "Deleting session " << sess->sessHandle << "@" << as_hex(sess);
+                if (sess->targetStepLatency > 0) {
+                    LOG(INFO) << "event: sess_slo_attainment "
+                              << nlohmann::json({
+                                     {"sess", sess->sessHandle},
+                                     {"targetStepLatency", sess->targetStepLatency},
+                                     {"met", sess->numSloMet.load()},
+                                     {"missed", sess->numSloMissed.load()},
+                                 });
+                }
                 if (sess->cleanupCb) {
                     sess->cleanupCb();
                     // reset cb to release anything that may depend on this
@@ -270,11 +283,23 @@ void TaskExecutor::scheduleLoop()
         // Deleted sessions are no longer needed, release them.
         changeset.deletedSessions.clear();
 
+        // Latency sensitive sessions always go first, keeping the scheduler's order within each class.
+        // Best effort ones are throttled for a bounded number of rounds while any latency sensitive
+        // step is at risk of missing its target.
+        const auto nowMs = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        const bool sloAtRisk = slo::prepareRound(m_sessions, candidates, m_schedParam, nowMs);
+
         // Schedule tasks from candidate sessions
         // NOTE: remainingCount only counts for candidate sessions in this sched iter.
         size_t remainingCount = 0;
         size_t scheduled = 0;
         for (auto &item : candidates) {
+            if (slo::shouldThrottle(*item, sloAtRisk, m_schedParam)) {
+                VLOG(3) << "Throttling best effort session " << item->sessHandle;
+                remainingCount += item->bgQueue.size();
+                continue;
+            }
+
             VLOG(3) << "Scheduling all opItem in session " << item->sessHandle << ": queue size "
                     << item->bgQueue.size();
 
@@ -293,11 +318,13 @@ void TaskExecutor::scheduleLoop()
         // Log performance counters
         CLOG(INFO, logging::kPerfTag)
             << "Scheduler iter stat: " << schedIterCount << " running: " << m_nRunningTasks
-            << " noPageRunning: " << m_nNoPagingRunningTasks;
+            << " noPageRunning: " << m_nNoPagingRunningTasks << " sloAtRisk: " << sloAtRisk;
         for (auto &item : m_sessions) {
             CLOG(INFO, logging::kPerfTag)
                 << "Sched iter " << schedIterCount << " session: " << item->sessHandle
-                << " pending: " << item->bgQueue.size() << " scheduled: " << item->lastScheduled << " "
+                << " pending: " << item->bgQueue.size() << " scheduled: " << item->lastScheduled
+                << " sloMet: " << item->numSloMet << " sloMissed: " << item->numSloMissed
+                << " holLimit: " << item->holLimit << " "
                 << scheduler->debugString(item);
         }
 
@@ -369,11 +396,63 @@ POpItem TaskExecutor::runTask(POpItem &&opItem)
     }
 
     // NOTE: this is waited by schedule thread, so we can't afford running
-    // the operation inline. If the thread pool is full, simply consider the
+    // the operation inline. The pool spills over instead of rejecting when its
+    // queues are full, but should it ever refuse the task, simply consider the
     // opItem as not scheduled.
 
+    // latency sensitive sessions' ops skip ahead of best effort ones queued in the pool
+    const auto priority = item->isLatencySensitive() ? TaskPriority::High : TaskPriority::Normal;
+
     // opItem has to be captured by value, we need it in case the thread pool is full
-    auto c = m_pool.tryRun([opItem, this]() mutable {
+    auto c = m_pool.tryRun(makeTaskClosure(opItem), priority);
+    if (!c) {
+        // successfully sent to thread pool, we can reset opItem
+        opItem.reset();
+    }
+    return std::move(opItem);
+}
+
+size_t TaskExecutor::runTasks(std::vector<POpItem> &opItems)
+{
+    // Same as runTask, but one tryRunBatch per priority, so the pool wakes up workers
+    // once for all of them
+    std::array<std::vector<ThreadPool::Closure>, kNumTaskPriorities> batches;
+    std::array<std::vector<size_t>, kNumTaskPriorities> indices;
+    for (size_t i = 0; i != opItems.size(); ++i) {
+        auto &opItem = opItems[i];
+        if (!opItem) {
+            continue;
+        }
+        auto item = opItem->sess.lock();
+        if (!item) {
+            // discard
+            opItem.reset();
+            continue;
+        }
+        const auto level = static_cast<size_t>(item->isLatencySensitive() ? TaskPriority::High : TaskPriority::Normal);
+        batches[level].emplace_back(makeTaskClosure(opItem));
+        indices[level].emplace_back(i);
+    }
+
+    size_t sent = 0;
+    for (size_t level = 0; level != kNumTaskPriorities; ++level) {
+        if (batches[level].empty()) {
+            continue;
+        }
+        sent += m_pool.tryRunBatch(batches[level], static_cast<TaskPriority>(level));
+        for (size_t k = 0; k != batches[level].size(); ++k) {
+            if (!batches[level][k]) {
+                // successfully sent to thread pool, we can reset opItem
+                opItems[indices[level][k]].reset();
+            }
+        }
+    }
+    return sent;
+}
+
+ThreadPool::Closure TaskExecutor::makeTaskClosure(POpItem opItem)
+{
+    return [opItem = std::move(opItem), this]() mutable {
         DCHECK(opItem);
 
         if (auto item = opItem->sess.lock()) {
@@ -398,6 +477,7 @@ POpItem TaskExecutor::runTask(POpItem &&opItem)
                 }
 
                 taskStopped(*opItem, true);
+                ++item->numOomRetries;
                 // failed due to OOM. Push back to queue and retry later
                 VLOG(2) << "Putting back OOM failed task: " << opItem->op;
                 queueTask(std::move(opItem));
@@ -408,18 +488,16 @@ POpItem TaskExecutor::runTask(POpItem &&opItem)
             taskRunning(*opItem);
             opItem->op->run(std::move(cbs));
         }
-    });
-    if (!c) {
-        // successfully sent to thread pool, we can reset opItem
-        opItem.reset();
-    }
-    return std::move(opItem);
+    };
 }
 
 void TaskExecutor::taskRunning(OperationItem &opItem)
 {
     LogOpTracing() << "OpItem Event " << opItem.op << " event: running";
     m_nRunningTasks += 1;
+    if (auto item = opItem.sess.lock()) {
+        item->numRunningTasks += 1;
+    }
     if (!opItem.op->isAsync()) {
         m_nNoPagingRunningTasks += 1;
     }
@@ -443,6 +521,9 @@ void TaskExecutor::taskStopped(OperationItem &opItem, bool failed)
     }
 
     m_nRunningTasks -= 1;
+    if (auto item = opItem.sess.lock()) {
+        item->numRunningTasks -= 1;
+    }
     if (!opItem.op->isAsync()) {
         m_nNoPagingRunningTasks -= 1;
     }
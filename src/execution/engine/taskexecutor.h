@@ -21,6 +21,7 @@
 #define SALUS_EXEC_TASKEXECUTOR_H
 
 #include "execution/scheduler/schedulingparam.h"
+#include "execution/threadpool/threadpool.h"
 #include "resources/resources.h"
 #include "utils/threadutils.h"
 
@@ -28,9 +29,9 @@
 #include <thread>
 #include <list>
 #include <memory>
+#include <vector>
 
 class ResourceMonitor;
-class ThreadPool;
 struct SessionItem;
 using PSessionItem = std::shared_ptr<SessionItem>;
 struct OperationItem;
@@ -62,6 +63,11 @@ public:
         return m_schedParam;
     }
 
+    const ResourceMonitor &resourceMonitor() const
+    {
+        return m_resMonitor;
+    }
+
     void insertSession(PSessionItem sess);
 
     /**
@@ -82,6 +88,13 @@ public:
     // actually run task
     POpItem runTask(POpItem &&opItem);
 
+    /**
+     * @brief Batched runTask. Tasks sent to the thread pool or discarded are reset in opItems,
+     * the rest are kept in place.
+     * @returns number of tasks sent to the thread pool
+     */
+    size_t runTasks(std::vector<POpItem> &opItems);
+
     void deleteSession(PSessionItem item);
 
 private:
@@ -113,6 +126,9 @@ private:
      */
     std::list<PSessionItem> m_sessions;
 
+    // Wrap opItem to run in the thread pool
+    ThreadPool::Closure makeTaskClosure(POpItem opItem);
+
     // Task life cycle
     void taskStopped(OperationItem &opItem, bool failed);
     void taskRunning(OperationItem &opItem);
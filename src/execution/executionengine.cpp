@@ -22,10 +22,12 @@
 #include "execution/executionengine.h"
 
 #include "execution/engine/iterationcontext.h"
+#include "execution/engine/iterationorder.h"
 #include "execution/engine/resourcecontext.h"
 #include "execution/iterationtask.h"
 #include "platform/logging.h"
 #include "platform/thread_annotations.h"
+#include "resources/profilecache.h"
 #include "utils/containerutils.h"
 #include "utils/date.h"
 #include "utils/debugging.h"
@@ -37,6 +39,7 @@
 #include <algorithm>
 #include <functional>
 #include <iomanip>
+#include <optional>
 #include <unordered_map>
 
 using std::chrono::duration_cast;
@@ -57,14 +60,26 @@ ExecutionEngine &ExecutionEngine::instance()
     return eng;
 }
 
+/*static*/ ThreadAffinity ExecutionEngine::m_poolAffinity;
+
 ExecutionEngine::ExecutionEngine()
-    : m_taskExecutor(m_pool, m_resMonitor, m_schedParam)
+    : m_pool(ThreadPoolOptions{}.setAffinity(m_poolAffinity))
+    , m_taskExecutor(m_pool, m_resMonitor, m_schedParam)
 {
 }
 
 void ExecutionEngine::startScheduler()
 {
+    // limits may have changed since construction, e.g. by discovering GPU memory
     m_resMonitor.initializeLimits();
+    m_allocReg.initializeLimits();
+
+    AllocationRegulator::QueueOptions queueOpts;
+    queueOpts.enabled = m_schedParam.allocQueue;
+    queueOpts.aging = std::chrono::milliseconds(m_schedParam.allocQueueAging);
+    queueOpts.timeout = std::chrono::milliseconds(m_schedParam.allocQueueTimeout);
+    m_allocReg.setQueueOptions(queueOpts);
+
     m_taskExecutor.startExecution();
 
     m_schedThread = std::make_unique<std::thread>(std::bind(&ExecutionEngine::scheduleLoop, this));
@@ -82,6 +97,8 @@ void ExecutionEngine::stopScheduler()
     }
 
     m_taskExecutor.stopExecution();
+
+    ProfileCache::instance().save(/*force=*/true);
 }
 
 ExecutionEngine::~ExecutionEngine()
@@ -247,41 +264,44 @@ int ExecutionEngine::scheduleOnQueue(LaneQueue &lctx, IterQueue &staging)
     // For all main iters
     lctx.queue.swap(staging);
 
-    auto rrSorter = [](const auto &iterItemA, const auto &iterItemB) {
-        std::shared_ptr<ExecutionContext> ectxA = iterItemA.wectx.lock();
-        std::shared_ptr<ExecutionContext> ectxB = iterItemB.wectx.lock();
-        if (!ectxB) {
-            return true; // A goes first
-        }
-        if (!ectxA) {
-            return false; // B goes first
-        }
-
-        return ectxA->m_item->numFinishedIters < ectxB->m_item->numFinishedIters;
-    };
+    if (auto cmp = iterorder::comparatorFor(m_schedParam.scheduler)) {
+        staging.sort([cmp](const auto &iterItemA, const auto &iterItemB) {
+            std::shared_ptr<ExecutionContext> ectxA = iterItemA.wectx.lock();
+            std::shared_ptr<ExecutionContext> ectxB = iterItemB.wectx.lock();
+            if (!ectxB) {
+                return true; // A goes first
+            }
+            if (!ectxA) {
+                return false; // B goes first
+            }
+            return cmp(*ectxA->m_item, *ectxB->m_item);
+        });
+    }
 
-    auto fairSorter = [](const auto &iterItemA, const auto &iterItemB) {
-        std::shared_ptr<ExecutionContext> ectxA = iterItemA.wectx.lock();
-        std::shared_ptr<ExecutionContext> ectxB = iterItemB.wectx.lock();
-        if (!ectxB) {
-            return true; // A goes first
+    // Latency sensitive iters go first in earliest deadline order, then the rest in the policy's order.
+    // They still go through the policy below, so exclusivity and work conservation apply to them too.
+    auto lsDeadline = [](const auto &iterItem) -> std::optional<system_clock::time_point> {
+        auto ectx = iterItem.wectx.lock();
+        if (!ectx || !ectx->m_item->isLatencySensitive()) {
+            return std::nullopt;
         }
-        if (!ectxA) {
-            return false; // B goes first
+        if (ectx->m_item->targetStepLatency == 0) {
+            return system_clock::time_point::max();
         }
-
-        // fairness (equalize time)
-        auto reA = ectxA->m_item->usedRunningTime.load();
-        auto reB = ectxB->m_item->usedRunningTime.load();
-        return reA < reB;
+        return iterItem.queued + milliseconds(ectx->m_item->targetStepLatency);
     };
+    // list::sort is stable, so the policy's order is kept within each class
+    staging.sort([&lsDeadline](const auto &iterItemA, const auto &iterItemB) {
+        auto deadlineA = lsDeadline(iterItemA);
+        auto deadlineB = lsDeadline(iterItemB);
+        if (!deadlineA) {
+            return false;
+        }
+        return !deadlineB || *deadlineA < *deadlineB;
+    });
 
-    if (m_schedParam.scheduler == "fair") {
-        staging.sort(fairSorter);
-    } else if (m_schedParam.scheduler == "rr") {
-        staging.sort(rrSorter);
-    } else if (m_schedParam.scheduler == "pack") {
-        // do nothing
+    if (m_schedParam.scheduler == "pack" || iterorder::comparatorFor(m_schedParam.scheduler)) {
+        // already in order, run by the loop below
     } else if (m_schedParam.scheduler == "fifo") {
         PSessionItem sessItem = nullptr;
         auto it = lctx.fifoQueue.begin();
@@ -326,7 +346,7 @@ int ExecutionEngine::scheduleOnQueue(LaneQueue &lctx, IterQueue &staging)
         PSessionItem sessItem = nullptr;
         for (auto &ws : lctx.sessions) {
             if (auto s = ws.lock()) {
-                auto remain = static_cast<int64_t>(s->totalRunningTime) - static_cast<int64_t>(s->usedRunningTime);
+                auto remain = iterorder::remainingTime(*s);
                 if (remain <= minRemainingTime) {
                     minRemainingTime = remain;
                     sessItem = std::move(s);
@@ -367,8 +387,11 @@ int ExecutionEngine::scheduleOnQueue(LaneQueue &lctx, IterQueue &staging)
         staging.clear();
     }
 
-    // If work conservation is disabled we will only schedule one iter
+    // If work conservation is disabled we will only schedule one iter.
+    // If any latency sensitive iter can't start yet, hold back best effort iters so they won't
+    // take the lane before it.
     bool done = false;
+    bool lsPending = false;
     for (auto &iterItem : staging) {
         if (iterItem.iter->isCanceled()) {
             continue;
@@ -379,7 +402,8 @@ int ExecutionEngine::scheduleOnQueue(LaneQueue &lctx, IterQueue &staging)
             continue;
         }
 
-        if (!m_schedParam.workConservative && done) {
+        const bool ls = ectx->m_item->isLatencySensitive();
+        if ((!m_schedParam.workConservative && done) || (lsPending && !ls)) {
             lctx.queue.emplace_back(std::move(iterItem));
             continue;
         }
@@ -391,6 +415,7 @@ int ExecutionEngine::scheduleOnQueue(LaneQueue &lctx, IterQueue &staging)
             }
         } else {
             lctx.queue.emplace_back(std::move(iterItem));
+            lsPending = lsPending || ls;
         }
     } // for (auto &iterItem : staging)
     staging.clear();
@@ -432,14 +457,22 @@ bool ExecutionEngine::runIter(IterationItem &iterItem, ExecutionContext &ectx, L
     }
 
     bool expensive = iterItem.iter->isExpensive();
+    if (expensive) {
+        ectx.m_item->stepQueuedAt = duration_cast<milliseconds>(iterItem.queued.time_since_epoch()).count();
+    }
 
     auto iCtx = std::make_shared<IterationContext>(m_taskExecutor, ectx.m_item,
-                                                   [&lctx, expensive, start = system_clock::now()](auto &sessItem) {
+                                                   [&lctx, expensive, queued = iterItem.queued,
+                                                    start = system_clock::now()](auto &sessItem) {
                                                        if (expensive) {
+                                                           auto now = system_clock::now();
                                                            auto usedTime =
-                                                               duration_cast<milliseconds>(system_clock::now() - start).count();
+                                                               duration_cast<milliseconds>(now - start).count();
                                                            sessItem.usedRunningTime += usedTime;
                                                            ++sessItem.numFinishedIters;
+                                                           sessItem.recordStepLatency(
+                                                               duration_cast<milliseconds>(now - queued).count());
+                                                           sessItem.stepQueuedAt = 0;
                                                            if (VLOG_IS_ON(1)) {
                                                                LogOpTracing() << "event: sess_add_time " << nlohmann::json({
                                                                    {"sess", sessItem.sessHandle},
@@ -507,6 +540,12 @@ void ExecutionContext::setInterruptCallback(std::function<void()> cb)
     m_item->setInterruptCallback(std::move(cb));
 }
 
+void ExecutionContext::setIterationEndCallback(std::function<void(const ResStats &)> cb)
+{
+    DCHECK(m_item);
+    m_item->setIterationEndCallback(std::move(cb));
+}
+
 std::unique_ptr<ResourceContext> ExecutionContext::makeResourceContext(uint64_t graphId, const DeviceSpec &spec,
                                                                        const Resources &res, Resources *missing)
 {
@@ -560,4 +599,23 @@ void ExecutionContext::setExpectedRunningTime(uint64_t time)
     DCHECK(m_item);
     m_item->totalRunningTime = time;
 }
+
+void ExecutionContext::setSchedulingWeight(double weight)
+{
+    DCHECK(m_item);
+    m_item->weight = weight;
+}
+
+void ExecutionContext::setServiceLevel(PriorityClass cls, uint64_t targetStepLatency)
+{
+    DCHECK(m_item);
+    m_item->priorityClass = cls;
+    m_item->targetStepLatency = targetStepLatency;
+}
+
+void ExecutionContext::setProfileKey(uint64_t key)
+{
+    DCHECK(m_item);
+    m_item->profileKey = key;
+}
 } // namespace salus
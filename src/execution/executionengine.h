@@ -73,6 +73,19 @@ public:
         return m_schedParam;
     }
 
+    /**
+     * @brief CPU affinity of the compute pool, only effective if set before the first call to instance()
+     */
+    static void setPoolAffinity(const ThreadAffinity &affinity)
+    {
+        m_poolAffinity = affinity;
+    }
+
+    static const ThreadAffinity &poolAffinity()
+    {
+        return m_poolAffinity;
+    }
+
     std::shared_ptr<ExecutionContext> makeContext();
 
 private:
@@ -80,6 +93,8 @@ private:
 
     ExecutionEngine();
 
+    static ThreadAffinity m_poolAffinity;
+
     // scheduler parameters
     salus::SchedulingParam m_schedParam;
 
@@ -98,6 +113,7 @@ private:
     {
         std::weak_ptr<ExecutionContext> wectx;
         std::unique_ptr<IterationTask> iter;
+        std::chrono::system_clock::time_point queued = std::chrono::system_clock::now();
     };
 
 
@@ -161,6 +177,10 @@ public:
 
     void registerPagingCallbacks(PagingCallbacks &&pcb);
     void setInterruptCallback(std::function<void()> cb);
+    /**
+     * @brief Called after every iteration with the session's usage estimated so far
+     */
+    void setIterationEndCallback(std::function<void(const ResStats &)> cb);
 
     void setSessionHandle(const std::string &h);
 
@@ -188,6 +208,24 @@ public:
 
     void setExpectedRunningTime(uint64_t time);
 
+    /**
+     * @brief Set the relative share of this session used by weighted schedulers.
+     * Must be called before setSessionHandle.
+     */
+    void setSchedulingWeight(double weight);
+
+    /**
+     * @brief Set the service class and target step latency (in ms, 0 means none) of this session.
+     * Must be called before setSessionHandle.
+     */
+    void setServiceLevel(PriorityClass cls, uint64_t targetStepLatency);
+
+    /**
+     * @brief Set the key under which the session's memory footprint is kept in ProfileCache.
+     * Must be called before setSessionHandle.
+     */
+    void setProfileKey(uint64_t key);
+
     /**
      * @brief Make a resource context that first allocate from session's resources
      * @param spec
@@ -24,12 +24,15 @@
 #include "execution/engine/resourcecontext.h"
 #include "execution/operationtask.h"
 #include "execution/scheduler/operationitem.h"
+#include "execution/scheduler/schedclock.h"
 #include "platform/logging.h"
 #include "utils/debugging.h"
 #include "utils/envutils.h"
 #include "utils/macros.h"
 #include "utils/threadutils.h"
 
+#include <algorithm>
+
 using std::chrono::duration_cast;
 using FpMS = std::chrono::duration<double, std::chrono::milliseconds::period>;
 using namespace std::chrono_literals;
@@ -160,11 +163,21 @@ std::string BaseScheduler::debugString() const
 }
 
 POpItem BaseScheduler::submitTask(POpItem &&opItem)
+{
+    if (preAllocateTask(opItem)) {
+        // Send to thread pool
+        opItem = m_taskExec.runTask(std::move(opItem));
+    }
+    return std::move(opItem);
+}
+
+bool BaseScheduler::preAllocateTask(POpItem &opItem)
 {
     auto item = opItem->sess.lock();
     if (!item) {
         // session already deleted, discard this task sliently
-        return nullptr;
+        opItem.reset();
+        return false;
     }
 
     VLOG(3) << "Scheduling opItem in session " << item->sessHandle << ": " << opItem->op;
@@ -187,14 +200,11 @@ POpItem BaseScheduler::submitTask(POpItem &&opItem)
 
     LogOpTracing() << "OpItem Event " << opItem->op << " event: prealloced";
 
-    // Send to thread pool
-    if (scheduled) {
-        opItem = m_taskExec.runTask(std::move(opItem));
-    } else {
+    if (!scheduled) {
         VLOG(2) << "Failed to schedule opItem in session " << item->sessHandle << ": "
                 << opItem->op->DebugString();
     }
-    return opItem;
+    return scheduled;
 }
 
 size_t BaseScheduler::submitAllTaskFromQueue(const PSessionItem &item)
@@ -207,9 +217,11 @@ size_t BaseScheduler::submitAllTaskFromQueue(const PSessionItem &item)
     }
 
     // Exam if queue front has been waiting for a long time
-    if (item->holWaiting > m_taskExec.schedulingParam().maxHolWaiting) {
+    const auto maxHolWaiting = holLimitFor(*item);
+    const bool headOnly = item->holWaiting > maxHolWaiting;
+    if (headOnly) {
         VLOG(2) << "In session " << item->sessHandle << ": HOL waiting exceeds maximum: " << item->holWaiting
-                << " (max=" << m_taskExec.schedulingParam().maxHolWaiting << ")";
+                << " (max=" << maxHolWaiting << ")";
         // Only try to schedule head in this case
         auto &head = queue.front();
         head = submitTask(std::move(head));
@@ -241,10 +253,24 @@ size_t BaseScheduler::submitAllTaskFromQueue(const PSessionItem &item)
             }
         }
 #else
+        // Pre-allocate for all first, then hand those succeeded to the thread pool in one batch,
+        // which wakes up workers once rather than once per task. Entries sent are reset in place,
+        // so what's left goes back to queue in the original order.
+        std::vector<POpItem> ready;
+        std::vector<SessionItem::UnsafeQueue::iterator> readyPos;
+        for (auto it = stage.begin(); it != stage.end(); ++it) {
+            if (preAllocateTask(*it)) {
+                ready.emplace_back(std::move(*it));
+                readyPos.emplace_back(it);
+            }
+        }
+        m_taskExec.runTasks(ready);
+        for (size_t i = 0; i != ready.size(); ++i) {
+            *readyPos[i] = std::move(ready[i]);
+        }
         for (auto &opItem : stage) {
-            auto poi = submitTask(std::move(opItem));
-            if (poi) {
-                queue.emplace_back(std::move(poi));
+            if (opItem) {
+                queue.emplace_back(std::move(opItem));
             }
         }
 #endif
@@ -262,7 +288,72 @@ size_t BaseScheduler::submitAllTaskFromQueue(const PSessionItem &item)
     } else {
         item->queueHeadHash = queue.front()->hash();
         item->holWaiting = 0;
+        item->holSince = SchedClock::now();
+    }
+
+    if (m_taskExec.schedulingParam().adaptiveHol) {
+        adaptHolLimit(*item, scheduled, headOnly);
     }
 
     return scheduled;
 }
+
+uint64_t BaseScheduler::holLimitFor(SessionItem &item) const
+{
+    const auto &param = m_taskExec.schedulingParam();
+    if (!param.adaptiveHol) {
+        return param.maxHolWaiting;
+    }
+    if (item.holLimit == 0) {
+        item.holLimit = std::clamp(param.maxHolWaiting, param.minHolWaiting, param.maxHolWaitingCap);
+        item.holLastAdjust = SchedClock::now();
+    }
+    return item.holLimit;
+}
+
+void BaseScheduler::adaptHolLimit(SessionItem &item, size_t scheduled, bool headOnly)
+{
+    const auto &param = m_taskExec.schedulingParam();
+    const auto target = std::chrono::milliseconds(param.holTargetBlocking);
+    const auto now = SchedClock::now();
+
+    auto oomRetries = item.numOomRetries.load();
+    bool oom = oomRetries > item.lastOomRetries;
+
+    if (now - item.holLastAdjust < target) {
+        return;
+    }
+    item.lastOomRetries = oomRetries;
+
+    // A head-only pass keeps the head in place, so it would always look blocked. Only passes that
+    // let later tasks go count as blocking the head.
+    bool idle = headOnly && scheduled == 0;
+    bool blocked = !headOnly && !item.bgQueue.empty() && now - item.holSince > target;
+
+    auto limit = item.holLimit;
+    const char *reason = nullptr;
+    if (oom) {
+        limit = std::max(param.minHolWaiting, limit / 2);
+        reason = "oom";
+    } else if (idle) {
+        limit = std::min(param.maxHolWaitingCap, limit + 1);
+        reason = "idle";
+    } else if (blocked) {
+        limit = std::max(param.minHolWaiting, limit / 2);
+        reason = "blocked";
+    }
+
+    if (!reason || limit == item.holLimit) {
+        return;
+    }
+
+    item.holLimit = limit;
+    item.holLastAdjust = now;
+    CLOG(INFO, logging::kPerfTag) << "event: hol_limit "
+                                  << nlohmann::json({
+                                         {"sess", item.sessHandle},
+                                         {"limit", limit},
+                                         {"reason", reason},
+                                         {"timestamp", now.time_since_epoch().count()},
+                                     });
+}
@@ -120,6 +120,13 @@ protected:
      */
     POpItem submitTask(POpItem &&opItem);
 
+    /**
+     * @brief Pre-allocate resources for the task on the first device it fits, the first half of submitTask.
+     * @param opItem the task, reset if its session is already gone
+     * @returns whether the task is ready to be sent to the thread pool
+     */
+    bool preAllocateTask(POpItem &opItem);
+
     /**
      * @brief a convenient helper function to submit all tasks in queue from session, with HOL blocking handled.
      *
@@ -130,6 +137,25 @@ protected:
      */
     size_t submitAllTaskFromQueue(const PSessionItem &item);
 
+    /**
+     * @brief Head-of-line waiting limit for the session, adaptive or from SchedulingParam
+     */
+    uint64_t holLimitFor(SessionItem &item) const;
+
+    /**
+     * @brief Feedback controller for the adaptive head-of-line waiting limit.
+     *
+     * Halves the limit when tasks failed due to OOM (bypassing tasks are eating memory the head needs),
+     * or when later tasks were let through while the queue head stayed blocked longer than the target.
+     * Raises it by one when only the head is tried and even that fails (blocking others doesn't help).
+     * Adjusts at most once every target blocking time.
+     *
+     * @param item the session just scheduled from
+     * @param scheduled number of tasks scheduled
+     * @param headOnly whether only the head was tried
+     */
+    void adaptHolLimit(SessionItem &item, size_t scheduled, bool headOnly);
+
 
     /**
      * @brief Missing resources per operation in this iteration.
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "drf.h"
+
+#include "execution/scheduler/operationitem.h"
+#include "execution/operationtask.h"
+#include "utils/macros.h"
+#include "utils/date.h"
+#include "platform/logging.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <sstream>
+
+using std::chrono::seconds;
+using FpSeconds = std::chrono::duration<double, seconds::period>;
+using namespace salus;
+
+namespace {
+SchedulerRegistary::Register reg("drf", [](auto &engine) {
+    return std::make_unique<DrfScheduler>(engine);
+});
+
+// Memory resources considered when computing the dominant share
+constexpr ResourceTag TrackedMemoryTags[] = {
+    resources::GPU0Memory,
+    resources::GPU1Memory,
+    resources::CPU0Memory,
+};
+
+// Weights below this are treated as this, to avoid dividing by zero
+constexpr double MinWeight = 1e-3;
+
+} // namespace
+
+DrfScheduler::DrfScheduler(TaskExecutor &engine)
+    : BaseScheduler(engine)
+    , m_lastSnapshot(SchedClock::now())
+{
+}
+
+DrfScheduler::~DrfScheduler() = default;
+
+std::string DrfScheduler::name() const
+{
+    return "drf";
+}
+
+double DrfScheduler::dominantShare(SessionItem &item, int64_t totalRunning) const
+{
+    const auto &capacity = m_taskExec.resourceMonitor().capacity();
+
+    double share = 0;
+    for (const auto &tag : TrackedMemoryTags) {
+        auto cap = sstl::getOrDefault(capacity, tag, 0);
+        if (cap == 0) {
+            continue;
+        }
+        share = std::max(share, static_cast<double>(item.resourceUsage(tag)) / cap);
+    }
+
+    // Compute is measured as the fraction of currently running tasks owned by the session
+    if (totalRunning > 0) {
+        share = std::max(share, static_cast<double>(item.numRunningTasks.load()) / totalRunning);
+    }
+    return share;
+}
+
+void DrfScheduler::notifyPreSchedulingIteration(const SessionList &sessions,
+                                                const SessionChangeSet &changeset,
+                                                sstl::not_null<CandidateList *> candidates)
+{
+    BaseScheduler::notifyPreSchedulingIteration(sessions, changeset, candidates);
+
+    candidates->clear();
+
+    // Remove old sessions, everyone else keeps their history
+    for (auto &sess : changeset.deletedSessions) {
+        m_clocks.erase(sess.get());
+    }
+
+    for (auto it = changeset.addedSessionBegin; it != changeset.addedSessionEnd; ++it) {
+        VLOG(2) << "Adding session " << (*it)->sessHandle << " with weight " << (*it)->weight
+                << " at virtual time " << m_systemVTime;
+    }
+
+    auto now = SchedClock::now();
+    auto sSinceLastSnapshot = FpSeconds(now - m_lastSnapshot).count();
+    m_lastSnapshot = now;
+
+    int64_t totalRunning = 0;
+    for (auto &sess : sessions) {
+        totalRunning += sess->numRunningTasks.load();
+    }
+
+    auto minVTime = std::numeric_limits<double>::max();
+    for (auto &sess : sessions) {
+        candidates->emplace_back(sess);
+
+        auto [it, inserted] = m_clocks.try_emplace(sess.get());
+        auto &clock = it->second;
+        if (inserted) {
+            // New sessions start at the system virtual time, so they neither lose to
+            // existing sessions forever nor get to claim the time before they arrive.
+            clock.vtime = m_systemVTime;
+        }
+        // Charge the share held since the last snapshot. The share now may already reflect tasks that
+        // finished just before this iteration, which would charge nothing for the time they ran.
+        clock.vtime += clock.share * sSinceLastSnapshot / std::max(sess->weight, MinWeight);
+        clock.share = dominantShare(*sess, totalRunning);
+        minVTime = std::min(minVTime, clock.vtime);
+    }
+    if (!sessions.empty()) {
+        m_systemVTime = std::max(m_systemVTime, minVTime);
+    }
+
+    // We assume m_sessions.size() is always no more than a few,
+    // therefore sorting in every iteration is acceptable.
+    using std::sort;
+    sort(candidates->begin(), candidates->end(), [this](const auto &lhs, const auto &rhs) {
+        const auto &l = m_clocks.at(lhs.get());
+        const auto &r = m_clocks.at(rhs.get());
+        if (l.vtime == r.vtime) {
+            return l.share < r.share;
+        }
+        return l.vtime < r.vtime;
+    });
+}
+
+std::pair<size_t, bool> DrfScheduler::maybeScheduleFrom(PSessionItem item)
+{
+    auto scheduled = submitAllTaskFromQueue(item);
+
+    return reportScheduleResult(scheduled);
+}
+
+std::pair<size_t, bool> DrfScheduler::reportScheduleResult(size_t scheduled) const
+{
+    static auto workConservative = m_taskExec.schedulingParam().workConservative;
+    // make sure the session with least virtual time is
+    // get scheduled solely, thus can keep up, without other
+    // sessions interfere
+    return {scheduled, workConservative && scheduled == 0};
+}
+
+std::string DrfScheduler::debugString(const PSessionItem &item) const
+{
+    std::ostringstream oss;
+    const auto &clock = m_clocks.at(item.get());
+    oss << "vtime: " << clock.vtime << " share: " << clock.share << " weight: " << item->weight;
+    return oss.str();
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_EXEC_SCHED_DRF_H
+#define SALUS_EXEC_SCHED_DRF_H
+
+#include "execution/scheduler/basescheduler.h"
+#include "execution/scheduler/schedclock.h"
+
+#include <chrono>
+#include <unordered_map>
+
+/**
+ * @brief Weighted dominant resource fairness across memory and compute.
+ *
+ * Each session carries a virtual time that advances by its dominant share divided by its weight.
+ * Sessions with the smallest virtual time are scheduled first. Unlike FairScheduler, the accounting
+ * is never reset when sessions come and go: new sessions join at the current system virtual time.
+ */
+class DrfScheduler : public BaseScheduler
+{
+public:
+    explicit DrfScheduler(salus::TaskExecutor &engine);
+    ~DrfScheduler() override;
+
+    std::string name() const override;
+
+    void notifyPreSchedulingIteration(const SessionList &sessions,
+                                      const SessionChangeSet &changeset,
+                                      sstl::not_null<CandidateList *> candidates) override;
+    std::pair<size_t, bool> maybeScheduleFrom(PSessionItem item) override;
+
+    using BaseScheduler::debugString;
+    std::string debugString(const PSessionItem &item) const override;
+
+private:
+    std::pair<size_t, bool> reportScheduleResult(size_t scheduled) const;
+
+    /**
+     * @brief Dominant share of a session, i.e. the maximum of its share on each tracked resource.
+     * @param item the session
+     * @param totalRunning number of running tasks across all sessions, used as compute capacity
+     */
+    double dominantShare(SessionItem &item, int64_t totalRunning) const;
+
+    struct VirtualClock
+    {
+        double vtime = 0;
+        double share = 0;
+    };
+    // Keyed by session item rather than handle, entries are only removed when the session is deleted.
+    std::unordered_map<const SessionItem *, VirtualClock> m_clocks;
+
+    // Minimum virtual time among active sessions, never goes backward.
+    double m_systemVTime = 0;
+
+    salus::SchedClock::time_point m_lastSnapshot;
+};
+
+#endif // SALUS_EXEC_SCHED_DRF_H
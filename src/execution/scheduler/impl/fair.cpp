@@ -20,6 +20,7 @@
 #include "fair.h"
 
 #include "execution/scheduler/operationitem.h"
+#include "execution/scheduler/schedclock.h"
 #include "execution/operationtask.h"
 #include "utils/macros.h"
 #include "utils/date.h"
@@ -60,7 +61,7 @@ void FairScheduler::notifyPreSchedulingIteration(const SessionList &sessions,
                                                  const SessionChangeSet &changeset,
                                                  sstl::not_null<CandidateList *> candidates)
 {
-    static auto lastSnapshotTime = system_clock::now();
+    static auto lastSnapshotTime = SchedClock::now();
 
     BaseScheduler::notifyPreSchedulingIteration(sessions, changeset, candidates);
 
@@ -74,7 +75,7 @@ void FairScheduler::notifyPreSchedulingIteration(const SessionList &sessions,
     // Sort sessions if needed. When there is addition, counters are reset thus no need to sort.
     // Snapshot resource usage counter first, or reset them
     if (changeset.numAddedSessions == 0) {
-        auto now = system_clock::now();
+        auto now = SchedClock::now();
         auto sSinceLastSnapshot = FpSeconds(now - lastSnapshotTime).count();
         lastSnapshotTime = now;
         for (auto &sess : sessions) {
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_EXEC_SCHED_SCHEDCLOCK_H
+#define SALUS_EXEC_SCHED_SCHEDCLOCK_H
+
+#include <atomic>
+#include <chrono>
+#include <limits>
+#include <optional>
+
+namespace salus {
+
+/**
+ * @brief Clock used by scheduling policies to measure elapsed time.
+ *
+ * Follows std::chrono::system_clock, unless a virtual time is installed, e.g. by the simulator,
+ * in which case all policies observe the virtual time instead.
+ */
+class SchedClock
+{
+public:
+    using time_point = std::chrono::system_clock::time_point;
+    using duration = std::chrono::system_clock::duration;
+
+    static time_point now()
+    {
+        auto v = s_virtualNow.load(std::memory_order_acquire);
+        if (v != kRealTime) {
+            return time_point(duration(v));
+        }
+        return std::chrono::system_clock::now();
+    }
+
+    /**
+     * @brief Install a virtual time, or go back to real time if `t` is empty.
+     */
+    static void setVirtualNow(std::optional<time_point> t)
+    {
+        s_virtualNow.store(t ? t->time_since_epoch().count() : kRealTime, std::memory_order_release);
+    }
+
+    static bool isVirtual()
+    {
+        return s_virtualNow.load(std::memory_order_acquire) != kRealTime;
+    }
+
+private:
+    static constexpr auto kRealTime = std::numeric_limits<duration::rep>::min();
+    inline static std::atomic<duration::rep> s_virtualNow{kRealTime};
+};
+
+} // namespace salus
+
+#endif // SALUS_EXEC_SCHED_SCHEDCLOCK_H
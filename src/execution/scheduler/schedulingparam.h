@@ -24,6 +24,16 @@
 #include <string>
 
 namespace salus {
+/**
+ * Service class of a session. Latency sensitive sessions are ordered before best effort ones,
+ * and best effort work is throttled when their step latency target is at risk.
+ */
+enum class PriorityClass
+{
+    BestEffort = 0,
+    LatencySensitive = 1,
+};
+
 struct SchedulingParam
 {
     /**
@@ -39,6 +49,45 @@ struct SchedulingParam
      * The scheduler to use
      */
     std::string scheduler = "fair";
+    /**
+     * Fraction of the target step latency a latency sensitive step may run before it is
+     * considered at risk. Best effort tasks are not scheduled while any step is at risk.
+     */
+    double sloRiskThreshold = 0.8;
+    /**
+     * Maximum consecutive scheduling rounds a best effort session with pending tasks is throttled.
+     * It is scheduled in the next round regardless, so a step that stays at risk can't starve it.
+     * 0 disables throttling.
+     */
+    uint64_t maxBestEffortSkip = 10;
+    /**
+     * Tune the head-of-line waiting limit per session from observed blocking time and OOM retries,
+     * starting from maxHolWaiting.
+     */
+    bool adaptiveHol = false;
+    /**
+     * How long a queue head may be blocked before the adaptive limit is decreased, in ms.
+     * Also the minimum interval between two adjustments.
+     */
+    uint64_t holTargetBlocking = 100;
+    /**
+     * Range of the adaptive limit.
+     */
+    uint64_t minHolWaiting = 1;
+    uint64_t maxHolWaitingCap = 1000;
+    /**
+     * Put iterations whose memory reservation fails in line, so they are not starved
+     * by smaller ones. See AllocationRegulator::QueueOptions.
+     */
+    bool allocQueue = false;
+    /**
+     * Time in ms for a waiting reservation to earmark all free memory it needs.
+     */
+    uint64_t allocQueueAging = 1000;
+    /**
+     * Time in ms after which a reservation not retried is dropped from line.
+     */
+    uint64_t allocQueueTimeout = 5000;
 };
 
 } // namespace salus
@@ -19,6 +19,8 @@
 
 #include "sessionitem.h"
 
+#include "resources/profilecache.h"
+
 using namespace salus;
 
 SessionItem::~SessionItem()
@@ -28,6 +30,19 @@ SessionItem::~SessionItem()
 
     // output stats
     VLOG(2) << "Stats for Session " << sessHandle << ": totalExecutedOp=" << totalExecutedOp;
+
+    if (profileKey != 0) {
+        ResStats footprint;
+        {
+            auto g = sstl::with_guard(mu);
+            footprint.persist = persistUsage;
+            footprint.temporary = peakUsage > persistUsage ? peakUsage - persistUsage : 0;
+            footprint.largest = largestAlloc;
+        }
+        auto &cache = ProfileCache::instance();
+        cache.record(profileKey, footprint, numFinishedIters);
+        cache.save();
+    }
 }
 
 void SessionItem::setPagingCallbacks(PagingCallbacks pcb)
@@ -42,6 +57,12 @@ void SessionItem::setInterruptCallback(std::function<void()> cb)
     interruptCb = std::move(cb);
 }
 
+void SessionItem::setIterationEndCallback(std::function<void(const ResStats &)> cb)
+{
+    auto g = sstl::with_guard(mu);
+    iterEndCb = std::move(cb);
+}
+
 void SessionItem::prepareDelete(std::function<void()> cb)
 {
     setExclusiveMode(false);
@@ -50,6 +71,7 @@ void SessionItem::prepareDelete(std::function<void()> cb)
     // clear paging callbacks so the executorImpl won't get called after it is deleted
     // but haven't been removed from session list yet.
     pagingCb = {};
+    iterEndCb = {};
 }
 
 void SessionItem::interrupt()
@@ -67,6 +89,30 @@ void SessionItem::interrupt()
     if (cb) cb();
 }
 
+bool SessionItem::sloAtRisk(double threshold, int64_t nowMs) const
+{
+    if (!isLatencySensitive() || targetStepLatency == 0) {
+        return false;
+    }
+    auto queuedAt = stepQueuedAt.load(std::memory_order_acquire);
+    if (queuedAt == 0) {
+        return false;
+    }
+    return nowMs - queuedAt >= threshold * targetStepLatency;
+}
+
+void SessionItem::recordStepLatency(uint64_t latency)
+{
+    if (targetStepLatency == 0) {
+        return;
+    }
+    if (latency <= targetStepLatency) {
+        ++numSloMet;
+    } else {
+        ++numSloMissed;
+    }
+}
+
 void SessionItem::queueTask(POpItem &&opItem)
 {
     auto g = sstl::with_guard(mu);
@@ -82,7 +128,7 @@ void SessionItem::notifyAlloc(const uint64_t graphId, uint64_t ticket, const Res
         tickets.emplace(ticket);
     }
 
-    updateTracker(graphId, tag);
+    updateTracker(graphId, tag, num);
 }
 
 void SessionItem::notifyDealloc(const uint64_t graphId, uint64_t ticket, const ResourceTag &tag, size_t num, bool last)
@@ -97,29 +143,59 @@ void SessionItem::notifyDealloc(const uint64_t graphId, uint64_t ticket, const R
     updateTracker(graphId, tag);
 }
 
-void SessionItem::updateTracker(const uint64_t graphId, const ResourceTag &tag)
+void SessionItem::updateTracker(const uint64_t graphId, const ResourceTag &tag, size_t allocated)
 {
     if (tag == trackerTag) {
         VLOG(2) << "SessionItem::updateTracker graphid=" << graphId << ", sess=" << sessHandle;
         auto g = sstl::with_guard(mu);
+        size_t usage = resourceUsage(tag);
+        peakUsage = std::max(peakUsage, usage);
+        largestAlloc = std::max(largestAlloc, allocated);
         auto it = allocTrackers.find(graphId);
         if (it != allocTrackers.end()) {
-            it->second.update(resourceUsage(tag));
+            it->second.update(usage);
         }
     }
 }
 
-bool SessionItem::beginIteration(AllocationRegulator::Ticket t, ResStats newRm, const uint64_t graphId)
+bool SessionItem::beginIteration(AllocationRegulator::Ticket t, ResStats newRm, const uint64_t graphId,
+                                 const uint64_t profileKey)
 {
     VLOG(2) << "SessionItem::beginIteration graphid=" << graphId << ", sess=" << sessHandle;
     auto g = sstl::with_guard(mu);
-    auto it = allocTrackers.try_emplace(graphId, trackerTag).first;
-    return it->second.beginIter(t, newRm, resourceUsage(trackerTag));
+    auto it = allocTrackers.try_emplace(graphId, trackerTag, profileKey).first;
+    size_t usage = resourceUsage(trackerTag);
+    persistUsage = std::max(persistUsage, usage);
+    return it->second.beginIter(t, newRm, usage);
+}
+
+ResStats SessionItem::estimationUnsafe() const
+{
+    // The session's hold covers all its graphs, which take turns, so follow the largest of them
+    // instead of whichever graph ended last
+    ResStats est;
+    for (const auto &p : allocTrackers) {
+        const auto &e = p.second.estimation();
+        est.temporary = std::max(est.temporary, e.temporary);
+        est.persist = std::max(est.persist, e.persist);
+        est.count = std::max(est.count, e.count);
+        est.largest = std::max(est.largest, e.largest);
+    }
+    return est;
 }
 
 void SessionItem::endIteration(const uint64_t graphId)
 {
     VLOG(2) << "SessionItem::endIteration graphid=" << graphId << ", sess=" << sessHandle;
-    auto g = sstl::with_guard(mu);
-    allocTrackers.at(graphId).endIter();
+    std::function<void(const ResStats &)> cb;
+    ResStats est;
+    {
+        auto g = sstl::with_guard(mu);
+        allocTrackers.at(graphId).endIter();
+        cb = iterEndCb;
+        est = estimationUnsafe();
+    }
+    if (cb) {
+        cb(est);
+    }
 }
@@ -26,6 +26,7 @@
 #include "execution/devices.h"
 #include "execution/engine/taskexecutor.h"
 #include "execution/engine/allocationlistener.h"
+#include "execution/scheduler/schedclock.h"
 #include "platform/thread_annotations.h"
 
 #include <list>
@@ -59,6 +60,9 @@ private:
     // called if the execution engine requires to interrupt the session
     std::function<void()> interruptCb GUARDED_BY(mu);
 
+    // called with the updated usage estimation of the session, over all its graphs, after every iteration
+    std::function<void(const ResStats &)> iterEndCb GUARDED_BY(mu);
+
     KernelQueue queue GUARDED_BY(mu);
     // total number of executed op in this session
     uint64_t totalExecutedOp = 0 GUARDED_BY(mu);
@@ -66,8 +70,13 @@ private:
     // rm for current iteration
     const static constexpr ResourceTag trackerTag = resources::GPU0Memory;
     std::unordered_map<uint64_t, salus::IterAllocTracker> allocTrackers GUARDED_BY(mu);
+    ResStats estimationUnsafe() const EXCLUSIVE_LOCKS_REQUIRED(mu);
+    // footprint of trackerTag over the whole session, recorded to ProfileCache on deletion
+    size_t peakUsage GUARDED_BY(mu) = 0;
+    size_t persistUsage GUARDED_BY(mu) = 0;
+    size_t largestAlloc GUARDED_BY(mu) = 0;
 
-    void updateTracker(uint64_t graphId, const ResourceTag &tag);
+    void updateTracker(uint64_t graphId, const ResourceTag &tag, size_t allocated = 0);
 
     std::mutex mu;
 
@@ -76,6 +85,13 @@ private:
     uint64_t holWaiting = 0;
     size_t queueHeadHash = 0;
 
+    // adaptive head-of-line waiting limit, 0 means not yet initialized
+    uint64_t holLimit = 0;
+    // when current queue head became head
+    salus::SchedClock::time_point holSince;
+    salus::SchedClock::time_point holLastAdjust;
+    uint64_t lastOomRetries = 0;
+
     std::unordered_set<uint64_t> tickets;
     std::mutex tickets_mu;
 
@@ -95,11 +111,30 @@ public:
     // Only accessed by main scheduling thread
     UnsafeQueue bgQueue;
     bool forceEvicted{false};
+    // consecutive scheduling rounds skipped as best effort while a latency sensitive step was at risk
+    uint64_t numThrottledRounds{0};
 
     // target runnimg time
     uint64_t totalRunningTime {0};
+    // relative share used by weighted schedulers, set before the session is inserted
+    double weight {1.0};
+    // number of tasks currently running in thread pool
+    std::atomic_int_fast64_t numRunningTasks {0};
     std::atomic_uint_fast64_t usedRunningTime {0};
     std::atomic_uint_fast64_t numFinishedIters {0};
+    // number of tasks put back to queue after failing due to OOM
+    std::atomic_uint_fast64_t numOomRetries {0};
+
+    // service class and target step latency in ms (0 means no target), set before the session is inserted
+    salus::PriorityClass priorityClass {salus::PriorityClass::BestEffort};
+    uint64_t targetStepLatency {0};
+    // key of the session's overall memory profile in ProfileCache, 0 if none. Set before the session is inserted
+    uint64_t profileKey {0};
+    // when the currently running step was queued, in ms since epoch, 0 if no step is running
+    std::atomic_int_fast64_t stepQueuedAt {0};
+    // SLO attainment counters, only updated for sessions with a target
+    std::atomic_uint_fast64_t numSloMet {0};
+    std::atomic_uint_fast64_t numSloMissed {0};
 
     explicit SessionItem(std::string handle)
         : sessHandle(std::move(handle))
@@ -121,14 +156,38 @@ public:
 
     void setPagingCallbacks(salus::PagingCallbacks pcb);
     void setInterruptCallback(std::function<void()> cb);
+    void setIterationEndCallback(std::function<void(const ResStats &)> cb);
     void setExclusiveMode(bool mode)
     {
         exlusiveMode = mode;
     }
 
+    bool isLatencySensitive() const
+    {
+        return priorityClass == salus::PriorityClass::LatencySensitive;
+    }
+
+    /**
+     * @brief Whether the running step has used more than `threshold` of its target latency
+     * @param threshold fraction of target step latency
+     * @param nowMs current time in ms since epoch
+     */
+    bool sloAtRisk(double threshold, int64_t nowMs) const;
+
+    /**
+     * @brief Record a finished step against the target latency
+     * @param latency step latency in ms, including queuing time
+     */
+    void recordStepLatency(uint64_t latency);
+
     void queueTask(POpItem &&opItem);
 
-    bool beginIteration(AllocationRegulator::Ticket t, ResStats newRm, uint64_t graphId);
+    /**
+     * @brief Start an iteration of graphId
+     * @param newRm estimated usage, only used before anything is learned about graphId
+     * @param profileKey key used to remember what is learned about graphId in ProfileCache, 0 if none
+     */
+    bool beginIteration(AllocationRegulator::Ticket t, ResStats newRm, uint64_t graphId, uint64_t profileKey = 0);
 
     void endIteration(uint64_t graphId);
 
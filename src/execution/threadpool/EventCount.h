@@ -12,6 +12,8 @@
 
 #include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <mutex>
 #include <thread>
 #include <vector>
 
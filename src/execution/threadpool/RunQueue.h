@@ -12,6 +12,7 @@
 
 #include <atomic>
 #include <cassert>
+#include <mutex>
 #include <vector>
 
 // RunQueue is a fixed-size, partially non-blocking deque for Work items.
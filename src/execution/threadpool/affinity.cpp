@@ -0,0 +1,299 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "affinity.h"
+
+#include "platform/logging.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+bool readLine(const std::string &path, std::string &line)
+{
+    std::ifstream in(path);
+    return in && std::getline(in, line);
+}
+
+} // namespace
+
+/*static*/ std::vector<int> CpuTopology::parseCpuList(const std::string &str)
+{
+    std::vector<int> cpus;
+    std::istringstream iss(str);
+    std::string range;
+    while (std::getline(iss, range, ',')) {
+        range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+        if (range.empty()) {
+            continue;
+        }
+        try {
+            size_t pos = 0;
+            auto first = std::stoi(range, &pos);
+            auto last = first;
+            if (pos != range.size()) {
+                if (range[pos] != '-') {
+                    throw std::invalid_argument(range);
+                }
+                size_t pos2 = 0;
+                last = std::stoi(range.substr(pos + 1), &pos2);
+                if (pos + 1 + pos2 != range.size()) {
+                    throw std::invalid_argument(range);
+                }
+            }
+            if (first < 0 || last < first) {
+                throw std::invalid_argument(range);
+            }
+            for (auto cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        } catch (const std::logic_error &) {
+            throw std::runtime_error("Invalid CPU list '" + str + "'");
+        }
+    }
+    return cpus;
+}
+
+/*static*/ CpuTopology CpuTopology::fromSysfs(const std::string &root)
+{
+    CpuTopology topo;
+
+    const auto base = root + "/devices/system/node/";
+    std::string line;
+    if (readLine(base + "online", line)) {
+        for (auto id : parseCpuList(line)) {
+            if (!readLine(base + "node" + std::to_string(id) + "/cpulist", line)) {
+                continue;
+            }
+            auto cpus = parseCpuList(line);
+            // memory only nodes have no CPUs
+            if (!cpus.empty()) {
+                topo.m_nodes.push_back({id, std::move(cpus)});
+            }
+        }
+    }
+
+    if (topo.m_nodes.empty()) {
+        auto &node = topo.m_nodes.emplace_back();
+        node.cpus.resize(std::max(std::thread::hardware_concurrency(), 1u));
+        for (size_t i = 0; i != node.cpus.size(); ++i) {
+            node.cpus[i] = static_cast<int>(i);
+        }
+    }
+
+    topo.buildIndex();
+    return topo;
+}
+
+/*static*/ const CpuTopology &CpuTopology::system()
+{
+    static const CpuTopology topo = []() {
+        auto fake = std::getenv("SALUS_SYSFS_ROOT");
+        auto topo = fromSysfs(fake ? fake : "/sys");
+        if (fake) {
+            return topo;
+        }
+
+        // respect taskset and cpusets
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+            return topo;
+        }
+        auto filtered = topo;
+        filtered.m_nodes.clear();
+        for (auto node : topo.m_nodes) {
+            node.cpus.erase(std::remove_if(node.cpus.begin(), node.cpus.end(),
+                                           [&](int cpu) { return cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed); }),
+                            node.cpus.end());
+            if (!node.cpus.empty()) {
+                filtered.m_nodes.emplace_back(std::move(node));
+            }
+        }
+        if (filtered.m_nodes.empty()) {
+            return topo;
+        }
+        filtered.buildIndex();
+        return filtered;
+    }();
+    return topo;
+}
+
+void CpuTopology::buildIndex()
+{
+    m_nodeOfCpu.clear();
+    for (size_t i = 0; i != m_nodes.size(); ++i) {
+        for (auto cpu : m_nodes[i].cpus) {
+            if (static_cast<size_t>(cpu) >= m_nodeOfCpu.size()) {
+                m_nodeOfCpu.resize(cpu + 1, -1);
+            }
+            m_nodeOfCpu[cpu] = static_cast<int>(i);
+        }
+    }
+}
+
+int CpuTopology::nodeIndexOf(int cpu) const
+{
+    if (cpu < 0 || static_cast<size_t>(cpu) >= m_nodeOfCpu.size()) {
+        return -1;
+    }
+    return m_nodeOfCpu[cpu];
+}
+
+int CpuTopology::currentNodeIndex() const
+{
+    return nodeIndexOf(sched_getcpu());
+}
+
+std::string CpuTopology::DebugString() const
+{
+    std::ostringstream oss;
+    oss << "CpuTopology(";
+    for (size_t i = 0; i != m_nodes.size(); ++i) {
+        if (i) {
+            oss << ", ";
+        }
+        oss << "node" << m_nodes[i].id << ": " << m_nodes[i].cpus.size() << " cpus";
+    }
+    oss << ")";
+    return oss.str();
+}
+
+/*static*/ ThreadAffinity ThreadAffinity::parse(const std::string &spec)
+{
+    ThreadAffinity affinity;
+    if (spec == "none") {
+        affinity.policy = Policy::None;
+    } else if (spec == "compact") {
+        affinity.policy = Policy::Compact;
+    } else if (spec == "scatter") {
+        affinity.policy = Policy::Scatter;
+    } else if (spec == "numa") {
+        affinity.policy = Policy::PerNode;
+    } else if (spec.compare(0, 5, "cpus:") == 0) {
+        affinity.policy = Policy::Explicit;
+        affinity.cpus = CpuTopology::parseCpuList(spec.substr(5));
+        if (affinity.cpus.empty()) {
+            throw std::runtime_error("Empty CPU list in affinity '" + spec + "'");
+        }
+    } else {
+        throw std::runtime_error("Unknown affinity '" + spec
+                                 + "', must be one of none, compact, scatter, numa or cpus:<list>");
+    }
+    return affinity;
+}
+
+std::string ThreadAffinity::DebugString() const
+{
+    switch (policy) {
+    case Policy::None:
+        return "none";
+    case Policy::Compact:
+        return "compact";
+    case Policy::Scatter:
+        return "scatter";
+    case Policy::PerNode:
+        return "numa";
+    case Policy::Explicit: {
+        std::ostringstream oss;
+        oss << "cpus:";
+        for (size_t i = 0; i != cpus.size(); ++i) {
+            oss << (i ? "," : "") << cpus[i];
+        }
+        return oss.str();
+    }
+    }
+    return "unknown";
+}
+
+std::vector<WorkerPlacement> placeWorkers(const CpuTopology &topo, const ThreadAffinity &affinity,
+                                          size_t numWorkers)
+{
+    std::vector<WorkerPlacement> placements(numWorkers);
+    const auto &nodes = topo.nodes();
+    if (nodes.empty()) {
+        return placements;
+    }
+
+    switch (affinity.policy) {
+    case ThreadAffinity::Policy::None:
+        break;
+    case ThreadAffinity::Policy::Explicit:
+        for (size_t i = 0; i != numWorkers; ++i) {
+            auto cpu = affinity.cpus[i % affinity.cpus.size()];
+            placements[i] = {{cpu}, topo.nodeIndexOf(cpu)};
+        }
+        break;
+    case ThreadAffinity::Policy::Compact: {
+        std::vector<int> all;
+        for (const auto &node : nodes) {
+            all.insert(all.end(), node.cpus.begin(), node.cpus.end());
+        }
+        for (size_t i = 0; i != numWorkers; ++i) {
+            auto cpu = all[i % all.size()];
+            placements[i] = {{cpu}, topo.nodeIndexOf(cpu)};
+        }
+        break;
+    }
+    case ThreadAffinity::Policy::Scatter:
+        for (size_t i = 0; i != numWorkers; ++i) {
+            auto n = i % nodes.size();
+            const auto &cpus = nodes[n].cpus;
+            placements[i] = {{cpus[(i / nodes.size()) % cpus.size()]}, static_cast<int>(n)};
+        }
+        break;
+    case ThreadAffinity::Policy::PerNode:
+        for (size_t i = 0; i != numWorkers; ++i) {
+            auto n = i % nodes.size();
+            placements[i] = {nodes[n].cpus, static_cast<int>(n)};
+        }
+        break;
+    }
+    return placements;
+}
+
+bool applyPlacement(const WorkerPlacement &placement)
+{
+    if (placement.cpus.empty()) {
+        return true;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (auto cpu : placement.cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (auto err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) {
+        LOG(WARNING) << "Failed to pin thread to " << placement.cpus.size() << " cpus starting at "
+                     << placement.cpus.front() << ": " << std::strerror(err);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,133 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EXECUTION_THREADPOOL_AFFINITY_H
+#define EXECUTION_THREADPOOL_AFFINITY_H
+
+#include <string>
+#include <vector>
+
+/**
+ * @brief CPUs grouped by NUMA node
+ */
+class CpuTopology
+{
+public:
+    struct Node
+    {
+        int id = 0;
+        std::vector<int> cpus;
+    };
+
+    /**
+     * @brief Read topology from <root>/devices/system/node. Falls back to a single node holding
+     * all CPUs if that doesn't exist.
+     */
+    static CpuTopology fromSysfs(const std::string &root);
+
+    /**
+     * @brief Topology of this machine, limited to CPUs this process may run on. Read once from /sys,
+     * or from the directory in environment variable SALUS_SYSFS_ROOT if set, e.g. a fake tree for tests.
+     */
+    static const CpuTopology &system();
+
+    /**
+     * @brief Parse a kernel CPU list such as "0-3,8,10-11". Throws std::runtime_error if malformed.
+     */
+    static std::vector<int> parseCpuList(const std::string &str);
+
+    const std::vector<Node> &nodes() const
+    {
+        return m_nodes;
+    }
+
+    /**
+     * @returns index into nodes() of the node holding cpu, or -1 if unknown
+     */
+    int nodeIndexOf(int cpu) const;
+
+    /**
+     * @returns index into nodes() of the node the calling thread currently runs on, or -1 if unknown
+     */
+    int currentNodeIndex() const;
+
+    std::string DebugString() const;
+
+private:
+    std::vector<Node> m_nodes;
+    // cpu -> index into m_nodes
+    std::vector<int> m_nodeOfCpu;
+
+    void buildIndex();
+};
+
+/**
+ * @brief How workers of a thread pool are pinned to CPUs
+ */
+struct ThreadAffinity
+{
+    enum class Policy
+    {
+        // no pinning
+        None,
+        // worker i on the i-th CPU, filling up one node before moving to the next
+        Compact,
+        // worker i on node i % #nodes, spreading workers evenly across nodes
+        Scatter,
+        // worker i on cpus[i % cpus.size()]
+        Explicit,
+        // worker i may run on any CPU of node i % #nodes, and prefers queues of its own node
+        PerNode,
+    };
+
+    Policy policy = Policy::None;
+    std::vector<int> cpus;
+
+    /**
+     * @brief Parse one of "none", "compact", "scatter", "numa" or "cpus:<cpulist>", e.g. "cpus:0-7,16-23".
+     * Throws std::runtime_error otherwise.
+     */
+    static ThreadAffinity parse(const std::string &spec);
+
+    std::string DebugString() const;
+};
+
+/**
+ * @brief Where a single worker goes
+ */
+struct WorkerPlacement
+{
+    // CPUs the worker may run on, empty for no pinning
+    std::vector<int> cpus;
+    // index into CpuTopology::nodes(), -1 if not tied to a node
+    int node = -1;
+};
+
+/**
+ * @brief Decide placement of numWorkers workers under affinity.
+ */
+std::vector<WorkerPlacement> placeWorkers(const CpuTopology &topo, const ThreadAffinity &affinity,
+                                          size_t numWorkers);
+
+/**
+ * @brief Pin the calling thread to placement's CPUs. Returns false and logs on failure.
+ */
+bool applyPlacement(const WorkerPlacement &placement);
+
+#endif // EXECUTION_THREADPOOL_AFFINITY_H
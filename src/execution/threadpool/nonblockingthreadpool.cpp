@@ -26,10 +26,18 @@
 #include "EventCount.h"
 #include "utils/fixed_function.hpp"
 #include "RunQueue.h"
+#include "platform/logging.h"
 #include "platform/thread_annotations.h"
 
+#include <concurrentqueue.h>
+
+#include <algorithm>
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -39,6 +47,8 @@ using std::vector;
 struct Task
 {
     ThreadPool::Closure c;
+    // Submission time in ns, only recorded for pools with adaptive spinning
+    uint64_t enqueued = 0;
 
     Task() = default;
     explicit Task(ThreadPool::Closure &&cc) : c(std::move(cc)) {}
@@ -88,36 +98,142 @@ public:
     ThreadPoolPrivate(ThreadPool *q, const ThreadPoolOptions &options);
     ~ThreadPoolPrivate();
 
-    Task tryRun(Task c);
+    Task tryRun(Task c, TaskPriority priority);
+    size_t tryRunBatch(vector<ThreadPool::Closure> &batch, TaskPriority priority);
     void stop();
     void join();
     size_t numThreads() const;
     int currentThreadId() const;
+    ThreadPool::Stats stats() const;
+
+    /**
+     * Pool the calling thread works for, either as a worker or as a spare, or null.
+     */
+    static ThreadPoolPrivate *current()
+    {
+        return getPerThread()->owner;
+    }
+
+    void beginBlocking();
+    void endBlocking();
 
 private:
+    bool isSpare() const
+    {
+        auto pt = getPerThread();
+        return pt->owner == this && pt->pool != this;
+    }
+
     struct PerThread
     {
         constexpr PerThread()
             : pool(nullptr)
+            , owner(nullptr)
             , rand(0)
             , thread_id(-1)
+            , highRun(0)
+            , woken(false)
         {
         }
-        ThreadPoolPrivate *pool; // Parent pool, or null for normal threads.
-        uint64_t rand;           // Random generator state.
-        int thread_id;           // Worker thread index in pool.
+        ThreadPoolPrivate *pool;  // Parent pool, or null for normal threads.
+        ThreadPoolPrivate *owner; // Parent pool, also set for spare workers which have no queue.
+        uint64_t rand;            // Random generator state.
+        int thread_id;            // Worker thread index in pool.
+        int highRun;              // High priority tasks run in a row.
+        bool woken;               // Just came back from parking, next task counts for wake latency.
     };
 
+    static constexpr size_t kHigh = static_cast<size_t>(TaskPriority::High);
+    static constexpr size_t kNormal = static_cast<size_t>(TaskPriority::Normal);
+
     /**
      * Main worker thread loop.
      */
     void workerLoop(int thread_id);
 
     /**
-     * Steal tries to steal work from other worker threads in best-effort manner.
+     * Loop of a spare worker, which steals tasks while some workers are blocked.
+     */
+    void spareLoop();
+
+    /**
+     * Spin calling attempt until it returns a task, for as many rounds as the spin policy allows.
+     * Returns an empty task if nothing came along or the pool is cancelled.
+     */
+    template<typename Attempt>
+    Task spin(Attempt &&attempt);
+
+    /**
+     * waitForWork, plus feeding how long it took into the adaptive spin policy.
+     */
+    bool park(PerThread *pt, EventCount::Waiter *waiter, Task *t);
+
+    /**
+     * Run t, accounting its wake latency if the worker was parked before.
+     */
+    void runTask(PerThread *pt, Task &t);
+
+    /**
+     * Current number of rounds to spin before parking.
+     */
+    int spinLimit() const;
+
+    void noteArrival(Task &t);
+
+    static uint64_t nowNs()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch())
+                                         .count());
+    }
+
+    /**
+     * Pop from the worker's own queues, honoring highPriorityBurst.
+     */
+    Task popLocal(PerThread *pt);
+
+    /**
+     * Steal tries to steal work from other worker threads in best-effort manner,
+     * higher priority first.
      */
     Task steal();
 
+    /**
+     * Steal from queues of the given priority level only.
+     */
+    Task stealAt(size_t level);
+
+    /**
+     * Put a task that didn't fit in its queue to the overflow list of the given level.
+     */
+    void spill(Task t, size_t level);
+
+    /**
+     * Take a task from the overflow list of the given level.
+     */
+    Task popOverflow(size_t level);
+
+    bool hasOverflow() const
+    {
+        for (auto &size : m_overflowSize) {
+            if (size.load(std::memory_order_relaxed) > 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Account for a task taken out of a queue of the given level.
+     */
+    Task popped(Task t, size_t level)
+    {
+        if (t && level == kHigh) {
+            m_pendingHigh.fetch_sub(1, std::memory_order_relaxed);
+        }
+        return t;
+    }
+
     /**
      * waitForWork blocks until new work is available (returns true), or if it is
      * time to exit (returns false). Can optionally return a task to execute in t
@@ -125,8 +241,16 @@ private:
      */
     bool waitForWork(EventCount::Waiter *waiter, Task *t);
 
+    /**
+     * Returns level * numThreads + index of a non empty queue, or -1.
+     */
     int nonEmptyQueueIndex();
 
+    /**
+     * Queue for a task submitted from outside of the pool
+     */
+    unsigned externalQueueIndex(PerThread *pt);
+
     static inline PerThread *getPerThread()
     {
         static thread_local PerThread per_thread;
@@ -144,14 +268,49 @@ private:
 
     ThreadPoolOptions m_options;
     vector<std::thread> m_threads;
-    vector<Queue> m_queues;
+    // One queue per worker for each priority level
+    std::array<vector<Queue>, kNumTaskPriorities> m_queues;
+    // Number of tasks in high priority queues, so that others needn't be scanned if there is none
+    std::atomic<int> m_pendingHigh;
+    // Unbounded spill over for each priority level, used when the target queue is full
+    std::array<moodycamel::ConcurrentQueue<Task>, kNumTaskPriorities> m_overflow;
+    std::array<std::atomic<int64_t>, kNumTaskPriorities> m_overflowSize;
+    std::atomic<uint64_t> m_overflows;
     vector<unsigned> m_coprimes;
     vector<EventCount::Waiter> m_waiters;
+    vector<WorkerPlacement> m_placements;
+    // Queues of workers on each NUMA node, empty if the pool is not NUMA aware
+    vector<vector<unsigned>> m_nodeQueues;
     std::atomic<unsigned> m_blocked;
     std::atomic<bool> m_spinning;
     std::atomic<bool> m_done;
     std::atomic<bool> m_cancelled;
     EventCount m_ec;
+
+    // Spare workers making up for workers in a blocking region
+    size_t m_maxSpares;
+    mutable std::mutex m_spareMu;
+    std::condition_variable m_spareCv;
+    vector<std::thread> m_spares GUARDED_BY(m_spareMu);
+    size_t m_blockingWorkers GUARDED_BY(m_spareMu);
+    size_t m_idleSpares GUARDED_BY(m_spareMu);
+    bool m_sparesExit GUARDED_BY(m_spareMu);
+    // Read without the lock by tryRun to decide whether to wake spares up
+    std::atomic<size_t> m_activeSpares;
+    std::atomic<uint64_t> m_blockingRegions;
+
+    // Adaptive spinning. Submitters write the arrival tracking, keep it off the workers' lines.
+    alignas(64) std::atomic<uint64_t> m_lastArrival;
+    std::atomic<uint64_t> m_arrivalGap; // moving average of ns between submissions
+    alignas(64) std::atomic<int> m_spinLimit;
+    int m_maxSpinLimit;
+    std::atomic<uint64_t> m_spinRoundNs; // moving average of ns per spin round
+    std::atomic<uint64_t> m_spinNs;
+    std::atomic<uint64_t> m_spins;
+    std::atomic<uint64_t> m_spinHits;
+    std::atomic<uint64_t> m_parks;
+    std::atomic<uint64_t> m_wakeups;
+    std::atomic<uint64_t> m_wakeLatencyNs;
 };
 
 ThreadPool::ThreadPool(const ThreadPoolOptions &options)
@@ -161,12 +320,16 @@ ThreadPool::ThreadPool(const ThreadPoolOptions &options)
 
 ThreadPool::~ThreadPool() = default;
 
-ThreadPool::Closure ThreadPool::tryRun(Closure c)
+ThreadPool::Closure ThreadPool::tryRun(Closure c, TaskPriority priority)
 {
     Task t(std::move(c));
-    t = d->tryRun(std::move(t));
+    t = d->tryRun(std::move(t), priority);
     return std::move(t.c);
 }
+size_t ThreadPool::tryRunBatch(std::vector<Closure> &batch, TaskPriority priority)
+{
+    return d->tryRunBatch(batch, priority);
+}
 void ThreadPool::stop()
 {
     d->stop();
@@ -183,19 +346,59 @@ int ThreadPool::currentThreadId() const
 {
     return d->currentThreadId();
 }
+ThreadPool::Stats ThreadPool::stats() const
+{
+    return d->stats();
+}
+
+ThreadPool::ScopedBlockingRegion::ScopedBlockingRegion()
+    : m_pool(ThreadPoolPrivate::current())
+{
+    if (m_pool) {
+        m_pool->beginBlocking();
+    }
+}
+
+ThreadPool::ScopedBlockingRegion::~ScopedBlockingRegion()
+{
+    if (m_pool) {
+        m_pool->endBlocking();
+    }
+}
 
 ThreadPoolPrivate::ThreadPoolPrivate(ThreadPool *q, const ThreadPoolOptions &options)
     : q(q)
     , m_options(options)
     // Queue is not movable or copyable, thus can only be constructed this way
-    , m_queues(options.numThreads)
+    , m_queues{vector<Queue>(options.numThreads), vector<Queue>(options.numThreads)}
+    , m_pendingHigh(0)
+    , m_overflowSize{0, 0}
+    , m_overflows(0)
     // Waiter is not movable or copyable, thus can only be constructed this way
     , m_waiters(options.numThreads)
+    , m_placements(placeWorkers(CpuTopology::system(), options.affinity, options.numThreads))
     , m_blocked(0)
     , m_spinning(false)
     , m_done(false)
     , m_cancelled(false)
     , m_ec(m_waiters)
+    , m_maxSpares(options.maxSpareThreads < 0 ? options.numThreads : static_cast<size_t>(options.maxSpareThreads))
+    , m_blockingWorkers(0)
+    , m_idleSpares(0)
+    , m_sparesExit(false)
+    , m_activeSpares(0)
+    , m_blockingRegions(0)
+    , m_lastArrival(0)
+    , m_arrivalGap(0)
+    , m_spinLimit(std::max(options.spinCount, 0))
+    , m_maxSpinLimit(16 * std::max(options.spinCount, 0))
+    , m_spinRoundNs(0)
+    , m_spinNs(0)
+    , m_spins(0)
+    , m_spinHits(0)
+    , m_parks(0)
+    , m_wakeups(0)
+    , m_wakeLatencyNs(0)
 {
     auto numThreads = m_options.numThreads;
 
@@ -223,21 +426,55 @@ ThreadPoolPrivate::ThreadPoolPrivate(ThreadPool *q, const ThreadPoolOptions &opt
         }
     }
 
+    // Only worth it when there is more than one node to prefer
+    if (m_options.affinity.policy != ThreadAffinity::Policy::None && CpuTopology::system().nodes().size() > 1) {
+        m_nodeQueues.resize(CpuTopology::system().nodes().size());
+        for (size_t i = 0; i < numThreads; i++) {
+            if (m_placements[i].node >= 0) {
+                m_nodeQueues[m_placements[i].node].push_back(i);
+            }
+        }
+    }
+
     for (size_t i = 0; i < numThreads; i++) {
         m_threads.emplace_back([this, i]() { workerLoop(i); });
     }
 }
 
-Task ThreadPoolPrivate::tryRun(Task t)
+unsigned ThreadPoolPrivate::externalQueueIndex(PerThread *pt)
 {
+    auto r = rand(&pt->rand);
+    if (!m_nodeQueues.empty()) {
+        auto node = CpuTopology::system().currentNodeIndex();
+        if (node >= 0 && static_cast<size_t>(node) < m_nodeQueues.size() && !m_nodeQueues[node].empty()) {
+            const auto &local = m_nodeQueues[node];
+            return local[r % local.size()];
+        }
+    }
+    return r % m_options.numThreads;
+}
+
+Task ThreadPoolPrivate::tryRun(Task t, TaskPriority priority)
+{
+    const auto level = static_cast<size_t>(priority);
     auto pt = getPerThread();
+    noteArrival(t);
+    if (level == kHigh) {
+        // Count before pushing, so workers never see the task without the count
+        m_pendingHigh.fetch_add(1, std::memory_order_relaxed);
+    }
     if (pt->pool == this) {
         // Worker thread of this pool, push onto the thread's queue.
-        t = m_queues[pt->thread_id].PushFront(std::move(t));
+        t = m_queues[level][pt->thread_id].PushFront(std::move(t));
     } else {
         // A free-standing thread (or worker of another pool), push onto a random
-        // queue.
-        t = m_queues[rand(&pt->rand) % m_queues.size()].PushBack(std::move(t));
+        // queue, of the caller's NUMA node if possible.
+        t = m_queues[level][externalQueueIndex(pt)].PushBack(std::move(t));
+    }
+    if (t) {
+        // The queue was full, spill over rather than bouncing the task back to the caller.
+        spill(std::move(t), level);
+        t = {};
     }
     // Note: below we touch this after making w available to worker threads.
     // Strictly speaking, this can lead to a racy-use-after-free. Consider that
@@ -248,10 +485,155 @@ Task ThreadPoolPrivate::tryRun(Task t)
     // this is kept alive while any threads can potentially be in Schedule.
     if (!t) {
         m_ec.Notify(false);
+        if (m_activeSpares.load(std::memory_order_relaxed) > 0) {
+            m_spareCv.notify_all();
+        }
     }
     return t;
 }
 
+size_t ThreadPoolPrivate::tryRunBatch(vector<ThreadPool::Closure> &batch, TaskPriority priority)
+{
+    const auto level = static_cast<size_t>(priority);
+    auto pt = getPerThread();
+    auto &queues = m_queues[level];
+
+    size_t count = 0;
+    for (auto &c : batch) {
+        count += c ? 1 : 0;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    if (level == kHigh) {
+        m_pendingHigh.fetch_add(static_cast<int>(count), std::memory_order_relaxed);
+    }
+
+    // Deal the batch out round-robin, starting from the caller's own queue if it is a worker,
+    // so that woken workers find something right in their own queues instead of all stealing
+    // from the same victim.
+    const size_t size = queues.size();
+    size_t next = pt->pool == this ? static_cast<size_t>(pt->thread_id) : externalQueueIndex(pt);
+    for (auto &c : batch) {
+        if (!c) {
+            continue;
+        }
+        Task t(std::move(c));
+        noteArrival(t);
+        if (pt->pool == this && next == static_cast<size_t>(pt->thread_id)) {
+            t = queues[next].PushFront(std::move(t));
+        } else {
+            t = queues[next].PushBack(std::move(t));
+        }
+        if (t) {
+            spill(std::move(t), level);
+        }
+        if (++next == size) {
+            next = 0;
+        }
+    }
+
+    // One round of wake ups for the whole batch. Notify returns right away once there is
+    // no waiter left, so at most min(batch, idle) workers are woken.
+    if (count >= size) {
+        m_ec.Notify(true);
+    } else {
+        for (size_t i = 0; i != count; ++i) {
+            m_ec.Notify(false);
+        }
+    }
+    if (m_activeSpares.load(std::memory_order_relaxed) > 0) {
+        m_spareCv.notify_all();
+    }
+    return count;
+}
+
+void ThreadPoolPrivate::spill(Task t, size_t level)
+{
+    // Workers pick it up after their own and stolen queues of the same level.
+    m_overflow[level].enqueue(std::move(t));
+    m_overflowSize[level].fetch_add(1, std::memory_order_release);
+    m_overflows.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ThreadPoolPrivate::beginBlocking()
+{
+    m_blockingRegions.fetch_add(1, std::memory_order_relaxed);
+
+    std::unique_lock<std::mutex> lock(m_spareMu);
+    ++m_blockingWorkers;
+    if (isSpare()) {
+        // A blocked spare doesn't make up for anyone
+        --m_activeSpares;
+    }
+    const auto needed = std::min(m_blockingWorkers, m_maxSpares);
+    if (m_activeSpares.load() >= needed) {
+        // Enough spares running already, or at the cap
+        return;
+    }
+    if (m_activeSpares.load() + m_idleSpares < needed && m_spares.size() < m_maxSpares) {
+        VLOG(2) << "Starting spare worker " << m_spares.size() << " for " << m_blockingWorkers
+                << " blocked workers";
+        // Counted as idle until it is up, so that it isn't started twice
+        ++m_idleSpares;
+        m_spares.emplace_back([this]() { spareLoop(); });
+    }
+    m_spareCv.notify_all();
+}
+
+void ThreadPoolPrivate::endBlocking()
+{
+    std::unique_lock<std::mutex> lock(m_spareMu);
+    DCHECK_GT(m_blockingWorkers, 0);
+    --m_blockingWorkers;
+    if (isSpare()) {
+        ++m_activeSpares;
+    }
+    // Surplus spares notice by themselves after their current task
+}
+
+void ThreadPoolPrivate::spareLoop()
+{
+    if (m_options.workerName.empty()) {
+        salus::threading::set_thread_name("ThreadPoolSpare");
+    } else {
+        salus::threading::set_thread_name(m_options.workerName);
+    }
+
+    auto pt = getPerThread();
+    pt->owner = this;
+    pt->rand = std::hash<std::thread::id>()(std::this_thread::get_id());
+
+    std::unique_lock<std::mutex> lock(m_spareMu);
+    while (true) {
+        // Park until some worker blocks
+        m_spareCv.wait(lock, [this]() {
+            return m_cancelled || m_sparesExit || m_activeSpares.load() < std::min(m_blockingWorkers, m_maxSpares);
+        });
+        --m_idleSpares;
+        if (m_cancelled || m_sparesExit) {
+            return;
+        }
+        ++m_activeSpares;
+
+        // Run tasks as long as we are needed. Being only a stand-in, there is no queue of our own,
+        // everything is stolen, and no EventCount waiter is available, so poll when out of work.
+        while (!m_cancelled && m_activeSpares.load() <= m_blockingWorkers) {
+            lock.unlock();
+            auto t = steal();
+            if (t) {
+                t();
+            }
+            lock.lock();
+            if (!t && !m_cancelled && m_activeSpares.load() <= m_blockingWorkers) {
+                m_spareCv.wait_for(lock, std::chrono::milliseconds(1));
+            }
+        }
+        --m_activeSpares;
+        ++m_idleSpares;
+    }
+}
+
 void ThreadPoolPrivate::stop()
 {
     m_cancelled = true;
@@ -268,6 +650,20 @@ void ThreadPoolPrivate::join()
             thr.join();
         }
     }
+
+    // Workers only exit when there is nothing left to do, so spares can go now, too
+    vector<std::thread> spares;
+    {
+        std::unique_lock<std::mutex> lock(m_spareMu);
+        m_sparesExit = true;
+        spares.swap(m_spares);
+    }
+    m_spareCv.notify_all();
+    for (auto &thr : spares) {
+        if (thr.joinable()) {
+            thr.join();
+        }
+    }
 }
 
 size_t ThreadPoolPrivate::numThreads() const
@@ -275,6 +671,29 @@ size_t ThreadPoolPrivate::numThreads() const
     return m_options.numThreads;
 }
 
+ThreadPool::Stats ThreadPoolPrivate::stats() const
+{
+    ThreadPool::Stats s;
+    s.overflows = m_overflows.load(std::memory_order_relaxed);
+    for (auto &size : m_overflowSize) {
+        s.overflowPending += static_cast<uint64_t>(std::max<int64_t>(size.load(std::memory_order_relaxed), 0));
+    }
+    s.blockingRegions = m_blockingRegions.load(std::memory_order_relaxed);
+    s.spinLimit = spinLimit();
+    s.arrivalGapNs = m_arrivalGap.load(std::memory_order_relaxed);
+    s.spinNs = m_spinNs.load(std::memory_order_relaxed);
+    s.spins = m_spins.load(std::memory_order_relaxed);
+    s.spinHits = m_spinHits.load(std::memory_order_relaxed);
+    s.parks = m_parks.load(std::memory_order_relaxed);
+    s.wakeups = m_wakeups.load(std::memory_order_relaxed);
+    s.wakeLatencyNs = m_wakeLatencyNs.load(std::memory_order_relaxed);
+    {
+        std::unique_lock<std::mutex> lock(m_spareMu);
+        s.spareThreads = m_spares.size();
+    }
+    return s;
+}
+
 int ThreadPoolPrivate::currentThreadId() const
 {
     auto pt = getPerThread();
@@ -297,8 +716,10 @@ ThreadPoolPrivate::~ThreadPoolPrivate()
     } else {
         // Since we were cancelled, there might be entries in the queues.
         // Empty them to prevent their destructor from asserting.
-        for (auto &q : m_queues) {
-            q.Flush();
+        for (auto &queues : m_queues) {
+            for (auto &q : queues) {
+                q.Flush();
+            }
         }
     }
 
@@ -306,23 +727,27 @@ ThreadPoolPrivate::~ThreadPoolPrivate()
     join();
 
     m_threads.clear();
-    m_queues.clear();
+    for (auto &queues : m_queues) {
+        queues.clear();
+    }
 }
 
 int ThreadPoolPrivate::nonEmptyQueueIndex()
 {
     auto pt = getPerThread();
-    const size_t size = m_queues.size();
+    const size_t size = m_options.numThreads;
     unsigned r = rand(&pt->rand);
     unsigned inc = m_coprimes[r % m_coprimes.size()];
-    unsigned victim = r % size;
-    for (unsigned i = 0; i < size; i++) {
-        if (!m_queues[victim].Empty()) {
-            return victim;
-        }
-        victim += inc;
-        if (victim >= size) {
-            victim -= size;
+    for (size_t level = 0; level != kNumTaskPriorities; ++level) {
+        unsigned victim = r % size;
+        for (unsigned i = 0; i < size; i++) {
+            if (!m_queues[level][victim].Empty()) {
+                return static_cast<int>(level * size + victim);
+            }
+            victim += inc;
+            if (victim >= size) {
+                victim -= size;
+            }
         }
     }
     return -1;
@@ -337,14 +762,15 @@ void ThreadPoolPrivate::workerLoop(int thread_id)
     }
 
     const auto numThreads = m_options.numThreads;
-    const auto spinCount = m_options.spinCount;
     const auto allowSpinning = m_options.allowSpinning;
 
+    applyPlacement(m_placements[thread_id]);
+
     auto pt = getPerThread();
     pt->pool = this;
+    pt->owner = this;
     pt->rand = std::hash<std::thread::id>()(std::this_thread::get_id());
     pt->thread_id = thread_id;
-    auto &q = m_queues[thread_id];
     auto waiter = &m_waiters[thread_id];
 
     if (numThreads == 1) {
@@ -355,61 +781,227 @@ void ThreadPoolPrivate::workerLoop(int thread_id)
         // counter-productive for the types of I/O workloads the single thread
         // pools tend to be used for.
         while (!m_cancelled) {
-            auto t = q.PopFront();
-            for (int i = 0; i < spinCount && !t; i++) {
-                if (!m_cancelled.load(std::memory_order_relaxed)) {
-                    t = q.PopFront();
-                }
+            auto t = popLocal(pt);
+            if (!t) {
+                t = popOverflow(kNormal);
             }
             if (!t) {
-                if (!waitForWork(waiter, &t)) {
+                t = spin([this, pt]() { return popLocal(pt); });
+            }
+            if (!t) {
+                if (!park(pt, waiter, &t)) {
                     return;
                 }
             }
             if (t) {
-                t();
+                runTask(pt, t);
             }
         }
     } else {
         while (!m_cancelled) {
-            auto t = q.PopFront();
+            auto t = popLocal(pt);
             if (!t) {
                 t = steal();
                 if (!t) {
                     // Leave one thread spinning. This reduces latency.
                     if (allowSpinning && !m_spinning && !m_spinning.exchange(true)) {
-                        for (int i = 0; i < spinCount && !t; i++) {
-                            if (!m_cancelled.load(std::memory_order_relaxed)) {
-                                t = steal();
-                            } else {
-                                return;
-                            }
-                        }
+                        t = spin([this]() { return steal(); });
                         m_spinning = false;
+                        if (m_cancelled) {
+                            return;
+                        }
                     }
                     if (!t) {
-                        if (!waitForWork(waiter, &t)) {
+                        if (!park(pt, waiter, &t)) {
                             return;
                         }
                     }
                 }
             }
             if (t) {
-                t();
+                runTask(pt, t);
             }
         }
     }
 }
 
+void ThreadPoolPrivate::noteArrival(Task &t)
+{
+    if (!m_options.adaptiveSpinning) {
+        return;
+    }
+    const auto now = nowNs();
+    t.enqueued = now;
+    const auto last = m_lastArrival.exchange(now, std::memory_order_relaxed);
+    if (last == 0 || now <= last) {
+        return;
+    }
+    // Anything beyond what the longest spin could cover just means "too far apart". Clamp it, so
+    // a single arrival after a long idle period doesn't keep the average up for ages.
+    const auto horizon = 2 * m_spinRoundNs.load(std::memory_order_relaxed) * static_cast<uint64_t>(m_maxSpinLimit);
+    auto gap = now - last;
+    if (horizon > 0) {
+        gap = std::min(gap, horizon);
+    }
+    // Moving average with weight 1/8. Concurrent updates may lose a sample, it is only a hint.
+    const auto avg = m_arrivalGap.load(std::memory_order_relaxed);
+    m_arrivalGap.store(avg == 0 ? gap : avg - avg / 8 + gap / 8, std::memory_order_relaxed);
+}
+
+int ThreadPoolPrivate::spinLimit() const
+{
+    if (!m_options.adaptiveSpinning) {
+        return m_options.spinCount;
+    }
+    // When work arrives further apart than even the longest spin lasts, spinning only burns CPU,
+    // go park right away.
+    const auto gap = m_arrivalGap.load(std::memory_order_relaxed);
+    const auto roundNs = m_spinRoundNs.load(std::memory_order_relaxed);
+    if (gap > 0 && roundNs > 0 && gap > roundNs * static_cast<uint64_t>(m_maxSpinLimit)) {
+        return 0;
+    }
+    return m_spinLimit.load(std::memory_order_relaxed);
+}
+
+template<typename Attempt>
+Task ThreadPoolPrivate::spin(Attempt &&attempt)
+{
+    const auto limit = spinLimit();
+    if (limit <= 0) {
+        return {};
+    }
+
+    const auto start = nowNs();
+    Task t;
+    int rounds = 0;
+    for (; rounds < limit && !t; rounds++) {
+        if (m_cancelled.load(std::memory_order_relaxed)) {
+            return {};
+        }
+        t = attempt();
+    }
+    const auto spent = nowNs() - start;
+
+    m_spins.fetch_add(1, std::memory_order_relaxed);
+    m_spinNs.fetch_add(spent, std::memory_order_relaxed);
+    if (t) {
+        m_spinHits.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (m_options.adaptiveSpinning && rounds > 0) {
+        const auto perRound = std::max<uint64_t>(spent / rounds, 1);
+        const auto avg = m_spinRoundNs.load(std::memory_order_relaxed);
+        m_spinRoundNs.store(avg == 0 ? perRound : avg - avg / 8 + perRound / 8, std::memory_order_relaxed);
+    }
+    return t;
+}
+
+bool ThreadPoolPrivate::park(PerThread *pt, EventCount::Waiter *waiter, Task *t)
+{
+    m_parks.fetch_add(1, std::memory_order_relaxed);
+    if (!m_options.adaptiveSpinning) {
+        return waitForWork(waiter, t);
+    }
+
+    const auto start = nowNs();
+    auto ok = waitForWork(waiter, t);
+    const auto idle = nowNs() - start;
+    pt->woken = true;
+
+    // How long the spin we gave up on would have lasted
+    const auto spinWindow = m_spinRoundNs.load(std::memory_order_relaxed)
+                            * static_cast<uint64_t>(std::max(m_spinLimit.load(std::memory_order_relaxed), 1));
+    // Never quite down to 0, or there would be no spin to learn from any more
+    constexpr int kMinSpinLimit = 16;
+    auto limit = m_spinLimit.load(std::memory_order_relaxed);
+    if (idle < spinWindow) {
+        // Work came in right after giving up, a bit more spinning would have caught it
+        limit = std::min(std::max(limit * 2, kMinSpinLimit), m_maxSpinLimit);
+    } else if (idle > 16 * spinWindow) {
+        // Long idle, the spin was wasted
+        limit = std::min(std::max(limit / 2, kMinSpinLimit), m_maxSpinLimit);
+    }
+    m_spinLimit.store(limit, std::memory_order_relaxed);
+    return ok;
+}
+
+void ThreadPoolPrivate::runTask(PerThread *pt, Task &t)
+{
+    if (pt->woken) {
+        pt->woken = false;
+        if (t.enqueued) {
+            const auto now = nowNs();
+            m_wakeups.fetch_add(1, std::memory_order_relaxed);
+            m_wakeLatencyNs.fetch_add(now > t.enqueued ? now - t.enqueued : 0, std::memory_order_relaxed);
+        }
+    }
+    t();
+}
+
+Task ThreadPoolPrivate::popLocal(PerThread *pt)
+{
+    const auto id = pt->thread_id;
+    const auto burst = m_options.highPriorityBurst;
+    if (burst > 0 && pt->highRun >= burst) {
+        // Give a normal priority task a turn
+        pt->highRun = 0;
+        if (auto t = m_queues[kNormal][id].PopFront()) {
+            return t;
+        }
+    }
+
+    if (auto t = popped(m_queues[kHigh][id].PopFront(), kHigh)) {
+        ++pt->highRun;
+        return t;
+    }
+    // A high priority task queued elsewhere goes before our own normal ones
+    if (m_pendingHigh.load(std::memory_order_relaxed) > 0) {
+        if (auto t = stealAt(kHigh)) {
+            ++pt->highRun;
+            return t;
+        }
+    }
+    pt->highRun = 0;
+    return m_queues[kNormal][id].PopFront();
+}
+
 Task ThreadPoolPrivate::steal()
 {
+    for (size_t level = 0; level != kNumTaskPriorities; ++level) {
+        if (level == kHigh && m_pendingHigh.load(std::memory_order_relaxed) <= 0) {
+            continue;
+        }
+        if (auto t = stealAt(level)) {
+            return t;
+        }
+    }
+    return {};
+}
+
+Task ThreadPoolPrivate::stealAt(size_t level)
+{
+    auto &queues = m_queues[level];
     auto pt = getPerThread();
-    const size_t size = m_queues.size();
     unsigned r = rand(&pt->rand);
+
+    // Try workers on the same node first, their tasks' data is more likely in local memory
+    if (!m_nodeQueues.empty() && pt->thread_id >= 0 && m_placements[pt->thread_id].node >= 0) {
+        const auto &local = m_nodeQueues[m_placements[pt->thread_id].node];
+        for (size_t i = 0, victim = r % local.size(); i < local.size(); i++) {
+            auto t = popped(queues[local[victim]].PopBack(), level);
+            if (t) {
+                return t;
+            }
+            if (++victim == local.size()) {
+                victim = 0;
+            }
+        }
+    }
+
+    const size_t size = queues.size();
     unsigned inc = m_coprimes[r % m_coprimes.size()];
     unsigned victim = r % size;
     for (unsigned i = 0; i < size; i++) {
-        auto t = m_queues[victim].PopBack();
+        auto t = popped(queues[victim].PopBack(), level);
         if (t) {
             return t;
         }
@@ -418,7 +1010,20 @@ Task ThreadPoolPrivate::steal()
             victim -= size;
         }
     }
-    return {};
+    return popOverflow(level);
+}
+
+Task ThreadPoolPrivate::popOverflow(size_t level)
+{
+    if (m_overflowSize[level].load(std::memory_order_acquire) <= 0) {
+        return {};
+    }
+    Task t;
+    if (!m_overflow[level].try_dequeue(t)) {
+        return {};
+    }
+    m_overflowSize[level].fetch_sub(1, std::memory_order_relaxed);
+    return popped(std::move(t), level);
 }
 
 bool ThreadPoolPrivate::waitForWork(EventCount::Waiter *waiter, Task *t)
@@ -432,10 +1037,22 @@ bool ThreadPoolPrivate::waitForWork(EventCount::Waiter *waiter, Task *t)
       if (m_cancelled) {
         return false;
       } else {
-        *t = m_queues[victim].PopBack();
+        const auto level = static_cast<size_t>(victim) / m_options.numThreads;
+        *t = popped(m_queues[level][victim % m_options.numThreads].PopBack(), level);
         return true;
       }
     }
+    if (hasOverflow()) {
+      m_ec.CancelWait(waiter);
+      if (m_cancelled) {
+        return false;
+      }
+      // May come back empty if some other worker was faster, the caller just loops again
+      for (size_t level = 0; level != kNumTaskPriorities && !*t; ++level) {
+        *t = popOverflow(level);
+      }
+      return true;
+    }
     // Number of blocked threads is used as termination condition.
     // If we are shutting down and all worker threads blocked without work,
     // that's we are done.
@@ -447,7 +1064,7 @@ bool ThreadPoolPrivate::waitForWork(EventCount::Waiter *waiter, Task *t)
       // right after incrementing blocked_ above. Now a free-standing thread
       // submits work and calls destructor (which sets done_). If we don't
       // re-check queues, we will exit leaving the work unexecuted.
-      if (nonEmptyQueueIndex() != -1) {
+      if (nonEmptyQueueIndex() != -1 || hasOverflow()) {
         // Note: we must not pop from queues before we decrement blocked_,
         // otherwise the following scenario is possible. Consider that instead
         // of checking for emptiness we popped the only element from queues.
@@ -20,10 +20,23 @@
 #ifndef EXECUTION_THREADPOOL_H
 #define EXECUTION_THREADPOOL_H
 
+#include "execution/threadpool/affinity.h"
 #include "utils/fixed_function.hpp"
 
 #include <future>
 #include <memory>
+#include <vector>
+
+/**
+ * @brief Priority class of a closure. Each worker has one queue per class, and runs and steals
+ * High closures before Normal ones.
+ */
+enum class TaskPriority
+{
+    High = 0,
+    Normal = 1,
+};
+constexpr size_t kNumTaskPriorities = 2;
 
 struct ThreadPoolOptions
 {
@@ -62,6 +75,20 @@ struct ThreadPoolOptions
         return *this;
     }
 
+    /**
+     * @brief Adapt the spin budget to the load instead of always spinning spinCount rounds.
+     * Workers spin longer, up to 16 times spinCount, when work keeps arriving shortly after they
+     * gave up and parked, and less when they stay parked for long. When submissions come further
+     * apart than the longest spin, workers park right away.
+     */
+    bool adaptiveSpinning = true;
+
+    ThreadPoolOptions &setAdaptiveSpinning(bool adaptive)
+    {
+        adaptiveSpinning = adaptive;
+        return *this;
+    }
+
     /**
      * @brief Optional worker thread name, truncated at 16 characters.
      */
@@ -73,6 +100,45 @@ struct ThreadPoolOptions
         return *this;
     }
 
+    /**
+     * @brief How workers are pinned to CPUs. Except for Policy::None, tasks submitted
+     * from outside the pool go to workers on the submitting thread's NUMA node, and
+     * workers steal from their own node first.
+     */
+    ThreadAffinity affinity;
+
+    ThreadPoolOptions &setAffinity(const ThreadAffinity &aff)
+    {
+        affinity = aff;
+        return *this;
+    }
+
+    /**
+     * @brief After running this many High priority tasks in a row, a worker runs one Normal
+     * priority task from its own queue if there is any, so they are not starved.
+     * Use 0 for strict priority.
+     */
+    int highPriorityBurst = 16;
+
+    ThreadPoolOptions &setHighPriorityBurst(int burst)
+    {
+        highPriorityBurst = burst;
+        return *this;
+    }
+
+    /**
+     * @brief Maximum number of spare workers started to make up for workers blocked
+     * in a ThreadPool::ScopedBlockingRegion.
+     * Use -1 for default value, which is numThreads. 0 disables compensation.
+     */
+    int maxSpareThreads = -1;
+
+    ThreadPoolOptions &setMaxSpareThreads(int num)
+    {
+        maxSpareThreads = num;
+        return *this;
+    }
+
     ThreadPoolOptions();
     ThreadPoolOptions(const ThreadPoolOptions &) = default;
     ThreadPoolOptions(ThreadPoolOptions &&) = default;
@@ -99,9 +165,20 @@ public:
 
     /**
      * @brief Try run a closure c in thread pool.
-     * @returns c itself if queue is full. Otherwise a default constructed Closure.
+     * Tasks that don't fit in the target queue are kept in an unbounded overflow list,
+     * so this currently always succeeds.
+     * @returns c itself if the task can't be accepted. Otherwise a default constructed Closure.
      */
-    Closure tryRun(Closure c);
+    Closure tryRun(Closure c, TaskPriority priority = TaskPriority::Normal);
+
+    /**
+     * @brief Try run all closures in batch, spread round-robin over the worker queues, waking
+     * up idle workers once for the whole batch rather than once per closure.
+     * Accepted closures are moved out of batch and left empty. Rejected ones are kept in
+     * place, which keeps the order and lets the caller map them back. Empty closures are skipped.
+     * @returns the number of closures accepted.
+     */
+    size_t tryRunBatch(std::vector<Closure> &batch, TaskPriority priority = TaskPriority::Normal);
 
     /**
      * @brief Run the Func f in thread pool, don't care about its completion.
@@ -109,9 +186,9 @@ public:
      * If the queue is full, then f is run on calling thread.
      */
     template<typename Func>
-    void run(Func f)
+    void run(Func f, TaskPriority priority = TaskPriority::Normal)
     {
-        auto c = tryRun(std::move(f));
+        auto c = tryRun(std::move(f), priority);
         if (c) {
             // enqueue failed, run on current thread
             c();
@@ -124,14 +201,14 @@ public:
      * @returns future holding the return value of function f.
      */
     template<typename Func>
-    auto post(Func f)
+    auto post(Func f, TaskPriority priority = TaskPriority::Normal)
     {
         using R = std::invoke_result_t<Func>;
         using Task = std::packaged_task<R()>;
 
         Task tk(std::move(f));
         auto fu = tk.get_future();
-        run(std::move(tk));
+        run(std::move(tk), priority);
         return fu;
     }
 
@@ -150,6 +227,52 @@ public:
      */
     size_t numThreads() const;
 
+    /**
+     * @brief Mark the calling worker as blocked for the lifetime of this object, e.g. while
+     * waiting for a semaphore or a device sync. A spare worker is woken or started, up to
+     * ThreadPoolOptions::maxSpareThreads, to keep running queued tasks in the meantime, so
+     * that tasks the blocked worker waits on are not stuck behind it.
+     *
+     * Does nothing if the calling thread is not a worker of any ThreadPool.
+     */
+    class ScopedBlockingRegion
+    {
+    public:
+        ScopedBlockingRegion();
+        ~ScopedBlockingRegion();
+
+        ScopedBlockingRegion(const ScopedBlockingRegion &) = delete;
+        ScopedBlockingRegion &operator=(const ScopedBlockingRegion &) = delete;
+
+    private:
+        ThreadPoolPrivate *m_pool;
+    };
+
+    struct Stats
+    {
+        // Number of tasks ever spilled to the overflow list because a queue was full
+        uint64_t overflows = 0;
+        // Number of tasks currently waiting in the overflow list
+        uint64_t overflowPending = 0;
+        // Number of times a worker entered a blocking region
+        uint64_t blockingRegions = 0;
+        // Number of spare workers started so far
+        uint64_t spareThreads = 0;
+        // Current spin budget in rounds, and the average ns between submissions it's based on
+        int spinLimit = 0;
+        uint64_t arrivalGapNs = 0;
+        // Time spent spinning, i.e. CPU burned while idle, and how many spins found work
+        uint64_t spinNs = 0;
+        uint64_t spins = 0;
+        uint64_t spinHits = 0;
+        // Times a worker parked, and the total time from submission to start of the first task
+        // after waking up, over wakeups such tasks
+        uint64_t parks = 0;
+        uint64_t wakeups = 0;
+        uint64_t wakeLatencyNs = 0;
+    };
+    Stats stats() const;
+
     /**
      * @returns a logical thread index between 0 and numThreads() - 1 if called
      * from one of the threads in the pool. Returns -1 otherwise.
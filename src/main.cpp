@@ -20,14 +20,20 @@
 #include "utils/macros.h"
 
 #ifdef SALUS_ENABLE_TENSORFLOW
+#include "oplibraries/tensorflow/device/gpu/cudagpubackend.h"
 #include "oplibraries/tensorflow/v3/smblocker.h"
 #endif
 
 #include "execution/executionengine.h"
+#include "resources/iteralloctracker.h"
+#include "resources/limitsprovider.h"
+#include "resources/memorymgr.h"
+#include "resources/profilecache.h"
 #include "resources/resources.h"
 #include "platform/logging.h"
 #include "platform/signals.h"
 #include "platform/profiler.h"
+#include "rpcserver/iothreadpool.h"
 #include "rpcserver/zmqserver.h"
 #include "utils/envutils.h"
 
@@ -37,6 +43,7 @@
 #include <memory>
 #include <optional>
 #include <regex>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 
@@ -50,7 +57,19 @@ const static auto listen = "--listen";
 const static auto maxHolWaiting = "--max-hol-waiting";
 const static auto disableFairness = "--disable-fairness";
 const static auto disableWorkConservative = "--disable-wc";
+const static auto adaptiveHol = "--adaptive-hol";
+const static auto allocQueue = "--alloc-queue";
+const static auto allocQuantile = "--alloc-quantile";
 const static auto smFactor = "--sm-factor";
+const static auto resourceFile = "--resource-file";
+const static auto limits = "--limits";
+const static auto gpuReserve = "--gpu-reserve";
+const static auto profileCache = "--profile-cache";
+const static auto hostAlloc = "--host-alloc";
+const static auto hostSizeClasses = "--host-size-classes";
+const static auto hugePages = "--hugepages";
+const static auto computeAffinity = "--compute-affinity";
+const static auto ioAffinity = "--io-affinity";
 const static auto scheduler = "--sched";
 
 const static auto logConf = "--logconf";
@@ -77,13 +96,36 @@ Options:
                                 Listen on ZeroMQ endpoint <endpoint>.
                                 [default: tcp://*:5501]
     -s <policy>, --sched=<policy>
-                                Use <policy> for scheduling . Choices: fair, preempt, pack, rr, fifo.
+                                Use <policy> for scheduling . Choices: fair, drf, preempt, pack, rr, fifo.
                                 [default: pack]
     --disable-wc                Disable work conservation. Only have effect when
                                 fairness is on.
     --max-hol-waiting=<num>     Maximum number of task allowed go before queue head
                                 in scheduling. [default: 50]
+    --adaptive-hol              Adapt the limit of --max-hol-waiting per session
+                                from observed queue head blocking and OOM retries.
+    --alloc-queue               Let iterations whose memory reservation fails wait
+                                in line instead of retrying against everyone.
+    --alloc-quantile=<q>        Estimate iteration memory usage as quantile <q> of
+                                past iterations, 0 uses the average. [default: 0.95]
     --sm-factor=<num>           Scale factor for # of SMs. [default: 1]
+    --resource-file=<file>      Read resource limits from JSON file <file>.
+    --limits=<specs>            Comma separated resource limit overrides, e.g.
+                                MEMORY:GPU:0=10G,GPU_STREAM:GPU:0=64
+    --gpu-reserve=<mb>          GPU memory in MB left unused on each GPU.
+    --profile-cache=<file>      Remember memory usage learned per graph in <file>,
+                                so later sessions of the same model start with it.
+    --host-alloc=<kind>         Allocator for host memory, one of slab or system.
+                                [default: system]
+    --host-size-classes=<sizes> Comma separated object sizes for the slab host
+                                allocator, e.g. 64,256,1K,4K.
+    --hugepages=<mode>          Back slab host memory with huge pages, one of off,
+                                madvise or hugetlb. [default: madvise]
+    --compute-affinity=<spec>   Pin compute workers to CPUs, one of none, compact,
+                                scatter, numa or cpus:<list>, e.g. cpus:0-7,16-23.
+                                [default: none]
+    --io-affinity=<spec>        Pin IO workers to CPUs, same choices as
+                                --compute-affinity. [default: none]
     -c <file>, --logconf=<file> Path to log configuration file. Note that
                                 settings in this file takes precedence over
                                 other command line arguments.
@@ -206,11 +248,82 @@ void initializeLogging(std::map<std::string, docopt::value> &args)
     });
 }
 
+bool configureResources(std::map<std::string, docopt::value> &args)
+{
+    LimitsProvider::Options opts;
+    opts.resourceFile = optional_arg<std::string>(args[flags::resourceFile]);
+    opts.overrides = value_or<std::string>(args[flags::limits], ""s);
+    if (auto reserve = optional_arg<long>(args[flags::gpuReserve])) {
+        opts.gpuReserve = static_cast<size_t>(*reserve) * 1024 * 1024;
+    }
+
+    try {
+        LimitsProvider::instance().configure(opts);
+    } catch (const std::exception &ex) {
+        LOG(ERROR) << "Invalid resource limits: " << ex.what();
+        return false;
+    }
+
+    // docopt doesn't handle double number
+    auto quantile = std::atof(value_or<std::string>(args[flags::allocQuantile], "0.95"s).c_str());
+    if (quantile < 0 || quantile >= 1) {
+        LOG(ERROR) << "Invalid allocation quantile " << quantile << ", must be in [0, 1)";
+        return false;
+    }
+    salus::IterAllocTracker::setEstimationQuantile(quantile);
+
+    if (auto path = optional_arg<std::string>(args[flags::profileCache])) {
+        try {
+            ProfileCache::instance().configure(*path);
+        } catch (const std::exception &ex) {
+            LOG(ERROR) << "Invalid profile cache: " << ex.what();
+            return false;
+        }
+    }
+
+    MemoryMgr::Options memOpts;
+    auto hostAlloc = value_or<std::string>(args[flags::hostAlloc], "system"s);
+    if (hostAlloc != "slab" && hostAlloc != "system") {
+        LOG(ERROR) << "Invalid host allocator " << hostAlloc << ", must be one of slab or system";
+        return false;
+    }
+    memOpts.slab = hostAlloc == "slab";
+    try {
+        memOpts.hugePages = MemoryMgr::parseHugePages(value_or<std::string>(args[flags::hugePages], "madvise"s));
+        std::istringstream iss(value_or<std::string>(args[flags::hostSizeClasses], ""s));
+        std::string size;
+        while (std::getline(iss, size, ',')) {
+            memOpts.sizeClasses.push_back(LimitsProvider::parseSize(size));
+        }
+        MemoryMgr::instance().configure(memOpts);
+    } catch (const std::exception &ex) {
+        LOG(ERROR) << "Invalid host allocator options: " << ex.what();
+        return false;
+    }
+    return true;
+}
+
+bool configureAffinity(std::map<std::string, docopt::value> &args)
+{
+    // must happen before the pools are created
+    try {
+        salus::ExecutionEngine::setPoolAffinity(
+            ThreadAffinity::parse(value_or<std::string>(args[flags::computeAffinity], "none"s)));
+        salus::IOThreadPool::setAffinity(ThreadAffinity::parse(value_or<std::string>(args[flags::ioAffinity], "none"s)));
+    } catch (const std::exception &ex) {
+        LOG(ERROR) << "Invalid thread affinity: " << ex.what();
+        return false;
+    }
+    return true;
+}
+
 void configureExecution(std::map<std::string, docopt::value> &args)
 {
     auto disableFairness = value_or<bool>(args[flags::disableFairness], false);
     uint64_t maxQueueHeadWaiting = value_or<long>(args[flags::maxHolWaiting], 50u);
     auto disableWorkConservative = value_or<bool>(args[flags::disableWorkConservative], false);
+    auto adaptiveHol = value_or<bool>(args[flags::adaptiveHol], false);
+    auto allocQueue = value_or<bool>(args[flags::allocQueue], false);
     auto sched = value_or<std::string>(args[flags::scheduler], "fair"s);
 
     // Handle deprecated arguments
@@ -218,7 +331,22 @@ void configureExecution(std::map<std::string, docopt::value> &args)
         sched = "pack";
     }
 
-    salus::ExecutionEngine::instance().setSchedulingParam({maxQueueHeadWaiting, !disableWorkConservative, sched});
+    salus::SchedulingParam param{maxQueueHeadWaiting, !disableWorkConservative, sched};
+    param.adaptiveHol = adaptiveHol;
+    param.allocQueue = allocQueue;
+    salus::ExecutionEngine::instance().setSchedulingParam(param);
+}
+
+void configureGpuBackend()
+{
+#ifdef SALUS_ENABLE_TENSORFLOW
+    using namespace salus::oplib::tensorflow;
+    if (!GpuBackend::hasInstance()) {
+        GpuBackend::setInstance(std::make_unique<CudaGpuBackend>());
+    }
+    // before the execution engine reads limits
+    GpuBackend::instance().discoverLimits();
+#endif
 }
 
 void configureSMBlocker(std::map<std::string, docopt::value> &args)
@@ -232,7 +360,7 @@ void configureSMBlocker(std::map<std::string, docopt::value> &args)
 #endif
 }
 
-void printConfiguration(std::map<std::string, docopt::value> &)
+void printConfiguration(std::map<std::string, docopt::value> &args)
 {
     LOG(INFO) << "Running build type: " << SALUS_BUILD_TYPE;
 
@@ -254,8 +382,24 @@ void printConfiguration(std::map<std::string, docopt::value> &)
     auto &param = salus::ExecutionEngine::instance().schedulingParam();
     LOG(INFO) << "    Policy: " << param.scheduler;
     LOG(INFO) << "    MaxQueueHeadWaiting: " << param.maxHolWaiting;
+    LOG(INFO) << "    AdaptiveHOL: " << (param.adaptiveHol ? "on" : "off");
+    LOG(INFO) << "    AllocationQueue: " << (param.allocQueue ? "on" : "off");
+    LOG(INFO) << "    AllocationQuantile: " << salus::IterAllocTracker::estimationQuantile();
     LOG(INFO) << "    WorkConservative: " << (param.workConservative ? "on" : "off");
 
+    LOG(INFO) << "Thread affinity: " << CpuTopology::system().DebugString();
+    LOG(INFO) << "    Compute: " << salus::ExecutionEngine::poolAffinity().DebugString();
+    LOG(INFO) << "    IO: " << salus::IOThreadPool::affinity().DebugString();
+
+    {
+        const auto &opts = MemoryMgr::instance().options();
+        LOG(INFO) << "Host allocator: " << (opts.slab ? "slab" : "system");
+        if (opts.slab) {
+            LOG(INFO) << "    Huge pages: " << value_or<std::string>(args[flags::hugePages], "madvise"s);
+            LOG(INFO) << "    Size classes: " << MemoryMgr::instance().stats().classes.size();
+        }
+    }
+
 #ifdef SALUS_ENABLE_TENSORFLOW
     LOG(INFO) << "GPU execution:";
     LOG(INFO) << "    SM scale factor: " << salus::oplib::tensorflow::SMBlocker::scaleFactorSM();
@@ -271,6 +415,16 @@ int main(int argc, char **argv)
 
     signals::initialize();
 
+    if (!configureResources(args)) {
+        return 1;
+    }
+
+    if (!configureAffinity(args)) {
+        return 1;
+    }
+
+    configureGpuBackend();
+
     configureExecution(args);
 
     configureSMBlocker(args);
@@ -292,5 +446,7 @@ int main(int argc, char **argv)
 
     salus::ExecutionEngine::instance().stopScheduler();
 
+    VLOG(1) << MemoryMgr::instance().stats().DebugString();
+
     return 0;
 }
@@ -0,0 +1,87 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "execution/threadpool/EventCount.h"
+#include "microbench/microbench.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using salus::bench::State;
+
+namespace {
+
+/**
+ * @brief Notify on an EventCount nobody waits on, the cost every submission to an all busy pool pays.
+ */
+void benchNotifyNoWaiter(State &state)
+{
+    std::vector<EventCount::Waiter> waiters(1);
+    EventCount ec(waiters);
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        ec.Notify(false);
+    }
+}
+
+/**
+ * @brief Ping-pong between two threads, each parking on its own EventCount until the other bumps
+ * a counter. Time per iteration is one full round trip, i.e. two wake ups.
+ */
+void benchWakeRoundTrip(State &state)
+{
+    std::vector<EventCount::Waiter> pingWaiters(1);
+    std::vector<EventCount::Waiter> pongWaiters(1);
+    EventCount pingEc(pingWaiters);
+    EventCount pongEc(pongWaiters);
+    std::atomic<uint64_t> ping{0};
+    std::atomic<uint64_t> pong{0};
+
+    auto waitFor = [](EventCount &ec, EventCount::Waiter *w, std::atomic<uint64_t> &value, uint64_t expected) {
+        while (value.load() < expected) {
+            ec.Prewait(w);
+            if (value.load() >= expected) {
+                ec.CancelWait(w);
+                break;
+            }
+            ec.CommitWait(w);
+        }
+    };
+
+    const auto n = state.iterations();
+    std::thread responder([&]() {
+        for (uint64_t i = 1; i <= n; ++i) {
+            waitFor(pingEc, &pingWaiters[0], ping, i);
+            pong.store(i);
+            pongEc.Notify(false);
+        }
+    });
+
+    for (uint64_t i = 1; i <= n; ++i) {
+        ping.store(i);
+        pingEc.Notify(false);
+        waitFor(pongEc, &pongWaiters[0], pong, i);
+    }
+    responder.join();
+}
+
+SALUS_MICROBENCH("eventCount/notify/noWaiter", benchNotifyNoWaiter);
+SALUS_MICROBENCH("eventCount/wake/roundTrip", benchWakeRoundTrip);
+
+} // namespace
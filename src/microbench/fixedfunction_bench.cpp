@@ -0,0 +1,77 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench/microbench.h"
+#include "utils/fixed_function.hpp"
+
+#include <array>
+#include <functional>
+
+using salus::bench::State;
+
+namespace {
+
+/**
+ * @brief A callable capturing about N bytes, like closures capturing an op item and some state.
+ */
+template<size_t N>
+struct Payload
+{
+    std::array<char, N> data{};
+
+    int operator()()
+    {
+        return data[0] + data[N - 1];
+    }
+};
+
+/**
+ * @brief Construct, move once as when pushed to a queue, and invoke. FixedFunction stores the
+ * callable inline as long as it is below its 128 byte STORAGE_SIZE, std::function allocates
+ * for anything beyond a couple of pointers.
+ */
+template<typename Function, size_t N>
+void benchConstruct(State &state)
+{
+    Payload<N> payload;
+    int sum = 0;
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        payload.data[0] = static_cast<char>(i);
+        Function f(payload);
+        Function moved(std::move(f));
+        sum += moved();
+    }
+    salus::bench::doNotOptimize(sum);
+    state.counter("captureBytes", N);
+}
+
+using Fixed = sstl::FixedFunction<int()>;
+using Std = std::function<int()>;
+
+SALUS_MICROBENCH("fixedFunction/construct/capture:8", (benchConstruct<Fixed, 8>));
+SALUS_MICROBENCH("fixedFunction/construct/capture:32", (benchConstruct<Fixed, 32>));
+SALUS_MICROBENCH("fixedFunction/construct/capture:64", (benchConstruct<Fixed, 64>));
+// largest that fits, the storage has to be strictly larger than the callable
+SALUS_MICROBENCH("fixedFunction/construct/capture:120", (benchConstruct<Fixed, 120>));
+SALUS_MICROBENCH("stdFunction/construct/capture:8", (benchConstruct<Std, 8>));
+SALUS_MICROBENCH("stdFunction/construct/capture:32", (benchConstruct<Std, 32>));
+SALUS_MICROBENCH("stdFunction/construct/capture:64", (benchConstruct<Std, 64>));
+SALUS_MICROBENCH("stdFunction/construct/capture:120", (benchConstruct<Std, 120>));
+
+} // namespace
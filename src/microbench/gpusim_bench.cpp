@@ -0,0 +1,143 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ *
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench/microbench.h"
+#include "oplibraries/tensorflow/device/gpu/simgpubackend.h"
+#include "oplibraries/tensorflow/device/gpu/smeventpoller.h"
+#include "oplibraries/tensorflow/v3/smblocker.h"
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+extern "C" void salus_kernel_launch_callback(unsigned int gridDimX, unsigned int gridDimY, unsigned int gridDimZ,
+                                             unsigned int blockDimX, unsigned int blockDimY, unsigned int blockDimZ,
+                                             unsigned int sharedMemBytes, void *);
+
+using salus::bench::State;
+using salus::oplib::tensorflow::GpuBackend;
+using salus::oplib::tensorflow::SimulatedGpuBackend;
+using salus::oplib::tensorflow::SMBlocker;
+using salus::oplib::tensorflow::SMEventPoller;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr uint64_t kGraphId = 1;
+constexpr int kNumKernels = 8;
+constexpr unsigned int kSMs = 80;
+
+/**
+ * @brief SMBlocker is a singleton sized by the backend set first, so all benches share one simulated GPU
+ * and the same set of kernels, kernel i using 10 * (i + 1) SMs.
+ */
+SMBlocker &blocker()
+{
+    static auto &b = []() -> SMBlocker & {
+        SimulatedGpuBackend::Options opts;
+        opts.smCount = kSMs;
+        GpuBackend::setInstance(std::make_unique<SimulatedGpuBackend>(opts));
+        SMBlocker::setScaleFactorSM(1.0);
+
+        auto &blocker = SMBlocker::instance();
+        for (int i = 0; i != kNumKernels; ++i) {
+            salus_kernel_launch_callback(10 * (i + 1), 1, 1, 256, 1, 1, 0, nullptr);
+            blocker.saveCurrentThreadResults(kGraphId, i);
+        }
+        return blocker;
+    }();
+    return b;
+}
+
+/**
+ * @brief Threads launch kernels through SMBlocker::tryTake onto their own virtual stream, and SMEventPoller
+ * releases the SMs once the modeled kernel finishes, as SalusGPUDevice does. Events fail at errorRate.
+ * That no SM leaks either way is checked in tests/test_smblocker.cpp.
+ */
+void benchLaunch(State &state, double errorRate)
+{
+    constexpr int kThreads = 4;
+    auto &b = blocker();
+
+    SimulatedGpuBackend::Options opts;
+    opts.smCount = kSMs;
+    opts.eventErrorRate = errorRate;
+    opts.seed = 42;
+    SimulatedGpuBackend backend(opts);
+
+    std::atomic<uint64_t> retries{0};
+    std::atomic<int> drained{0};
+    {
+        SMEventPoller poller(backend, 0);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t != kThreads; ++t) {
+            threads.emplace_back([&, t]() {
+                auto stream = backend.createStream(0);
+                for (auto i = static_cast<uint64_t>(t); i < state.iterations(); i += kThreads) {
+                    auto kernel = static_cast<int>(i % kNumKernels);
+                    while (!b.tryTake(kGraphId, kernel, 10)) {
+                        ++retries;
+                        std::this_thread::yield();
+                    }
+                    stream->launch(10us);
+                    poller.thenReleaseSM(stream.get(), b.currentThreadSMHolding());
+                }
+                // Events keep no reference to the stream, so it can go before they complete
+                poller.thenExecute(stream.get(), [&drained]() { ++drained; });
+            });
+        }
+        for (auto &th : threads) {
+            th.join();
+        }
+        while (drained.load() != kThreads) {
+            std::this_thread::sleep_for(100us);
+        }
+    }
+
+    state.counter("retriesPerKernel", static_cast<double>(retries) / std::max<uint64_t>(state.iterations(), 1));
+    state.counter("eventsFailed", static_cast<double>(backend.stats().eventsFailed));
+}
+
+/**
+ * @brief Events on a busy stream have to be polled until the modeled work is done
+ */
+void benchEventPoll(State &state)
+{
+    SimulatedGpuBackend backend;
+    auto stream = backend.createStream(0);
+    auto evt = backend.createEvent(0);
+
+    uint64_t polls = 0;
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        stream->launch(1us);
+        evt->record(stream.get());
+        while (evt->poll() == GpuBackend::Event::Status::Pending) {
+            ++polls;
+        }
+    }
+    state.counter("pollsPerEvent", static_cast<double>(polls) / std::max<uint64_t>(state.iterations(), 1));
+}
+
+SALUS_MICROBENCH("gpuSim/event/poll:1us", benchEventPoll);
+SALUS_MICROBENCH("gpuSim/smBlocker/launch", [](State &state) { benchLaunch(state, 0.0); });
+SALUS_MICROBENCH("gpuSim/smBlocker/launch/errors:1%", [](State &state) { benchLaunch(state, 0.01); });
+
+} // namespace
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench/microbench.h"
+#include "platform/logging.h"
+
+#include <docopt.h>
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+using namespace std::string_literals;
+
+namespace {
+
+namespace flags {
+const static auto filter = "--filter";
+const static auto minTime = "--min-time";
+const static auto json = "--json";
+} // namespace flags
+
+const static auto kUsage =
+    R"(Usage:
+    salus-microbench [options]
+    salus-microbench --help
+
+Microbenchmarks for Salus internals.
+
+Options:
+    -h, --help                  Print this help message and exit.
+    -f <regex>, --filter=<regex>
+                                Only run benchmarks whose name matches <regex>.
+                                [default: .*]
+    --min-time=<ms>             Minimum running time of each benchmark in ms.
+                                [default: 200]
+    --json                      Print results as JSON.
+)"s;
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    auto args = docopt::docopt(kUsage, {argv + 1, argv + argc}, /* help = */ true);
+
+    logging::initialize({});
+
+    auto minTime = std::chrono::milliseconds(args[flags::minTime].asLong());
+    auto results = salus::bench::Registry::instance().run(args[flags::filter].asString(), minTime);
+
+    if (args[flags::json].asBool()) {
+        auto arr = nlohmann::json::array();
+        for (const auto &r : results) {
+            arr.push_back({
+                {"name", r.name},
+                {"iterations", r.iterations},
+                {"nsPerIter", r.nsPerIter},
+                {"counters", r.counters},
+            });
+        }
+        std::cout << arr.dump(4) << std::endl;
+        return 0;
+    }
+
+    for (const auto &r : results) {
+        std::cout << std::left << std::setw(48) << r.name << std::right << std::setw(14) << std::fixed
+                  << std::setprecision(2) << r.nsPerIter << " ns" << std::setw(14) << r.iterations;
+        for (const auto &[name, value] : r.counters) {
+            std::cout << " " << name << "=" << value;
+        }
+        std::cout << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench/microbench.h"
+#include "platform/memory.h"
+#include "resources/memorymgr.h"
+#include "utils/envutils.h"
+
+#include <nlohmann/json.hpp>
+
+#include <dlfcn.h>
+
+#include <fstream>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using salus::bench::State;
+
+namespace {
+
+/**
+ * @brief A sequence of allocations and deallocations. Live allocations are identified by slots,
+ * which are reused once freed.
+ */
+struct AllocTrace
+{
+    struct Event
+    {
+        bool alloc;
+        uint32_t slot;
+        size_t size;
+        int alignment;
+    };
+    std::vector<Event> events;
+    uint32_t numSlots = 0;
+};
+
+/**
+ * @brief Roughly what CPU kernels of a TF training step allocate: many small shape and scalar
+ * buffers, some kilobyte sized tensors and a few large ones, mostly freed soon and in LIFO order.
+ */
+AllocTrace syntheticTrace()
+{
+    AllocTrace trace;
+    std::mt19937 rng(42);
+    std::vector<uint32_t> live;
+    std::vector<uint32_t> freeSlots;
+    for (size_t i = 0; i != 100000; ++i) {
+        if (live.empty() || rng() % 100 < 52) {
+            size_t size;
+            auto kind = rng() % 100;
+            if (kind < 70) {
+                size = 4 + rng() % 252;
+            } else if (kind < 97) {
+                size = 1024 + rng() % (63 * 1024);
+            } else {
+                size = (256 << 10) + rng() % (4 << 20);
+            }
+            uint32_t slot;
+            if (freeSlots.empty()) {
+                slot = trace.numSlots++;
+            } else {
+                slot = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            live.push_back(slot);
+            trace.events.push_back({true, slot, size, 64});
+        } else {
+            // mostly the latest one, sometimes an older one
+            auto idx = rng() % 4 ? live.size() - 1 : rng() % live.size();
+            auto slot = live[idx];
+            live.erase(live.begin() + static_cast<long>(idx));
+            freeSlots.push_back(slot);
+            trace.events.push_back({false, slot, 0, 0});
+        }
+    }
+    return trace;
+}
+
+/**
+ * @brief Load host allocations from an allocation log of salus-server, i.e. lines like
+ * "event: alloc {...}" as logged by SessionAllocator. GPU allocators are skipped.
+ */
+AllocTrace loadTrace(const std::string &path)
+{
+    AllocTrace trace;
+    std::ifstream in(path);
+    std::unordered_map<uint64_t, uint32_t> slots;
+    std::vector<uint32_t> freeSlots;
+    std::string line;
+    while (std::getline(in, line)) {
+        bool alloc;
+        size_t pos;
+        if ((pos = line.find("event: alloc ")) != std::string::npos) {
+            alloc = true;
+            pos += 13;
+        } else if ((pos = line.find("event: dealloc ")) != std::string::npos) {
+            alloc = false;
+            pos += 15;
+        } else {
+            continue;
+        }
+        auto j = nlohmann::json::parse(line.substr(pos), nullptr, false);
+        if (j.is_discarded()) {
+            continue;
+        }
+        auto name = j.value("allocator", std::string{});
+        if (name.find("GPU") != std::string::npos || name.find("gpu") != std::string::npos) {
+            continue;
+        }
+        auto ptr = j.value("ptr", uint64_t{0});
+        if (alloc) {
+            uint32_t slot;
+            if (freeSlots.empty()) {
+                slot = trace.numSlots++;
+            } else {
+                slot = freeSlots.back();
+                freeSlots.pop_back();
+            }
+            slots[ptr] = slot;
+            trace.events.push_back({true, slot, j.value("size", size_t{0}), j.value("alignment", 64)});
+        } else if (auto it = slots.find(ptr); it != slots.end()) {
+            freeSlots.push_back(it->second);
+            trace.events.push_back({false, it->second, 0, 0});
+            slots.erase(it);
+        }
+    }
+    return trace;
+}
+
+struct SystemAlloc
+{
+    static void *allocate(int alignment, size_t size)
+    {
+        return mem::alignedAlloc(alignment, size);
+    }
+    static void deallocate(void *ptr)
+    {
+        mem::alignedFree(ptr);
+    }
+};
+
+struct SlabAlloc
+{
+    static void *allocate(int alignment, size_t size)
+    {
+        return MemoryMgr::instance().allocate(alignment, size);
+    }
+    static void deallocate(void *ptr)
+    {
+        MemoryMgr::instance().deallocate(ptr);
+    }
+};
+
+/**
+ * @brief Replay one event of trace per iteration, starting over when reaching the end
+ */
+template<typename Alloc>
+void replay(const AllocTrace &trace, uint64_t iterations)
+{
+    std::vector<void *> slots(trace.numSlots, nullptr);
+    size_t next = 0;
+    for (uint64_t i = 0; i != iterations; ++i) {
+        if (next == trace.events.size()) {
+            for (auto &ptr : slots) {
+                Alloc::deallocate(ptr);
+                ptr = nullptr;
+            }
+            next = 0;
+        }
+        auto &ev = trace.events[next++];
+        if (ev.alloc) {
+            auto ptr = Alloc::allocate(ev.alignment, ev.size);
+            // touch it like a kernel writing its output would
+            if (ev.size) {
+                static_cast<char *>(ptr)[0] = 1;
+            }
+            slots[ev.slot] = ptr;
+        } else {
+            Alloc::deallocate(slots[ev.slot]);
+            slots[ev.slot] = nullptr;
+        }
+    }
+    for (auto ptr : slots) {
+        Alloc::deallocate(ptr);
+    }
+}
+
+template<typename Alloc>
+void benchTrace(State &state, const AllocTrace &trace, size_t numThreads)
+{
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t != numThreads; ++t) {
+        threads.emplace_back([&]() { replay<Alloc>(trace, state.iterations()); });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    // the system allocator may be tcmalloc, depending on WITH_TCMALLOC
+    state.counter("tcmalloc", dlsym(RTLD_DEFAULT, "tc_malloc") != nullptr);
+    state.counter("events", trace.events.size());
+}
+
+const AllocTrace &traceFor(const std::string &name)
+{
+    static const auto synthetic = syntheticTrace();
+    static const auto recorded = loadTrace(std::string(sstl::fromEnvVarStr("SALUS_BENCH_ALLOC_TRACE", "")));
+    return name == "recorded" ? recorded : synthetic;
+}
+
+struct Registrar
+{
+    Registrar()
+    {
+        std::vector<std::string> traces{"synthetic"};
+        if (!std::string(sstl::fromEnvVarStr("SALUS_BENCH_ALLOC_TRACE", "")).empty()) {
+            traces.emplace_back("recorded");
+        }
+        for (const auto &trace : traces) {
+            for (size_t threads : {1, 4, 8}) {
+                auto name = "memoryMgr/" + trace + "/threads:" + std::to_string(threads);
+                salus::bench::Registry::instance().add(name + "/system", [trace, threads](State &state) {
+                    benchTrace<SystemAlloc>(state, traceFor(trace), threads);
+                });
+                salus::bench::Registry::instance().add(name + "/slab", [trace, threads](State &state) {
+                    benchTrace<SlabAlloc>(state, traceFor(trace), threads);
+                });
+            }
+        }
+    }
+} registrar;
+
+} // namespace
@@ -0,0 +1,70 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench/microbench.h"
+
+#include <regex>
+
+namespace salus::bench {
+
+/*static*/ Registry &Registry::instance()
+{
+    static Registry registry;
+    return registry;
+}
+
+void Registry::add(std::string name, BenchFn fn)
+{
+    m_benches.emplace_back(std::move(name), std::move(fn));
+}
+
+std::vector<Result> Registry::run(const std::string &filter, std::chrono::nanoseconds minTime) const
+{
+    using Clock = std::chrono::steady_clock;
+
+    std::regex re(filter);
+    std::vector<Result> results;
+    for (const auto &[name, fn] : m_benches) {
+        if (!std::regex_search(name, re)) {
+            continue;
+        }
+
+        uint64_t iterations = 1;
+        while (true) {
+            State state(iterations);
+            auto start = Clock::now();
+            fn(state);
+            auto elapsed = Clock::now() - start;
+
+            if (elapsed >= minTime || iterations >= (1ull << 40)) {
+                Result r;
+                r.name = name;
+                r.iterations = iterations;
+                r.nsPerIter = static_cast<double>(std::chrono::nanoseconds(elapsed).count()) / iterations;
+                r.counters = state.counters();
+                results.emplace_back(std::move(r));
+                break;
+            }
+            iterations *= 2;
+        }
+    }
+    return results;
+}
+
+} // namespace salus::bench
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_MICROBENCH_MICROBENCH_H
+#define SALUS_MICROBENCH_MICROBENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace salus::bench {
+
+/**
+ * @brief Passed to each benchmark. The benchmark should run its body iterations() times,
+ * any setup before the loop is not excluded from timing, so keep it cheap.
+ */
+class State
+{
+public:
+    explicit State(uint64_t iterations)
+        : m_iterations(iterations)
+    {
+    }
+
+    uint64_t iterations() const
+    {
+        return m_iterations;
+    }
+
+    /**
+     * @brief Report an extra value along with timing, e.g. a rate or a configuration.
+     */
+    void counter(const std::string &name, double value)
+    {
+        m_counters[name] = value;
+    }
+
+    const std::map<std::string, double> &counters() const
+    {
+        return m_counters;
+    }
+
+private:
+    uint64_t m_iterations;
+    std::map<std::string, double> m_counters;
+};
+
+using BenchFn = std::function<void(State &)>;
+
+struct Result
+{
+    std::string name;
+    uint64_t iterations = 0;
+    double nsPerIter = 0;
+    std::map<std::string, double> counters;
+};
+
+class Registry
+{
+public:
+    static Registry &instance();
+
+    void add(std::string name, BenchFn fn);
+
+    /**
+     * @brief Run benchmarks whose name matches filter, doubling iterations until one run takes minTime.
+     */
+    std::vector<Result> run(const std::string &filter, std::chrono::nanoseconds minTime) const;
+
+private:
+    std::vector<std::pair<std::string, BenchFn>> m_benches;
+};
+
+struct Registrar
+{
+    Registrar(std::string name, BenchFn fn)
+    {
+        Registry::instance().add(std::move(name), std::move(fn));
+    }
+};
+
+/**
+ * @brief Keep the compiler from optimizing away the computation of value.
+ */
+template<typename T>
+inline void doNotOptimize(T &&value)
+{
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+} // namespace salus::bench
+
+#define SALUS_MICROBENCH_CONCAT_(a, b) a##b
+#define SALUS_MICROBENCH_CONCAT(a, b) SALUS_MICROBENCH_CONCAT_(a, b)
+
+/**
+ * @brief Register a benchmark function void(salus::bench::State &) under name.
+ */
+#define SALUS_MICROBENCH(name, fn)                                                                           \
+    static ::salus::bench::Registrar SALUS_MICROBENCH_CONCAT(microbench_registrar_, __LINE__)(name, fn)
+
+#endif // SALUS_MICROBENCH_MICROBENCH_H
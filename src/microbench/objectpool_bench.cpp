@@ -0,0 +1,87 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench/microbench.h"
+#include "utils/objectpool.h"
+
+#include <array>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using salus::bench::State;
+
+namespace {
+
+/**
+ * @brief Something the size of a small per op record, reset() is what ObjectPool calls on reuse.
+ */
+struct Record
+{
+    explicit Record(uint64_t id)
+    {
+        reset(id);
+    }
+
+    void reset(uint64_t id)
+    {
+        data.fill(0);
+        data[0] = id;
+    }
+
+    std::array<uint64_t, 32> data;
+};
+
+/**
+ * @brief Acquire and release from numThreads threads sharing one pool, against plain new/delete.
+ */
+void benchAcquireRelease(State &state, size_t numThreads, bool pooled)
+{
+    auto pool = std::make_shared<sstl::ObjectPool<Record>>();
+
+    auto body = [&]() {
+        for (uint64_t i = 0; i != state.iterations(); ++i) {
+            if (pooled) {
+                auto r = pool->acquire(i);
+                salus::bench::doNotOptimize(r->data[0]);
+            } else {
+                auto r = std::make_unique<Record>(i);
+                salus::bench::doNotOptimize(r->data[0]);
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < numThreads; ++t) {
+        threads.emplace_back(body);
+    }
+    body();
+    for (auto &t : threads) {
+        t.join();
+    }
+    state.counter("threads", static_cast<double>(numThreads));
+    state.counter("pooledObjects", static_cast<double>(pool->size()));
+}
+
+SALUS_MICROBENCH("objectPool/acquireRelease/threads:1", [](State &state) { benchAcquireRelease(state, 1, true); });
+SALUS_MICROBENCH("objectPool/acquireRelease/threads:4", [](State &state) { benchAcquireRelease(state, 4, true); });
+SALUS_MICROBENCH("objectPool/baseline:new/threads:1", [](State &state) { benchAcquireRelease(state, 1, false); });
+SALUS_MICROBENCH("objectPool/baseline:new/threads:4", [](State &state) { benchAcquireRelease(state, 4, false); });
+
+} // namespace
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench/microbench.h"
+#include "resources/resources.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace salus;
+using salus::bench::State;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void spinFor(std::chrono::microseconds dur)
+{
+    auto until = Clock::now() + dur;
+    while (Clock::now() < until) {
+        std::this_thread::yield();
+    }
+}
+
+/**
+ * @brief Stress test: numSmall threads keep taking small holds while one thread wants a hold
+ * larger than what is left whenever any small hold is active. Without the queue the large one
+ * mostly loses. Reports how often and how quickly it got through, and checks nothing leaks.
+ */
+void benchStarvation(State &state, size_t numSmall, bool queue)
+{
+    constexpr size_t kCapacity = 1000;
+    AllocationRegulator reg({{resources::GPU0Memory, kCapacity}});
+
+    AllocationRegulator::QueueOptions opts;
+    opts.enabled = queue;
+    opts.minFraction = 0.5;
+    opts.aging = std::chrono::milliseconds(1);
+    opts.timeout = std::chrono::milliseconds(1000);
+    reg.setQueueOptions(opts);
+
+    const Resources small{{resources::GPU0Memory, kCapacity / 10}};
+    const Resources large{{resources::GPU0Memory, kCapacity * 6 / 10}};
+
+    std::atomic<size_t> smallDone{0};
+    std::vector<std::thread> threads;
+
+    auto start = Clock::now();
+    for (size_t t = 0; t != numSmall; ++t) {
+        threads.emplace_back([&]() {
+            auto ticket = reg.registerJob();
+            for (uint64_t i = 0; i != state.iterations(); ++i) {
+                while (!ticket.beginAllocation(small)) {
+                    std::this_thread::yield();
+                }
+                spinFor(std::chrono::microseconds(5));
+                ticket.endAllocation(small);
+            }
+            ticket.finishJob();
+            ++smallDone;
+        });
+    }
+
+    size_t largeGrants = 0;
+    Clock::duration maxWait{0};
+    Clock::duration totalWait{0};
+    threads.emplace_back([&]() {
+        auto ticket = reg.registerJob();
+        while (smallDone < numSmall) {
+            auto t0 = Clock::now();
+            bool granted = false;
+            while (!(granted = ticket.beginAllocation(large)) && smallDone < numSmall) {
+                std::this_thread::yield();
+            }
+            if (!granted) {
+                break;
+            }
+            auto wait = Clock::now() - t0;
+            maxWait = std::max(maxWait, wait);
+            totalWait += wait;
+            ++largeGrants;
+            spinFor(std::chrono::microseconds(50));
+            ticket.endAllocation(large);
+        }
+        ticket.finishJob();
+    });
+
+    for (auto &th : threads) {
+        th.join();
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    // everything must be back
+    auto check = reg.registerJob();
+    bool consistent = check.beginAllocation({{resources::GPU0Memory, kCapacity}});
+    check.finishJob();
+
+    using us = std::chrono::duration<double, std::micro>;
+    state.counter("smallGrantsPerSec", numSmall * state.iterations() / elapsed.count());
+    state.counter("largeGrants", largeGrants);
+    state.counter("largeMaxWaitUs", us(maxWait).count());
+    state.counter("largeAvgWaitUs", largeGrants ? us(totalWait).count() / largeGrants : 0);
+    state.counter("consistent", consistent);
+}
+
+struct Registrar
+{
+    Registrar()
+    {
+        for (size_t threads : {2, 4, 8}) {
+            for (bool queue : {false, true}) {
+                auto name = "allocRegulator/starvation/small:" + std::to_string(threads)
+                            + (queue ? "/queue" : "/noqueue");
+                bench::Registry::instance().add(name, [threads, queue](State &state) {
+                    benchStarvation(state, threads, queue);
+                });
+            }
+        }
+    }
+} registrar;
+
+} // namespace
@@ -0,0 +1,172 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench/microbench.h"
+#include "resources/resources.h"
+
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+using namespace salus;
+using salus::bench::doNotOptimize;
+using salus::bench::State;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * @brief Run body(threadIndex) on numThreads threads, each for state.iterations() operations,
+ * and report the aggregated rate.
+ */
+template<typename Body>
+void runThreads(State &state, size_t numThreads, Body &&body)
+{
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads);
+
+    auto start = Clock::now();
+    for (size_t t = 0; t != numThreads; ++t) {
+        threads.emplace_back([&body, t]() { body(t); });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+
+    state.counter("threads", numThreads);
+    state.counter("allocsPerSec", numThreads * state.iterations() / elapsed.count());
+}
+
+// each executor thread allocating from its own staged ticket, as allocator callbacks do
+void benchAllocFree(State &state, size_t numThreads)
+{
+    ResourceMonitor monitor;
+    monitor.initializeLimits();
+
+    const Resources staged{{resources::GPU0Memory, 64_sz * 1024 * 1024}};
+    const Resources req{{resources::GPU0Memory, 4096}};
+
+    std::vector<uint64_t> tickets;
+    for (size_t t = 0; t != numThreads; ++t) {
+        tickets.push_back(*monitor.preAllocate(staged, nullptr));
+    }
+
+    runThreads(state, numThreads, [&](size_t t) {
+        auto ticket = tickets[t];
+        for (uint64_t i = 0; i != state.iterations(); ++i) {
+            doNotOptimize(monitor.allocate(ticket, req));
+            monitor.free(ticket, req);
+        }
+    });
+
+    for (auto ticket : tickets) {
+        monitor.freeStaging(ticket);
+    }
+}
+
+// allocations beyond the staged amount, going to the shared counters
+void benchAllocFreeUnstaged(State &state, size_t numThreads)
+{
+    ResourceMonitor monitor;
+    monitor.initializeLimits();
+
+    const Resources staged{{resources::GPU0Memory, 1024}};
+    const Resources req{{resources::GPU0Memory, 4096}};
+
+    std::vector<uint64_t> tickets;
+    for (size_t t = 0; t != numThreads; ++t) {
+        tickets.push_back(*monitor.preAllocate(staged, nullptr));
+    }
+
+    runThreads(state, numThreads, [&](size_t t) {
+        auto ticket = tickets[t];
+        for (uint64_t i = 0; i != state.iterations(); ++i) {
+            doNotOptimize(monitor.allocate(ticket, req));
+            monitor.free(ticket, req);
+        }
+    });
+
+    for (auto ticket : tickets) {
+        monitor.freeStaging(ticket);
+    }
+}
+
+// whole life cycle of a ticket
+void benchTicketCycle(State &state, size_t numThreads)
+{
+    ResourceMonitor monitor;
+    monitor.initializeLimits();
+
+    const Resources staged{{resources::GPU0Memory, 4096}};
+
+    runThreads(state, numThreads, [&](size_t) {
+        for (uint64_t i = 0; i != state.iterations(); ++i) {
+            auto ticket = monitor.preAllocate(staged, nullptr);
+            monitor.allocate(*ticket, staged);
+            monitor.free(*ticket, staged);
+            monitor.freeStaging(*ticket);
+        }
+    });
+}
+
+// victim selection among one session's tickets while many other tickets are alive
+void benchSortVictim(State &state, size_t numTickets)
+{
+    ResourceMonitor monitor;
+    monitor.initializeLimits();
+
+    std::unordered_set<uint64_t> candidates;
+    for (size_t i = 0; i != numTickets; ++i) {
+        auto ticket = *monitor.preAllocate({}, nullptr);
+        monitor.allocate(ticket, {{resources::GPU0Memory, 4096 + i % 97}});
+        if (i % 8 == 0) {
+            candidates.insert(ticket);
+        }
+    }
+
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        doNotOptimize(monitor.sortVictim(candidates));
+    }
+    state.counter("tickets", numTickets);
+    state.counter("candidates", candidates.size());
+}
+
+struct Registrar
+{
+    Registrar()
+    {
+        for (size_t threads : {1, 2, 4, 8, 16}) {
+            auto suffix = "/threads:" + std::to_string(threads);
+            bench::Registry::instance().add("resourceMonitor/allocFree" + suffix,
+                                            [threads](State &state) { benchAllocFree(state, threads); });
+            bench::Registry::instance().add("resourceMonitor/allocFreeUnstaged" + suffix,
+                                            [threads](State &state) { benchAllocFreeUnstaged(state, threads); });
+            bench::Registry::instance().add("resourceMonitor/ticketCycle" + suffix,
+                                            [threads](State &state) { benchTicketCycle(state, threads); });
+        }
+        for (size_t tickets : {64, 1024, 16384}) {
+            bench::Registry::instance().add("resourceMonitor/sortVictim/tickets:" + std::to_string(tickets),
+                                            [tickets](State &state) { benchSortVictim(state, tickets); });
+        }
+    }
+} registrar;
+
+} // namespace
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "microbench/microbench.h"
+#include "resources/resources.h"
+
+using namespace salus;
+using salus::bench::doNotOptimize;
+using salus::bench::State;
+
+namespace {
+
+// roughly what the monitor holds for a single GPU server
+Resources sampleAvail()
+{
+    return {
+        {{ResourceType::MEMORY, devices::CPU0}, 100_sz * 1024 * 1024 * 1024},
+        {{ResourceType::MEMORY, devices::GPU0}, 14_sz * 1024 * 1024 * 1024},
+        {{ResourceType::GPU_STREAM, devices::GPU0}, 128},
+        {{ResourceType::EXCLUSIVE, devices::GPU0}, 1},
+    };
+}
+
+// a typical op allocation request
+Resources sampleReq()
+{
+    return {
+        {{ResourceType::MEMORY, devices::GPU0}, 4096},
+        {{ResourceType::GPU_STREAM, devices::GPU0}, 1},
+    };
+}
+
+template<typename R>
+void benchContains(State &state)
+{
+    const R avail(sampleAvail());
+    const R req(sampleReq());
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        doNotOptimize(resources::contains(avail, req));
+    }
+}
+
+template<typename R>
+void benchMergeSubtract(State &state)
+{
+    R avail(sampleAvail());
+    const R req(sampleReq());
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        resources::subtract(avail, req);
+        resources::merge(avail, req);
+        doNotOptimize(avail);
+    }
+}
+
+template<typename R>
+void benchMergeSkipNonExist(State &state)
+{
+    R avail(sampleReq());
+    const R req(sampleAvail());
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        resources::merge(avail, req, true /* skipNonExist */);
+        resources::subtract(avail, req, true /* skipNonExist */);
+        doNotOptimize(avail);
+    }
+}
+
+template<typename R>
+void benchSubtractBounded(State &state)
+{
+    R avail(sampleAvail());
+    const R req(sampleReq());
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        auto res = resources::subtractBounded(avail, req);
+        resources::merge(avail, res);
+        doNotOptimize(avail);
+    }
+}
+
+// the sequence ResourceMonitor::allocateUnsafe goes through when staging covers the request
+template<typename R>
+void benchStagedAllocate(State &state)
+{
+    R staging(sampleAvail());
+    R inuse;
+    const R req(sampleReq());
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        if (resources::contains(staging, req)) {
+            resources::subtract(staging, req);
+            resources::merge(inuse, req);
+        }
+        resources::merge(staging, req);
+        resources::subtract(inuse, req);
+        resources::removeInvalid(inuse);
+        doNotOptimize(staging);
+    }
+}
+
+void benchFromResources(State &state)
+{
+    const auto req = sampleReq();
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        ResourceVector vec(req);
+        doNotOptimize(vec);
+    }
+}
+
+void benchToResources(State &state)
+{
+    const ResourceVector vec(sampleReq());
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        auto res = vec.toResources();
+        doNotOptimize(res);
+    }
+}
+
+SALUS_MICROBENCH("resources/contains/map", benchContains<Resources>);
+SALUS_MICROBENCH("resources/contains/vector", benchContains<ResourceVector>);
+SALUS_MICROBENCH("resources/mergeSubtract/map", benchMergeSubtract<Resources>);
+SALUS_MICROBENCH("resources/mergeSubtract/vector", benchMergeSubtract<ResourceVector>);
+SALUS_MICROBENCH("resources/mergeSkipNonExist/map", benchMergeSkipNonExist<Resources>);
+SALUS_MICROBENCH("resources/mergeSkipNonExist/vector", benchMergeSkipNonExist<ResourceVector>);
+SALUS_MICROBENCH("resources/subtractBounded/map", benchSubtractBounded<Resources>);
+SALUS_MICROBENCH("resources/subtractBounded/vector", benchSubtractBounded<ResourceVector>);
+SALUS_MICROBENCH("resources/stagedAllocate/map", benchStagedAllocate<Resources>);
+SALUS_MICROBENCH("resources/stagedAllocate/vector", benchStagedAllocate<ResourceVector>);
+SALUS_MICROBENCH("resources/convert/fromResources", benchFromResources);
+SALUS_MICROBENCH("resources/convert/toResources", benchToResources);
+
+} // namespace
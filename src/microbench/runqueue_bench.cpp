@@ -0,0 +1,125 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "execution/threadpool/RunQueue.h"
+#include "execution/threadpool/threadpool.h"
+#include "microbench/microbench.h"
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using salus::bench::State;
+
+namespace {
+
+// Same element type and capacity as the thread pool uses
+using Closure = ThreadPool::Closure;
+using Queue = RunQueue<Closure, 1024>;
+
+/**
+ * @brief Owner side only: PushFront then PopFront, what a worker does with tasks it spawns itself.
+ */
+void benchOwner(State &state)
+{
+    auto q = std::make_unique<Queue>();
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        auto rejected = q->PushFront([&sum]() { ++sum; });
+        salus::bench::doNotOptimize(rejected);
+        auto c = q->PopFront();
+        c();
+    }
+    salus::bench::doNotOptimize(sum);
+}
+
+/**
+ * @brief Remote side only: PushBack then PopBack, both serialized by the queue's mutex.
+ * This is the path of submissions from outside of the pool and of stealing.
+ */
+void benchRemote(State &state)
+{
+    auto q = std::make_unique<Queue>();
+    uint64_t sum = 0;
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        auto rejected = q->PushBack([&sum]() { ++sum; });
+        salus::bench::doNotOptimize(rejected);
+        auto c = q->PopBack();
+        c();
+    }
+    salus::bench::doNotOptimize(sum);
+}
+
+/**
+ * @brief Owner keeps pushing and popping at the front while numThieves threads steal from the back.
+ * Timing is of the owner's push/pop pair, stolenRatio tells how much of the work the thieves got.
+ */
+void benchSteal(State &state, size_t numThieves)
+{
+    auto q = std::make_unique<Queue>();
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> stolen{0};
+    std::atomic<uint64_t> ran{0};
+
+    std::vector<std::thread> thieves;
+    for (size_t t = 0; t != numThieves; ++t) {
+        thieves.emplace_back([&]() {
+            while (!stop.load(std::memory_order_relaxed)) {
+                if (auto c = q->PopBack()) {
+                    c();
+                    stolen.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        });
+    }
+
+    // Keep a short backlog, so there is always something at the back to steal
+    constexpr unsigned kBacklog = 16;
+    uint64_t rejected = 0;
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        if (q->PushFront([&ran]() { ran.fetch_add(1, std::memory_order_relaxed); })) {
+            ++rejected;
+        }
+        if (q->Size() > kBacklog) {
+            if (auto c = q->PopFront()) {
+                c();
+            }
+        }
+    }
+    stop = true;
+    for (auto &t : thieves) {
+        t.join();
+    }
+    while (auto c = q->PopFront()) {
+        c();
+    }
+
+    const auto pushed = state.iterations() - rejected;
+    state.counter("stolenRatio", static_cast<double>(stolen.load()) / pushed);
+}
+
+SALUS_MICROBENCH("runQueue/pushPopFront", benchOwner);
+SALUS_MICROBENCH("runQueue/pushPopBack", benchRemote);
+SALUS_MICROBENCH("runQueue/steal/thieves:1", [](State &state) { benchSteal(state, 1); });
+SALUS_MICROBENCH("runQueue/steal/thieves:3", [](State &state) { benchSteal(state, 3); });
+
+} // namespace
@@ -0,0 +1,301 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "execution/threadpool/threadpool.h"
+#include "microbench/microbench.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using salus::bench::State;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+void spinFor(std::chrono::microseconds dur)
+{
+    auto until = Clock::now() + dur;
+    while (Clock::now() < until) {
+    }
+}
+
+/**
+ * @brief Keep the pool saturated with a backlog of normal priority tasks, e.g. training ops,
+ * and measure how long a probe task, e.g. an inference op, waits before it starts running.
+ */
+void benchQueueingDelay(State &state, TaskPriority probePriority)
+{
+    constexpr size_t kThreads = 4;
+    constexpr int kBacklog = 64 * kThreads;
+
+    std::atomic<int> queued{0};
+    std::atomic<bool> stop{false};
+    // destroyed before the counters above, after finishing remaining tasks
+    ThreadPool pool(ThreadPoolOptions{}.setNumThreads(kThreads).setWorkerName("BenchWorker"));
+
+    std::thread feeder([&]() {
+        while (!stop) {
+            if (queued.load() < kBacklog) {
+                ++queued;
+                pool.run([&]() {
+                    spinFor(std::chrono::microseconds(20));
+                    --queued;
+                });
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    });
+    // let the backlog build up
+    while (queued.load() < kBacklog) {
+        std::this_thread::yield();
+    }
+
+    std::vector<double> delays;
+    delays.reserve(state.iterations());
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        std::atomic<bool> done{false};
+        Clock::time_point started;
+        auto submitted = Clock::now();
+        pool.run(
+            [&]() {
+                started = Clock::now();
+                done = true;
+            },
+            probePriority);
+        while (!done) {
+            std::this_thread::yield();
+        }
+        delays.push_back(std::chrono::duration<double, std::micro>(started - submitted).count());
+    }
+
+    stop = true;
+    feeder.join();
+
+    std::sort(delays.begin(), delays.end());
+    state.counter("p50DelayUs", delays[delays.size() / 2]);
+    state.counter("p99DelayUs", delays[delays.size() * 99 / 100]);
+}
+
+SALUS_MICROBENCH("threadPool/queueingDelay/probe:normal",
+                 [](State &state) { benchQueueingDelay(state, TaskPriority::Normal); });
+SALUS_MICROBENCH("threadPool/queueingDelay/probe:high",
+                 [](State &state) { benchQueueingDelay(state, TaskPriority::High); });
+
+/**
+ * @brief Push a burst of closures from threads outside of the pool, more than the worker queues
+ * can hold, and measure how fast all of them get through.
+ */
+void benchBurst(State &state)
+{
+    constexpr size_t kThreads = 4;
+    constexpr size_t kProducers = 4;
+    constexpr uint64_t kClosures = 100 * 1000;
+
+    uint64_t overflows = 0;
+    double seconds = 0;
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        std::atomic<uint64_t> executed{0};
+        ThreadPool pool(ThreadPoolOptions{}.setNumThreads(kThreads).setWorkerName("BenchWorker"));
+
+        auto start = Clock::now();
+        std::vector<std::thread> producers;
+        for (size_t p = 0; p != kProducers; ++p) {
+            producers.emplace_back([&, p]() {
+                for (auto j = p; j < kClosures; j += kProducers) {
+                    pool.run([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); });
+                }
+            });
+        }
+        for (auto &t : producers) {
+            t.join();
+        }
+        while (executed.load() != kClosures) {
+            std::this_thread::yield();
+        }
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+        overflows += pool.stats().overflows;
+    }
+
+    state.counter("closuresPerSec", kClosures * state.iterations() / seconds);
+    state.counter("overflowsPerBurst", static_cast<double>(overflows) / state.iterations());
+}
+
+SALUS_MICROBENCH("threadPool/burst/closures:100k", benchBurst);
+
+/**
+ * @brief Regression check for workers blocking inside tasks. Every worker runs a task that waits,
+ * in a blocking region, for a gate only opened by a task queued behind them. Without spare workers
+ * this deadlocks, which shows up as gateTimeouts instead of hanging the benchmark.
+ */
+void benchBlockingTasks(State &state)
+{
+    constexpr size_t kThreads = 4;
+    // More than the workers, so spares block too, yet within what the default maxSpareThreads covers
+    constexpr size_t kBlockers = kThreads + kThreads / 2;
+    constexpr auto kGateTimeout = std::chrono::seconds(5);
+
+    uint64_t timeouts = 0;
+    uint64_t spares = 0;
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        std::mutex mu;
+        std::condition_variable cv;
+        bool open = false;
+        std::atomic<size_t> finished{0};
+        std::atomic<uint64_t> timedOut{0};
+
+        ThreadPool pool(ThreadPoolOptions{}.setNumThreads(kThreads).setWorkerName("BenchWorker"));
+        for (size_t j = 0; j != kBlockers; ++j) {
+            pool.run([&]() {
+                {
+                    ThreadPool::ScopedBlockingRegion blocking;
+                    std::unique_lock<std::mutex> lock(mu);
+                    if (!cv.wait_for(lock, kGateTimeout, [&]() { return open; })) {
+                        ++timedOut;
+                    }
+                }
+                ++finished;
+            });
+        }
+        pool.run([&]() {
+            {
+                std::unique_lock<std::mutex> lock(mu);
+                open = true;
+            }
+            cv.notify_all();
+            ++finished;
+        });
+        while (finished.load() != kBlockers + 1) {
+            std::this_thread::yield();
+        }
+        timeouts += timedOut;
+        spares += pool.stats().spareThreads;
+    }
+
+    state.counter("gateTimeouts", static_cast<double>(timeouts));
+    state.counter("sparesPerRound", static_cast<double>(spares) / state.iterations());
+}
+
+SALUS_MICROBENCH("threadPool/blocking/deadlock", benchBlockingTasks);
+
+/**
+ * @brief Submit rounds of tiny closures from a non-worker thread, like the scheduling thread does,
+ * either one tryRun per closure or one tryRunBatch per round, and wait for each round to finish.
+ */
+void benchSubmit(State &state, size_t batchSize, bool batched)
+{
+    constexpr size_t kThreads = 4;
+    ThreadPool pool(ThreadPoolOptions{}.setNumThreads(kThreads).setWorkerName("BenchWorker"));
+
+    std::atomic<size_t> executed{0};
+    std::vector<ThreadPool::Closure> batch;
+    batch.reserve(batchSize);
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        executed = 0;
+        if (batched) {
+            batch.clear();
+            for (size_t j = 0; j != batchSize; ++j) {
+                batch.emplace_back([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); });
+            }
+            pool.tryRunBatch(batch);
+        } else {
+            for (size_t j = 0; j != batchSize; ++j) {
+                pool.run([&executed]() { executed.fetch_add(1, std::memory_order_relaxed); });
+            }
+        }
+        while (executed.load() != batchSize) {
+            std::this_thread::yield();
+        }
+    }
+    state.counter("closures", static_cast<double>(batchSize));
+}
+
+SALUS_MICROBENCH("threadPool/submit/tryRun/n:16", [](State &state) { benchSubmit(state, 16, false); });
+SALUS_MICROBENCH("threadPool/submit/tryRunBatch/n:16", [](State &state) { benchSubmit(state, 16, true); });
+SALUS_MICROBENCH("threadPool/submit/tryRun/n:256", [](State &state) { benchSubmit(state, 256, false); });
+SALUS_MICROBENCH("threadPool/submit/tryRunBatch/n:256", [](State &state) { benchSubmit(state, 256, true); });
+
+/**
+ * @brief Submit one closure at a time to an otherwise idle pool, after a short pause, and measure
+ * how long until it starts. Spinning workers pick it up right away, parked ones need a wake up.
+ * The fixed spin policies are measured with adaptive spinning off.
+ */
+void benchWakeLatency(State &state, bool allowSpinning, int spinCount, bool adaptive = false,
+                      std::chrono::microseconds pause = std::chrono::microseconds(20))
+{
+    constexpr size_t kThreads = 2;
+
+    auto opts = ThreadPoolOptions{}.setNumThreads(kThreads).setWorkerName("BenchWorker").setAllowSpinning(allowSpinning)
+                    .setAdaptiveSpinning(adaptive);
+    if (spinCount >= 0) {
+        opts.setSpinCount(spinCount);
+    }
+    ThreadPool pool(opts);
+
+    std::vector<double> latencies;
+    latencies.reserve(state.iterations());
+    auto start = Clock::now();
+    for (uint64_t i = 0; i != state.iterations(); ++i) {
+        spinFor(pause);
+        std::atomic<bool> done{false};
+        Clock::time_point started;
+        auto submitted = Clock::now();
+        pool.run([&]() {
+            started = Clock::now();
+            done = true;
+        });
+        while (!done) {
+            std::this_thread::yield();
+        }
+        latencies.push_back(std::chrono::duration<double, std::micro>(started - submitted).count());
+    }
+
+    std::sort(latencies.begin(), latencies.end());
+    state.counter("p50WakeUs", latencies[latencies.size() / 2]);
+    state.counter("p99WakeUs", latencies[latencies.size() * 99 / 100]);
+    state.counter("spinCount", opts.spinCount);
+
+    auto stats = pool.stats();
+    state.counter("spinLimit", stats.spinLimit);
+    // share of one core burned spinning over the run
+    state.counter("spinCpu", stats.spinNs / std::chrono::duration<double, std::nano>(Clock::now() - start).count());
+}
+
+SALUS_MICROBENCH("threadPool/wakeLatency/spinning:off",
+                 [](State &state) { benchWakeLatency(state, false, -1); });
+SALUS_MICROBENCH("threadPool/wakeLatency/spinning:on/spinCount:default",
+                 [](State &state) { benchWakeLatency(state, true, -1); });
+SALUS_MICROBENCH("threadPool/wakeLatency/spinning:on/spinCount:50000",
+                 [](State &state) { benchWakeLatency(state, true, 50000); });
+SALUS_MICROBENCH("threadPool/wakeLatency/spinning:adaptive",
+                 [](State &state) { benchWakeLatency(state, true, -1, true); });
+// sparse arrivals, where spinning is mostly wasted
+SALUS_MICROBENCH("threadPool/wakeLatency/pause:2ms/spinning:on/spinCount:50000", [](State &state) {
+    benchWakeLatency(state, true, 50000, false, std::chrono::milliseconds(2));
+});
+SALUS_MICROBENCH("threadPool/wakeLatency/pause:2ms/spinning:adaptive", [](State &state) {
+    benchWakeLatency(state, true, 50000, true, std::chrono::milliseconds(2));
+});
+
+} // namespace
@@ -24,11 +24,32 @@
 #include "execution/executionengine.h"
 #include "oplibraries/tensorflow/device/shadowdevices.h"
 #include "oplibraries/tensorflow/device/sessionallocator.h"
+#include "resources/memorymgr.h"
 #include "utils/objectpool.h"
 #include "utils/threadutils.h"
 
 namespace salus::oplib::tensorflow {
 
+void *HostSlabAllocator::AllocateRaw(size_t alignment, size_t num_bytes)
+{
+    return MemoryMgr::instance().allocate(static_cast<int>(alignment), num_bytes);
+}
+
+void HostSlabAllocator::DeallocateRaw(void *ptr)
+{
+    MemoryMgr::instance().deallocate(ptr);
+}
+
+tf::Allocator *hostAllocator()
+{
+    if (!MemoryMgr::instance().options().slab) {
+        // use tf::cpu_allocator to select from cpu allocatory registary
+        return tf::cpu_allocator();
+    }
+    static HostSlabAllocator alloc;
+    return &alloc;
+}
+
 SalusCPUDevice::SalusCPUDevice(const tf::SessionOptions &options, const std::string &name, tf::Bytes memory_limit,
                                const tf::DeviceLocality &locality, tf::Allocator *allocator, tf::Allocator *cudaAlloc)
     : LocalDevice(options, tf::Device::BuildDeviceAttributes(name, tf::DEVICE_CPU, memory_limit, locality))
@@ -88,8 +109,7 @@ Status SalusCPUDeviceFactory::CreateDevices(const tf::SessionOptions &options, c
     }
     for (int i = 0; i < n; i++) {
         auto name = tf::strings::StrCat(name_prefix, "/cpu:", i);
-        // use tf::cpu_allocator to select from cpu allocatory registary
-        auto dev = new SalusCPUDevice(options, name, tf::Bytes(256 << 20), {}, tf::cpu_allocator());
+        auto dev = new SalusCPUDevice(options, name, tf::Bytes(256 << 20), {}, hostAllocator());
         VLOG(3) << "Creating SalusCPUDevice " << as_hex(dev) << " which is a tf::Device "
                 << as_hex(static_cast<tf::Device *>(dev)) << " and also a ISalusDevice "
                 << as_hex(static_cast<ISalusDevice *>(dev));
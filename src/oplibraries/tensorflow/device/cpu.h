@@ -27,6 +27,28 @@
 
 namespace salus::oplib::tensorflow {
 
+/**
+ * @brief Host allocator serving from MemoryMgr's slab arenas
+ */
+class HostSlabAllocator : public tf::Allocator
+{
+public:
+    std::string Name() override
+    {
+        return "salus_host_slab";
+    }
+
+    void *AllocateRaw(size_t alignment, size_t num_bytes) override;
+
+    void DeallocateRaw(void *ptr) override;
+};
+
+/**
+ * @brief The allocator CPU devices should use: HostSlabAllocator unless MemoryMgr is configured to
+ * pass through to the system allocator, in which case tf::cpu_allocator is used.
+ */
+tf::Allocator *hostAllocator();
+
 class PerTaskCPUDevice;
 class SalusCPUDevice : public ISalusDevice, public tf::LocalDevice
 {
@@ -0,0 +1,220 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ *
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "oplibraries/tensorflow/device/gpu/cudagpubackend.h"
+
+#include "oplibraries/tensorflow/device/cpu.h"
+#include "oplibraries/tensorflow/device/gpu/gpu.h"
+#include "oplibraries/tensorflow/tfexception.h"
+#include "oplibraries/tensorflow/tfinstance.h"
+#include "resources/memorylayout.h"
+#include "utils/envutils.h"
+#include "utils/macros.h"
+
+namespace tfgpu = perftools::gputools;
+
+namespace salus::oplib::tensorflow {
+
+namespace {
+
+std::string GetShortDeviceDescription(int device_id, const tfgpu::DeviceDescription &desc)
+{
+    int cc_major;
+    int cc_minor;
+    if (!desc.cuda_compute_capability(&cc_major, &cc_minor)) {
+        cc_major = 0;
+        cc_minor = 0;
+    }
+    return tf::strings::StrCat("device: ", device_id, ", name: ", desc.name(), ", pci bus id: ", desc.pci_bus_id(),
+                               ", compute capability: ", cc_major, ".", cc_minor);
+}
+
+class CudaEvent : public GpuBackend::Event
+{
+public:
+    explicit CudaEvent(tfgpu::StreamExecutor *se)
+        : m_event(se)
+    {
+        m_event.Init();
+    }
+
+    void record(GpuBackend::StreamHandle stream) override
+    {
+        CHECK_NOTNULL(stream);
+        static_cast<tfgpu::Stream *>(stream)->ThenRecordEvent(&m_event);
+    }
+
+    Status poll() override
+    {
+        switch (m_event.PollForStatus()) {
+        case tfgpu::Event::Status::kPending:
+            return Status::Pending;
+        case tfgpu::Event::Status::kComplete:
+            return Status::Complete;
+        default:
+            return Status::Error;
+        }
+    }
+
+private:
+    tfgpu::Event m_event;
+};
+
+class CudaLaneDevice : public GpuBackend::LaneDevice
+{
+public:
+    CudaLaneDevice(std::unique_ptr<tf::Allocator> &&alloc, std::unique_ptr<tf::BaseGPUDevice> &&dev)
+        : m_alloc(std::move(alloc))
+        , m_dev(std::move(dev))
+    {
+    }
+
+    tf::Device *as_tfdevice() override
+    {
+        return m_dev.get();
+    }
+
+private:
+    // must outlive m_dev
+    std::unique_ptr<tf::Allocator> m_alloc;
+    std::unique_ptr<tf::BaseGPUDevice> m_dev;
+};
+
+} // namespace
+
+CudaGpuBackend::CudaGpuBackend()
+{
+    SALUS_THROW_IF_ERROR(tf::ValidateGPUMachineManager());
+}
+
+CudaGpuBackend::~CudaGpuBackend() = default;
+
+int CudaGpuBackend::deviceCount() const
+{
+    return tf::GPUMachineManager()->VisibleDeviceCount();
+}
+
+tf::gpu::StreamExecutor *CudaGpuBackend::streamExecutor(int id) const
+{
+    return tf::GPUMachineManager()->ExecutorForDevice(id).ValueOrDie();
+}
+
+GpuBackend::DeviceInfo CudaGpuBackend::deviceInfo(int id) const
+{
+    auto se = streamExecutor(id);
+
+    tf::int64 availableMemory, totalMemory;
+    if (!se->DeviceMemoryUsage(&availableMemory, &totalMemory)) {
+        throw TFException(tf::errors::Unknown("Failed to query available memory for GPU ", id));
+    }
+
+    const auto &desc = se->GetDeviceDescription();
+    DeviceInfo info;
+    info.id = id;
+    info.description = GetShortDeviceDescription(id, desc);
+    info.numaNode = desc.numa_node();
+    info.availableMemory = static_cast<size_t>(availableMemory);
+    info.totalMemory = static_cast<size_t>(totalMemory);
+    info.smCount = static_cast<uint64_t>(desc.core_count());
+    info.threadsPerBlock = desc.threads_per_block_limit();
+    return info;
+}
+
+std::unique_ptr<GpuBackend::Event> CudaGpuBackend::createEvent(int id)
+{
+    return std::make_unique<CudaEvent>(streamExecutor(id));
+}
+
+void CudaGpuBackend::initializeHost()
+{
+    std::call_once(m_hostOnce, [this]() {
+        // Request CUDA host memory through the first StreamExecutor, since any will work.
+        struct CudaHostAllocTag;
+        // 64 GB max by default
+        size_t cuda_host_mem_limit_in_mb =
+            sstl::fromEnvVarCached<CudaHostAllocTag>("TF_CUDA_HOST_MEM_LIMIT_IN_MB", 1_sz << 16);
+        size_t cuda_host_mem_limit = cuda_host_mem_limit_in_mb * (1LL << 20);
+        m_cudaHostAlloc =
+            std::make_unique<tf::BFCAllocator>(new tf::CUDAHostAllocator(streamExecutor(0)), cuda_host_mem_limit,
+                                               true /*allow_growth*/, "cuda_host_bfc" /*name*/);
+
+        auto name = tf::strings::StrCat(TFInstance::namePrefix(), "/device:CPU:0");
+        tf::SessionOptions opt;
+        tf::DeviceLocality locality;
+        m_cpu = std::make_unique<SalusCPUDevice>(opt, name, tf::Bytes(256 << 20), locality, hostAllocator(),
+                                                 m_cudaHostAlloc.get());
+    });
+}
+
+tf::Device *CudaGpuBackend::compatibleCPUDevice()
+{
+    initializeHost();
+    return m_cpu.get();
+}
+
+std::unique_ptr<GpuBackend::LaneDevice> CudaGpuBackend::createLaneDevice(int index, const DeviceInfo &info,
+                                                                         size_t memory, MemoryLayout &layout)
+{
+    initializeHost();
+
+    const std::string name = tf::strings::StrCat(TFInstance::namePrefix(), "/device:GPU:", index);
+    int numa_node = info.numaNode;
+    if (numa_node < 0) {
+        // For some reason the StreamExecutor couldn't get the NUMA
+        // affinity of the GPU.  If this is not a multi-socket mobo with
+        // GPUs local to different buses, it doesn't matter.  If it is, we
+        // may run into trouble later with data transfer operations.  The
+        // trouble may manifest as slower than expected performance, or
+        // outright failures.
+        LOG(INFO) << "Could not identify NUMA node of " << name
+                  << ", defaulting to 0.  Your kernel may not have been built "
+                  << "with NUMA support.";
+        numa_node = 0;
+    }
+
+    auto allocated_bytes = static_cast<tf::Bytes>(memory);
+
+    // Get GPU bus_id from its reported NUMA affinity.  Because GPUs are
+    // virtualized in some environments, we can't just use the GPU id.
+    // NUMA locales are indexed from 0, buses are indexed from 1.
+    tf::DeviceLocality dev_locality;
+    dev_locality.set_bus_id(numa_node + 1);
+    VLOG(2) << "GPUDevice id " << info.id << " on bus " << dev_locality.bus_id() << " numa: " << numa_node
+            << " " << info.description;
+
+    auto process_state = tf::ProcessState::singleton();
+
+    auto max_streams = 1;
+
+    struct GpuLaneTag;
+    tf::GPUOptions gpuOpt;
+    auto useSmallOpt = sstl::fromEnvVarCached<GpuLaneTag>("SALUS_ALLOCATOR_SMALL_OPT", false);
+    auto alloc = std::make_unique<tf::GPUDoubleBFCAllocator>(info.id, memory, gpuOpt, useSmallOpt);
+
+    tf::SessionOptions opt;
+    auto dev = std::make_unique<SalusGPUDevice>(opt, name, allocated_bytes, dev_locality, info.id, info.description,
+                                                alloc.get(), process_state->GetCPUAllocator(numa_node),
+                                                m_cudaHostAlloc.get(), max_streams);
+    dev->setMemoryLayout(&layout);
+    SALUS_THROW_IF_ERROR(dev->Init(opt));
+
+    return std::make_unique<CudaLaneDevice>(std::move(alloc), std::move(dev));
+}
+
+} // namespace salus::oplib::tensorflow
@@ -0,0 +1,78 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ *
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_OPLIB_TENSORFLOW_CUDAGPUBACKEND_H
+#define SALUS_OPLIB_TENSORFLOW_CUDAGPUBACKEND_H
+
+#include "oplibraries/tensorflow/tensorflow_headers.h"
+
+#include "oplibraries/tensorflow/device/gpu/gpubackend.h"
+
+#include <memory>
+#include <mutex>
+
+namespace salus::oplib::tensorflow {
+
+class SalusCPUDevice;
+
+/**
+ * @brief GPU backend on top of TensorFlow's StreamExecutor. Stream handles are perftools::gputools::Stream.
+ * Lanes run on SalusGPUDevice.
+ */
+class CudaGpuBackend : public GpuBackend
+{
+public:
+    CudaGpuBackend();
+    ~CudaGpuBackend() override;
+
+    const char *name() const override
+    {
+        return "cuda";
+    }
+
+    int deviceCount() const override;
+
+    DeviceInfo deviceInfo(int id) const override;
+
+    std::unique_ptr<Event> createEvent(int id) override;
+
+    std::unique_ptr<LaneDevice> createLaneDevice(int index, const DeviceInfo &info, size_t memory,
+                                                 MemoryLayout &layout) override;
+
+    tf::Device *compatibleCPUDevice() override;
+
+    /**
+     * @brief The underlying StreamExecutor, for things that only exist on real GPUs, e.g. CUDA host memory
+     */
+    tf::gpu::StreamExecutor *streamExecutor(int id) const;
+
+private:
+    /**
+     * @brief Create the CUDA host allocator and the CPU device on first use
+     */
+    void initializeHost();
+
+    std::once_flag m_hostOnce;
+    std::unique_ptr<tf::Allocator> m_cudaHostAlloc;
+    std::unique_ptr<SalusCPUDevice> m_cpu;
+};
+
+} // namespace salus::oplib::tensorflow
+
+#endif // SALUS_OPLIB_TENSORFLOW_CUDAGPUBACKEND_H
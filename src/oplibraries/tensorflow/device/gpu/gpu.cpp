@@ -38,11 +38,8 @@ SalusGPUDevice::SalusGPUDevice(const tf::SessionOptions &options, const std::str
                     false /* sync every op */, max_streams)
     , m_streamUsed(static_cast<size_t>(max_streams), false)
     , m_cudaHostAlloc(cuda_host_alloc)
-    , m_SMPoller(nullptr)
+    , m_SMPoller(std::make_unique<SMEventPoller>(GpuBackend::instance(), gpu_id))
 {
-    auto executor_status = tf::GPUMachineManager()->ExecutorForDevice(gpu_id);
-
-    m_SMPoller = std::make_unique<SMEventPoller>(executor_status.ValueOrDie());
 }
 
 tf::Allocator *SalusGPUDevice::GetAllocator(tf::AllocatorAttributes attr)
@@ -185,7 +182,7 @@ std::unique_ptr<ShadowDevice> SalusGPUDevice::createSessionDevice(std::string ne
     std::vector<SessionDevice::StreamAndContext> scs{ {streams_[streamBase], device_contexts_[streamBase]} };
 
     auto d = std::make_unique<SessionDevice>(this, std::move(newBaseName), std::move(sessHandle),
-                                             newInfo, std::move(scs));
+                                             newInfo, std::move(scs), m_layout);
     return d;
 }
 
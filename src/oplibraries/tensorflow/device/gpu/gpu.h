@@ -23,6 +23,7 @@
 #include "oplibraries/tensorflow/tensorflow_headers.h"
 #include "oplibraries/tensorflow/device/salusdevices.h"
 #include "oplibraries/tensorflow/device/gpu/smeventpoller.h"
+#include "resources/memorylayout.h"
 #include "utils/objectpool.h"
 
 #include <mutex>
@@ -62,6 +63,14 @@ public:
 
     std::unique_ptr<ShadowDevice> createSessionDevice(std::string newBaseName, std::string sessHandle) override;
 
+    /**
+     * @brief Model of the GPU allocator's layout, fed by allocations of session devices. Not owned.
+     */
+    void setMemoryLayout(MemoryLayout *layout)
+    {
+        m_layout = layout;
+    }
+
     tf::Device &as_tfdevice() override
     {
         return *this;
@@ -105,6 +114,7 @@ private:
     std::vector<bool> m_streamUsed;
     tf::Allocator *m_cudaHostAlloc;
     std::unique_ptr<SMEventPoller> m_SMPoller;
+    MemoryLayout *m_layout = nullptr;
 };
 
 class SalusGPUDeviceFactory : public tf::BaseGPUDeviceFactory
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ *
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "oplibraries/tensorflow/device/gpu/gpubackend.h"
+
+#include "platform/logging.h"
+#include "resources/limitsprovider.h"
+
+namespace salus::oplib::tensorflow {
+
+std::unique_ptr<GpuBackend> GpuBackend::m_instance;
+
+std::unique_ptr<GpuBackend::LaneDevice> GpuBackend::createLaneDevice(int, const DeviceInfo &, size_t, MemoryLayout &)
+{
+    return nullptr;
+}
+
+::tensorflow::Device *GpuBackend::compatibleCPUDevice()
+{
+    return nullptr;
+}
+
+void GpuBackend::discoverLimits()
+{
+    for (int id = 0; id != deviceCount(); ++id) {
+        try {
+            auto info = deviceInfo(id);
+            LimitsProvider::instance().discoverGpuMemory(id, info.availableMemory);
+        } catch (const std::exception &ex) {
+            LOG(WARNING) << "Can not discover memory of GPU " << id << ", using default limit: " << ex.what();
+        }
+    }
+}
+
+/*static*/ GpuBackend &GpuBackend::instance()
+{
+    CHECK(m_instance) << "Must call GpuBackend::setInstance before using GPUs";
+    return *m_instance;
+}
+
+/*static*/ void GpuBackend::setInstance(std::unique_ptr<GpuBackend> backend)
+{
+    CHECK(backend);
+    LOG(INFO) << "Using GPU backend: " << backend->name();
+    m_instance = std::move(backend);
+}
+
+/*static*/ bool GpuBackend::hasInstance()
+{
+    return m_instance != nullptr;
+}
+
+} // namespace salus::oplib::tensorflow
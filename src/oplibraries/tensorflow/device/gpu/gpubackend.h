@@ -0,0 +1,146 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ *
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_OPLIB_TENSORFLOW_GPUBACKEND_H
+#define SALUS_OPLIB_TENSORFLOW_GPUBACKEND_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace tensorflow {
+class Device;
+} // namespace tensorflow
+
+namespace salus {
+class MemoryLayout;
+} // namespace salus
+
+namespace salus::oplib::tensorflow {
+
+/**
+ * @brief The part of the GPU runtime used by lane management and SM blocking: device properties,
+ * events recorded on streams to learn when queued work is done, and the TensorFlow devices lanes run on.
+ *
+ * CudaGpuBackend forwards to TensorFlow's StreamExecutor, SimulatedGpuBackend models devices in
+ * software so the same logic runs on machines without a GPU.
+ */
+class GpuBackend
+{
+public:
+    struct DeviceInfo
+    {
+        int id = 0;
+        std::string description;
+        // -1 if unknown
+        int numaNode = -1;
+        size_t availableMemory = 0;
+        size_t totalMemory = 0;
+        uint64_t smCount = 0;
+        uint64_t threadsPerBlock = 0;
+    };
+
+    /**
+     * @brief Stream owned by the caller: a perftools::gputools::Stream for CudaGpuBackend,
+     * a SimulatedGpuBackend::Stream for SimulatedGpuBackend.
+     */
+    using StreamHandle = void *;
+
+    class Event
+    {
+    public:
+        enum class Status
+        {
+            Pending,
+            Complete,
+            Error,
+        };
+
+        virtual ~Event() = default;
+
+        /**
+         * @brief Complete the event once all work queued on stream so far is done.
+         * An event can be recorded again after it completed.
+         */
+        virtual void record(StreamHandle stream) = 0;
+
+        virtual Status poll() = 0;
+    };
+
+    virtual ~GpuBackend() = default;
+
+    virtual const char *name() const = 0;
+
+    virtual int deviceCount() const = 0;
+
+    /**
+     * @brief Query the device, throws if the device can't be queried
+     */
+    virtual DeviceInfo deviceInfo(int id) const = 0;
+
+    virtual std::unique_ptr<Event> createEvent(int id) = 0;
+
+    /**
+     * @brief Report the available memory of each device to LimitsProvider, so GPU memory limits
+     * follow the actual devices rather than the built-in default. Devices that can't be queried keep the default.
+     */
+    void discoverLimits();
+
+    /**
+     * @brief The device a lane runs sessions on, owned by the lane
+     */
+    class LaneDevice
+    {
+    public:
+        virtual ~LaneDevice() = default;
+
+        virtual ::tensorflow::Device *as_tfdevice() = 0;
+    };
+
+    /**
+     * @brief Create the device for a new lane of memory bytes on the index-th GPU used by LaneMgr.
+     * The device reports its allocations to layout, which outlives it.
+     * @return nullptr if lanes on this backend only account for memory
+     */
+    virtual std::unique_ptr<LaneDevice> createLaneDevice(int index, const DeviceInfo &info, size_t memory,
+                                                         MemoryLayout &layout);
+
+    /**
+     * @brief The CPU device sessions use along with their lane devices, nullptr if lanes have no device
+     */
+    virtual ::tensorflow::Device *compatibleCPUDevice();
+
+    /**
+     * @brief The backend used by LaneMgr, SMBlocker and SMEventPoller. Must be set before any of them
+     * is created.
+     */
+    static GpuBackend &instance();
+
+    static void setInstance(std::unique_ptr<GpuBackend> backend);
+
+    static bool hasInstance();
+
+private:
+    static std::unique_ptr<GpuBackend> m_instance;
+};
+
+} // namespace salus::oplib::tensorflow
+
+#endif // SALUS_OPLIB_TENSORFLOW_GPUBACKEND_H
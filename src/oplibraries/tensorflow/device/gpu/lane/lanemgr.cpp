@@ -19,106 +19,161 @@
 
 #include "oplibraries/tensorflow/device/gpu/lane/lanemgr.h"
 
-#include "oplibraries/tensorflow/device/cpu.h"
-#include "oplibraries/tensorflow/device/gpu/gpu.h"
-#include "oplibraries/tensorflow/tfexception.h"
-#include "oplibraries/tensorflow/tfinstance.h"
+#include "resources/limitsprovider.h"
 #include "utils/envutils.h"
+#include "utils/macros.h"
 #include "utils/threadutils.h"
 
 #include <numeric>
 #include <algorithm>
 
-namespace tfgpu = perftools::gputools;
-
 namespace salus::oplib::tensorflow {
 
 LaneMgr::LaneMgr()
+    : LaneMgr(GpuBackend::instance())
 {
-    SALUS_THROW_IF_ERROR(tf::ValidateGPUMachineManager());
-    auto gpu_manager = tf::GPUMachineManager();
+}
 
+LaneMgr::LaneMgr(GpuBackend &backend)
+    : m_backend(backend)
+    , m_packer(sstl::fromEnvVar("SALUS_LANE_MAX_BYPASS", uint64_t{32}))
+{
     // Initialize GPU CUDA context
     const auto &validIds = getValidGpuIds();
     CHECK(!validIds.empty()) << "At least 1 GPU should be present";
 
     // Initialize CUDA runtime on each GPU
     for (auto gpuId : validIds) {
-        auto se = gpu_manager->ExecutorForDevice(gpuId).ValueOrDie();
-
-        if (!m_cpuCudaHostAlloc) {
-            // Find the first valid StreamExecutor to request CUDA host memory
-            // through, since any will work.
-            createCudaHostAllocator(se);
-        }
-
-        tf::int64 availableMemory, totalMemory;
-        if (!se->DeviceMemoryUsage(&availableMemory, &totalMemory)) {
-            throw TFException(tf::errors::Unknown("Failed to query available memory for GPU ", gpuId));
-        }
-        availableMemory = availableMemory - 300 * 1024 * 1024;
+        auto info = m_backend.deviceInfo(gpuId);
+        auto availableMemory =
+            LimitsProvider::instance().gpuMemoryLimit(static_cast<int>(m_gpus.size()), info.availableMemory);
+        LOG(INFO) << "GPU " << gpuId << " memory available to lanes: " << availableMemory;
 
         // We don't care about the theorical totalMemory, but what is available to us in maximum
-        totalMemory = availableMemory;
-
-        auto &gcb = m_gpus.emplace_back(*this, m_gpus.size(), gpuId, *se, totalMemory);
-        gcb.availableMemory = static_cast<size_t>(availableMemory);
+        auto &gcb = m_gpus.emplace_back(*this, m_gpus.size(), std::move(info), availableMemory);
+        gcb.availableMemory = availableMemory;
         CHECK_LE(gcb.availableMemory, gcb.totalMemory);
     }
 
-    // Initialize CPU device
-    auto name = tf::strings::StrCat(TFInstance::namePrefix(), "/device:CPU:0");
-    // use tf::cpu_allocator to select from cpu allocatory registary
-    tf::SessionOptions opt;
-    tf::DeviceLocality locality;
-    m_cpu = std::make_unique<SalusCPUDevice>(opt, name, tf::Bytes(256 << 20), locality, tf::cpu_allocator(),
-                                             m_cpuCudaHostAlloc.get());
-
     // Check env
     setDisabled(sstl::fromEnvVar("SALUS_DISABLE_LANEMGR", false));
-}
+    m_elastic.enabled = !sstl::fromEnvVar("SALUS_DISABLE_ELASTIC_LANE", false);
 
-LaneMgr::~LaneMgr() = default;
+    m_timeoutThread = std::thread(&LaneMgr::timeoutLoop, this);
+}
 
-std::vector<int> LaneMgr::getValidGpuIds()
+LaneMgr::~LaneMgr()
 {
-    return {0};
+    {
+        auto g = sstl::with_guard(m_mu);
+        m_stopping = true;
+    }
+    m_timeoutCv.notify_all();
+    if (m_timeoutThread.joinable()) {
+        m_timeoutThread.join();
+    }
 }
 
-tf::Device *LaneMgr::compatibleCPUDevice() const
+std::vector<int> LaneMgr::getValidGpuIds()
 {
-    return m_cpu.get();
+    // Only the first GPU is used by default, other parts (e.g. resource limits) assume a single GPU
+    auto numVisible = m_backend.deviceCount();
+    auto numGpus = std::min(numVisible, sstl::fromEnvVar("SALUS_NUM_GPUS", 1));
+
+    std::vector<int> ids(static_cast<size_t>(std::max(numGpus, 0)));
+    std::iota(ids.begin(), ids.end(), 0);
+    return ids;
 }
 
-void LaneMgr::createCudaHostAllocator(tfgpu::StreamExecutor *se)
+tf::Device *LaneMgr::compatibleCPUDevice() const
 {
-    struct CudaHostAllocTag;
-    // 64 GB max by default
-    size_t cuda_host_mem_limit_in_mb =
-        sstl::fromEnvVarCached<CudaHostAllocTag>("TF_CUDA_HOST_MEM_LIMIT_IN_MB", 1_sz << 16);
-    size_t cuda_host_mem_limit = cuda_host_mem_limit_in_mb * (1LL << 20);
-    m_cpuCudaHostAlloc = std::make_unique<tf::BFCAllocator>(new tf::CUDAHostAllocator(se), cuda_host_mem_limit,
-                                                            true /*allow_growth*/, "cuda_host_bfc" /*name*/);
+    return m_backend.compatibleCPUDevice();
 }
 
 void LaneMgr::requestLanes(Layout layout, RequestLaneCallback &&cb)
 {
     CHECK_EQ(layout.persistentOccupation.size(), layout.memoryLimits.size());
 
+    for (size_t i = 0; i != layout.memoryLimits.size(); ++i) {
+        CHECK_LE(layout.persistentOccupation.at(i), layout.memoryLimits.at(i));
+    }
+
+    auto g = sstl::with_guard(m_mu);
+
     static bool newLaneInitialized = false;
     if (m_disabled && !newLaneInitialized) {
         newLaneInitialized = true;
-        auto &gcb = m_gpus.at(0);
-        gcb.newLane(gcb.availableMemory, sstl::with_guard(*gcb.mu));
+        for (auto &gcb : m_gpus) {
+            gcb.newLane(gcb.availableMemory, sstl::with_guard(*gcb.mu));
+        }
     }
 
-    for (size_t i = 0; i != layout.memoryLimits.size(); ++i) {
-        CHECK_LE(layout.persistentOccupation.at(i), layout.memoryLimits.at(i));
+    auto &req = m_pending.emplace_back(m_nextRequestId++, std::move(layout), std::move(cb));
+    if (req.deadline != std::chrono::steady_clock::time_point::max()) {
+        m_timeoutCv.notify_all();
     }
+    processRequests(std::move(g));
+}
 
+void LaneMgr::updateHold(LaneHolder &holder, const ResStats &usage)
+{
+    if (!m_elastic.enabled || m_disabled) {
+        return;
+    }
+
+    auto pad = [this](size_t v) { return static_cast<size_t>(v * (1 + m_elastic.headroom)); };
+    const auto newHold = pad(usage.persist);
+    const auto newPeak = pad(usage.temporary);
+    if (newHold + newPeak == 0) {
+        return;
+    }
+
+    // Growing takes memory, which tryGrant assumes only happens under m_mu
     auto g = sstl::with_guard(m_mu);
-    m_pending.emplace_back(std::move(layout), std::move(cb));
-    processRequests(std::move(g));
+
+    auto &lane = *holder.m_lane;
+    bool shrunk = false;
+    {
+        auto hg = sstl::with_guard(holder.m_mu);
+        if (++holder.m_observed <= m_elastic.warmup) {
+            return;
+        }
+
+        const auto current = holder.m_hold + holder.m_peak;
+        const auto target = newHold + newPeak;
+        if (target > current) {
+            // grow right away, otherwise sessions admitted next to it may run out of memory
+            if (!lane.resizeHold(holder.m_hold, holder.m_peak, newHold, newPeak)) {
+                if (!holder.m_growFailed) {
+                    LOG(WARNING) << "No room on lane " << lane.id() << " to grow a hold from " << current << " to "
+                                 << target;
+                    holder.m_growFailed = true;
+                }
+                return;
+            }
+        } else if (target < current * (1 - m_elastic.shrinkThreshold)
+                   && holder.m_observed - holder.m_lastShrink >= m_elastic.cooldown) {
+            if (!lane.resizeHold(holder.m_hold, holder.m_peak, newHold, newPeak)) {
+                return;
+            }
+            holder.m_lastShrink = holder.m_observed;
+            shrunk = true;
+        } else {
+            return;
+        }
+
+        LOG(INFO) << "Resized hold on lane " << lane.id() << " from " << holder.m_hold << "+" << holder.m_peak
+                  << " to " << newHold << "+" << newPeak << " after " << holder.m_observed << " iterations";
+        holder.m_hold = newHold;
+        holder.m_peak = newPeak;
+    }
+
+    if (shrunk) {
+        if (lane.resizable()) {
+            lane.releaseSpare();
+        }
+        processRequests(std::move(g));
+    }
 }
 
 void LaneMgr::processRequests()
@@ -128,54 +183,191 @@ void LaneMgr::processRequests()
 
 void LaneMgr::processRequests(sstl::detail::Guard &&)
 {
-    auto it = m_pending.begin();
-    auto end = m_pending.end();
-    while (it != end) {
-        auto &req = *it;
-        const auto reqLen = req.layout.memoryLimits.size();
-
-        CHECK_LE(reqLen, m_gpus.size()) << "Requested more GPU than available";
-
-        // use a greedy algorithm, sort requested layout in desc order, and try to fit the largest one first
-        std::vector<int> indices(reqLen);
-        std::iota(indices.begin(), indices.end(), 0);
-        std::sort(indices.begin(), indices.end(), [&req](const int a, const int b) {
-            if (req.layout.memoryLimits.at(a) == req.layout.memoryLimits.at(b)) {
-                return req.layout.persistentOccupation.at(a) < req.layout.persistentOccupation.at(b);
-            }
-            return req.layout.memoryLimits.at(a) < req.layout.memoryLimits.at(b);
-        });
+    expireRequests();
+    packRequests();
+}
 
-        std::vector<std::shared_ptr<LaneHolder>> lanes;
-        for (auto idx : indices) {
-            std::shared_ptr<LaneHolder> lane{nullptr};
+void LaneMgr::packRequests()
+{
+    if (m_pending.empty()) {
+        return;
+    }
+
+    // Look at all pending requests at once instead of greedily in arrival order
+    std::vector<std::list<LaneRequest>::iterator> its;
+    std::vector<LanePacker::Request> reqs;
+    for (auto it = m_pending.begin(); it != m_pending.end(); ++it) {
+        its.emplace_back(it);
+        reqs.push_back({it->totalMemory(), it->bypassed, m_drainingFor == it->id});
+    }
+
+    auto granted = m_packer.pass(reqs, [&its, this](size_t idx, bool oldest) {
+        return tryGrant(*its[idx], oldest);
+    });
+
+    for (size_t i = 0; i != its.size(); ++i) {
+        if (granted[i]) {
+            m_pending.erase(its[i]);
+        } else {
+            its[i]->bypassed = reqs[i].bypassed;
+        }
+    }
+}
+
+bool LaneMgr::tryGrant(LaneRequest &req, bool mayDefragment)
+{
+    const auto reqLen = req.layout.memoryLimits.size();
+
+    CHECK_LE(reqLen, m_gpus.size()) << "Requested more GPU than available";
+
+    // use a greedy algorithm, sort requested layout in desc order, and try to fit the largest one first
+    std::vector<size_t> indices(reqLen);
+    std::iota(indices.begin(), indices.end(), 0);
+    std::sort(indices.begin(), indices.end(), [&req](const size_t a, const size_t b) {
+        if (req.layout.memoryLimits.at(a) == req.layout.memoryLimits.at(b)) {
+            return req.layout.persistentOccupation.at(a) > req.layout.persistentOccupation.at(b);
+        }
+        return req.layout.memoryLimits.at(a) > req.layout.memoryLimits.at(b);
+    });
+
+    // First plan the whole gang without taking any memory, so a request never holds a partial allocation.
+    // GPUs are visited in index order and only one GCB is locked at a time, and memory is only taken under
+    // m_mu, so concurrent requests can't deadlock or invalidate a plan: other threads can only release memory.
+    std::vector<std::optional<GpuControlBlock::Placement>> placements(reqLen);
+    std::vector<bool> used(m_gpus.size(), false);
+    bool planned = true;
+    for (auto idx : indices) {
+        const auto largestAllocation =
+            idx < req.layout.largestAllocations.size() ? req.layout.largestAllocations[idx] : 0_sz;
+        for (auto &gcb : m_gpus) {
+            if (used.at(gcb.index)) {
+                continue;
+            }
+            placements.at(idx) = gcb.bestFitFor(req.layout.memoryLimits.at(idx), req.layout.persistentOccupation.at(idx),
+                                                largestAllocation);
+            if (placements.at(idx)) {
+                used.at(gcb.index) = true;
+                break;
+            }
+        }
+        if (!placements.at(idx) && mayDefragment) {
             for (auto &gcb : m_gpus) {
-                lane = gcb.bestFitFor(req.layout.memoryLimits.at(idx), req.layout.persistentOccupation.at(idx));
-                if (lane) {
+                if (used.at(gcb.index) || !gcb.defragment(req.layout.memoryLimits.at(idx))) {
+                    continue;
+                }
+                m_drainingFor = req.id;
+                placements.at(idx) = gcb.bestFitFor(req.layout.memoryLimits.at(idx),
+                                                    req.layout.persistentOccupation.at(idx), largestAllocation);
+                if (placements.at(idx)) {
+                    used.at(gcb.index) = true;
                     break;
                 }
             }
-            if (!lane) {
-                // can't find a suitable allocation
-                break;
+        }
+        if (!placements.at(idx)) {
+            // can't find a suitable allocation
+            planned = false;
+            break;
+        }
+    }
+
+    if (!planned) {
+        for (auto &p : placements) {
+            if (p) {
+                p->gcb->release(std::move(*p));
             }
-            lanes.emplace_back(std::move(lane));
         }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<LaneHolder>> committed;
+    committed.reserve(reqLen);
+    for (auto &p : placements) {
+        auto &gcb = *p->gcb;
+        auto holder = gcb.commit(std::move(*p));
+        if (!holder) {
+            // Shouldn't happen, but leave the request pending for the next pass rather than granting part of it
+            LOG(ERROR) << "Failed to commit a planned lane on GPU " << gcb.id << ", retrying later";
+            for (size_t i = 0; i != committed.size(); ++i) {
+                placements[i]->gcb->rollback(std::move(committed[i]));
+            }
+            for (auto &rest : placements) {
+                rest->gcb->release(std::move(*rest));
+            }
+            return false;
+        }
+        committed.emplace_back(std::move(holder));
+    }
+
+    std::vector<std::shared_ptr<LaneHolder>> lanes;
+    lanes.reserve(reqLen);
+    for (auto &h : committed) {
+        lanes.emplace_back(std::move(h));
+    }
+
+    if (m_drainingFor == req.id) {
+        stopDraining();
+    }
+
+    req.cb(std::move(lanes));
+    return true;
+}
+
+void LaneMgr::stopDraining()
+{
+    m_drainingFor.reset();
+    for (auto &gcb : m_gpus) {
+        gcb.clearDraining();
+    }
+}
 
-        if (lanes.size() != reqLen) {
-            // no enough lanes
-            lanes.clear();
+bool LaneMgr::expireRequests()
+{
+    auto now = std::chrono::steady_clock::now();
+    bool expired = false;
+    auto it = m_pending.begin();
+    while (it != m_pending.end()) {
+        if (it->deadline > now) {
             ++it;
             continue;
         }
+        LOG(WARNING) << "Lane request for " << it->layout.memoryLimits.size() << " GPU(s) timed out after "
+                     << it->layout.timeout.count() << "ms";
+        if (m_drainingFor == it->id) {
+            stopDraining();
+        }
+        it->cb({});
+        it = m_pending.erase(it);
+        expired = true;
+    }
+    return expired;
+}
 
-        req.cb(std::move(lanes));
+void LaneMgr::timeoutLoop()
+{
+    threading::set_thread_name("LaneMgrTimeout");
 
-        it = m_pending.erase(it);
+    auto l = sstl::with_uguard(m_mu);
+    while (!m_stopping) {
+        auto next = std::chrono::steady_clock::time_point::max();
+        for (auto &req : m_pending) {
+            next = std::min(next, req.deadline);
+        }
+        if (next == std::chrono::steady_clock::time_point::max()) {
+            m_timeoutCv.wait(l);
+        } else {
+            m_timeoutCv.wait_until(l, next);
+        }
+        if (!m_stopping && expireRequests()) {
+            // requests held back by an expired one, or by lanes draining for it, may fit now
+            packRequests();
+        }
     }
 }
 
-std::unique_ptr<LaneHolder> LaneMgr::GpuControlBlock::bestFitFor(size_t memory, size_t persistentSize)
+std::optional<LaneMgr::GpuControlBlock::Placement> LaneMgr::GpuControlBlock::bestFitFor(size_t memory,
+                                                                                        size_t persistentSize,
+                                                                                        size_t largestAllocation)
 {
     CHECK_GE(memory, persistentSize);
 
@@ -186,10 +378,8 @@ std::unique_ptr<LaneHolder> LaneMgr::GpuControlBlock::bestFitFor(size_t memory,
     LOG(INFO) << "Checking to create lane for memory size " << memory << " available now " << availableMemory;
     if (!mgr.m_disabled) {
         if (availableMemory >= memory) {
-            auto lane = newLane(memory, std::move(g));
-            auto holder = lane->tryFit(persistentSize, temporaryPeak);
-            CHECK_NE(holder, nullptr);
-            return holder;
+            // a new lane is one contiguous region
+            return Placement{this, sstl::ScopedUnref<GpuLane>{}, memory, persistentSize, largestAllocation};
         }
     }
 
@@ -199,13 +389,133 @@ std::unique_ptr<LaneHolder> LaneMgr::GpuControlBlock::bestFitFor(size_t memory,
     if (!sstl::fromEnvVarCached<NoSharedLaneTag>("SALUS_DISABLE_SHARED_LANE", false)) {
         // use linear search because we at most will have handful of lanes
         for (auto &lane : lanes) {
-            if (auto holder = lane->tryFit(persistentSize, temporaryPeak)) {
-                return holder;
+            if (lane->canFit(persistentSize, temporaryPeak, largestAllocation)) {
+                return Placement{this, sstl::add_ref(lane.get()), memory, persistentSize, largestAllocation};
             }
         }
     }
-    // TODO: defragmentation
-    return {};
+    return std::nullopt;
+}
+
+bool LaneMgr::GpuControlBlock::defragment(size_t memory)
+{
+    if (mgr.m_disabled) {
+        return false;
+    }
+
+    auto g = sstl::with_guard(*mu);
+    if (availableMemory >= memory) {
+        return false;
+    }
+
+    struct Candidate
+    {
+        GpuLane *lane;
+        size_t spare;
+        size_t footprint;
+    };
+    std::vector<Candidate> candidates;
+    auto totalFree = availableMemory;
+    for (auto &lane : lanes) {
+        auto footprint = lane->footprint();
+        auto spare = lane->totalMemory() - footprint;
+        if (spare > 0) {
+            candidates.push_back({lane.get(), spare, footprint});
+            totalFree += spare;
+        }
+    }
+    if (totalFree < memory) {
+        // not fragmentation, the GPU is just full
+        return false;
+    }
+
+    // Shrink what can be shrunk right away, then drain the lanes with the least memory in use, which are the
+    // ones likely to empty first
+    std::sort(candidates.begin(), candidates.end(), [](const auto &a, const auto &b) {
+        if (a.lane->resizable() != b.lane->resizable()) {
+            return a.lane->resizable();
+        }
+        return a.footprint < b.footprint;
+    });
+
+    size_t freed = 0;
+    bool started = false;
+    auto expected = availableMemory;
+    for (auto &c : candidates) {
+        if (expected >= memory) {
+            break;
+        }
+        if (c.lane->resizable()) {
+            auto f = c.lane->shrinkToFit();
+            availableMemory += f;
+            freed += f;
+            VLOG(2) << "Shrunk lane " << c.lane->id() << " on GPU " << id << " by " << f;
+        } else {
+            c.lane->setDraining(true);
+            VLOG(2) << "Draining lane " << c.lane->id() << " on GPU " << id << " with " << c.spare << " spare";
+        }
+        expected += c.spare;
+        started = true;
+    }
+
+    if (freed > 0) {
+        lanes.sort([](const auto &a, const auto &b) { return a->availableMemory() < b->availableMemory(); });
+        LOG(INFO) << "Defragmented GPU " << id << " for lane of " << memory << ": freed " << freed
+                  << ", available " << availableMemory;
+    }
+    return started;
+}
+
+void LaneMgr::GpuControlBlock::clearDraining()
+{
+    auto g = sstl::with_guard(*mu);
+    for (auto &lane : lanes) {
+        lane->setDraining(false);
+    }
+}
+
+std::unique_ptr<LaneHolder> LaneMgr::GpuControlBlock::commit(Placement &&placement)
+{
+    DCHECK_EQ(placement.gcb, this);
+
+    auto lane = std::move(placement.lane);
+    if (!lane) {
+        lane = newLane(placement.memory, sstl::with_guard(*mu));
+        if (!lane) {
+            return {};
+        }
+    }
+    auto holder = lane->tryFit(placement.persistentSize, placement.memory - placement.persistentSize,
+                               placement.largestAllocation);
+    if (!holder) {
+        // don't leave a new lane without holders behind
+        placement.lane = std::move(lane);
+        release(std::move(placement));
+    }
+    return holder;
+}
+
+void LaneMgr::GpuControlBlock::rollback(std::unique_ptr<LaneHolder> &&holder)
+{
+    holder->m_lane->removeHold(holder->m_hold, holder->m_peak);
+    release(Placement{this, std::move(holder->m_lane)});
+    holder.reset();
+}
+
+void LaneMgr::GpuControlBlock::release(Placement &&placement)
+{
+    DCHECK_EQ(placement.gcb, this);
+
+    auto theLane = placement.lane.release();
+    if (!theLane) {
+        return;
+    }
+    // Holders may have gone away while we were holding the ref, in which case we are
+    // responsible to remove the lane.
+    CHECK(!theLane->Unref());
+    if (theLane->RefCountIsOne()) {
+        maybeRemoveLane(theLane);
+    }
 }
 
 sstl::ScopedUnref<GpuLane> LaneMgr::GpuControlBlock::newLane(size_t memory, sstl::detail::Guard &&g)
@@ -257,6 +567,11 @@ void LaneMgr::GpuControlBlock::maybeRemoveLane(sstl::not_null<GpuLane *> lane)
 
     auto g = sstl::with_guard(*mu);
 
+    // A pending request may have taken a ref on this lane since the check
+    if (!lane->RefCountIsOne()) {
+        return;
+    }
+
     // lanes contains ScopedUnref, so removing from
     // list calls Unref
     size_t avail = 0;
@@ -277,99 +592,129 @@ void LaneMgr::GpuControlBlock::maybeRemoveLane(sstl::not_null<GpuLane *> lane)
 
 GpuLane::GpuLane(LaneMgr::GpuControlBlock &gcb, size_t memoryLimit, int baseStreamIndex)
     : m_gcb(gcb)
-    , m_totalMemory(memoryLimit)
     , m_baseStreamIndex(baseStreamIndex)
+    , m_totalMemory(memoryLimit)
     , m_availableMemory(memoryLimit)
     , m_maxPeak()
+    , m_layout(memoryLimit)
     , m_id(++NextId)
 {
-    // create TFDevice
-    initializeDevice();
+    m_dev = m_gcb.backend().createLaneDevice(m_gcb.index, m_gcb.info, memoryLimit, m_layout);
 }
 
-namespace {
-
-std::string GetShortDeviceDescription(int device_id, const tfgpu::DeviceDescription &desc)
+size_t GpuLane::footprintUnsafe() const
 {
-    int cc_major;
-    int cc_minor;
-    if (!desc.cuda_compute_capability(&cc_major, &cc_minor)) {
-        cc_major = 0;
-        cc_minor = 0;
+    auto used = m_totalMemory - m_availableMemory;
+    if (!m_maxPeak.empty()) {
+        used += *m_maxPeak.cbegin();
     }
-    return tf::strings::StrCat("device: ", device_id, ", name: ", desc.name(), ", pci bus id: ", desc.pci_bus_id(),
-                               ", compute capability: ", cc_major, ".", cc_minor);
+    return std::min(used, m_totalMemory);
 }
 
-} // namespace
+size_t GpuLane::footprint() const
+{
+    auto g = sstl::with_guard(m_mu);
+    return footprintUnsafe();
+}
 
-void GpuLane::initializeDevice()
+bool GpuLane::resizeHold(size_t size, size_t peak, size_t newSize, size_t newPeak)
 {
-    const std::string name = tf::strings::StrCat(TFInstance::namePrefix(), "/device:GPU:", m_gcb.index);
-    const auto &desc = m_gcb.se.GetDeviceDescription();
-    int numa_node = desc.numa_node();
-    if (numa_node < 0) {
-        // For some reason the StreamExecutor couldn't get the NUMA
-        // affinity of the GPU.  If this is not a multi-socket mobo with
-        // GPUs local to different buses, it doesn't matter.  If it is, we
-        // may run into trouble later with data transfer operations.  The
-        // trouble may manifest as slower than expected performance, or
-        // outright failures.
-        LOG(INFO) << "Could not identify NUMA node of " << name
-                  << ", defaulting to 0.  Your kernel may not have been built "
-                  << "with NUMA support.";
-        numa_node = 0;
+    std::unique_lock<std::mutex> gcbLock;
+    if (resizable()) {
+        // same lock order as GpuControlBlock::defragment
+        gcbLock = std::unique_lock<std::mutex>(*m_gcb.mu);
     }
+    auto g = sstl::with_guard(m_mu);
 
-    auto allocated_bytes = static_cast<tf::Bytes>(m_availableMemory);
-
-    // Get GPU bus_id from its reported NUMA affinity.  Because GPUs are
-    // virtualized in some environments, we can't just use the GPU id.
-    // NUMA locales are indexed from 0, buses are indexed from 1.
-    tf::DeviceLocality dev_locality;
-    dev_locality.set_bus_id(numa_node + 1);
-    VLOG(2) << "GPUDevice id " << m_gcb.id << " on bus " << dev_locality.bus_id() << " numa: " << numa_node
-            << " pci: " << desc.pci_bus_id();
+    auto it = m_maxPeak.find(peak);
+    CHECK_NE(it, m_maxPeak.end());
+    m_maxPeak.erase(it);
 
-    auto process_state = tf::ProcessState::singleton();
+    auto maxPeak = newPeak;
+    if (!m_maxPeak.empty()) {
+        maxPeak = std::max(maxPeak, *m_maxPeak.cbegin());
+    }
+    auto available = m_availableMemory + size;
+    if (newSize + maxPeak > available) {
+        auto deficit = newSize + maxPeak - available;
+        if (!gcbLock || m_gcb.availableMemory < deficit) {
+            m_maxPeak.insert(peak);
+            return false;
+        }
+        m_gcb.availableMemory -= deficit;
+        m_totalMemory += deficit;
+        available += deficit;
+    }
 
-    auto max_streams = 1;
+    m_availableMemory = available - newSize;
+    m_maxPeak.insert(newPeak);
+    return true;
+}
 
-    tf::SessionOptions opt;
-    m_dev =
-        std::make_unique<SalusGPUDevice>(opt, name, allocated_bytes, dev_locality, m_gcb.id,
-                                         GetShortDeviceDescription(m_gcb.id, desc), getGPUAllocator(),
-                                         process_state->GetCPUAllocator(numa_node), m_gcb.cudaHostAlloc(), max_streams);
-    SALUS_THROW_IF_ERROR(m_dev->Init(opt));
+size_t GpuLane::releaseSpare()
+{
+    if (!resizable()) {
+        return 0;
+    }
+    auto g = sstl::with_guard(*m_gcb.mu);
+    auto freed = shrinkToFit();
+    m_gcb.availableMemory += freed;
+    return freed;
 }
 
-tf::Allocator *GpuLane::getGPUAllocator()
+size_t GpuLane::shrinkToFit()
 {
-    struct GpuLaneTag;
-    if (!m_alloc) {
-        tf::GPUOptions opt;
-        auto useSmallOpt = sstl::fromEnvVarCached<GpuLaneTag>("SALUS_ALLOCATOR_SMALL_OPT", false);
-        m_alloc = std::make_unique<tf::GPUDoubleBFCAllocator>(m_gcb.id, m_availableMemory, opt, useSmallOpt);
+    if (!resizable()) {
+        return 0;
     }
-    return m_alloc.get();
+    auto g = sstl::with_guard(m_mu);
+    auto freed = m_totalMemory - footprintUnsafe();
+    m_totalMemory -= freed;
+    m_availableMemory -= freed;
+    return freed;
 }
 
-std::unique_ptr<LaneHolder> GpuLane::tryFit(size_t persistent, size_t peak)
+std::unique_ptr<LaneHolder> GpuLane::tryFit(size_t persistent, size_t peak, size_t largestAllocation)
 {
     auto g = sstl::with_guard(m_mu);
+    if (m_draining) {
+        return {};
+    }
     auto maxPeak = peak;
     if (!m_maxPeak.empty()) {
         maxPeak = std::max(maxPeak, *m_maxPeak.cbegin());
     }
-    if ((persistent + maxPeak) <= m_availableMemory) {
+    if ((persistent + maxPeak) <= m_availableMemory && m_layout.canFit(largestAllocation, 0)) {
         addHoldUnsafe(persistent, peak);
         return std::make_unique<LaneHolder>(sstl::add_ref(this), persistent, peak);
     }
     return {};
 }
 
+bool GpuLane::canFit(size_t persistent, size_t peak, size_t largestAllocation) const
+{
+    auto g = sstl::with_guard(m_mu);
+    if (m_draining) {
+        return false;
+    }
+    auto maxPeak = peak;
+    if (!m_maxPeak.empty()) {
+        maxPeak = std::max(maxPeak, *m_maxPeak.cbegin());
+    }
+    if (!m_layout.canFit(largestAllocation, 0)) {
+        VLOG(2) << "Lane " << m_id << " too fragmented for allocation of " << largestAllocation << ": "
+                << m_layout.DebugString();
+        return false;
+    }
+    return (persistent + maxPeak) <= m_availableMemory;
+}
+
 LaneHolder::~LaneHolder()
 {
+    if (!m_lane) {
+        // rolled back
+        return;
+    }
     m_lane->removeHold(m_hold, m_peak);
     // Notify LaneMgr to unref lane
     auto l = m_lane.get();
@@ -20,38 +20,74 @@
 #ifndef SALUS_OPLIB_TENSORFLOW_LANEMGR_H
 #define SALUS_OPLIB_TENSORFLOW_LANEMGR_H
 
-#include "oplibraries/tensorflow/tensorflow_headers.h"
-
+#include "oplibraries/tensorflow/device/gpu/gpubackend.h"
+#include "oplibraries/tensorflow/device/gpu/lane/lanepacker.h"
 #include "oplibraries/tensorflow/tfutils.h"
+#include "platform/logging.h"
+#include "platform/thread_annotations.h"
+#include "resources/memorylayout.h"
+#include "resources/resources.h"
 #include "utils/fixed_function.hpp"
 #include "utils/pointerutils.h"
 #include "utils/threadutils.h"
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <functional>
 #include <list>
 #include <memory>
+#include <numeric>
+#include <optional>
 #include <set>
+#include <thread>
 
 namespace salus::oplib::tensorflow {
 
-class SalusCPUDevice;
 class GpuLane;
 class LaneHolder;
 class LaneMgr
 {
 public:
     LaneMgr();
+    /**
+     * @brief Manage lanes on the GPUs of backend. Lanes have TensorFlow devices if the backend creates them,
+     * otherwise they only account for memory.
+     */
+    explicit LaneMgr(GpuBackend &backend);
     ~LaneMgr();
 
     using RequestLaneCallback = sstl::FixedFunction<void(std::vector<std::shared_ptr<LaneHolder>> &&)>;
     struct Layout
     {
+        /**
+         * One entry per GPU. Entries are placed on distinct GPUs and are granted all together or not at all.
+         */
         std::vector<size_t> memoryLimits;
         std::vector<size_t> persistentOccupation;
+        /**
+         * Largest single allocation expected on each GPU, which must fit in one free block of a shared lane.
+         * Missing or 0 entries mean unknown.
+         */
+        std::vector<size_t> largestAllocations;
+        /**
+         * Give up if the lanes can't be granted within this time, zero means wait forever.
+         */
+        std::chrono::milliseconds timeout{0};
     };
+    /**
+     * @brief Request lanes for the layout. cb is called with one lane per layout entry in the same order,
+     * or with an empty vector if the request timed out.
+     */
     void requestLanes(Layout layout, RequestLaneCallback &&cb);
 
+    /**
+     * @brief Resize the hold of a session on its lane to the usage observed at an iteration boundary.
+     * Holds grow right away, but only shrink by more than a threshold and not more often than a cooldown,
+     * to not thrash. Memory given back is offered to pending requests.
+     */
+    void updateHold(LaneHolder &holder, const ResStats &usage);
+
     tf::Device *compatibleCPUDevice() const;
 
     void setDisabled(bool value)
@@ -71,26 +107,75 @@ public:
 
 private:
     std::vector<int> getValidGpuIds();
-    void createCudaHostAllocator(tfgpu::StreamExecutor *se);
 
+    GpuBackend &m_backend;
     bool m_disabled = false;
 
+    struct ElasticParam
+    {
+        bool enabled = true;
+        // padding on top of the observed usage
+        double headroom = 0.1;
+        // shrink only when the hold would go down by more than this fraction
+        double shrinkThreshold = 0.2;
+        // iterations observed before the first resize
+        uint64_t warmup = 5;
+        // iterations between two shrinks of a hold
+        uint64_t cooldown = 20;
+    };
+    ElasticParam m_elastic;
+
     struct LaneRequest
     {
+        uint64_t id = 0;
         Layout layout;
         RequestLaneCallback cb;
+        std::chrono::steady_clock::time_point deadline;
+        // times a younger request was granted first
+        uint64_t bypassed = 0;
+
+        size_t totalMemory() const
+        {
+            return std::accumulate(layout.memoryLimits.begin(), layout.memoryLimits.end(), size_t{0});
+        }
 
         LaneRequest() = default;
-        LaneRequest(Layout &&layout, RequestLaneCallback &&cb)
-            : layout(std::move(layout))
+        LaneRequest(uint64_t id, Layout &&layout, RequestLaneCallback &&cb)
+            : id(id)
+            , layout(std::move(layout))
             , cb(std::move(cb))
+            , deadline(this->layout.timeout.count() > 0 ? std::chrono::steady_clock::now() + this->layout.timeout
+                                                        : std::chrono::steady_clock::time_point::max())
         {
         }
     };
     std::mutex m_mu;
     std::list<LaneRequest> m_pending GUARDED_BY(m_mu);
+    uint64_t m_nextRequestId GUARDED_BY(m_mu) = 0;
+    // the request lanes are draining for, they stay draining until it is granted or timed out
+    std::optional<uint64_t> m_drainingFor GUARDED_BY(m_mu);
+    void stopDraining() EXCLUSIVE_LOCKS_REQUIRED(m_mu);
+    // order to try pending requests in
+    LanePacker m_packer;
     void processRequests();
     void processRequests(sstl::detail::Guard &&g);
+    /**
+     * @brief Grant req if it can be placed. With mayDefragment, make room on GPUs whose free memory is enough
+     * in total but split between lanes.
+     */
+    void packRequests() EXCLUSIVE_LOCKS_REQUIRED(m_mu);
+    bool tryGrant(LaneRequest &req, bool mayDefragment) EXCLUSIVE_LOCKS_REQUIRED(m_mu);
+    /**
+     * @brief Fail timed out requests
+     * @return whether any request timed out
+     */
+    bool expireRequests() EXCLUSIVE_LOCKS_REQUIRED(m_mu);
+
+    // Fails timed out requests even when nothing else triggers processRequests
+    bool m_stopping GUARDED_BY(m_mu) = false;
+    std::condition_variable m_timeoutCv;
+    std::thread m_timeoutThread;
+    void timeoutLoop();
 
     friend class GpuLane;
     class GpuControlBlock
@@ -98,23 +183,23 @@ private:
         LaneMgr &mgr;
 
     public:
-        explicit GpuControlBlock(LaneMgr &mgr, int index, int gpuId, tfgpu::StreamExecutor &se, size_t totalMemory)
+        explicit GpuControlBlock(LaneMgr &mgr, int index, GpuBackend::DeviceInfo info, size_t totalMemory)
             : mgr(mgr)
             , index(index)
-            , id(gpuId)
-            , se(se)
+            , id(info.id)
+            , info(std::move(info))
             , totalMemory(totalMemory)
         {
         }
 
-        tf::Allocator *cudaHostAlloc() const
+        GpuBackend &backend() const
         {
-            return mgr.m_cpuCudaHostAlloc.get();
+            return mgr.m_backend;
         }
 
         const int index;
         const int id;
-        tfgpu::StreamExecutor &se;
+        const GpuBackend::DeviceInfo info;
         const size_t totalMemory;
 
         size_t availableMemory GUARDED_BY(*mu){0};
@@ -126,7 +211,53 @@ private:
         // lanes are sorted in asc order
         std::list<sstl::ScopedUnref<GpuLane>> lanes GUARDED_BY(*mu);
 
-        std::unique_ptr<LaneHolder> bestFitFor(size_t memory, size_t persistentSize);
+        /**
+         * @brief Where a lane request would go on this GPU. An empty lane means a new lane.
+         * Holds a ref on the chosen shared lane so it won't be removed before commit.
+         */
+        struct Placement
+        {
+            GpuControlBlock *gcb = nullptr;
+            sstl::ScopedUnref<GpuLane> lane;
+            size_t memory = 0;
+            size_t persistentSize = 0;
+            size_t largestAllocation = 0;
+        };
+
+        /**
+         * @brief Find a placement without taking any memory
+         */
+        std::optional<Placement> bestFitFor(size_t memory, size_t persistentSize, size_t largestAllocation);
+
+        /**
+         * @brief Take memory for a placement found by bestFitFor.
+         * Memory is only taken under LaneMgr::m_mu, so this succeeds when called under it. Otherwise nothing
+         * is taken and nullptr is returned.
+         */
+        std::unique_ptr<LaneHolder> commit(Placement &&placement);
+
+        /**
+         * @brief Undo a commit, without offering the memory to pending requests
+         */
+        void rollback(std::unique_ptr<LaneHolder> &&holder);
+
+        /**
+         * @brief Drop a placement that is not going to be committed
+         */
+        void release(Placement &&placement);
+
+        /**
+         * @brief Make room for a new lane of memory when enough is free in total but split between lanes.
+         * Resizable lanes are shrunk to their footprint right away. Other lanes with spare memory are set
+         * draining, so they take no new sessions and coalesce back once their sessions are done.
+         * Returns whether any lane was shrunk or set draining.
+         */
+        bool defragment(size_t memory);
+
+        /**
+         * @brief Let draining lanes take new sessions again
+         */
+        void clearDraining();
 
         sstl::ScopedUnref<GpuLane> newLane(size_t memory, sstl::detail::Guard &&g);
 
@@ -134,12 +265,10 @@ private:
         void maybeRemoveLane(sstl::not_null<GpuLane *> lane);
     };
     std::vector<GpuControlBlock> m_gpus;
-    std::unique_ptr<tf::Allocator> m_cpuCudaHostAlloc;
-    std::unique_ptr<SalusCPUDevice> m_cpu;
 };
 
 class LaneHolder;
-class GpuLane : public tf::core::RefCounted
+class GpuLane : public sstl::RefCounted
 {
 public:
     uint64_t id() const
@@ -147,12 +276,29 @@ public:
         return m_id;
     }
 
+    /**
+     * @brief The TensorFlow device of the lane, nullptr if the backend creates no lane devices
+     */
     tf::Device *as_tfdevice() const
     {
-        return m_dev.get();
+        return m_dev ? m_dev->as_tfdevice() : nullptr;
     }
 
-    std::unique_ptr<LaneHolder> tryFit(size_t persistent, size_t peak);
+    /**
+     * @brief Take a hold if persistent plus the largest peak on the lane fits, and the largest single
+     * allocation fits in a free block of the lane's allocator. largestAllocation 0 means unknown.
+     */
+    std::unique_ptr<LaneHolder> tryFit(size_t persistent, size_t peak, size_t largestAllocation = 0);
+
+    bool canFit(size_t persistent, size_t peak, size_t largestAllocation = 0) const;
+
+    /**
+     * @brief Layout of the lane's GPU allocator, fed by the session allocators on top of it
+     */
+    const MemoryLayout &memoryLayout() const
+    {
+        return m_layout;
+    }
 
     size_t availableMemory() const
     {
@@ -162,9 +308,44 @@ public:
 
     size_t totalMemory() const
     {
+        auto g = sstl::with_guard(m_mu);
         return m_totalMemory;
     }
 
+    /**
+     * @brief Memory the holders may use at most: all persistent memory plus the largest peak
+     */
+    size_t footprint() const;
+
+    /**
+     * @brief Whether the capacity can change in place, i.e. there is no device allocator sized for it
+     */
+    bool resizable() const
+    {
+        return !m_dev;
+    }
+
+    /**
+     * @brief Shrink a resizable lane down to its footprint
+     * @return memory freed
+     */
+    size_t shrinkToFit();
+
+    /**
+     * @brief A draining lane takes no new holders
+     */
+    void setDraining(bool value)
+    {
+        auto g = sstl::with_guard(m_mu);
+        m_draining = value;
+    }
+
+    bool draining() const
+    {
+        auto g = sstl::with_guard(m_mu);
+        return m_draining;
+    }
+
     int baseStreamIndex() const
     {
         return m_baseStreamIndex;
@@ -179,6 +360,18 @@ public:
         m_maxPeak.erase(it);
     }
 
+    /**
+     * @brief Replace a hold of (size, peak) by (newSize, newPeak) if that fits. A resizable lane takes
+     * more memory from its GPU when needed.
+     */
+    bool resizeHold(size_t size, size_t peak, size_t newSize, size_t newPeak);
+
+    /**
+     * @brief Give the memory of a resizable lane that no holder may use back to its GPU
+     * @return memory given back
+     */
+    size_t releaseSpare();
+
     void notifyGCB(sstl::ScopedUnref<GpuLane> &&self);
 
     GpuLane(LaneMgr::GpuControlBlock &gcb, size_t memoryLimit, int baseStreamIndex);
@@ -195,20 +388,23 @@ private:
         m_maxPeak.insert(peak);
     }
 
-    void initializeDevice();
-    tf::Allocator *getGPUAllocator();
+
+    size_t footprintUnsafe() const EXCLUSIVE_LOCKS_REQUIRED(m_mu);
 
     LaneMgr::GpuControlBlock &m_gcb;
 
-    const size_t m_totalMemory;
     const int m_baseStreamIndex;
 
     mutable std::mutex m_mu;
+    size_t m_totalMemory GUARDED_BY(m_mu);
     size_t m_availableMemory GUARDED_BY(m_mu);
     std::multiset<size_t, std::greater<>> m_maxPeak GUARDED_BY(m_mu);
+    bool m_draining GUARDED_BY(m_mu) = false;
 
-    std::unique_ptr<tf::Allocator> m_alloc;
-    std::unique_ptr<tf::BaseGPUDevice> m_dev;
+    // must outlive m_dev, whose session allocators feed it
+    MemoryLayout m_layout;
+
+    std::unique_ptr<GpuBackend::LaneDevice> m_dev;
 
     inline static std::atomic_uint_fast64_t NextId{0};
     uint64_t m_id;
@@ -220,6 +416,13 @@ class LaneHolder
     size_t m_hold;
     size_t m_peak;
 
+    friend class LaneMgr;
+    // serializes LaneMgr::updateHold
+    std::mutex m_mu;
+    uint64_t m_observed GUARDED_BY(m_mu) = 0;
+    uint64_t m_lastShrink GUARDED_BY(m_mu) = 0;
+    bool m_growFailed GUARDED_BY(m_mu) = false;
+
 public:
     explicit LaneHolder(sstl::ScopedUnref<GpuLane> &&lane, size_t hold, size_t peak)
         : m_lane(std::move(lane))
@@ -250,6 +453,11 @@ public:
         return m_lane->totalMemory();
     }
 
+    const MemoryLayout &memoryLayout() const
+    {
+        return m_lane->memoryLayout();
+    }
+
     int baseStreamIndex() const
     {
         return m_lane->baseStreamIndex();
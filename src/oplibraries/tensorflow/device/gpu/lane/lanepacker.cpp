@@ -0,0 +1,70 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ *
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "oplibraries/tensorflow/device/gpu/lane/lanepacker.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace salus::oplib::tensorflow {
+
+std::vector<bool> LanePacker::pass(std::vector<Request> &requests, TryGrant &&tryGrant) const
+{
+    const auto num = requests.size();
+
+    std::vector<size_t> order(num);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        if (requests[a].defragmenting != requests[b].defragmenting) {
+            return requests[a].defragmenting;
+        }
+        auto agedA = aged(requests[a]);
+        auto agedB = aged(requests[b]);
+        if (agedA != agedB) {
+            return agedA;
+        }
+        if (agedA) {
+            return a < b;
+        }
+        return requests[a].memory > requests[b].memory;
+    });
+
+    std::vector<bool> granted(num, false);
+    for (auto idx : order) {
+        if (tryGrant(idx, idx == 0)) {
+            granted[idx] = true;
+        } else if (aged(requests[idx])) {
+            // hold everything back until it fits
+            break;
+        }
+    }
+
+    // Older requests have seen every grant younger ones have, so aged requests are always the oldest ones
+    uint64_t youngerGranted = 0;
+    for (auto idx = num; idx-- > 0;) {
+        if (granted[idx]) {
+            ++youngerGranted;
+        } else {
+            requests[idx].bypassed += youngerGranted;
+        }
+    }
+    return granted;
+}
+
+} // namespace salus::oplib::tensorflow
@@ -0,0 +1,88 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ *
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_OPLIB_TENSORFLOW_LANEPACKER_H
+#define SALUS_OPLIB_TENSORFLOW_LANEPACKER_H
+
+#include "utils/fixed_function.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace salus::oplib::tensorflow {
+
+/**
+ * @brief Decides in which order pending lane requests are tried in one pass.
+ *
+ * Requests are tried largest first (first-fit-decreasing), which packs GPU memory tighter than arrival
+ * order. A request ages each time a younger one is granted ahead of it. Once it was bypassed maxBypass
+ * times it is tried before all others, and while it can't be granted no other request is, so it is
+ * never starved. With maxBypass 0 this is plain FIFO. A request memory is being defragmented for is
+ * tried before everything else, so what is freed for it isn't taken by others first.
+ *
+ * TF free, so the simulator replays lane admission with the same policy.
+ */
+class LanePacker
+{
+public:
+    struct Request
+    {
+        // total memory over all GPUs of the request
+        size_t memory = 0;
+        uint64_t bypassed = 0;
+        // lanes are draining on behalf of this request
+        bool defragmenting = false;
+    };
+
+    /**
+     * @brief Try to grant requests[index]. oldest is set for the request that arrived first,
+     * which may take more expensive measures, e.g. defragmentation.
+     */
+    using TryGrant = sstl::FixedFunction<bool(size_t index, bool oldest)>;
+
+    explicit LanePacker(uint64_t maxBypass)
+        : m_maxBypass(maxBypass)
+    {
+    }
+
+    uint64_t maxBypass() const
+    {
+        return m_maxBypass;
+    }
+
+    bool aged(const Request &req) const
+    {
+        return req.bypassed >= m_maxBypass;
+    }
+
+    /**
+     * @brief Go through requests, which are in arrival order, once.
+     * Requests passed by a younger granted one get their bypassed count increased.
+     * @return whether each request was granted
+     */
+    std::vector<bool> pass(std::vector<Request> &requests, TryGrant &&tryGrant) const;
+
+private:
+    const uint64_t m_maxBypass;
+};
+
+} // namespace salus::oplib::tensorflow
+
+#endif // SALUS_OPLIB_TENSORFLOW_LANEPACKER_H
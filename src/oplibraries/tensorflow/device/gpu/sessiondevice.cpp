@@ -28,8 +28,9 @@
 
 namespace salus::oplib::tensorflow {
 
-SessionDevice::SessionDevice(sstl::not_null<tf::Device *> base, const std::string &newBaseName, std::string sessHandle,
-                             GpuDeviceInfo newInfo, std::vector<StreamAndContext> streams)
+SessionDevice::SessionDevice(sstl::not_null<SalusGPUDevice *> base, const std::string &newBaseName,
+                             std::string sessHandle, GpuDeviceInfo newInfo, std::vector<StreamAndContext> streams,
+                             MemoryLayout *layout)
     : ShadowDevice(base, NewNameBase(newBaseName, base),
                    /*isolateSessionState = */ true, /*ownsBase = */ false,
                    [this](auto alloc, auto &&attrs) {
@@ -38,6 +39,8 @@ SessionDevice::SessionDevice(sstl::not_null<tf::Device *> base, const std::strin
     , m_sessHandle(std::move(sessHandle))
     , m_gpuDeviceInfo(newInfo)
     , m_streams(std::move(streams))
+    , m_gpuAlloc(base->gpu_allocator_)
+    , m_layout(layout)
 {
     DCHECK(!m_streams.empty());
 
@@ -47,7 +50,9 @@ SessionDevice::SessionDevice(sstl::not_null<tf::Device *> base, const std::strin
 sstl::ScopedUnref<ForwardingAllocator> SessionDevice::createWrappedAllocator(tf::Allocator *alloc,
                                                                              const tf::AllocatorAttributes &)
 {
-    return sstl::make_scoped_unref<SessionAllocator>(m_sessHandle, sstl::not_null{alloc});
+    // only the GPU allocator is modeled, not host allocators
+    return sstl::make_scoped_unref<SessionAllocator>(m_sessHandle, sstl::not_null{alloc},
+                                                     alloc == m_gpuAlloc ? m_layout : nullptr);
 }
 
 tf::Status SessionDevice::FillContextMap(const tf::Graph *, tf::DeviceContextMap *)
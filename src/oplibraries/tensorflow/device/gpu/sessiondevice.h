@@ -38,8 +38,12 @@ class SessionDevice : public ShadowDevice
 public:
     using StreamAndContext = std::pair<sstl::not_null<SalusGPUDevice::StreamGroup*>,
         sstl::not_null<tf::GPUDeviceContext*>>;
-    explicit SessionDevice(sstl::not_null<tf::Device *> base, const std::string &newBaseName, std::string sessHandle,
-                           GpuDeviceInfo newInfo, std::vector<StreamAndContext> streams);
+    /**
+     * @param layout if not null, model of base's GPU allocator that allocations of this device are reported to
+     */
+    explicit SessionDevice(sstl::not_null<SalusGPUDevice *> base, const std::string &newBaseName, std::string sessHandle,
+                           GpuDeviceInfo newInfo, std::vector<StreamAndContext> streams,
+                           MemoryLayout *layout = nullptr);
 
     tf::Status Sync() override;
     tf::Status FillContextMap(const tf::Graph *graph, tf::DeviceContextMap *device_context_map) override;
@@ -51,6 +55,9 @@ private:
     const std::string m_sessHandle;
     GpuDeviceInfo m_gpuDeviceInfo;
     std::vector<StreamAndContext> m_streams;
+
+    tf::Allocator *m_gpuAlloc;
+    MemoryLayout *m_layout;
 };
 
 } // namespace salus::oplib::tensorflow
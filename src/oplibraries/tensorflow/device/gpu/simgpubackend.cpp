@@ -0,0 +1,209 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ *
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "oplibraries/tensorflow/device/gpu/simgpubackend.h"
+
+#include "platform/logging.h"
+#include "utils/threadutils.h"
+
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace salus::oplib::tensorflow {
+
+/*static*/ SimulatedGpuBackend::Options SimulatedGpuBackend::Options::parse(const std::string &spec)
+{
+    Options opts;
+    std::istringstream iss(spec);
+    std::string item;
+    while (std::getline(iss, item, ',')) {
+        if (item.empty()) {
+            continue;
+        }
+        auto pos = item.find('=');
+        if (pos == std::string::npos) {
+            throw std::runtime_error("Malformed simulated GPU spec item: " + item);
+        }
+        auto key = item.substr(0, pos);
+        auto value = item.substr(pos + 1);
+        try {
+            if (key == "devices") {
+                opts.deviceCount = std::stoi(value);
+            } else if (key == "memory") {
+                opts.memory = std::stoull(value) * 1024 * 1024;
+            } else if (key == "sms") {
+                opts.smCount = std::stoull(value);
+            } else if (key == "threads") {
+                opts.threadsPerBlock = std::stoull(value);
+            } else if (key == "numa") {
+                opts.numaNode = std::stoi(value);
+            } else if (key == "errors") {
+                opts.eventErrorRate = std::stod(value);
+            } else if (key == "fail") {
+                opts.failingDevice = std::stoi(value);
+            } else if (key == "seed") {
+                opts.seed = std::stoull(value);
+            } else {
+                throw std::runtime_error("Unknown simulated GPU spec key: " + key);
+            }
+        } catch (const std::logic_error &) {
+            throw std::runtime_error("Invalid value for simulated GPU spec key " + key + ": " + value);
+        }
+    }
+    if (opts.deviceCount < 0 || opts.eventErrorRate < 0 || opts.eventErrorRate > 1) {
+        throw std::runtime_error("Invalid simulated GPU spec: " + spec);
+    }
+    return opts;
+}
+
+void SimulatedGpuBackend::Stream::launch(std::chrono::nanoseconds duration)
+{
+    auto g = sstl::with_guard(m_mu);
+    m_idleAt = std::max(m_idleAt, Clock::now()) + duration;
+}
+
+SimulatedGpuBackend::Clock::time_point SimulatedGpuBackend::Stream::idleAt() const
+{
+    auto g = sstl::with_guard(m_mu);
+    return m_idleAt;
+}
+
+void SimulatedGpuBackend::Stream::synchronize() const
+{
+    std::this_thread::sleep_until(idleAt());
+}
+
+class SimulatedGpuBackend::SimEvent : public GpuBackend::Event
+{
+public:
+    explicit SimEvent(SimulatedGpuBackend &backend, int device)
+        : m_backend(backend)
+        , m_device(device)
+    {
+    }
+
+    void record(StreamHandle stream) override
+    {
+        auto s = static_cast<Stream *>(stream);
+        CHECK_NOTNULL(s);
+        CHECK_EQ(s->device(), m_device) << "Recording event on a stream of another device";
+        m_completeAt = s->idleAt();
+        m_failed = m_backend.injectError();
+        m_recorded = true;
+        ++m_backend.m_eventsRecorded;
+    }
+
+    Status poll() override
+    {
+        if (!m_recorded) {
+            return Status::Error;
+        }
+        if (Clock::now() < m_completeAt) {
+            return Status::Pending;
+        }
+        return m_failed ? Status::Error : Status::Complete;
+    }
+
+private:
+    SimulatedGpuBackend &m_backend;
+    const int m_device;
+
+    // Like a CUDA event, it is recorded before being handed to whoever polls it
+    Clock::time_point m_completeAt{};
+    bool m_failed = false;
+    bool m_recorded = false;
+};
+
+SimulatedGpuBackend::SimulatedGpuBackend()
+    : SimulatedGpuBackend(Options{})
+{
+}
+
+SimulatedGpuBackend::SimulatedGpuBackend(Options opts)
+    : m_opts(std::move(opts))
+    , m_rng(m_opts.seed)
+    , m_errorDist(m_opts.eventErrorRate)
+{
+}
+
+SimulatedGpuBackend::~SimulatedGpuBackend() = default;
+
+void SimulatedGpuBackend::checkDevice(int id) const
+{
+    if (id < 0 || id >= m_opts.deviceCount) {
+        throw std::out_of_range("No simulated GPU " + std::to_string(id));
+    }
+}
+
+GpuBackend::DeviceInfo SimulatedGpuBackend::deviceInfo(int id) const
+{
+    checkDevice(id);
+    if (id == m_opts.failingDevice) {
+        throw std::runtime_error("Failed to query simulated GPU " + std::to_string(id));
+    }
+
+    DeviceInfo info;
+    info.id = id;
+    info.description = "device: " + std::to_string(id) + ", name: Simulated GPU";
+    info.numaNode = m_opts.numaNode;
+    info.availableMemory = m_opts.memory;
+    info.totalMemory = m_opts.memory;
+    info.smCount = m_opts.smCount;
+    info.threadsPerBlock = m_opts.threadsPerBlock;
+    return info;
+}
+
+std::unique_ptr<GpuBackend::Event> SimulatedGpuBackend::createEvent(int id)
+{
+    checkDevice(id);
+    return std::make_unique<SimEvent>(*this, id);
+}
+
+std::unique_ptr<SimulatedGpuBackend::Stream> SimulatedGpuBackend::createStream(int id)
+{
+    checkDevice(id);
+    return std::make_unique<Stream>(id);
+}
+
+bool SimulatedGpuBackend::injectError()
+{
+    if (m_opts.eventErrorRate <= 0) {
+        return false;
+    }
+    bool failed;
+    {
+        auto g = sstl::with_guard(m_mu);
+        failed = m_errorDist(m_rng);
+    }
+    if (failed) {
+        ++m_eventsFailed;
+    }
+    return failed;
+}
+
+SimulatedGpuBackend::Stats SimulatedGpuBackend::stats() const
+{
+    Stats s;
+    s.eventsRecorded = m_eventsRecorded.load();
+    s.eventsFailed = m_eventsFailed.load();
+    return s;
+}
+
+} // namespace salus::oplib::tensorflow
@@ -0,0 +1,152 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ *
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_OPLIB_TENSORFLOW_SIMGPUBACKEND_H
+#define SALUS_OPLIB_TENSORFLOW_SIMGPUBACKEND_H
+
+#include "oplibraries/tensorflow/device/gpu/gpubackend.h"
+
+#include "platform/thread_annotations.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <string>
+
+namespace salus::oplib::tensorflow {
+
+/**
+ * @brief GPU backend modeled in software, for running lane management and SM blocking without a GPU.
+ *
+ * Work launched on a virtual stream runs in order for its modeled duration in wall clock time, and an
+ * event completes once all work queued on its stream before record() is done. Errors can be injected
+ * into events and device queries.
+ */
+class SimulatedGpuBackend : public GpuBackend
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options
+    {
+        int deviceCount = 1;
+        size_t memory = size_t{16} << 30;
+        uint64_t smCount = 80;
+        uint64_t threadsPerBlock = 1024;
+        int numaNode = 0;
+        // Probability for an event to complete with an error
+        double eventErrorRate = 0.0;
+        // deviceInfo throws for this device, -1 means none
+        int failingDevice = -1;
+        uint64_t seed = 0;
+
+        /**
+         * @brief Parse a comma separated spec, e.g. "devices=2,memory=16384,sms=80,threads=1024,errors=0.01,fail=1,seed=7",
+         * where memory is in MB. Throws std::runtime_error on malformed spec.
+         */
+        static Options parse(const std::string &spec);
+    };
+
+    class Stream
+    {
+    public:
+        explicit Stream(int device)
+            : m_device(device)
+            , m_idleAt(Clock::now())
+        {
+        }
+
+        int device() const
+        {
+            return m_device;
+        }
+
+        /**
+         * @brief Queue work running for duration after all work queued before
+         */
+        void launch(std::chrono::nanoseconds duration);
+
+        /**
+         * @brief When all work queued so far is done
+         */
+        Clock::time_point idleAt() const;
+
+        /**
+         * @brief Block until all work queued so far is done
+         */
+        void synchronize() const;
+
+    private:
+        const int m_device;
+        mutable std::mutex m_mu;
+        Clock::time_point m_idleAt GUARDED_BY(m_mu);
+    };
+
+    SimulatedGpuBackend();
+    explicit SimulatedGpuBackend(Options opts);
+    ~SimulatedGpuBackend() override;
+
+    const char *name() const override
+    {
+        return "simulated";
+    }
+
+    int deviceCount() const override
+    {
+        return m_opts.deviceCount;
+    }
+
+    DeviceInfo deviceInfo(int id) const override;
+
+    std::unique_ptr<Event> createEvent(int id) override;
+
+    std::unique_ptr<Stream> createStream(int id);
+
+    const Options &options() const
+    {
+        return m_opts;
+    }
+
+    struct Stats
+    {
+        uint64_t eventsRecorded = 0;
+        uint64_t eventsFailed = 0;
+    };
+    Stats stats() const;
+
+private:
+    class SimEvent;
+
+    void checkDevice(int id) const;
+    bool injectError();
+
+    const Options m_opts;
+
+    std::mutex m_mu;
+    std::mt19937_64 m_rng GUARDED_BY(m_mu);
+    std::bernoulli_distribution m_errorDist GUARDED_BY(m_mu);
+
+    std::atomic<uint64_t> m_eventsRecorded{0};
+    std::atomic<uint64_t> m_eventsFailed{0};
+};
+
+} // namespace salus::oplib::tensorflow
+
+#endif // SALUS_OPLIB_TENSORFLOW_SIMGPUBACKEND_H
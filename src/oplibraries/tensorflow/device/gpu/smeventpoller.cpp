@@ -20,6 +20,7 @@
 #include "smeventpoller.h"
 
 #include "oplibraries/tensorflow/v3/smblocker.h"
+#include "platform/logging.h"
 #include "platform/thread_annotations.h"
 
 namespace salus::oplib::tensorflow {
@@ -28,12 +29,13 @@ namespace {
 
 } // namespace
 
-SMEventPoller::SMEventPoller(tf::gpu::StreamExecutor *se)
+SMEventPoller::SMEventPoller(GpuBackend &backend, int gpuId)
     : m_pool(ThreadPoolOptions{}
              .setWorkerName("SMEvtWorker")
              // one thread for poller, one thread for executing callbacks
              .setNumThreads(2))
-    , m_se(se)
+    , m_backend(backend)
+    , m_gpuId(gpuId)
 {
     startPollingLoop();
 }
@@ -107,18 +109,19 @@ SMEventPoller::PendingActions SMEventPoller::pollEvents()
     while (it != m_pendingActions.end()) {
         auto &act = *it;
         CHECK_NOTNULL(act.event);
-        auto s = act.event->PollForStatus();
+        auto s = act.event->poll();
         switch (s) {
-        default:
-        case tf::gpu::Event::Status::kUnknown:
-        case tf::gpu::Event::Status::kError:
-            // We don't expect to see these.  Someday maybe propagate
-            // a Status error, but for now fail hard.
-            LOG(FATAL) << "Unexpected Event status: " << static_cast<int>(s);
+        case GpuBackend::Event::Status::Pending:
             break;
-        case tf::gpu::Event::Status::kPending:
-            break;
-        case tf::gpu::Event::Status::kComplete:
+        case GpuBackend::Event::Status::Error:
+            // The work on the stream is gone either way, so still run the action to not leak SMs.
+            // The event itself is dropped rather than reused.
+            LOG(ERROR) << "Error event on GPU " << m_gpuId << ", releasing " << act.count << " SMs anyway";
+            act.event.reset();
+            ready.emplace_back(std::move(act));
+            it = m_pendingActions.erase(it);
+            continue;
+        case GpuBackend::Event::Status::Complete:
             // add event back to free event
             {
                 auto g = sstl::with_guard(m_mu);
@@ -147,11 +150,11 @@ void SMEventPoller::executeReady(SMEventPoller::PendingActions &ready)
     }
 }
 
-void SMEventPoller::queueAction(tf::gpu::Stream *stream, PendingAction act)
+void SMEventPoller::queueAction(GpuBackend::StreamHandle stream, PendingAction act)
 {
     act.event = allocEvent();
     CHECK_NOTNULL(act.event);
-    stream->ThenRecordEvent(act.event.get());
+    act.event->record(stream);
 
     {
         auto g = sstl::with_guard(m_mu);
@@ -161,14 +164,13 @@ void SMEventPoller::queueAction(tf::gpu::Stream *stream, PendingAction act)
     m_eventsStaging.notify();
 }
 
-std::unique_ptr<tf::gpu::Event> SMEventPoller::allocEvent()
+std::unique_ptr<GpuBackend::Event> SMEventPoller::allocEvent()
 {
     auto g = sstl::with_guard(m_mu);
     // Events are created on demand, and repeatedly reused.  There is no
     // limit placed here on the number of allocated Events.
     if (m_freeEvents.empty()) {
-        m_freeEvents.emplace_back(std::make_unique<tf::gpu::Event>(m_se));
-        m_freeEvents.back()->Init();
+        m_freeEvents.emplace_back(m_backend.createEvent(m_gpuId));
     }
     auto e = std::move(m_freeEvents.back());
     m_freeEvents.pop_back();
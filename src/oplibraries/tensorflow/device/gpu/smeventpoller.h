@@ -20,9 +20,9 @@
 #ifndef SALUS_OPLIB_TENSORFLOW_SMEVENTPOLLER_H
 #define SALUS_OPLIB_TENSORFLOW_SMEVENTPOLLER_H
 
-#include "oplibraries/tensorflow/tensorflow_headers.h"
-
+#include "oplibraries/tensorflow/device/gpu/gpubackend.h"
 #include "execution/threadpool/threadpool.h"
+#include "platform/thread_annotations.h"
 #include "utils/fixed_function.hpp"
 #include "utils/threadutils.h"
 #include "utils/pointerutils.h"
@@ -36,10 +36,10 @@ namespace salus::oplib::tensorflow {
 class SMEventPoller
 {
 public:
-    explicit SMEventPoller(tf::gpu::StreamExecutor *se);
+    explicit SMEventPoller(GpuBackend &backend, int gpuId);
     ~SMEventPoller();
 
-    inline void thenReleaseSM(tf::gpu::Stream *stream, uint64_t count)
+    inline void thenReleaseSM(GpuBackend::StreamHandle stream, uint64_t count)
     {
         if (count == 0) {
             return;
@@ -47,7 +47,7 @@ public:
         queueAction(stream, {count, {}, nullptr});
     }
 
-    inline void thenExecute(tf::gpu::Stream *stream, sstl::FixedFunction<void()> func)
+    inline void thenExecute(GpuBackend::StreamHandle stream, sstl::FixedFunction<void()> func)
     {
         queueAction(stream, {{}, std::move(func), nullptr});
     }
@@ -58,14 +58,14 @@ private:
     {
         uint64_t count; // num of SMs to release
         sstl::FixedFunction<void()> func; // action to execute
-        std::unique_ptr<tf::gpu::Event> event; // perform action after this event
+        std::unique_ptr<GpuBackend::Event> event; // perform action after this event
     };
 
     using PendingActions = std::vector<PendingAction>;
 
-    std::unique_ptr<tf::gpu::Event> allocEvent();
+    std::unique_ptr<GpuBackend::Event> allocEvent();
 
-    void queueAction(tf::gpu::Stream *stream, PendingAction action);
+    void queueAction(GpuBackend::StreamHandle stream, PendingAction action);
 
     void startPollingLoop();
     void stopPollingLoop();
@@ -89,10 +89,11 @@ private:
     sstl::notification m_eventsStaging;
 
     // GPU Event related variables
-    tf::gpu::StreamExecutor * const m_se;
+    GpuBackend &m_backend;
+    const int m_gpuId;
 
     // Free events
-    std::vector<std::unique_ptr<tf::gpu::Event>> m_freeEvents GUARDED_BY(m_mu);
+    std::vector<std::unique_ptr<GpuBackend::Event>> m_freeEvents GUARDED_BY(m_mu);
 };
 
 } // namespace salus::oplib::tensorflow
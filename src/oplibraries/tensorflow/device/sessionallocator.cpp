@@ -21,9 +21,11 @@
 
 namespace salus::oplib::tensorflow {
 
-SessionAllocator::SessionAllocator(const std::string &sess, sstl::not_null<tf::Allocator *> base)
+SessionAllocator::SessionAllocator(const std::string &sess, sstl::not_null<tf::Allocator *> base,
+                                   MemoryLayout *layout)
     : ForwardingAllocator(base)
     , m_sessHandle(sess)
+    , m_layout(layout)
 {
 }
 
@@ -47,6 +49,9 @@ void SessionAllocator::postAllocation(void *ptr, size_t alignment, size_t num_by
     if (!ptr) {
         return;
     }
+    if (m_layout) {
+        m_layout->allocated(reinterpret_cast<uintptr_t>(ptr), num_bytes);
+    }
     UNUSED(maybeMemmap);
     LogAlloc() << "event: alloc "
                << nlohmann::json({
@@ -61,6 +66,9 @@ void SessionAllocator::postAllocation(void *ptr, size_t alignment, size_t num_by
 
 void SessionAllocator::preDeallocation(void *ptr)
 {
+    if (m_layout) {
+        m_layout->deallocated(reinterpret_cast<uintptr_t>(ptr));
+    }
     LogAlloc() << "event: dealloc "
                << nlohmann::json({
                       {"ptr", reinterpret_cast<uint64_t>(ptr)},
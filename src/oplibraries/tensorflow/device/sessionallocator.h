@@ -23,6 +23,7 @@
 #include "oplibraries/tensorflow/tensorflow_headers.h"
 
 #include "oplibraries/tensorflow/device/shadowdevices.h"
+#include "resources/memorylayout.h"
 
 namespace salus::oplib::tensorflow {
 
@@ -30,7 +31,11 @@ class SessionAllocator : public ForwardingAllocator
 {
 public:
 
-    explicit SessionAllocator(const std::string &sess, sstl::not_null<tf::Allocator*> base);
+    /**
+     * @param layout if not null, allocations and deallocations are reported to it
+     */
+    explicit SessionAllocator(const std::string &sess, sstl::not_null<tf::Allocator*> base,
+                              MemoryLayout *layout = nullptr);
 
     ~SessionAllocator() override;
 
@@ -41,6 +46,7 @@ protected:
 
 private:
     std::string m_sessHandle;
+    MemoryLayout *m_layout;
 };
 
 } // namespace salus::oplib::tensorflow
@@ -79,6 +79,7 @@
 #include <tensorflow/core/lib/gtl/stl_util.h>
 #include <tensorflow/core/lib/strings/strcat.h>
 #include <tensorflow/core/lib/strings/stringprintf.h>
+#include <tensorflow/core/platform/fingerprint.h>
 #include <tensorflow/core/platform/mutex.h>
 #include <tensorflow/core/protobuf/config.pb.h>
 #include <tensorflow/core/protobuf/master.pb.h>
@@ -87,6 +88,9 @@
 #include <tensorflow/core/util/tensor_slice_reader_cache.h>
 #include <third_party/eigen3/unsupported/Eigen/CXX11/Tensor>
 
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
 #ifdef NEED_UNDEF_NDEBUG
 #undef NDEBUG
 #undef NEED_UNDEF_NDEBUG
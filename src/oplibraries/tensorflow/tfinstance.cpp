@@ -29,6 +29,7 @@
 #include "oplibraries/tensorflow/handlercallback.h"
 #include "oplibraries/tensorflow/tfexception.h"
 #include "oplibraries/tensorflow/tfsession.h"
+#include "resources/profilecache.h"
 #include "utils/macros.h"
 
 namespace salus::oplib::tensorflow {
@@ -89,6 +90,18 @@ void TFInstance::handleCreateSession(std::unique_ptr<tf::CreateSessionRequest> &
     // We don't need exclusive mode anymore.
     ectx->dropExlusiveMode();
 
+    // Sessions running a graph seen before reuse its learned footprint, which only covers GPU0.
+    // An empty graph tells nothing about the model, so don't key on it.
+    const auto profileKey = req->graph_def().node_size() > 0 ? graphFingerprint(req->graph_def()) : 0;
+    std::optional<ResStats> cached;
+    if (profileKey != 0) {
+        ectx->setProfileKey(profileKey);
+        cached = ProfileCache::instance().lookup(profileKey);
+    }
+    if (cached && cached->persist + cached->temporary == 0) {
+        cached.reset();
+    }
+
     LaneMgr::Layout layout;
     // Get resource estimation from client
     constexpr const char *rt[] = {
@@ -107,24 +120,36 @@ void TFInstance::handleCreateSession(std::unique_ptr<tf::CreateSessionRequest> &
 
         size_t limit = 0;
         size_t persistant = 0;
-        auto p = sstl::optionalGet(m.persistant(), rt[iGpu]);
-        auto t = sstl::optionalGet(m.temporary(), rt[iGpu]);
-        if (!p || !t) {
-            break;
-        }
-        persistant = static_cast<size_t>(std::round(*p));
-        // HACK: scale persistent up 10% to mitigate OOM and fragmentation
-        persistant = static_cast<size_t>(persistant * 1.1);
-        limit += persistant;
+        const bool fromCache = iGpu == 0 && cached;
+        if (fromCache) {
+            // measured in an earlier run, no need to pad for estimation errors
+            persistant = cached->persist;
+            limit += persistant + cached->temporary;
+            LOG(INFO) << "Using cached memory profile " << ProfileCache::keyFor(profileKey) << ": "
+                      << cached->DebugString();
+        } else {
+            auto p = sstl::optionalGet(m.persistant(), rt[iGpu]);
+            auto t = sstl::optionalGet(m.temporary(), rt[iGpu]);
+            if (!p || !t) {
+                break;
+            }
+            persistant = static_cast<size_t>(std::round(*p));
+            // HACK: scale persistent up 10% to mitigate OOM and fragmentation
+            persistant = static_cast<size_t>(persistant * 1.1);
+            limit += persistant;
 
-        limit += static_cast<size_t>(std::round(*t));
+            limit += static_cast<size_t>(std::round(*t));
+        }
 
-        // HACK: scale the total up 5%, just to be safe
-        limit = static_cast<size_t>(limit * 1.05); // and even more 10%
+        if (!fromCache) {
+            // HACK: scale the total up 5%, just to be safe
+            limit = static_cast<size_t>(limit * 1.05); // and even more 10%
+        }
         limit = std::min(limit, totalGPUMemory); // cap to max value
 
         layout.memoryLimits.push_back(limit);
         layout.persistentOccupation.push_back(persistant);
+        layout.largestAllocations.push_back(fromCache ? cached->largest : 0);
     }
 
     if (layout.memoryLimits.empty()) {
@@ -136,6 +161,10 @@ void TFInstance::handleCreateSession(std::unique_ptr<tf::CreateSessionRequest> &
 
     CHECK_EQ(layout.memoryLimits.size(), layout.persistentOccupation.size());
 
+    // how long to wait for all lanes in ms, 0 means forever
+    layout.timeout = std::chrono::milliseconds(
+        static_cast<int64_t>(std::round(sstl::getOrDefault(m.persistant(), "SCHED:LANE_TIMEOUT", 0.0))));
+
     auto totalRunningTime =
         static_cast<uint64_t>(std::round(sstl::getOrDefault(m.persistant(), "TIME:TOTAL", 0.0))) * 1000;
     ectx->setExpectedRunningTime(totalRunningTime);
@@ -143,14 +172,39 @@ void TFInstance::handleCreateSession(std::unique_ptr<tf::CreateSessionRequest> &
     // smaller is higher priority
     auto priority = static_cast<int>(sstl::getOrDefault(m.persistant(), "SCHED:PRIORITY", 20));
 
-    LOG(INFO) << "Accept session with priority " << priority;
+    // relative share for weighted schedulers, larger is more
+    auto weight = sstl::getOrDefault(m.persistant(), "SCHED:WEIGHT", 1.0);
+    if (weight <= 0) {
+        LOG(WARNING) << "Ignoring invalid scheduling weight " << weight << ", using 1.0";
+        weight = 1.0;
+    }
+    ectx->setSchedulingWeight(weight);
+
+    // service class (0: best effort, 1: latency sensitive) and target step latency in ms
+    auto cls = static_cast<int>(sstl::getOrDefault(m.persistant(), "SCHED:CLASS", 0));
+    auto priorityClass = PriorityClass::BestEffort;
+    if (cls == static_cast<int>(PriorityClass::LatencySensitive)) {
+        priorityClass = PriorityClass::LatencySensitive;
+    } else if (cls != static_cast<int>(PriorityClass::BestEffort)) {
+        LOG(WARNING) << "Ignoring unknown priority class " << cls << ", using best effort";
+    }
+    auto targetStepLatency =
+        static_cast<uint64_t>(std::max(0.0, std::round(sstl::getOrDefault(m.persistant(), "SCHED:SLO_LATENCY", 0.0))));
+    ectx->setServiceLevel(priorityClass, targetStepLatency);
+
+    LOG(INFO) << "Accept session with priority " << priority << " weight " << weight << " class " << cls
+              << " target step latency " << targetStepLatency << "ms";
 
     m_laneMgr->requestLanes(std::move(layout), [&resp, priority,
                                                 cb = std::move(cb), req = std::move(req), ectx = std::move(ectx),
                                                 this](auto &&lanes) mutable {
         std::vector<tf::Device *> devices;
 
-        CHECK(!lanes.empty());
+        if (lanes.empty()) {
+            // timed out waiting for lanes
+            cb(tf::errors::ResourceExhausted("Timed out waiting for GPU lanes"));
+            return;
+        }
         // add CPU device
         devices.emplace_back(m_laneMgr->compatibleCPUDevice());
 
@@ -169,15 +223,25 @@ void TFInstance::handleCreateSession(std::unique_ptr<tf::CreateSessionRequest> &
             std::make_shared<TFSession>(*this, ectx, std::move(devices), req->config(), req->mutable_graph_def());
         auto handle = session->handle();
 
-        auto &lane = lanes.at(0);
-        LOG(INFO) << "event: lane_assigned "
-                       << nlohmann::json({
-                              {"sess", handle},
-                              {"laneId", lane->id()},
-                              {"laneSize", lane->totalMemory()},
-                              {"laneAvail", lane->availableMemory()},
-                              {"laneStream", lane->baseStreamIndex()},
-                          });
+        for (auto &lane : lanes) {
+            LOG(INFO) << "event: lane_assigned "
+                      << nlohmann::json({
+                             {"sess", handle},
+                             {"laneId", lane->id()},
+                             {"laneSize", lane->totalMemory()},
+                             {"laneAvail", lane->availableMemory()},
+                             {"laneLargestFree", lane->memoryLayout().largestFreeBlock()},
+                             {"laneFragmentation", lane->memoryLayout().fragmentation()},
+                             {"laneStream", lane->baseStreamIndex()},
+                         });
+        }
+        // Follow the session's actual usage on its first lane, the only GPU allocation trackers watch
+        ectx->setIterationEndCallback([this, lane = std::weak_ptr<LaneHolder>(lanes.at(0))](const ResStats &usage) {
+            if (auto holder = lane.lock()) {
+                m_laneMgr->updateHold(*holder, usage);
+            }
+        });
+
         // Keep a reference for lanes on ectx's user data
         // which should outlive the TFSession.
         ectx->setUserData(TFExecutionCtxData{std::forward<decltype(lanes)>(lanes), priority});
@@ -84,4 +84,23 @@ std::string tfGraphToGraphviz(const tf::Graph &g, const std::string &name)
     return os.str();
 }
 
+uint64_t graphFingerprint(const tf::GraphDef &gdef)
+{
+    // Send/Recv pairs carry the incarnation of the sending device, which is random per process
+    tf::GraphDef canonical(gdef);
+    for (auto &node : *canonical.mutable_node()) {
+        node.mutable_attr()->erase("send_device_incarnation");
+    }
+
+    // Map fields have no defined order unless serialized deterministically
+    std::string buf;
+    {
+        google::protobuf::io::StringOutputStream sos(&buf);
+        google::protobuf::io::CodedOutputStream cos(&sos);
+        cos.SetSerializationDeterministic(true);
+        canonical.SerializeToCodedStream(&cos);
+    }
+    return tf::Fingerprint64(buf);
+}
+
 } // namespace salus::oplib::tensorflow
@@ -43,6 +43,7 @@ class Status;
 class DeviceType;
 class OpKernel;
 class Graph;
+class GraphDef;
 } // namespace tensorflow
 
 namespace perftools::gputools {
@@ -73,6 +74,12 @@ using POpKernel = std::unique_ptr<tf::OpKernel, void (*)(tf::OpKernel *)>;
 
 std::string tfGraphToGraphviz(const tf::Graph &g, const std::string &name);
 
+/**
+ * @brief Fingerprint of gdef that is stable across processes running the same model.
+ * Attributes that differ between runs, like device incarnations, are ignored.
+ */
+uint64_t graphFingerprint(const tf::GraphDef &gdef);
+
 class LaneHolder;
 struct TFExecutionCtxData
 {
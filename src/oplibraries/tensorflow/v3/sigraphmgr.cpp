@@ -148,6 +148,10 @@ tf::Status SIGraphMgr::InitSIItem(const std::string &session, const tf::GraphDef
     params.session = session;
     params.graphHandle = item.handle;
 
+    // Partitions contain generated node names that change every time, so key memory profiles
+    // on the registered graph plus the partition's device instead.
+    const auto gdefFingerprint = graphFingerprint(gdef);
+
     item.units.reserve(partitions.size());
     item.graph_mgr = this;
     const auto &optimizer_opts = graph_options.optimizer_options();
@@ -221,6 +225,7 @@ tf::Status SIGraphMgr::InitSIItem(const std::string &session, const tf::GraphDef
         }
 
         params.ins = m_execCtx;
+        params.profileKey = tf::FingerprintCat64(gdefFingerprint, tf::Fingerprint64(key));
         TF_RETURN_IF_ERROR(NewTFExecutor(params, std::move(subgraph), &unit.root));
     }
     return Status::OK();
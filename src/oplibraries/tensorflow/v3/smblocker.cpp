@@ -24,8 +24,9 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include "oplibraries/tensorflow/tensorflow_headers.h"
 #include "oplibraries/tensorflow/v3/smblocker.h"
+#include "oplibraries/tensorflow/device/gpu/gpubackend.h"
+#include "execution/threadpool/threadpool.h"
 #include "utils/threadutils.h"
 #include "utils/containerutils.h"
 
@@ -88,13 +89,9 @@ SMBlocker &SMBlocker::instance()
 
 SMUsage SMBlocker::queryAvailableSM()
 {
-    auto gpu_manager = tf::GPUMachineManager();
     // TODO: assume each device has the same number of SM
-    auto se = gpu_manager->ExecutorForDevice(0).ValueOrDie();
-    return {
-        se->GetDeviceDescription().threads_per_block_limit(),
-        static_cast<uint64_t>(se->GetDeviceDescription().core_count())
-    };
+    auto info = GpuBackend::instance().deviceInfo(0);
+    return {info.threadsPerBlock, info.smCount};
 }
 
 SMBlocker::SMBlocker(double factor)
@@ -160,7 +157,11 @@ void SMBlocker::wait(uint64_t graphId, int nodeId, int priority)
 
     LogSMTracing() << "Wait at SMBlocker: graph " << graphId << " node " << nodeId
                << " sm " << smUsage << " priority " << priority;
-    m_freeBlocks.wait(smUsage, priority);
+    {
+        // Called from compute pool workers, let others keep the pool busy meanwhile
+        ThreadPool::ScopedBlockingRegion blocking;
+        m_freeBlocks.wait(smUsage, priority);
+    }
     LogSMTracing() << "Took at SMBlocker: graph " << graphId << " node " << nodeId
                << " sm " << smUsage << " priority " << priority;
 }
@@ -27,8 +27,7 @@
 #ifndef SALUS_OPLIB_TENSORFLOW_SMBLOCKER_H
 #define SALUS_OPLIB_TENSORFLOW_SMBLOCKER_H
 
-#include "oplibraries/tensorflow/tensorflow_headers.h"
-
+#include "platform/logging.h"
 #include "utils/threadutils.h"
 
 #include <boost/functional/hash.hpp>
@@ -18,8 +18,10 @@ limitations under the License.
 
 #include "execution/engine/iterationcontext.h"
 #include "execution/iterationtask.h"
+#include "execution/threadpool/threadpool.h"
 #include "oplibraries/tensorflow/tfinstance.h"
 #include "oplibraries/tensorflow/v3/smblocker.h"
+#include "resources/profilecache.h"
 #include "utils/envutils.h"
 
 namespace salus::oplib::tensorflow {
@@ -2087,6 +2089,7 @@ void ExecutorState::Finish()
         // devices like GPUs that continue to execute Ops after their Compute
         // methods have completed, this ensures that control is not returned to
         // the user until the step (and its side-effects) has actually completed.
+        ThreadPool::ScopedBlockingRegion blocking;
         status = impl_->params_.device->Sync();
     }
 
@@ -2457,12 +2460,17 @@ public:
         }
 
         auto &ectx = m_impl.params_.ins;
-        return ectx->m_item->beginIteration(ectx->m_ticket, {}, graphId());
+        return ectx->m_item->beginIteration(ectx->m_ticket, estimatedPeakAllocation(devices::GPU0), graphId(),
+                                            m_impl.params_.profileKey);
     }
 
-    ResStats estimatedPeakAllocation(const DeviceSpec &) const override
+    ResStats estimatedPeakAllocation(const DeviceSpec &dev) const override
     {
-        return {};
+        // Only memory on GPU0 is tracked per iteration, see SessionItem::trackerTag
+        if (dev != devices::GPU0 || m_impl.params_.profileKey == 0) {
+            return {};
+        }
+        return ProfileCache::instance().lookup(m_impl.params_.profileKey).value_or(ResStats{});
     }
 
     void runAsync(std::shared_ptr<IterationContext> &&ictx) noexcept override
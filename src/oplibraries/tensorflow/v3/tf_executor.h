@@ -34,6 +34,9 @@ struct TFExecutorParams
 
     std::shared_ptr<ExecutionContext> ins;
 
+    // Key of this executor's memory profile in ProfileCache, 0 if none
+    uint64_t profileKey = 0;
+
     tf::Device *device;
 
     // The library runtime support.
@@ -18,9 +18,12 @@
  */
 
 #include "resources/iteralloctracker.h"
+#include "resources/profilecache.h"
 #include "utils/date.h"
 #include "platform/logging.h"
 
+#include <cmath>
+
 using std::chrono::duration_cast;
 using std::chrono::microseconds;
 using std::chrono::milliseconds;
@@ -33,10 +36,15 @@ using namespace date;
 
 namespace salus {
 
-IterAllocTracker::IterAllocTracker(const ResourceTag &tag, size_t window, double peakthr)
+double IterAllocTracker::m_estimationQuantile = 0.95;
+
+IterAllocTracker::IterAllocTracker(const ResourceTag &tag, uint64_t fingerprint, size_t window, double peakthr)
     : m_tag(tag)
     , m_peakthr(peakthr)
     , m_window(window)
+    , m_fingerprint(fingerprint)
+    , m_tempQuantile(m_estimationQuantile)
+    , m_persistQuantile(m_estimationQuantile)
 {
 }
 
@@ -154,14 +162,31 @@ void IterAllocTracker::endIter()
     // first release hold, because we'll be modifying m_est
     releaseAllocationHold();
 
-    // update our estimation using running average
+    // update our estimation, using either a running average or a quantile over iterations.
+    // Averages underestimate peaks of jobs whose iterations vary, e.g. in sequence length.
+    const bool useQuantile = m_estimationQuantile > 0;
 
     // persist usage
     if (m_currPeak > m_currPersist) {
         auto newTemporary = m_currPeak - m_currPersist;
-        m_est.temporary = runningAvg(m_est.temporary, newTemporary, m_numIters);
+        if (useQuantile) {
+            m_tempQuantile.add(newTemporary);
+            m_est.temporary = static_cast<size_t>(std::ceil(m_tempQuantile.value()));
+        } else {
+            m_est.temporary = runningAvg(m_est.temporary, newTemporary, m_numIters);
+        }
     }
     m_est.count = runningAvg(m_est.count, m_count, m_numIters);
+    if (useQuantile) {
+        m_persistQuantile.add(m_currPersist);
+        m_est.persist = static_cast<size_t>(std::ceil(m_persistQuantile.value()));
+    } else {
+        m_est.persist = runningAvg(m_est.persist, m_currPersist, m_numIters);
+    }
+
+    if (m_fingerprint != 0) {
+        ProfileCache::instance().record(m_fingerprint, m_est, static_cast<uint64_t>(m_numIters));
+    }
 }
 
 } // namespace salus
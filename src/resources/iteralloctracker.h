@@ -21,6 +21,7 @@
 #define SALUS_MEM_ITERATIONALLOCATIONTRACKER_H
 
 #include "resources/resources.h"
+#include "utils/quantile.h"
 
 #include <boost/circular_buffer.hpp>
 
@@ -32,10 +33,15 @@ class IterAllocTracker
     ResourceTag m_tag;
     double m_peakthr;
     size_t m_window;
+    // key in ProfileCache, 0 means don't record
+    uint64_t m_fingerprint;
 
     // cross iter state
     int m_numIters = 0;
     ResStats m_est{};
+    // per iteration temporary and persist usage, only used when m_estimationQuantile is set
+    sstl::P2Quantile m_tempQuantile;
+    sstl::P2Quantile m_persistQuantile;
     // in iter state
     bool m_holding = false;
     uint64_t m_currPersist = 0;
@@ -46,12 +52,41 @@ class IterAllocTracker
     boost::circular_buffer<std::pair<long, size_t>> m_buf;
 
     void releaseAllocationHold();
+
+    static double m_estimationQuantile;
 public:
-    IterAllocTracker(const ResourceTag &tag, size_t window = 0, double peakthr = 0.9);
+    /**
+     * @brief Estimate usage of an iteration as this quantile of past iterations, e.g. 0.95.
+     * 0 means use the running average. Affects trackers created afterwards.
+     */
+    static void setEstimationQuantile(double q)
+    {
+        m_estimationQuantile = q;
+    }
+
+    static double estimationQuantile()
+    {
+        return m_estimationQuantile;
+    }
+
+    IterAllocTracker(const ResourceTag &tag, uint64_t fingerprint = 0, size_t window = 0, double peakthr = 0.9);
 
     bool beginIter(AllocationRegulator::Ticket ticket, ResStats estimation, uint64_t currentUsage);
     bool update(size_t num);
     void endIter();
+
+    /**
+     * @brief Usage estimated from the iterations so far, updated by endIter
+     */
+    const ResStats &estimation() const
+    {
+        return m_est;
+    }
+
+    int numIters() const
+    {
+        return m_numIters;
+    }
 };
 
 } // namespace salus
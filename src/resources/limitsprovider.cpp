@@ -0,0 +1,393 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resources/limitsprovider.h"
+
+#include "resources/resources.h"
+#include "platform/logging.h"
+#include "utils/threadutils.h"
+
+#include <boost/lexical_cast.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace salus;
+
+namespace {
+
+constexpr size_t kDefaultGpuReserve = 300_sz * 1024 * 1024;
+
+// cgroup v1 reports a page aligned LONG_MAX when there is no limit
+constexpr size_t kCgroupUnlimited = 1_sz << 62;
+
+std::optional<std::string> readFirstLine(const std::string &path)
+{
+    std::ifstream in(path);
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+        return {};
+    }
+    return line;
+}
+
+std::optional<size_t> readCgroupValue(const std::string &path)
+{
+    auto line = readFirstLine(path);
+    if (!line) {
+        return {};
+    }
+    if (*line == "max") {
+        return {};
+    }
+    size_t val = 0;
+    if (!boost::conversion::try_lexical_convert(*line, val) || val >= kCgroupUnlimited) {
+        return {};
+    }
+    return val;
+}
+
+std::string trim(const std::string &str)
+{
+    auto first = str.find_first_not_of(" \t\n");
+    if (first == std::string::npos) {
+        return {};
+    }
+    auto last = str.find_last_not_of(" \t\n");
+    return str.substr(first, last - first + 1);
+}
+
+size_t sizeFromJson(const nlohmann::json &j)
+{
+    if (j.is_number_unsigned()) {
+        return j.get<size_t>();
+    }
+    if (j.is_string()) {
+        return LimitsProvider::parseSize(j.get<std::string>());
+    }
+    throw std::runtime_error("Expect a size, got " + j.dump());
+}
+
+void setLimit(Resources &res, const ResourceTag &tag, size_t val, const std::string &source)
+{
+    if (val == 0) {
+        throw std::runtime_error("Limit of " + tag.DebugString() + " from " + source + " must be positive");
+    }
+    res[tag] = val;
+}
+
+} // namespace
+
+/*static*/ LimitsProvider &LimitsProvider::instance()
+{
+    static LimitsProvider provider;
+    return provider;
+}
+
+/*static*/ size_t LimitsProvider::parseSize(const std::string &str)
+{
+    auto s = trim(str);
+    size_t pos = 0;
+    double num = 0;
+    try {
+        num = std::stod(s, &pos);
+    } catch (const std::exception &) {
+        throw std::runtime_error("Invalid size '" + str + "'");
+    }
+    if (num < 0 || !std::isfinite(num)) {
+        throw std::runtime_error("Invalid size '" + str + "'");
+    }
+
+    auto suffix = trim(s.substr(pos));
+    // accept K, KB, KiB and so on
+    if (suffix.size() > 1 && (suffix.back() == 'B' || suffix.back() == 'b')) {
+        suffix.pop_back();
+        if (suffix.size() > 1 && suffix.back() == 'i') {
+            suffix.pop_back();
+        }
+    }
+
+    double scale = 1;
+    if (suffix.empty() || suffix == "B" || suffix == "b") {
+        scale = 1;
+    } else if (suffix == "K" || suffix == "k") {
+        scale = 1024.0;
+    } else if (suffix == "M" || suffix == "m") {
+        scale = 1024.0 * 1024;
+    } else if (suffix == "G" || suffix == "g") {
+        scale = 1024.0 * 1024 * 1024;
+    } else if (suffix == "T" || suffix == "t") {
+        scale = 1024.0 * 1024 * 1024 * 1024;
+    } else {
+        throw std::runtime_error("Invalid size suffix in '" + str + "'");
+    }
+    return static_cast<size_t>(num * scale);
+}
+
+/*static*/ ResourceTag LimitsProvider::parseTag(const std::string &str)
+{
+    // ResourceTag::fromString is lenient and falls back to CPU on typos, which is not what we want here
+    auto s = trim(str);
+    auto p1 = s.find(':');
+    auto p2 = p1 == std::string::npos ? std::string::npos : s.find(':', p1 + 1);
+    if (p2 == std::string::npos) {
+        throw std::runtime_error("Invalid resource tag '" + str + "', expect TYPE:DEVICE:ID, e.g. MEMORY:GPU:0");
+    }
+
+    ResourceTag tag{};
+    tag.type = resourceTypeFromString(s.substr(0, p1));
+    if (tag.type == ResourceType::UNKNOWN) {
+        throw std::runtime_error("Unknown resource type in '" + str + "'");
+    }
+
+    auto dev = s.substr(p1 + 1, p2 - p1 - 1);
+    if (dev == "CPU") {
+        tag.device.type = DeviceType::CPU;
+    } else if (dev == "GPU") {
+        tag.device.type = DeviceType::GPU;
+    } else {
+        throw std::runtime_error("Unknown device type in '" + str + "'");
+    }
+
+    if (!boost::conversion::try_lexical_convert(s.substr(p2 + 1), tag.device.id) || tag.device.id < 0) {
+        throw std::runtime_error("Invalid device id in '" + str + "'");
+    }
+    return tag;
+}
+
+/*static*/ std::optional<size_t> LimitsProvider::readCgroupMemoryLimit(const std::string &procRoot,
+                                                                      const std::string &cgroupRoot)
+{
+    std::ifstream in(procRoot + "/self/cgroup");
+    if (!in) {
+        return {};
+    }
+
+    // lines are hierarchy-ID:controller-list:cgroup-path, v2 has an empty controller list
+    std::optional<std::string> v1Path;
+    std::optional<std::string> v2Path;
+    std::string line;
+    while (std::getline(in, line)) {
+        auto p1 = line.find(':');
+        auto p2 = p1 == std::string::npos ? std::string::npos : line.find(':', p1 + 1);
+        if (p2 == std::string::npos) {
+            continue;
+        }
+        auto controllers = "," + line.substr(p1 + 1, p2 - p1 - 1) + ",";
+        auto path = line.substr(p2 + 1);
+        if (controllers == ",,") {
+            v2Path = path;
+        } else if (controllers.find(",memory,") != std::string::npos) {
+            v1Path = path;
+        }
+    }
+
+    // inside a container the cgroup namespace root is mounted directly, so also try the root
+    if (v1Path) {
+        for (const auto &dir : {cgroupRoot + "/memory" + *v1Path, cgroupRoot + "/memory"}) {
+            if (auto val = readCgroupValue(dir + "/memory.limit_in_bytes")) {
+                return val;
+            }
+        }
+    }
+    if (v2Path) {
+        for (const auto &dir : {cgroupRoot + *v2Path, cgroupRoot}) {
+            if (auto val = readCgroupValue(dir + "/memory.max")) {
+                return val;
+            }
+        }
+    }
+    return {};
+}
+
+/*static*/ std::optional<size_t> LimitsProvider::readMemTotal(const std::string &procRoot)
+{
+    std::ifstream in(procRoot + "/meminfo");
+    std::string key;
+    size_t val;
+    std::string unit;
+    while (in >> key >> val) {
+        std::getline(in, unit);
+        if (key == "MemTotal:") {
+            return trim(unit) == "kB" ? val * 1024 : val;
+        }
+    }
+    return {};
+}
+
+void LimitsProvider::configure(const Options &opts)
+{
+    Resources limits;
+    Resources explicitLimits;
+
+    // defaults, same as what used to be hard coded. GPU memory is replaced once the GPU backend reports it.
+    limits[resources::CPU0Memory] = 100_sz * 1024 * 1024 * 1024;
+    limits[resources::GPU0Memory] = 14_sz * 1024 * 1024 * 1024;
+    limits[{ResourceType::GPU_STREAM, devices::GPU0}] = 128;
+    limits[{ResourceType::EXCLUSIVE, devices::GPU0}] = 1;
+
+    // discovered
+    auto memTotal = readMemTotal(opts.procRoot);
+    auto cgroupLimit = readCgroupMemoryLimit(opts.procRoot, opts.cgroupRoot);
+    std::optional<size_t> hostMemory;
+    if (memTotal && cgroupLimit) {
+        hostMemory = std::min(*memTotal, *cgroupLimit);
+    } else if (memTotal) {
+        hostMemory = memTotal;
+    } else {
+        hostMemory = cgroupLimit;
+    }
+    if (hostMemory) {
+        limits[resources::CPU0Memory] = *hostMemory;
+    } else {
+        LOG(WARNING) << "Can not discover host memory from " << opts.procRoot << " or " << opts.cgroupRoot
+                     << ", using default";
+    }
+
+    size_t gpuReserve = kDefaultGpuReserve;
+
+    // resource file
+    if (opts.resourceFile) {
+        const auto &path = *opts.resourceFile;
+        std::ifstream in(path);
+        if (!in) {
+            throw std::runtime_error("Can't open resource file " + path);
+        }
+        try {
+            auto j = nlohmann::json::parse(in);
+            if (auto it = j.find("limits"); it != j.end()) {
+                for (const auto &[key, value] : it->items()) {
+                    setLimit(explicitLimits, parseTag(key), sizeFromJson(value), path);
+                }
+            }
+            if (auto it = j.find("gpuReserve"); it != j.end()) {
+                gpuReserve = sizeFromJson(*it);
+            }
+        } catch (const nlohmann::json::exception &ex) {
+            throw std::runtime_error("Malformed resource file " + path + ": " + ex.what());
+        }
+    }
+
+    // command line
+    std::istringstream iss(opts.overrides);
+    std::string spec;
+    while (std::getline(iss, spec, ',')) {
+        if (trim(spec).empty()) {
+            continue;
+        }
+        auto pos = spec.find('=');
+        if (pos == std::string::npos) {
+            throw std::runtime_error("Invalid limit '" + spec + "', expect TAG=VALUE");
+        }
+        setLimit(explicitLimits, parseTag(spec.substr(0, pos)), parseSize(spec.substr(pos + 1)), "command line");
+    }
+    if (opts.gpuReserve) {
+        gpuReserve = *opts.gpuReserve;
+    }
+
+    // validate explicit limits against what is discovered
+    if (auto it = explicitLimits.find(resources::CPU0Memory); it != explicitLimits.end() && hostMemory
+                                                                && it->second > *hostMemory) {
+        LOG(WARNING) << "Configured " << it->first.DebugString() << " " << it->second
+                     << " exceeds what is available to this process " << *hostMemory << ", capping";
+        it->second = *hostMemory;
+    }
+    for (const auto &[tag, val] : explicitLimits) {
+        limits[tag] = val;
+    }
+
+    LOG(INFO) << "Resource limits:";
+    for (const auto &[tag, val] : limits) {
+        LOG(INFO) << "    " << tag.DebugString() << ": " << val
+                  << (explicitLimits.count(tag) ? " (configured)" : "");
+    }
+    LOG(INFO) << "    Host memory: " << (memTotal ? std::to_string(*memTotal) : "unknown")
+              << ", cgroup limit: " << (cgroupLimit ? std::to_string(*cgroupLimit) : "none");
+    LOG(INFO) << "    GPU memory reserve: " << gpuReserve;
+
+    auto g = sstl::with_guard(m_mu);
+    m_limits = std::move(limits);
+    m_explicit = std::move(explicitLimits);
+    m_gpuReserve = gpuReserve;
+    m_configured = true;
+}
+
+void LimitsProvider::ensureConfigured() const
+{
+    std::call_once(m_defaultOnce, [this]() {
+        {
+            auto g = sstl::with_guard(m_mu);
+            if (m_configured) {
+                return;
+            }
+        }
+        const_cast<LimitsProvider *>(this)->configure({});
+    });
+}
+
+Resources LimitsProvider::limits() const
+{
+    ensureConfigured();
+    auto g = sstl::with_guard(m_mu);
+    return m_limits;
+}
+
+size_t LimitsProvider::gpuReserve() const
+{
+    ensureConfigured();
+    auto g = sstl::with_guard(m_mu);
+    return m_gpuReserve;
+}
+
+size_t LimitsProvider::gpuMemoryLimit(int gpuIndex, size_t deviceAvailable) const
+{
+    ensureConfigured();
+    auto g = sstl::with_guard(m_mu);
+    return gpuMemoryLimitUnsafe(gpuIndex, deviceAvailable);
+}
+
+size_t LimitsProvider::discoverGpuMemory(int gpuIndex, size_t deviceAvailable)
+{
+    ensureConfigured();
+    auto g = sstl::with_guard(m_mu);
+
+    auto limit = gpuMemoryLimitUnsafe(gpuIndex, deviceAvailable);
+    ResourceTag tag{ResourceType::MEMORY, DeviceSpec{DeviceType::GPU, gpuIndex}};
+    LOG(INFO) << "Discovered " << tag.DebugString() << ": " << limit << " (device has " << deviceAvailable
+              << " available, reserve " << m_gpuReserve << ")";
+    m_limits[tag] = limit;
+    return limit;
+}
+
+size_t LimitsProvider::gpuMemoryLimitUnsafe(int gpuIndex, size_t deviceAvailable) const
+{
+    auto limit = deviceAvailable > m_gpuReserve ? deviceAvailable - m_gpuReserve : 0;
+    ResourceTag tag{ResourceType::MEMORY, DeviceSpec{DeviceType::GPU, gpuIndex}};
+    if (auto it = m_explicit.find(tag); it != m_explicit.end()) {
+        if (it->second > limit) {
+            LOG(WARNING) << "Configured " << tag.DebugString() << " " << it->second
+                         << " exceeds what the device has available " << limit << ", capping";
+        } else {
+            limit = it->second;
+        }
+    }
+    return limit;
+}
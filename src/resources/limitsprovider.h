@@ -0,0 +1,125 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_EXEC_LIMITSPROVIDER_H
+#define SALUS_EXEC_LIMITSPROVIDER_H
+
+#include "resources/resourcetag.h"
+
+#include <mutex>
+#include <optional>
+#include <string>
+
+/**
+ * @brief Discovers resource limits of the machine Salus runs on.
+ *
+ * Limits are layered, later ones take precedence:
+ *   1. built-in defaults for GPU0,
+ *   2. CPU memory from /proc/meminfo, capped by the cgroup (v1 or v2) memory limit,
+ *   3. a JSON resource file,
+ *   4. per-tag overrides from the command line.
+ *
+ * Everything is validated and logged once in configure. Malformed input throws std::runtime_error.
+ * GPU memory reported by the GPU backend replaces the built-in default afterwards, see discoverGpuMemory.
+ */
+class LimitsProvider
+{
+public:
+    struct Options
+    {
+        /**
+         * @brief JSON resource file, e.g.
+         * {"limits": {"MEMORY:GPU:0": "11G", "GPU_STREAM:GPU:0": 128}, "gpuReserve": "300M"}
+         */
+        std::optional<std::string> resourceFile;
+        /**
+         * @brief Comma separated overrides, e.g. "MEMORY:GPU:0=10G,MEMORY:GPU:1=10G"
+         */
+        std::string overrides;
+        /**
+         * @brief Memory left untouched on each GPU for CUDA context and other processes
+         */
+        std::optional<size_t> gpuReserve;
+
+        // Root of proc and cgroup filesystems, tests may point these to fake trees
+        std::string procRoot = "/proc";
+        std::string cgroupRoot = "/sys/fs/cgroup";
+    };
+
+    static LimitsProvider &instance();
+
+    /**
+     * @brief Discover, validate and log limits. Uses default options if never called.
+     */
+    void configure(const Options &opts);
+
+    Resources limits() const;
+
+    size_t gpuReserve() const;
+
+    /**
+     * @brief GPU memory Salus may use on GPU gpuIndex, given the free memory the device reports.
+     * This is the reported memory minus the reserve, further capped by any configured limit.
+     */
+    size_t gpuMemoryLimit(int gpuIndex, size_t deviceAvailable) const;
+
+    /**
+     * @brief Set the memory limit of GPU gpuIndex in limits() to gpuMemoryLimit of what the device reports.
+     * Discovered devices are forgotten by configure.
+     * @returns the new limit
+     */
+    size_t discoverGpuMemory(int gpuIndex, size_t deviceAvailable);
+
+    /**
+     * @brief Parse a size with an optional binary suffix, e.g. "300M", "11G", "1.5G", "4096"
+     */
+    static size_t parseSize(const std::string &str);
+
+    /**
+     * @brief Parse a resource tag in the form TYPE:DEVICE:ID, e.g. "MEMORY:GPU:0"
+     */
+    static ResourceTag parseTag(const std::string &str);
+
+    /**
+     * @brief Memory limit of the cgroup this process is in, or empty if unlimited or unknown
+     */
+    static std::optional<size_t> readCgroupMemoryLimit(const std::string &procRoot, const std::string &cgroupRoot);
+
+    /**
+     * @brief MemTotal from meminfo, or empty if unknown
+     */
+    static std::optional<size_t> readMemTotal(const std::string &procRoot);
+
+private:
+    LimitsProvider() = default;
+
+    void ensureConfigured() const;
+    size_t gpuMemoryLimitUnsafe(int gpuIndex, size_t deviceAvailable) const;
+
+    mutable std::once_flag m_defaultOnce;
+    mutable std::mutex m_mu;
+    bool m_configured = false;
+
+    Resources m_limits;
+    // limits set explicitly by resource file or command line
+    Resources m_explicit;
+    size_t m_gpuReserve = 0;
+};
+
+#endif // SALUS_EXEC_LIMITSPROVIDER_H
@@ -0,0 +1,190 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resources/memorylayout.h"
+
+#include "platform/logging.h"
+#include "utils/threadutils.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace salus {
+
+MemoryLayout::MemoryLayout(size_t capacity, size_t granularity)
+    : m_capacity(capacity)
+    , m_granularity(std::max<size_t>(granularity, 1))
+{
+}
+
+void MemoryLayout::allocated(uintptr_t ptr, size_t size)
+{
+    size = roundUp(size);
+
+    auto g = sstl::with_guard(m_mu);
+    if (!m_allocs.emplace(ptr, size).second) {
+        LOG(WARNING) << "MemoryLayout: duplicate allocation at " << as_hex(reinterpret_cast<void *>(ptr));
+        return;
+    }
+    m_used += size;
+
+    if (!m_base) {
+        rebaseUnsafe(ptr);
+        return;
+    }
+    if (ptr < *m_base) {
+        rebaseUnsafe(ptr);
+        return;
+    }
+    takeUnsafe(ptr, size);
+}
+
+void MemoryLayout::deallocated(uintptr_t ptr)
+{
+    auto g = sstl::with_guard(m_mu);
+    auto it = m_allocs.find(ptr);
+    if (it == m_allocs.end()) {
+        VLOG(2) << "MemoryLayout: unknown deallocation at " << as_hex(reinterpret_cast<void *>(ptr));
+        return;
+    }
+    auto size = it->second;
+    m_allocs.erase(it);
+    m_used -= size;
+    giveBackUnsafe(ptr, size);
+}
+
+void MemoryLayout::takeUnsafe(uintptr_t start, size_t size)
+{
+    // the free block containing start, if any
+    auto it = m_free.upper_bound(start);
+    if (it == m_free.begin()) {
+        return;
+    }
+    --it;
+    auto [blockStart, blockSize] = *it;
+    auto blockEnd = blockStart + blockSize;
+    if (start >= blockEnd) {
+        return;
+    }
+    auto end = std::min(start + size, blockEnd);
+
+    m_freeSizes.erase(m_freeSizes.find(blockSize));
+    m_free.erase(it);
+    if (start > blockStart) {
+        m_free.emplace(blockStart, start - blockStart);
+        m_freeSizes.insert(start - blockStart);
+    }
+    if (end < blockEnd) {
+        m_free.emplace(end, blockEnd - end);
+        m_freeSizes.insert(blockEnd - end);
+    }
+}
+
+void MemoryLayout::giveBackUnsafe(uintptr_t start, size_t size)
+{
+    // clip to the region
+    auto regionEnd = *m_base + m_capacity;
+    if (start >= regionEnd) {
+        return;
+    }
+    auto end = std::min(start + size, regionEnd);
+
+    auto next = m_free.lower_bound(start);
+    if (next != m_free.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == start) {
+            start = prev->first;
+            m_freeSizes.erase(m_freeSizes.find(prev->second));
+            m_free.erase(prev);
+        }
+    }
+    if (next != m_free.end() && next->first == end) {
+        end += next->second;
+        m_freeSizes.erase(m_freeSizes.find(next->second));
+        m_free.erase(next);
+    }
+    m_free.emplace(start, end - start);
+    m_freeSizes.insert(end - start);
+}
+
+void MemoryLayout::rebaseUnsafe(uintptr_t base)
+{
+    m_base = base;
+    m_free.clear();
+    m_freeSizes.clear();
+    m_free.emplace(base, m_capacity);
+    m_freeSizes.insert(m_capacity);
+    for (const auto &[ptr, size] : m_allocs) {
+        takeUnsafe(ptr, size);
+    }
+}
+
+size_t MemoryLayout::largestFreeBlockUnsafe() const
+{
+    if (!m_base) {
+        return m_capacity;
+    }
+    return m_freeSizes.empty() ? 0 : *m_freeSizes.rbegin();
+}
+
+size_t MemoryLayout::usedBytes() const
+{
+    auto g = sstl::with_guard(m_mu);
+    return m_used;
+}
+
+size_t MemoryLayout::freeBytes() const
+{
+    auto g = sstl::with_guard(m_mu);
+    return m_used >= m_capacity ? 0 : m_capacity - m_used;
+}
+
+size_t MemoryLayout::largestFreeBlock() const
+{
+    auto g = sstl::with_guard(m_mu);
+    return largestFreeBlockUnsafe();
+}
+
+double MemoryLayout::fragmentation() const
+{
+    auto g = sstl::with_guard(m_mu);
+    auto free = m_used >= m_capacity ? 0 : m_capacity - m_used;
+    if (free == 0) {
+        return 0;
+    }
+    return 1.0 - static_cast<double>(std::min(largestFreeBlockUnsafe(), free)) / free;
+}
+
+bool MemoryLayout::canFit(size_t largest, size_t total) const
+{
+    auto g = sstl::with_guard(m_mu);
+    auto free = m_used >= m_capacity ? 0 : m_capacity - m_used;
+    return total <= free && roundUp(largest) <= largestFreeBlockUnsafe();
+}
+
+std::string MemoryLayout::DebugString() const
+{
+    auto g = sstl::with_guard(m_mu);
+    std::ostringstream oss;
+    oss << "MemoryLayout(capacity=" << m_capacity << ", used=" << m_used << ", allocations=" << m_allocs.size()
+        << ", freeBlocks=" << m_free.size() << ", largestFree=" << largestFreeBlockUnsafe() << ")";
+    return oss.str();
+}
+
+} // namespace salus
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_MEM_MEMORYLAYOUT_H
+#define SALUS_MEM_MEMORYLAYOUT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <set>
+#include <string>
+
+namespace salus {
+
+/**
+ * @brief Address level model of one allocator region, e.g. the BFC allocator of a GPU lane.
+ *
+ * Fed with allocation and deallocation events, it keeps the free space as coalesced blocks, so
+ * the largest free contiguous block is known in O(1) and maintained in O(log n). Totals alone
+ * can't tell that an allocation fails on fragmentation.
+ *
+ * The region base is not known upfront. As BFC carves chunks from the start of its region, the
+ * first allocation is taken as the base, and the model rebases if anything lands below it.
+ * Sizes are rounded up to the allocator granularity.
+ */
+class MemoryLayout
+{
+public:
+    explicit MemoryLayout(size_t capacity, size_t granularity = 256);
+
+    void allocated(uintptr_t ptr, size_t size);
+    void deallocated(uintptr_t ptr);
+
+    size_t capacity() const
+    {
+        return m_capacity;
+    }
+
+    size_t usedBytes() const;
+    size_t freeBytes() const;
+    size_t largestFreeBlock() const;
+
+    /**
+     * @brief 1 - largest free block / free bytes. 0 means all free memory is contiguous.
+     */
+    double fragmentation() const;
+
+    /**
+     * @brief Whether total more bytes, with the largest single allocation being largest, would fit now
+     */
+    bool canFit(size_t largest, size_t total) const;
+
+    std::string DebugString() const;
+
+private:
+    size_t roundUp(size_t size) const
+    {
+        return (size + m_granularity - 1) / m_granularity * m_granularity;
+    }
+
+    void takeUnsafe(uintptr_t start, size_t size);
+    void giveBackUnsafe(uintptr_t start, size_t size);
+    void rebaseUnsafe(uintptr_t base);
+    size_t largestFreeBlockUnsafe() const;
+
+    const size_t m_capacity;
+    const size_t m_granularity;
+
+    mutable std::mutex m_mu;
+    std::optional<uintptr_t> m_base;
+    size_t m_used = 0;
+    // start -> rounded size
+    std::map<uintptr_t, size_t> m_allocs;
+    // coalesced free blocks within [base, base + capacity), start -> size
+    std::map<uintptr_t, size_t> m_free;
+    std::multiset<size_t> m_freeSizes;
+};
+
+} // namespace salus
+
+#endif // SALUS_MEM_MEMORYLAYOUT_H
@@ -21,6 +21,85 @@
 
 #include "platform/logging.h"
 #include "platform/memory.h"
+#include "utils/threadutils.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+class MemoryMgr::ThreadCache
+{
+public:
+    static ThreadCache &local()
+    {
+        thread_local ThreadCache cache;
+        return cache;
+    }
+
+    ~ThreadCache()
+    {
+        for (size_t cls = 0; cls != m_bins.size(); ++cls) {
+            auto &bin = m_bins[cls];
+            if (bin.head) {
+                auto tail = bin.head;
+                while (tail->next) {
+                    tail = tail->next;
+                }
+                MemoryMgr::instance().release(cls, bin.head, tail, bin.count);
+            }
+        }
+    }
+
+    void *pop(MemoryMgr &mgr, size_t cls)
+    {
+        auto &bin = m_bins[cls];
+        if (!bin.head) {
+            bin.count = static_cast<uint32_t>(mgr.fetch(cls, mgr.m_batch[cls], bin.head));
+            if (!bin.head) {
+                return nullptr;
+            }
+        }
+        auto node = bin.head;
+        bin.head = node->next;
+        --bin.count;
+        return node;
+    }
+
+    void push(MemoryMgr &mgr, size_t cls, void *ptr)
+    {
+        auto &bin = m_bins[cls];
+        auto node = static_cast<FreeNode *>(ptr);
+        node->next = bin.head;
+        bin.head = node;
+        ++bin.count;
+
+        // keep at most two batches, so alternating alloc and free never bounces off the central list
+        const auto batch = mgr.m_batch[cls];
+        if (bin.count > 2 * batch) {
+            auto head = bin.head;
+            auto tail = head;
+            for (uint32_t i = 1; i != batch; ++i) {
+                tail = tail->next;
+            }
+            bin.head = tail->next;
+            bin.count -= batch;
+            tail->next = nullptr;
+            mgr.release(cls, head, tail, batch);
+        }
+    }
+
+private:
+    struct Bin
+    {
+        FreeNode *head = nullptr;
+        uint32_t count = 0;
+    };
+    std::array<Bin, kMaxClasses> m_bins;
+};
 
 MemoryMgr &MemoryMgr::instance()
 {
@@ -28,13 +107,160 @@ MemoryMgr &MemoryMgr::instance()
     return mgr;
 }
 
-MemoryMgr::MemoryMgr() = default;
+MemoryMgr::MemoryMgr()
+{
+    configure({});
+}
 
+// chunks may still be referenced by other threads during exit, so leave the mapping alone
 MemoryMgr::~MemoryMgr() = default;
 
+/*static*/ std::vector<size_t> MemoryMgr::defaultSizeClasses()
+{
+    // 16 byte steps up to 128, then four classes per doubling up to 256K
+    std::vector<size_t> sizes;
+    for (size_t s = kMinClassSize; s <= 128; s += kMinClassSize) {
+        sizes.push_back(s);
+    }
+    for (size_t base = 128; base < (size_t{256} << 10); base *= 2) {
+        for (size_t step = 1; step <= 4; ++step) {
+            sizes.push_back(base + base / 4 * step);
+        }
+    }
+    return sizes;
+}
+
+/*static*/ MemoryMgr::HugePages MemoryMgr::parseHugePages(const std::string &str)
+{
+    if (str == "off") {
+        return HugePages::Off;
+    }
+    if (str == "madvise") {
+        return HugePages::Advise;
+    }
+    if (str == "hugetlb") {
+        return HugePages::HugeTLB;
+    }
+    throw std::runtime_error("Unknown huge page mode '" + str + "', must be one of off, madvise or hugetlb");
+}
+
+void MemoryMgr::configure(const Options &opts)
+{
+    if (m_used.load()) {
+        throw std::runtime_error("MemoryMgr can't be configured after allocation");
+    }
+
+    auto sizes = opts.sizeClasses.empty() ? defaultSizeClasses() : opts.sizeClasses;
+    if (sizes.size() > kMaxClasses) {
+        throw std::runtime_error("Too many size classes: " + std::to_string(sizes.size()));
+    }
+    for (size_t i = 0; i != sizes.size(); ++i) {
+        if (sizes[i] == 0 || sizes[i] % kMinClassSize != 0) {
+            throw std::runtime_error("Size class " + std::to_string(sizes[i]) + " is not a multiple of "
+                                     + std::to_string(kMinClassSize));
+        }
+        if (sizes[i] > kChunkSize / 4) {
+            throw std::runtime_error("Size class " + std::to_string(sizes[i]) + " is too large");
+        }
+        if (i > 0 && sizes[i] <= sizes[i - 1]) {
+            throw std::runtime_error("Size classes are not in ascending order");
+        }
+    }
+
+    unreserve();
+
+    m_opts = opts;
+    m_sizes = std::move(sizes);
+    m_batch.clear();
+    for (auto size : m_sizes) {
+        // move about 64K at a time, bounded to [2, 64] objects
+        m_batch.push_back(static_cast<uint32_t>(std::clamp<size_t>((64 << 10) / size, 2, 64)));
+    }
+    m_lookup.assign(m_sizes.back() / kMinClassSize + 1, 0);
+    for (size_t i = 0, cls = 0; i != m_lookup.size(); ++i) {
+        while (m_sizes[cls] < i * kMinClassSize) {
+            ++cls;
+        }
+        m_lookup[i] = static_cast<uint8_t>(cls);
+    }
+
+    if (m_opts.slab) {
+        reserve();
+    }
+}
+
+void MemoryMgr::reserve()
+{
+    m_numChunks = m_opts.reserveBytes / kChunkSize;
+    if (m_numChunks == 0) {
+        return;
+    }
+    // one extra chunk to align the base
+    m_reservedLen = (m_numChunks + 1) * kChunkSize;
+    auto addr = ::mmap(nullptr, m_reservedLen, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) {
+        LOG(WARNING) << "Failed to reserve " << m_reservedLen << " bytes for host memory arenas: "
+                     << std::strerror(errno) << ". Using the system allocator instead";
+        m_reservedLen = 0;
+        m_numChunks = 0;
+        return;
+    }
+    m_reserved = addr;
+    auto aligned = (reinterpret_cast<uintptr_t>(addr) + kChunkSize - 1) & ~(kChunkSize - 1);
+    m_base = reinterpret_cast<char *>(aligned);
+
+    m_chunkClass = std::make_unique<std::atomic<uint8_t>[]>(m_numChunks);
+    for (size_t i = 0; i != m_numChunks; ++i) {
+        m_chunkClass[i].store(static_cast<uint8_t>(kNoClass), std::memory_order_relaxed);
+    }
+}
+
+void MemoryMgr::unreserve()
+{
+    if (m_reserved) {
+        ::munmap(m_reserved, m_reservedLen);
+    }
+    m_reserved = nullptr;
+    m_reservedLen = 0;
+    m_base = nullptr;
+    m_numChunks = 0;
+    m_chunkClass.reset();
+
+    auto g = sstl::with_guard(m_chunkMu);
+    m_nextChunk = 0;
+}
+
+size_t MemoryMgr::classFor(size_t alignment, size_t num_bytes) const
+{
+    if (!m_base || num_bytes > m_sizes.back()) {
+        return kNoClass;
+    }
+    size_t cls = m_lookup[(num_bytes + kMinClassSize - 1) / kMinClassSize];
+    // objects are placed at multiples of their size in a chunk aligned to kChunkSize
+    if (alignment > 1) {
+        while (cls != m_sizes.size() && (m_sizes[cls] & (alignment - 1)) != 0) {
+            ++cls;
+        }
+    }
+    return cls == m_sizes.size() ? kNoClass : cls;
+}
+
 void *MemoryMgr::allocate(int alignment, size_t num_bytes)
 {
-    // TODO: proper memory management
+    auto cls = classFor(static_cast<size_t>(std::max(alignment, 1)), num_bytes);
+    if (cls != kNoClass) {
+        if (auto ptr = ThreadCache::local().pop(*this, cls)) {
+            return ptr;
+        }
+    }
+    return systemAllocate(alignment, num_bytes);
+}
+
+void *MemoryMgr::systemAllocate(int alignment, size_t num_bytes)
+{
+    if (m_opts.slab) {
+        m_systemAllocs.fetch_add(1, std::memory_order_relaxed);
+    }
     auto ptr = mem::alignedAlloc(alignment, num_bytes);
     if (!ptr) {
         LOG(ERROR) << "allocation failed for request: " << num_bytes << " bytes with alignment " << alignment;
@@ -44,6 +270,148 @@ void *MemoryMgr::allocate(int alignment, size_t num_bytes)
 
 void MemoryMgr::deallocate(void *ptr)
 {
-    // TODO: proper memory management
+    auto p = static_cast<char *>(ptr);
+    if (p >= m_base && p < m_base + m_numChunks * kChunkSize) {
+        auto cls = m_chunkClass[static_cast<size_t>(p - m_base) / kChunkSize].load(std::memory_order_relaxed);
+        ThreadCache::local().push(*this, cls, ptr);
+        return;
+    }
     mem::alignedFree(ptr);
 }
+
+size_t MemoryMgr::fetch(size_t cls, size_t n, FreeNode *&head)
+{
+    const auto size = m_sizes[cls];
+    auto &central = m_central[cls];
+    auto g = sstl::with_guard(central.mu);
+
+    size_t got = 0;
+    while (got != n && central.head) {
+        auto node = central.head;
+        central.head = node->next;
+        node->next = head;
+        head = node;
+        ++got;
+    }
+    central.numFree -= got;
+
+    while (got != n) {
+        if (central.bump + size > central.bumpEnd) {
+            auto chunk = newChunk(cls);
+            if (!chunk) {
+                break;
+            }
+            ++central.chunks;
+            central.bump = chunk;
+            central.bumpEnd = chunk + kChunkSize;
+        }
+        auto node = reinterpret_cast<FreeNode *>(central.bump);
+        central.bump += size;
+        node->next = head;
+        head = node;
+        ++got;
+    }
+
+    central.outstanding += got;
+    ++central.refills;
+    m_used.store(true, std::memory_order_relaxed);
+    return got;
+}
+
+void MemoryMgr::release(size_t cls, FreeNode *head, FreeNode *tail, size_t n)
+{
+    auto &central = m_central[cls];
+    auto g = sstl::with_guard(central.mu);
+    tail->next = central.head;
+    central.head = head;
+    central.numFree += n;
+    central.outstanding -= n;
+}
+
+char *MemoryMgr::newChunk(size_t cls)
+{
+    size_t idx;
+    {
+        auto g = sstl::with_guard(m_chunkMu);
+        if (m_nextChunk == m_numChunks) {
+            return nullptr;
+        }
+        idx = m_nextChunk++;
+    }
+
+    auto addr = m_base + idx * kChunkSize;
+    if (!commitChunk(addr)) {
+        return nullptr;
+    }
+    m_chunkClass[idx].store(static_cast<uint8_t>(cls), std::memory_order_relaxed);
+    return addr;
+}
+
+bool MemoryMgr::commitChunk(char *addr)
+{
+    if (m_opts.hugePages == HugePages::HugeTLB) {
+        // Never map over the reservation directly: a failed MAP_FIXED mmap may leave a hole in it that
+        // others can map into. Map elsewhere and atomically move it in place instead.
+        auto tmp = ::mmap(nullptr, kChunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+                          -1, 0);
+        if (tmp != MAP_FAILED) {
+            if (::mremap(tmp, kChunkSize, kChunkSize, MREMAP_MAYMOVE | MREMAP_FIXED, addr) != MAP_FAILED) {
+                m_hugeTLBChunks.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            ::munmap(tmp, kChunkSize);
+        }
+        // most likely no huge pages are reserved in /proc/sys/vm/nr_hugepages
+        if (m_hugeTLBFallbacks.fetch_add(1, std::memory_order_relaxed) == 0) {
+            LOG(WARNING) << "Failed to map huge pages for host memory arena: " << std::strerror(errno)
+                         << ". Falling back to normal pages";
+        }
+    }
+
+    if (::mprotect(addr, kChunkSize, PROT_READ | PROT_WRITE) != 0) {
+        LOG(ERROR) << "Failed to commit host memory arena chunk at " << as_hex(addr) << ": " << std::strerror(errno);
+        return false;
+    }
+    if (m_opts.hugePages != HugePages::Off) {
+        // best effort, transparent huge pages may be disabled
+        ::madvise(addr, kChunkSize, MADV_HUGEPAGE);
+    }
+    return true;
+}
+
+MemoryMgr::Stats MemoryMgr::stats() const
+{
+    Stats stats;
+    stats.slab = m_base != nullptr;
+    for (size_t cls = 0; cls != m_sizes.size(); ++cls) {
+        auto &central = m_central[cls];
+        auto g = sstl::with_guard(central.mu);
+        auto &cs = stats.classes.emplace_back();
+        cs.size = m_sizes[cls];
+        cs.chunks = central.chunks;
+        cs.outstanding = central.outstanding;
+        cs.centralFree = central.numFree;
+        cs.refills = central.refills;
+        stats.mappedBytes += central.chunks * kChunkSize;
+    }
+    stats.hugeTLBChunks = m_hugeTLBChunks.load(std::memory_order_relaxed);
+    stats.hugeTLBFallbacks = m_hugeTLBFallbacks.load(std::memory_order_relaxed);
+    stats.systemAllocations = m_systemAllocs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+std::string MemoryMgr::Stats::DebugString() const
+{
+    std::ostringstream oss;
+    oss << "MemoryMgr(slab=" << slab << ", mapped=" << mappedBytes << ", hugetlbChunks=" << hugeTLBChunks
+        << ", hugetlbFallbacks=" << hugeTLBFallbacks << ", systemAllocations=" << systemAllocations << ")";
+    for (auto &cs : classes) {
+        if (cs.chunks == 0) {
+            continue;
+        }
+        oss << std::endl
+            << "    class " << cs.size << ": chunks=" << cs.chunks << ", outstanding=" << cs.outstanding
+            << ", centralFree=" << cs.centralFree << ", refills=" << cs.refills;
+    }
+    return oss.str();
+}
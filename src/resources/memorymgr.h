@@ -20,23 +20,174 @@
 #ifndef MEMORYMGR_H
 #define MEMORYMGR_H
 
+#include "platform/thread_annotations.h"
+
+#include <array>
+#include <atomic>
 #include <cstddef>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 /**
- * @todo write docs
+ * @brief Host memory manager serving allocations from size-class slabs.
+ *
+ * A large range of address space is reserved up front and committed in 2MB chunks, each of which is
+ * carved into objects of a single size class. Chunks are backed by huge pages when possible, either
+ * explicitly via MAP_HUGETLB or transparently via madvise(MADV_HUGEPAGE). Freed objects go to a
+ * per-thread cache first, and move between the cache and the central per-class free list in batches,
+ * so the common case takes no lock.
+ *
+ * Allocations larger than the largest size class, with an alignment no size class satisfies, or after
+ * the reserved range is used up are passed to the system allocator.
+ *
+ * Chunks are never returned to the system.
  */
 class MemoryMgr
 {
 public:
+    enum class HugePages
+    {
+        Off,
+        Advise,
+        HugeTLB,
+    };
+
+    struct Options
+    {
+        /**
+         * @brief Serve allocations from slabs, otherwise everything goes to the system allocator
+         */
+        bool slab = false;
+        /**
+         * @brief Object sizes in ascending order, each a multiple of kMinClassSize. Empty uses the default classes
+         */
+        std::vector<size_t> sizeClasses;
+        HugePages hugePages = HugePages::Advise;
+        /**
+         * @brief Address space reserved for chunks
+         */
+        size_t reserveBytes = size_t{64} << 30;
+    };
+
+    struct ClassStats
+    {
+        size_t size = 0;
+        size_t chunks = 0;
+        /**
+         * @brief Objects currently given out to threads, including those sitting in thread caches
+         */
+        uint64_t outstanding = 0;
+        uint64_t centralFree = 0;
+        uint64_t refills = 0;
+    };
+
+    struct Stats
+    {
+        bool slab = false;
+        std::vector<ClassStats> classes;
+        size_t mappedBytes = 0;
+        size_t hugeTLBChunks = 0;
+        size_t hugeTLBFallbacks = 0;
+        uint64_t systemAllocations = 0;
+
+        std::string DebugString() const;
+    };
+
+    static constexpr size_t kChunkSize = size_t{2} << 20;
+    static constexpr size_t kMinClassSize = 16;
+    static constexpr size_t kMaxClasses = 128;
+
     static MemoryMgr &instance();
     ~MemoryMgr();
 
+    /**
+     * @brief Apply opts. Only allowed before the first allocation, throws std::runtime_error otherwise
+     * or if opts are invalid.
+     */
+    void configure(const Options &opts);
+
+    const Options &options() const
+    {
+        return m_opts;
+    }
+
     void *allocate(int alignment, size_t num_bytes);
     void deallocate(void *ptr);
 
+    Stats stats() const;
+
+    /**
+     * @brief Parse one of "off", "madvise" or "hugetlb", throws std::runtime_error otherwise
+     */
+    static HugePages parseHugePages(const std::string &str);
+    static std::vector<size_t> defaultSizeClasses();
+
 private:
     MemoryMgr();
+
+    static constexpr size_t kNoClass = kMaxClasses;
+
+    struct FreeNode
+    {
+        FreeNode *next;
+    };
+
+    struct CentralList
+    {
+        mutable std::mutex mu;
+        FreeNode *head GUARDED_BY(mu) = nullptr;
+        uint64_t numFree GUARDED_BY(mu) = 0;
+        // uncarved rest of the latest chunk
+        char *bump GUARDED_BY(mu) = nullptr;
+        char *bumpEnd GUARDED_BY(mu) = nullptr;
+
+        size_t chunks GUARDED_BY(mu) = 0;
+        uint64_t outstanding GUARDED_BY(mu) = 0;
+        uint64_t refills GUARDED_BY(mu) = 0;
+    };
+
+    class ThreadCache;
+
+    void reserve();
+    void unreserve();
+
+    size_t classFor(size_t alignment, size_t num_bytes) const;
+
+    /**
+     * @brief Take up to n objects of class cls from the central list, returns number of objects taken
+     */
+    size_t fetch(size_t cls, size_t n, FreeNode *&head);
+    void release(size_t cls, FreeNode *head, FreeNode *tail, size_t n);
+
+    char *newChunk(size_t cls);
+    bool commitChunk(char *addr);
+
+    void *systemAllocate(int alignment, size_t num_bytes);
+
+    Options m_opts;
+    std::vector<size_t> m_sizes;
+    // number of objects moved between thread cache and central list at a time
+    std::vector<uint32_t> m_batch;
+    // (num_bytes + kMinClassSize - 1) / kMinClassSize -> smallest class holding num_bytes
+    std::vector<uint8_t> m_lookup;
+    std::array<CentralList, kMaxClasses> m_central;
+
+    void *m_reserved = nullptr;
+    size_t m_reservedLen = 0;
+    char *m_base = nullptr;
+    size_t m_numChunks = 0;
+    std::unique_ptr<std::atomic<uint8_t>[]> m_chunkClass;
+
+    std::mutex m_chunkMu;
+    size_t m_nextChunk GUARDED_BY(m_chunkMu) = 0;
+
+    std::atomic<size_t> m_hugeTLBChunks{0};
+    std::atomic<size_t> m_hugeTLBFallbacks{0};
+    std::atomic<uint64_t> m_systemAllocs{0};
+    std::atomic<bool> m_used{false};
 };
 
 #endif // MEMORYMGR_H
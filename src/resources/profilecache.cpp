@@ -0,0 +1,184 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resources/profilecache.h"
+
+#include "platform/logging.h"
+#include "utils/threadutils.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+constexpr int kCacheVersion = 1;
+
+uint64_t parseKey(const std::string &key)
+{
+    size_t pos = 0;
+    uint64_t fp = 0;
+    try {
+        fp = std::stoull(key, &pos, 16);
+    } catch (const std::exception &) {
+        pos = 0;
+    }
+    if (pos == 0 || pos != key.size()) {
+        throw std::runtime_error("Invalid fingerprint " + key);
+    }
+    return fp;
+}
+
+} // namespace
+
+/*static*/ ProfileCache &ProfileCache::instance()
+{
+    static ProfileCache cache;
+    return cache;
+}
+
+/*static*/ std::string ProfileCache::keyFor(uint64_t fingerprint)
+{
+    std::ostringstream oss;
+    oss << std::hex << std::setw(16) << std::setfill('0') << fingerprint;
+    return oss.str();
+}
+
+void ProfileCache::configure(const std::string &path)
+{
+    std::unordered_map<uint64_t, Entry> entries;
+
+    std::ifstream in(path);
+    if (in) {
+        try {
+            auto j = nlohmann::json::parse(in);
+            if (j.value("version", 0) != kCacheVersion) {
+                throw std::runtime_error("Unsupported version in profile cache " + path);
+            }
+            for (const auto &[key, value] : j.at("entries").items()) {
+                Entry entry;
+                entry.stats.temporary = value.at("temporary").get<size_t>();
+                entry.stats.persist = value.at("persist").get<size_t>();
+                entry.stats.count = value.value("count", size_t{0});
+                entry.stats.largest = value.value("largest", size_t{0});
+                entry.iterations = value.value("iterations", uint64_t{0});
+                entries.emplace(parseKey(key), entry);
+            }
+        } catch (const nlohmann::json::exception &ex) {
+            throw std::runtime_error("Malformed profile cache " + path + ": " + ex.what());
+        }
+    } else {
+        LOG(INFO) << "Profile cache " << path << " does not exist yet, starting empty";
+    }
+
+    auto g = sstl::with_guard(m_mu);
+    m_path = path;
+    m_entries = std::move(entries);
+    m_dirty = false;
+    m_lastSave = Clock::now();
+    LOG(INFO) << "Loaded " << m_entries.size() << " memory profiles from " << m_path;
+}
+
+bool ProfileCache::enabled() const
+{
+    auto g = sstl::with_guard(m_mu);
+    return !m_path.empty();
+}
+
+size_t ProfileCache::size() const
+{
+    auto g = sstl::with_guard(m_mu);
+    return m_entries.size();
+}
+
+std::optional<ResStats> ProfileCache::lookup(uint64_t fingerprint) const
+{
+    auto g = sstl::with_guard(m_mu);
+    if (m_path.empty()) {
+        return {};
+    }
+    auto it = m_entries.find(fingerprint);
+    if (it == m_entries.end()) {
+        return {};
+    }
+    return it->second.stats;
+}
+
+void ProfileCache::record(uint64_t fingerprint, const ResStats &stats, uint64_t iterations)
+{
+    if (iterations == 0) {
+        return;
+    }
+
+    auto g = sstl::with_guard(m_mu);
+    if (m_path.empty()) {
+        return;
+    }
+    auto &entry = m_entries[fingerprint];
+    if (entry.iterations > iterations && iterations < kRefreshIterations) {
+        return;
+    }
+    entry.stats = stats;
+    entry.iterations = iterations;
+    m_dirty = true;
+}
+
+void ProfileCache::save(bool force)
+{
+    std::string path;
+    nlohmann::json entries = nlohmann::json::object();
+    {
+        auto g = sstl::with_guard(m_mu);
+        auto now = Clock::now();
+        if (m_path.empty() || !m_dirty || (!force && now - m_lastSave < kSaveInterval)) {
+            return;
+        }
+        for (const auto &[fp, entry] : m_entries) {
+            entries[keyFor(fp)] = {
+                {"temporary", entry.stats.temporary},
+                {"persist", entry.stats.persist},
+                {"count", entry.stats.count},
+                {"largest", entry.stats.largest},
+                {"iterations", entry.iterations},
+            };
+        }
+        path = m_path;
+        m_dirty = false;
+        m_lastSave = now;
+    }
+
+    auto numEntries = entries.size();
+    auto g = sstl::with_guard(m_saveMu);
+    auto tmp = path + ".tmp";
+    bool ok;
+    {
+        std::ofstream out(tmp, std::ios::trunc);
+        out << nlohmann::json({{"version", kCacheVersion}, {"entries", std::move(entries)}}).dump(4) << std::endl;
+        ok = static_cast<bool>(out);
+    }
+    if (!ok || std::rename(tmp.c_str(), path.c_str()) != 0) {
+        LOG(ERROR) << "Failed to save profile cache " << path << ", will retry later";
+        auto g2 = sstl::with_guard(m_mu);
+        m_dirty = true;
+        return;
+    }
+    VLOG(2) << "Saved " << numEntries << " memory profiles to " << path;
+}
@@ -0,0 +1,100 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_EXEC_PROFILECACHE_H
+#define SALUS_EXEC_PROFILECACHE_H
+
+#include "resources/resources.h"
+
+#include <chrono>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Memory profiles learned in earlier runs, keyed by graph fingerprint.
+ *
+ * IterAllocTracker records its estimation here at the end of every iteration, and sessions record
+ * their overall footprint when they are deleted. A later session running the same graph can then
+ * be admitted and regulated with the learned numbers from its very first iteration.
+ *
+ * The cache is a JSON file, e.g.
+ * {"version": 1, "entries": {"9f86d081884c7d65": {"temporary": 1024, "persist": 4096, "count": 300, "iterations": 20}}}
+ *
+ * Saving is rate limited and done via a temporary file plus rename, so a crash never leaves
+ * a truncated cache behind. Nothing is loaded or saved unless configure is called with a path.
+ */
+class ProfileCache
+{
+public:
+    struct Entry
+    {
+        ResStats stats;
+        uint64_t iterations = 0;
+    };
+
+    static constexpr uint64_t kRefreshIterations = 10;
+
+    static ProfileCache &instance();
+
+    /**
+     * @brief Use file at path as the backing store, loading any entries it has.
+     * A missing file is fine, a malformed one throws std::runtime_error.
+     */
+    void configure(const std::string &path);
+
+    bool enabled() const;
+
+    std::optional<ResStats> lookup(uint64_t fingerprint) const;
+
+    /**
+     * @brief Remember stats learned over iterations for fingerprint. An entry learned over more iterations
+     * is only replaced by one learned over fewer once that has at least kRefreshIterations, so the first
+     * iterations of a run don't clobber it, but a changed footprint, e.g. another batch size for the
+     * same graph, is still picked up.
+     */
+    void record(uint64_t fingerprint, const ResStats &stats, uint64_t iterations);
+
+    /**
+     * @brief Write dirty entries to disk, at most once every save interval unless force is set
+     */
+    void save(bool force = false);
+
+    size_t size() const;
+
+    static std::string keyFor(uint64_t fingerprint);
+
+private:
+    using Clock = std::chrono::steady_clock;
+    static constexpr auto kSaveInterval = std::chrono::seconds(30);
+
+    ProfileCache() = default;
+
+    mutable std::mutex m_mu;
+    std::string m_path;
+    std::unordered_map<uint64_t, Entry> m_entries;
+    bool m_dirty = false;
+    Clock::time_point m_lastSave{};
+
+    // serializes file writes, which are done without holding m_mu
+    std::mutex m_saveMu;
+};
+
+#endif // SALUS_EXEC_PROFILECACHE_H
@@ -19,6 +19,7 @@
 
 #include "resources/resources.h"
 
+#include "resources/limitsprovider.h"
 #include "platform/logging.h"
 #include "utils/containerutils.h"
 #include "utils/threadutils.h"
@@ -96,7 +97,7 @@ std::string ResourceTag::DebugString() const
 std::string ResStats::DebugString() const
 {
     std::ostringstream oss;
-    oss << "ResStats(temporary=" << temporary << ", persist=" << persist << ", count=" << count << ")";
+    oss << "ResStats(temporary=" << temporary << ", persist=" << persist << ", count=" << count << ", largest=" << largest << ")";
     return oss.str();
 }
 
@@ -105,24 +106,31 @@ std::string ResourceMonitor::DebugString() const
     std::ostringstream oss;
     oss << "ResourceMonitor: dumping available resources" << std::endl;
 
-    auto g = sstl::with_guard(m_mu);
-
     oss << "    Available:" << std::endl;
-    oss << resources::DebugString(m_limits, "        ");
-
-    oss << "    Staging " << m_staging.size() << " tickets, in total:" << std::endl;
-    Resources total;
-    for (auto p : m_staging) {
-        resources::merge(total, p.second);
+    oss << available().DebugString("        ");
+
+    size_t numStaging = 0;
+    size_t numUsing = 0;
+    ResourceVector staging;
+    for (const auto &shard : m_shards) {
+        auto g = sstl::with_guard(shard.mu);
+        for (const auto &[ticket, state] : shard.tickets) {
+            UNUSED(ticket);
+            if (state.hasStaging) {
+                ++numStaging;
+                resources::merge(staging, state.staging);
+            }
+            if (!state.inuse.empty()) {
+                ++numUsing;
+            }
+        }
     }
-    oss << resources::DebugString(total, "       ");
 
-    oss << "    In use " << m_using.size() << " tickets, in total:" << std::endl;
-    total.clear();
-    for (auto p : m_using) {
-        resources::merge(total, p.second);
-    }
-    oss << resources::DebugString(total, "       ");
+    oss << "    Staging " << numStaging << " tickets, in total:" << std::endl;
+    oss << staging.DebugString("       ");
+
+    oss << "    In use " << numUsing << " tickets, in total:" << std::endl;
+    oss << inuse().DebugString("       ");
 
     return oss.str();
 }
@@ -229,43 +237,45 @@ std::string DebugString(const Resources &res, const std::string &indent)
     return oss.str();
 }
 
-Resources platformLimits()
-{
-    Resources res;
-    res[{ResourceType::MEMORY, devices::CPU0}] = 100_sz * 1024 * 1024 * 1024;
-
-    // 14 G for GPU 0
-    res[{ResourceType::MEMORY, devices::GPU0}] = 14_sz * 1024 * 1024 * 1024;
-
-    // 128 streams for GPU 0
-    res[{ResourceType::GPU_STREAM, devices::GPU0}] = 128;
-
-    res[{ResourceType::EXCLUSIVE, devices::GPU0}] = 1;
-
-    return res;
-}
-
 } // namespace resources
 
 using namespace resources;
 
 // Read limits from hardware, and capped by cap
 AllocationRegulator::AllocationRegulator()
+    : AllocationRegulator(Resources{})
 {
-    m_limits = resources::platformLimits();
 }
 
 AllocationRegulator::AllocationRegulator(const Resources &cap)
-    : AllocationRegulator()
 {
-    auto lend = m_limits.end();
+    initializeLimits(cap);
+}
+
+void AllocationRegulator::initializeLimits(const Resources &cap)
+{
+    auto limits = LimitsProvider::instance().limits();
+    auto lend = limits.end();
 
     for (auto [tag, val] : cap) {
-        auto it = m_limits.find(tag);
+        auto it = limits.find(tag);
         if (it != lend) {
             it->second = std::min(it->second, val);
         }
     }
+    auto g = sstl::with_guard(m_mu);
+    DCHECK(m_jobs.empty());
+    m_limits = ResourceVector(limits);
+    m_total = m_limits;
+}
+
+void AllocationRegulator::setQueueOptions(const QueueOptions &opts)
+{
+    auto g = sstl::with_guard(m_mu);
+    m_queueOpts = opts;
+    if (!m_queueOpts.enabled) {
+        m_waiters.clear();
+    }
 }
 
 AllocationRegulator::Ticket AllocationRegulator::registerJob()
@@ -278,16 +288,12 @@ AllocationRegulator::Ticket AllocationRegulator::registerJob()
 
 bool AllocationRegulator::Ticket::beginAllocation(const Resources &res)
 {
+    ResourceVector req(res);
     {
         auto g = sstl::with_guard(reg->m_mu);
-
-        if (!contains(reg->m_limits, res)) {
+        if (!reg->beginAllocation(*this, req)) {
             return false;
         }
-
-        subtract(reg->m_limits, res);
-
-        merge(reg->m_jobs[*this].inuse, res);
     }
     LogAlloc() << "Start session allocation hold: ticket=" << as_int
             << ", res=" << sstl::getOrDefault(res, resources::GPU0Memory, 0);
@@ -295,9 +301,88 @@ bool AllocationRegulator::Ticket::beginAllocation(const Resources &res)
     return true;
 }
 
+bool AllocationRegulator::beginAllocation(Ticket ticket, const ResourceVector &req)
+{
+    if (!m_queueOpts.enabled) {
+        if (!contains(m_limits, req)) {
+            return false;
+        }
+        subtract(m_limits, req);
+        merge(m_jobs[ticket].inuse, req);
+        return true;
+    }
+
+    auto now = Clock::now();
+    expireWaiters(now);
+
+    // Earmark free capacity for requests ahead in line. A waiter's share grows with its waiting time,
+    // so a fresh waiter still lets small requests through, while an old one gets everything freed.
+    auto avail = m_limits;
+    auto it = m_waiters.begin();
+    for (; it != m_waiters.end() && it->ticket != ticket; ++it) {
+        double share = 1.0;
+        if (m_queueOpts.aging.count() > 0) {
+            share = std::min(1.0, std::chrono::duration<double>(now - it->enqueued) / m_queueOpts.aging);
+        }
+        ResourceVector earmark;
+        for (auto m = it->req.presentMask(); m; m &= m - 1) {
+            auto i = __builtin_ctz(m);
+            auto val = std::min(it->req.get(i), avail.get(i));
+            earmark.set(i, static_cast<size_t>(val * share));
+        }
+        subtract(avail, earmark, true /* skipNonExist */);
+    }
+
+    if (contains(avail, req)) {
+        subtract(m_limits, req);
+        merge(m_jobs[ticket].inuse, req);
+        if (it != m_waiters.end()) {
+            VLOG(2) << "AllocationRegulator: ticket " << ticket.as_int << " leaves line after "
+                    << std::chrono::duration_cast<std::chrono::milliseconds>(now - it->enqueued).count() << "ms";
+            m_waiters.erase(it);
+        }
+        return true;
+    }
+
+    if (it != m_waiters.end()) {
+        it->req = req;
+        it->lastTry = now;
+    } else if (isLarge(req)) {
+        VLOG(2) << "AllocationRegulator: ticket " << ticket.as_int << " waits in line at position "
+                << m_waiters.size() << " for " << req;
+        m_waiters.push_back({ticket, req, now, now});
+    }
+    return false;
+}
+
+bool AllocationRegulator::isLarge(const ResourceVector &req) const
+{
+    for (auto m = req.presentMask(); m; m &= m - 1) {
+        auto i = __builtin_ctz(m);
+        if (req.get(i) > 0 && req.get(i) >= m_queueOpts.minFraction * m_total.get(i)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void AllocationRegulator::expireWaiters(Clock::time_point now)
+{
+    for (auto it = m_waiters.begin(); it != m_waiters.end();) {
+        if (now - it->lastTry > m_queueOpts.timeout) {
+            LOG(WARNING) << "AllocationRegulator: ticket " << it->ticket.as_int << " dropped from line, not retried in "
+                         << m_queueOpts.timeout.count() << "ms";
+            it = m_waiters.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 void AllocationRegulator::Ticket::endAllocation(const Resources &res)
 {
-    Resources released;
+    ResourceVector req(res);
+    ResourceVector released;
     {
         auto g = sstl::with_guard(reg->m_mu);
 
@@ -308,13 +393,13 @@ void AllocationRegulator::Ticket::endAllocation(const Resources &res)
         }
         auto &js = it->second;
 
-        released = subtractBounded(js.inuse, res);
+        released = subtractBounded(js.inuse, req);
 
         removeInvalid(js.inuse);
         merge(reg->m_limits, released);
     }
     LogAlloc() << "End session allocation hold: ticket=" << as_int
-            << ", res=" << sstl::getOrDefault(released, resources::GPU0Memory, 0);
+            << ", res=" << released.get(resources::GPU0Memory);
 }
 
 void AllocationRegulator::Ticket::finishJob()
@@ -325,6 +410,7 @@ void AllocationRegulator::Ticket::finishJob()
         merge(reg->m_limits, it->second.inuse);
         reg->m_jobs.erase(it);
     }
+    reg->m_waiters.remove_if([this](const auto &w) { return w.ticket == *this; });
 }
 
 std::string AllocationRegulator::DebugString() const
@@ -338,55 +424,128 @@ std::string AllocationRegulator::DebugString() const
     for (const auto &[ticket, state] : m_jobs) {
         oss << "      " << ticket.as_int << " -> " << state.inuse;
     }
+    if (!m_waiters.empty()) {
+        oss << "    Waiting in line:" << std::endl;
+        for (const auto &w : m_waiters) {
+            oss << "      " << w.ticket.as_int << " -> " << w.req;
+        }
+    }
     oss << ")";
     return oss.str();
 }
 
 void ResourceMonitor::initializeLimits()
 {
-    auto g = sstl::with_guard(m_mu);
-
-    m_limits = resources::platformLimits();
+    initializeLimits({});
 }
 
 void ResourceMonitor::initializeLimits(const Resources &cap)
 {
-    initializeLimits();
-
-    auto g = sstl::with_guard(m_mu);
+    auto limits = LimitsProvider::instance().limits();
 
-    auto lend = m_limits.end();
+    auto lend = limits.end();
 
     ResourceTag tag{};
     size_t val;
     for (auto p : cap) {
         std::tie(tag, val) = p;
-        auto it = m_limits.find(tag);
+        auto it = limits.find(tag);
         if (it != lend) {
             it->second = std::min(it->second, val);
         }
     }
+
+    // Not expected to run concurrently with other operations
+    ResourceVector vec(limits);
+    for (size_t i = 0; i != ResourceVector::kSlots; ++i) {
+        m_avail[i].value.store(vec.get(i), std::memory_order_relaxed);
+    }
+    m_availPresent = vec.presentMask();
+    m_capacity = std::move(limits);
+}
+
+bool ResourceMonitor::tryReserve(const ResourceVector &res)
+{
+    ResourceVector::Mask reserved = 0;
+    for (auto m = res.presentMask(); m; m &= m - 1) {
+        auto i = __builtin_ctz(m);
+        auto val = res.get(i);
+        auto &counter = m_avail[i].value;
+        auto cur = counter.load(std::memory_order_relaxed);
+        do {
+            if (cur < val) {
+                // roll back what is already taken
+                for (auto r = reserved; r; r &= r - 1) {
+                    auto j = __builtin_ctz(r);
+                    m_avail[j].value.fetch_add(res.get(j), std::memory_order_relaxed);
+                }
+                return false;
+            }
+        } while (!counter.compare_exchange_weak(cur, cur - val, std::memory_order_acq_rel,
+                                                std::memory_order_relaxed));
+        reserved |= ResourceVector::Mask{1} << i;
+    }
+    return true;
+}
+
+void ResourceMonitor::release(const ResourceVector &res)
+{
+    for (auto m = res.presentMask(); m; m &= m - 1) {
+        auto i = __builtin_ctz(m);
+        m_avail[i].value.fetch_add(res.get(i), std::memory_order_release);
+    }
+}
+
+ResourceVector ResourceMonitor::available() const
+{
+    ResourceVector res;
+    for (auto m = m_availPresent; m; m &= m - 1) {
+        auto i = __builtin_ctz(m);
+        res.set(i, m_avail[i].value.load(std::memory_order_acquire));
+    }
+    return res;
+}
+
+ResourceVector ResourceMonitor::inuse() const
+{
+    ResourceVector res;
+    for (const auto &shard : m_shards) {
+        auto g = sstl::with_guard(shard.mu);
+        merge(res, shard.inuse);
+    }
+    return res;
+}
+
+Resources ResourceMonitor::totalUsage() const
+{
+    auto res = inuse();
+    removeInvalid(res);
+    return res.toResources();
 }
 
-std::optional<uint64_t> ResourceMonitor::preAllocate(const Resources &req, Resources *missing)
+std::optional<uint64_t> ResourceMonitor::preAllocate(const Resources &res, Resources *missing)
 {
     // TODO: check ticket
 
-    auto g = sstl::with_guard(m_mu);
-    if (!contains(m_limits, req)) {
+    ResourceVector req(res);
+
+    if (!tryReserve(req)) {
         if (missing) {
-            *missing = req;
-            subtract(*missing, m_limits, true /* skipNonExist */);
-            removeInvalid(*missing);
+            auto m = req;
+            subtract(m, available(), true /* skipNonExist */);
+            removeInvalid(m);
+            *missing = m.toResources();
         }
         return {};
     }
 
-    auto ticket = ++m_nextTicket;
+    auto ticket = m_nextTicket.fetch_add(1, std::memory_order_relaxed) + 1;
 
-    // Allocate
-    subtract(m_limits, req);
-    m_staging[ticket] = req;
+    auto &shard = shardFor(ticket);
+    auto g = sstl::with_guard(shard.mu);
+    auto &state = shard.tickets[ticket];
+    state.staging = req;
+    state.hasStaging = true;
 
     return ticket;
 }
@@ -398,59 +557,66 @@ bool ResourceMonitor::allocate(uint64_t ticket, const Resources &res)
         return false;
     }
 
-    auto g = sstl::with_uguard(m_mu);
-    return allocateUnsafe(ticket, res);
+    ResourceVector req(res);
+
+    auto &shard = shardFor(ticket);
+    auto g = sstl::with_guard(shard.mu);
+    return allocateUnsafe(shard, ticket, req);
 }
 
 bool ResourceMonitor::LockedProxy::allocate(uint64_t ticket, const Resources &res)
 {
-    assert(m_resMonitor);
+    DCHECK(m_resMonitor);
+    DCHECK_EQ(ticket % kTicketShards, m_ticket % kTicketShards);
     if (ticket == 0) {
         LOG(ERROR) << "Invalid ticket 0";
         return false;
     }
 
-    return m_resMonitor->allocateUnsafe(ticket, res);
+    return m_resMonitor->allocateUnsafe(m_resMonitor->shardFor(ticket), ticket, ResourceVector(res));
 }
 
-bool ResourceMonitor::allocateUnsafe(uint64_t ticket, const Resources &res)
+bool ResourceMonitor::allocateUnsafe(TicketShard &shard, uint64_t ticket, const ResourceVector &res)
 {
     auto remaining(res);
-    auto it = m_staging.find(ticket);
-    if (it != m_staging.end()) {
+    auto it = shard.tickets.find(ticket);
+    const bool staged = it != shard.tickets.end() && it->second.hasStaging;
+    if (staged) {
+        auto &staging = it->second.staging;
         // first try allocate from reserve
-        if (contains(it->second, remaining)) {
-            subtract(it->second, remaining);
-            merge(m_using[ticket], remaining);
+        if (contains(staging, remaining)) {
+            subtract(staging, remaining);
+            merge(it->second.inuse, remaining);
+            merge(shard.inuse, remaining);
             return true;
         }
 
         // pre-allocation is not enough, see how much we need
         // to request from global avail...
-        subtract(remaining, it->second, true /*skipNonExist*/);
+        subtract(remaining, staging, true /*skipNonExist*/);
     }
 
     removeInvalid(remaining);
 
     // ... then try from global avail
-    if (!contains(m_limits, remaining)) {
+    if (!tryReserve(remaining)) {
         return false;
     }
 
-    if (it != m_staging.end()) {
+    if (staged) {
         // actual subtract from staging
         auto fromStaging(res);
         subtract(fromStaging, remaining);
         removeInvalid(fromStaging);
-        assert(contains(it->second, fromStaging));
-        subtract(it->second, fromStaging);
+        assert(contains(it->second.staging, fromStaging));
+        subtract(it->second.staging, fromStaging);
+    } else if (it == shard.tickets.end()) {
+        it = shard.tickets.try_emplace(ticket).first;
     }
 
-    // actual subtract from global
-    subtract(m_limits, remaining);
-
     // add to used
-    merge(m_using[ticket], res);
+    merge(it->second.inuse, res);
+    merge(shard.inuse, res);
 
     return true;
 }
@@ -463,63 +629,110 @@ void ResourceMonitor::freeStaging(uint64_t ticket)
         return;
     }
 
-    auto g = sstl::with_uguard(m_mu);
+    auto &shard = shardFor(ticket);
+    auto g = sstl::with_uguard(shard.mu);
 
-    auto it = m_staging.find(ticket);
-    if (it == m_staging.end()) {
+    auto it = shard.tickets.find(ticket);
+    if (it == shard.tickets.end() || !it->second.hasStaging) {
         g.unlock();
         LOG(ERROR) << "Unknown ticket for freeStaging: " << ticket;
         return;
     }
 
-    merge(m_limits, it->second);
-    m_staging.erase(it);
+    release(it->second.staging);
+    it->second.staging.clear();
+    it->second.hasStaging = false;
+    if (it->second.inuse.empty()) {
+        shard.tickets.erase(it);
+    }
 }
 
 bool ResourceMonitor::free(uint64_t ticket, const Resources &res)
 {
-    auto g = sstl::with_guard(m_mu);
-    return freeUnsafe(ticket, res);
+    ResourceVector req(res);
+
+    auto &shard = shardFor(ticket);
+    auto g = sstl::with_guard(shard.mu);
+    return freeUnsafe(shard, ticket, req);
 }
 
 bool ResourceMonitor::LockedProxy::free(uint64_t ticket, const Resources &res)
 {
-    assert(m_resMonitor);
-    return m_resMonitor->freeUnsafe(ticket, res);
+    DCHECK(m_resMonitor);
+    DCHECK_EQ(ticket % kTicketShards, m_ticket % kTicketShards);
+    return m_resMonitor->freeUnsafe(m_resMonitor->shardFor(ticket), ticket, ResourceVector(res));
 }
 
 std::optional<Resources> ResourceMonitor::LockedProxy::queryStaging(uint64_t ticket) const
 {
     DCHECK(m_resMonitor);
-    return m_resMonitor->queryStagingUnsafe(ticket);
+    DCHECK_EQ(ticket % kTicketShards, m_ticket % kTicketShards);
+    return m_resMonitor->queryStagingUnsafe(m_resMonitor->shardFor(ticket), ticket);
 }
 
-bool ResourceMonitor::freeUnsafe(uint64_t ticket, const Resources &res)
+bool ResourceMonitor::freeUnsafe(TicketShard &shard, uint64_t ticket, const ResourceVector &res)
 {
     // Ticket can not be 0 when free actual resource to prevent
     // monitor go out of sync of physical usage.
     DCHECK_NE(ticket, 0);
 
-    merge(m_limits, res);
+    release(res);
 
-    auto it = m_using.find(ticket);
-    DCHECK_NE(it, m_using.end());
+    auto it = shard.tickets.find(ticket);
+    DCHECK(it != shard.tickets.end());
 
-    DCHECK(contains(it->second, res));
+    auto &inuse = it->second.inuse;
+    DCHECK(contains(inuse, res));
 
-    subtract(it->second, res);
-    removeInvalid(it->second);
-    if (it->second.empty()) {
-        m_using.erase(it);
+    subtract(inuse, res);
+    removeInvalid(inuse);
+    subtract(shard.inuse, res);
+    if (inuse.empty()) {
+        if (!it->second.hasStaging) {
+            shard.tickets.erase(it);
+        }
         return true;
     }
     return false;
 }
 
-std::optional<Resources> ResourceMonitor::queryStagingUnsafe(uint64_t ticket) const
+std::optional<Resources> ResourceMonitor::queryStagingUnsafe(const TicketShard &shard, uint64_t ticket) const
 {
     DCHECK_NE(ticket, 0);
-    return sstl::optionalGet(m_staging, ticket);
+    auto it = shard.tickets.find(ticket);
+    if (it == shard.tickets.end() || !it->second.hasStaging) {
+        return {};
+    }
+    return it->second.staging.toResources();
+}
+
+template<typename Fn>
+void ResourceMonitor::forEachTicket(const std::unordered_set<uint64_t> &tickets, Fn &&fn) const
+{
+    // bucket tickets by shard in one counting pass
+    std::array<size_t, kTicketShards + 1> offsets{};
+    for (auto t : tickets) {
+        ++offsets[t % kTicketShards + 1];
+    }
+    for (size_t i = 1; i != offsets.size(); ++i) {
+        offsets[i] += offsets[i - 1];
+    }
+    std::vector<uint64_t> bucketed(tickets.size());
+    auto next = offsets;
+    for (auto t : tickets) {
+        bucketed[next[t % kTicketShards]++] = t;
+    }
+
+    for (size_t i = 0; i != kTicketShards; ++i) {
+        if (offsets[i] == offsets[i + 1]) {
+            continue;
+        }
+        auto &shard = m_shards[i];
+        auto g = sstl::with_guard(shard.mu);
+        for (auto j = offsets[i]; j != offsets[i + 1]; ++j) {
+            fn(shard, bucketed[j]);
+        }
+    }
 }
 
 std::vector<std::pair<size_t, uint64_t>> ResourceMonitor::sortVictim(
@@ -531,21 +744,21 @@ std::vector<std::pair<size_t, uint64_t>> ResourceMonitor::sortVictim(
     usages.reserve(candidates.size());
 
     // TODO: currently only select based on GPU memory usage, generalize to all resources
-    ResourceTag tag{ResourceType::MEMORY, devices::GPU0};
-    {
-        auto g = sstl::with_guard(m_mu);
-        for (auto &ticket : candidates) {
-            auto usagemap = sstl::optionalGet(m_using, ticket);
-            if (!usagemap) {
-                continue;
-            }
-            auto gpuusage = sstl::optionalGet(usagemap, tag);
-            if (!gpuusage || *gpuusage == 0) {
-                continue;
-            }
-            usages.emplace_back(*gpuusage, ticket);
-        }
+    auto slot = ResourceTagRegistry::find({ResourceType::MEMORY, devices::GPU0});
+    if (!slot) {
+        return usages;
     }
+    forEachTicket(candidates, [&usages, slot = *slot](const auto &shard, auto ticket) {
+        auto it = shard.tickets.find(ticket);
+        if (it == shard.tickets.end()) {
+            return;
+        }
+        auto gpuusage = it->second.inuse.get(slot);
+        if (gpuusage == 0) {
+            return;
+        }
+        usages.emplace_back(gpuusage, ticket);
+    });
 
     std::sort(usages.begin(), usages.end(), [](const auto &lhs, const auto &rhs) {
         return lhs > rhs;
@@ -555,22 +768,30 @@ std::vector<std::pair<size_t, uint64_t>> ResourceMonitor::sortVictim(
 
 Resources ResourceMonitor::queryUsages(const std::unordered_set<uint64_t> &tickets) const
 {
-    auto g = sstl::with_guard(m_mu);
-    Resources res;
-    for (auto t : tickets) {
-        merge(res, sstl::getOrDefault(m_using, t, {}));
-    }
-    return res;
+    ResourceVector res;
+    forEachTicket(tickets, [&res](const auto &shard, auto ticket) {
+        if (auto it = shard.tickets.find(ticket); it != shard.tickets.end()) {
+            merge(res, it->second.inuse);
+        }
+    });
+    return res.toResources();
 }
 
 optional<Resources> ResourceMonitor::queryUsage(uint64_t ticket) const
 {
-    auto g = sstl::with_guard(m_mu);
-    return sstl::optionalGet(m_using, ticket);
+    auto &shard = shardFor(ticket);
+    auto g = sstl::with_guard(shard.mu);
+    auto it = shard.tickets.find(ticket);
+    if (it == shard.tickets.end() || it->second.inuse.empty()) {
+        return {};
+    }
+    return it->second.inuse.toResources();
 }
 
 bool ResourceMonitor::hasUsage(uint64_t ticket) const
 {
-    auto g = sstl::with_guard(m_mu);
-    return m_using.count(ticket) > 0;
+    auto &shard = shardFor(ticket);
+    auto g = sstl::with_guard(shard.mu);
+    auto it = shard.tickets.find(ticket);
+    return it != shard.tickets.end() && !it->second.inuse.empty();
 }
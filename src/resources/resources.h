@@ -20,12 +20,17 @@
 #ifndef SALUS_EXEC_RESOURCES_H
 #define SALUS_EXEC_RESOURCES_H
 
+#include "resources/resourcetag.h"
+#include "resources/resourcevector.h"
 #include "execution/devices.h"
 #include "utils/macros.h"
 #include "utils/pointerutils.h"
 #include "utils/threadutils.h"
 #include "platform/thread_annotations.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <list>
 #include <mutex>
 #include <unordered_map>
@@ -33,68 +38,6 @@
 #include <vector>
 #include <optional>
 
-enum class ResourceType
-{
-    COMPUTE,
-    MEMORY,
-    GPU_STREAM,
-    /**
-     * @brief A special type of resource that has only 1 unit of it.
-     */
-    EXCLUSIVE,
-
-    UNKNOWN = 1000,
-};
-
-std::string enumToString(const ResourceType &rt);
-ResourceType resourceTypeFromString(const std::string &rt);
-
-struct ResourceTag
-{
-    ResourceType type;
-    salus::DeviceSpec device;
-
-    static ResourceTag fromString(const std::string &str);
-
-    std::string DebugString() const;
-
-private:
-    friend bool operator==(const ResourceTag &lhs, const ResourceTag &rhs);
-    friend bool operator!=(const ResourceTag &lhs, const ResourceTag &rhs);
-
-    auto tie() const
-    {
-        return std::tie(type, device);
-    }
-};
-
-inline bool operator==(const ResourceTag &lhs, const ResourceTag &rhs)
-{
-    return lhs.tie() == rhs.tie();
-}
-
-inline bool operator!=(const ResourceTag &lhs, const ResourceTag &rhs)
-{
-    return lhs.tie() != rhs.tie();
-}
-
-namespace std {
-template<>
-class hash<ResourceTag>
-{
-public:
-    inline size_t operator()(const ResourceTag &tag) const
-    {
-        size_t res = 0;
-        sstl::hash_combine(res, tag.type);
-        sstl::hash_combine(res, tag.device);
-        return res;
-    }
-};
-} // namespace std
-
-using Resources = std::unordered_map<ResourceTag, size_t>;
-
 namespace resources {
 /**
  * @brief Whether 'avail' contains 'req'
@@ -185,6 +128,11 @@ struct ResStats
      */
     size_t count = 0;
 
+    /**
+     * @brief Largest single allocation, which must fit in one contiguous free block
+     */
+    size_t largest = 0;
+
     std::string DebugString() const;
 };
 /**
@@ -245,11 +193,42 @@ public:
     };
 
     AllocationRegulator();
-    // Read limits from hardware, and capped by cap
+    // Read limits from LimitsProvider, and capped by cap
     explicit AllocationRegulator(const Resources &cap);
 
     ~AllocationRegulator() = default;
 
+    /**
+     * @brief Read limits from LimitsProvider again, capped by cap. Only meant to be called before any
+     * job is registered, e.g. once GPU memory is discovered.
+     */
+    void initializeLimits(const Resources &cap = {});
+
+    /**
+     * @brief Options of the reservation queue. When enabled, a failed beginAllocation puts the
+     * request in line, and later requests may only use what is left after earmarking free capacity
+     * for requests ahead of them. Callers still retry beginAllocation as before.
+     */
+    struct QueueOptions
+    {
+        bool enabled = false;
+        /**
+         * @brief Only requests of at least this fraction of total capacity of some resource get in line
+         */
+        double minFraction = 0.0;
+        /**
+         * @brief A waiting request earmarks a growing share of free capacity, reaching all it needs
+         * after waiting this long. 0 means earmark everything right away (strict FIFO).
+         */
+        std::chrono::milliseconds aging{0};
+        /**
+         * @brief A request is dropped from the line if not retried for this long
+         */
+        std::chrono::milliseconds timeout{5000};
+    };
+
+    void setQueueOptions(const QueueOptions &opts);
+
     /**
      * @brief Register and get a ticket that can be used to start
      * allocation phases
@@ -259,15 +238,33 @@ public:
     std::string DebugString() const;
 
 private:
+    using Clock = std::chrono::steady_clock;
+
+    bool beginAllocation(Ticket ticket, const ResourceVector &req) EXCLUSIVE_LOCKS_REQUIRED(m_mu);
+    void expireWaiters(Clock::time_point now) EXCLUSIVE_LOCKS_REQUIRED(m_mu);
+    bool isLarge(const ResourceVector &req) const EXCLUSIVE_LOCKS_REQUIRED(m_mu);
+
     mutable std::mutex m_mu;
 
     uint64_t m_next = 0 GUARDED_BY(m_mu);
 
-    Resources m_limits GUARDED_BY(m_mu);
+    ResourceVector m_limits GUARDED_BY(m_mu);
+    ResourceVector m_total GUARDED_BY(m_mu);
+
+    QueueOptions m_queueOpts GUARDED_BY(m_mu);
+
+    struct Waiter
+    {
+        Ticket ticket;
+        ResourceVector req;
+        Clock::time_point enqueued;
+        Clock::time_point lastTry;
+    };
+    std::list<Waiter> m_waiters GUARDED_BY(m_mu);
 
     struct JobState
     {
-        Resources inuse;
+        ResourceVector inuse;
     };
 
     struct TicketHasher
@@ -284,18 +281,24 @@ private:
 
 /**
  * A monitor of resources. This class is thread-safe.
+ *
+ * Available resources are kept as one atomic counter per resource tag (i.e. sharded by device),
+ * reserved with CAS without any lock. Per ticket staging and in-use resources are kept in
+ * a fixed number of ticket shards, each with its own lock.
  */
 class ResourceMonitor
 {
+    struct TicketShard;
+
 public:
     ResourceMonitor() = default;
 
     /**
-     * @brief Read limits from hardware
+     * @brief Read limits from LimitsProvider
      */
     void initializeLimits();
     /**
-     * @brief Read limits from hardware, and capped by cap
+     * @brief Read limits from LimitsProvider, and capped by cap
      */
     void initializeLimits(const Resources &cap);
 
@@ -324,25 +327,49 @@ public:
      */
     bool free(uint64_t ticket, const Resources &res);
 
+    /**
+     * @brief Candidates holding GPU memory, in descending order of usage.
+     * Each shard is locked once, however many candidates it has.
+     */
     std::vector<std::pair<size_t, uint64_t>> sortVictim(const std::unordered_set<uint64_t> &candidates) const;
 
     Resources queryUsages(const std::unordered_set<uint64_t> &tickets) const;
 
+    /**
+     * @brief In-use resources summed over all tickets, from per shard totals maintained as tickets
+     * allocate and free. Not consistent with concurrent allocations.
+     */
+    Resources totalUsage() const;
+
     std::optional<Resources> queryUsage(uint64_t ticket) const;
     bool hasUsage(uint64_t ticket) const;
 
+    /**
+     * @brief Total resources managed by this monitor, as set by initializeLimits.
+     * This does not change after initialization, thus no locking is needed.
+     */
+    const Resources &capacity() const
+    {
+        return m_capacity;
+    }
+
+    /**
+     * @brief Holds the lock of one ticket's shard, so a sequence of operations on that ticket is atomic.
+     */
     struct LockedProxy
     {
         SALUS_DISALLOW_COPY_AND_ASSIGN(LockedProxy);
 
-        explicit LockedProxy(sstl::not_null<ResourceMonitor*> resMon)
+        explicit LockedProxy(sstl::not_null<ResourceMonitor*> resMon, uint64_t ticket)
             : m_resMonitor(resMon)
-            , m_ug(sstl::with_uguard(m_resMonitor->m_mu))
+            , m_ticket(ticket)
+            , m_ug(sstl::with_uguard(m_resMonitor->shardFor(ticket).mu))
         {
         }
 
         LockedProxy(LockedProxy &&other) noexcept
             : m_resMonitor(other.m_resMonitor)
+            , m_ticket(other.m_ticket)
             , m_ug(std::move(other.m_ug))
         {
             other.m_resMonitor = nullptr;
@@ -353,6 +380,8 @@ public:
             release();
             using std::swap;
             swap(m_resMonitor, other.m_resMonitor);
+            swap(m_ticket, other.m_ticket);
+            swap(m_ug, other.m_ug);
             return *this;
         }
 
@@ -377,40 +406,99 @@ public:
         }
 
         ResourceMonitor *m_resMonitor;
+        uint64_t m_ticket;
         sstl::detail::UGuard m_ug;
     };
 
-    LockedProxy lock()
+    LockedProxy lock(uint64_t ticket)
     {
-        return LockedProxy(this);
+        return LockedProxy(this, ticket);
     }
 
     std::string DebugString() const;
 
 private:
-    bool allocateUnsafe(uint64_t ticket, const Resources &res);
-    bool freeUnsafe(uint64_t ticket, const Resources &res);
-    std::optional<Resources> queryStagingUnsafe(uint64_t ticket) const;
+    bool allocateUnsafe(TicketShard &shard, uint64_t ticket, const ResourceVector &res);
+    bool freeUnsafe(TicketShard &shard, uint64_t ticket, const ResourceVector &res);
+    std::optional<Resources> queryStagingUnsafe(const TicketShard &shard, uint64_t ticket) const;
 
-    mutable std::mutex m_mu;
+    /**
+     * @brief Atomically take res from available resources, all or nothing.
+     */
+    bool tryReserve(const ResourceVector &res);
+    /**
+     * @brief Return res to available resources
+     */
+    void release(const ResourceVector &res);
+    /**
+     * @brief Snapshot of available resources, not consistent with concurrent reservations
+     */
+    ResourceVector available() const;
 
-    // 0 is invalid ticket
-    uint64_t m_nextTicket = 1;
+    /**
+     * @brief Sum of per shard in-use totals
+     */
+    ResourceVector inuse() const;
+
+    struct TicketState
+    {
+        /**
+         * @brief Staging resources
+         */
+        ResourceVector staging;
+        bool hasStaging = false;
+
+        /**
+         * @brief In-use resources
+         */
+        ResourceVector inuse;
+    };
+
+    struct alignas(64) TicketShard
+    {
+        mutable std::mutex mu;
+        std::unordered_map<uint64_t, TicketState> tickets GUARDED_BY(mu);
+        // sum of inuse of all tickets in this shard
+        ResourceVector inuse GUARDED_BY(mu);
+    };
+
+    static constexpr size_t kTicketShards = 16;
+
+    TicketShard &shardFor(uint64_t ticket)
+    {
+        return m_shards[ticket % kTicketShards];
+    }
+
+    const TicketShard &shardFor(uint64_t ticket) const
+    {
+        return m_shards[ticket % kTicketShards];
+    }
 
     /**
-     * @brief Available resources
+     * @brief Call fn(shard, ticket) for every ticket, holding the lock of each shard only once
      */
-    Resources m_limits;
+    template<typename Fn>
+    void forEachTicket(const std::unordered_set<uint64_t> &tickets, Fn &&fn) const;
+
+    // 0 is invalid ticket
+    std::atomic<uint64_t> m_nextTicket{1};
 
     /**
-     * @brief Staging resources
+     * @brief Available resources, one counter per resource tag slot
      */
-    std::unordered_map<uint64_t, Resources> m_staging;
+    struct alignas(64) Counter
+    {
+        std::atomic<uint64_t> value{0};
+    };
+    std::array<Counter, ResourceVector::kSlots> m_avail;
+    ResourceVector::Mask m_availPresent = 0;
 
     /**
-     * @brief In-use resources
+     * @brief Total resources
      */
-    std::unordered_map<uint64_t, Resources> m_using;
+    Resources m_capacity;
+
+    std::array<TicketShard, kTicketShards> m_shards;
 };
 
 #endif // SALUS_EXEC_RESOURCES_H
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_EXEC_RESOURCETAG_H
+#define SALUS_EXEC_RESOURCETAG_H
+
+#include "execution/devices.h"
+#include "utils/macros.h"
+
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+enum class ResourceType
+{
+    COMPUTE,
+    MEMORY,
+    GPU_STREAM,
+    /**
+     * @brief A special type of resource that has only 1 unit of it.
+     */
+    EXCLUSIVE,
+
+    UNKNOWN = 1000,
+};
+
+std::string enumToString(const ResourceType &rt);
+ResourceType resourceTypeFromString(const std::string &rt);
+
+struct ResourceTag
+{
+    ResourceType type;
+    salus::DeviceSpec device;
+
+    static ResourceTag fromString(const std::string &str);
+
+    std::string DebugString() const;
+
+private:
+    friend bool operator==(const ResourceTag &lhs, const ResourceTag &rhs);
+    friend bool operator!=(const ResourceTag &lhs, const ResourceTag &rhs);
+
+    auto tie() const
+    {
+        return std::tie(type, device);
+    }
+};
+
+inline bool operator==(const ResourceTag &lhs, const ResourceTag &rhs)
+{
+    return lhs.tie() == rhs.tie();
+}
+
+inline bool operator!=(const ResourceTag &lhs, const ResourceTag &rhs)
+{
+    return lhs.tie() != rhs.tie();
+}
+
+namespace std {
+template<>
+class hash<ResourceTag>
+{
+public:
+    inline size_t operator()(const ResourceTag &tag) const
+    {
+        size_t res = 0;
+        sstl::hash_combine(res, tag.type);
+        sstl::hash_combine(res, tag.device);
+        return res;
+    }
+};
+} // namespace std
+
+using Resources = std::unordered_map<ResourceTag, size_t>;
+
+#endif // SALUS_EXEC_RESOURCETAG_H
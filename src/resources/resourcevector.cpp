@@ -0,0 +1,151 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resources/resourcevector.h"
+
+#include "platform/logging.h"
+#include "utils/threadutils.h"
+
+#include <atomic>
+#include <mutex>
+#include <sstream>
+
+namespace {
+
+class TagTable
+{
+public:
+    static TagTable &instance()
+    {
+        static TagTable table;
+        return table;
+    }
+
+    std::optional<size_t> find(const ResourceTag &tag) const
+    {
+        auto size = m_size.load(std::memory_order_acquire);
+        for (size_t i = 0; i != size; ++i) {
+            if (m_tags[i] == tag) {
+                return i;
+            }
+        }
+        return {};
+    }
+
+    size_t slotFor(const ResourceTag &tag)
+    {
+        if (auto slot = find(tag)) {
+            return *slot;
+        }
+
+        auto g = sstl::with_guard(m_mu);
+        // recheck, somebody else may have registered it
+        if (auto slot = find(tag)) {
+            return *slot;
+        }
+        auto size = m_size.load(std::memory_order_relaxed);
+        CHECK_LT(size, ResourceTagRegistry::kMaxSlots) << "Too many resource tags, can not register " << tag.DebugString();
+        m_tags[size] = tag;
+        m_size.store(size + 1, std::memory_order_release);
+        return size;
+    }
+
+    const ResourceTag &tagAt(size_t slot) const
+    {
+        DCHECK_LT(slot, m_size.load(std::memory_order_acquire));
+        return m_tags[slot];
+    }
+
+    size_t size() const
+    {
+        return m_size.load(std::memory_order_acquire);
+    }
+
+private:
+    std::mutex m_mu;
+    // append only, entries below m_size never change
+    std::array<ResourceTag, ResourceTagRegistry::kMaxSlots> m_tags{};
+    std::atomic<size_t> m_size{0};
+};
+
+} // namespace
+
+/*static*/ size_t ResourceTagRegistry::slotFor(const ResourceTag &tag)
+{
+    return TagTable::instance().slotFor(tag);
+}
+
+/*static*/ std::optional<size_t> ResourceTagRegistry::find(const ResourceTag &tag)
+{
+    return TagTable::instance().find(tag);
+}
+
+/*static*/ const ResourceTag &ResourceTagRegistry::tagAt(size_t slot)
+{
+    return TagTable::instance().tagAt(slot);
+}
+
+/*static*/ size_t ResourceTagRegistry::size()
+{
+    return TagTable::instance().size();
+}
+
+ResourceVector::ResourceVector(const Resources &res)
+{
+    for (const auto &[tag, val] : res) {
+        auto slot = ResourceTagRegistry::slotFor(tag);
+        m_values[slot] = val;
+        m_present |= Mask{1} << slot;
+    }
+}
+
+Resources ResourceVector::toResources() const
+{
+    Resources res;
+    for (size_t i = 0; i != kSlots; ++i) {
+        if (has(i)) {
+            res.emplace(ResourceTagRegistry::tagAt(i), m_values[i]);
+        }
+    }
+    return res;
+}
+
+size_t ResourceVector::get(const ResourceTag &tag) const
+{
+    auto slot = ResourceTagRegistry::find(tag);
+    return slot ? m_values[*slot] : 0;
+}
+
+void ResourceVector::set(const ResourceTag &tag, size_t val)
+{
+    auto slot = ResourceTagRegistry::slotFor(tag);
+    m_values[slot] = val;
+    m_present |= Mask{1} << slot;
+}
+
+std::string ResourceVector::DebugString(const std::string &indent) const
+{
+    std::ostringstream oss;
+    for (size_t i = 0; i != kSlots; ++i) {
+        if (has(i)) {
+            oss << indent << ResourceTagRegistry::tagAt(i).DebugString() << " -> " << m_values[i] << std::endl;
+        }
+    }
+    return oss.str();
+}
@@ -0,0 +1,259 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_EXEC_RESOURCEVECTOR_H
+#define SALUS_EXEC_RESOURCEVECTOR_H
+
+#include "resources/resourcetag.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * @brief Assigns each ResourceTag a dense slot index.
+ *
+ * The set of tags (ResourceType x device) is small and fixed once the server starts,
+ * so slots are never reused. Registering is serialized, lookup is lock-free.
+ */
+class ResourceTagRegistry
+{
+public:
+    static constexpr size_t kMaxSlots = 32;
+
+    /**
+     * @brief Slot for tag, registering it if not yet known. Fails hard if out of slots.
+     */
+    static size_t slotFor(const ResourceTag &tag);
+
+    /**
+     * @brief Slot for tag, or empty if the tag was never registered.
+     */
+    static std::optional<size_t> find(const ResourceTag &tag);
+
+    static const ResourceTag &tagAt(size_t slot);
+
+    static size_t size();
+};
+
+class ResourceVector;
+
+namespace resources {
+inline bool contains(const ResourceVector &avail, const ResourceVector &req);
+inline ResourceVector &merge(ResourceVector &lhs, const ResourceVector &rhs, bool skipNonExist = false);
+inline ResourceVector &subtract(ResourceVector &lhs, const ResourceVector &rhs, bool skipNonExist = false);
+inline ResourceVector subtractBounded(ResourceVector &lhs, const ResourceVector &rhs);
+inline ResourceVector &removeInvalid(ResourceVector &lhs);
+} // namespace resources
+
+/**
+ * @brief Dense form of Resources, with one fixed slot per registered ResourceTag.
+ *
+ * Slots not present hold 0, so element-wise operations don't need to look at the presence mask,
+ * which is only used to keep the same semantics as the map form (e.g. skipNonExist, empty()).
+ * Use this on hot paths and convert at API boundaries.
+ */
+class ResourceVector
+{
+public:
+    static constexpr size_t kSlots = ResourceTagRegistry::kMaxSlots;
+    using Mask = uint32_t;
+    static_assert(sizeof(Mask) * 8 >= kSlots, "Mask too small");
+
+    ResourceVector() noexcept = default;
+    explicit ResourceVector(const Resources &res);
+
+    Resources toResources() const;
+
+    size_t get(const ResourceTag &tag) const;
+    size_t get(size_t slot) const
+    {
+        return m_values[slot];
+    }
+
+    void set(const ResourceTag &tag, size_t val);
+
+    void set(size_t slot, size_t val)
+    {
+        m_values[slot] = val;
+        m_present |= Mask{1} << slot;
+    }
+
+    Mask presentMask() const
+    {
+        return m_present;
+    }
+
+    bool has(size_t slot) const
+    {
+        return m_present & (Mask{1} << slot);
+    }
+
+    bool empty() const
+    {
+        return m_present == 0;
+    }
+
+    void clear()
+    {
+        m_values.fill(0);
+        m_present = 0;
+    }
+
+    std::string DebugString(const std::string &indent = "") const;
+
+private:
+    friend bool resources::contains(const ResourceVector &avail, const ResourceVector &req);
+    friend ResourceVector &resources::merge(ResourceVector &lhs, const ResourceVector &rhs, bool skipNonExist);
+    friend ResourceVector &resources::subtract(ResourceVector &lhs, const ResourceVector &rhs, bool skipNonExist);
+    friend ResourceVector resources::subtractBounded(ResourceVector &lhs, const ResourceVector &rhs);
+    friend ResourceVector &resources::removeInvalid(ResourceVector &lhs);
+
+    alignas(32) std::array<uint64_t, kSlots> m_values{};
+    Mask m_present = 0;
+};
+
+inline std::ostream &operator<<(std::ostream &out, const ResourceVector &res)
+{
+    return out << res.DebugString();
+}
+
+namespace resources {
+
+/**
+ * @brief Whether 'avail' contains 'req'. Same semantics as the Resources version.
+ */
+inline bool contains(const ResourceVector &avail, const ResourceVector &req)
+{
+#if defined(__AVX2__)
+    // AVX2 only has signed 64-bit compare, flip the sign bit to compare unsigned
+    const auto bias = _mm256_set1_epi64x(static_cast<int64_t>(1ull << 63));
+    auto gt = _mm256_setzero_si256();
+    for (size_t i = 0; i != ResourceVector::kSlots; i += 4) {
+        auto a = _mm256_load_si256(reinterpret_cast<const __m256i *>(&avail.m_values[i]));
+        auto r = _mm256_load_si256(reinterpret_cast<const __m256i *>(&req.m_values[i]));
+        gt = _mm256_or_si256(gt, _mm256_cmpgt_epi64(_mm256_xor_si256(r, bias), _mm256_xor_si256(a, bias)));
+    }
+    return _mm256_testz_si256(gt, gt);
+#else
+    // without wide compares, only look at slots present in req
+    for (auto m = req.m_present; m; m &= m - 1) {
+        auto i = __builtin_ctz(m);
+        if (req.m_values[i] > avail.m_values[i]) {
+            return false;
+        }
+    }
+    return true;
+#endif
+}
+
+/**
+ * @brief Merge 'rhs' into 'lhs'. Same semantics as the Resources version.
+ */
+inline ResourceVector &merge(ResourceVector &lhs, const ResourceVector &rhs, bool skipNonExist)
+{
+    if (skipNonExist && (rhs.m_present & ~lhs.m_present)) {
+        for (auto m = rhs.m_present & lhs.m_present; m; m &= m - 1) {
+            auto i = __builtin_ctz(m);
+            lhs.m_values[i] += rhs.m_values[i];
+        }
+        return lhs;
+    }
+#if defined(__AVX2__)
+    for (size_t i = 0; i != ResourceVector::kSlots; i += 4) {
+        auto l = reinterpret_cast<__m256i *>(&lhs.m_values[i]);
+        auto r = _mm256_load_si256(reinterpret_cast<const __m256i *>(&rhs.m_values[i]));
+        _mm256_store_si256(l, _mm256_add_epi64(_mm256_load_si256(l), r));
+    }
+#else
+    for (size_t i = 0; i != ResourceVector::kSlots; ++i) {
+        lhs.m_values[i] += rhs.m_values[i];
+    }
+#endif
+    lhs.m_present |= rhs.m_present;
+    return lhs;
+}
+
+/**
+ * @brief Subtract 'rhs' from 'lhs'. Same semantics as the Resources version.
+ */
+inline ResourceVector &subtract(ResourceVector &lhs, const ResourceVector &rhs, bool skipNonExist)
+{
+    if (skipNonExist && (rhs.m_present & ~lhs.m_present)) {
+        for (auto m = rhs.m_present & lhs.m_present; m; m &= m - 1) {
+            auto i = __builtin_ctz(m);
+            lhs.m_values[i] -= rhs.m_values[i];
+        }
+        return lhs;
+    }
+#if defined(__AVX2__)
+    for (size_t i = 0; i != ResourceVector::kSlots; i += 4) {
+        auto l = reinterpret_cast<__m256i *>(&lhs.m_values[i]);
+        auto r = _mm256_load_si256(reinterpret_cast<const __m256i *>(&rhs.m_values[i]));
+        _mm256_store_si256(l, _mm256_sub_epi64(_mm256_load_si256(l), r));
+    }
+#else
+    for (size_t i = 0; i != ResourceVector::kSlots; ++i) {
+        lhs.m_values[i] -= rhs.m_values[i];
+    }
+#endif
+    lhs.m_present |= rhs.m_present;
+    return lhs;
+}
+
+/**
+ * @brief Subtract 'rhs' from 'lhs', anything not contained in 'lhs' is skipped
+ * @return actual res subtracted
+ */
+inline ResourceVector subtractBounded(ResourceVector &lhs, const ResourceVector &rhs)
+{
+    ResourceVector res;
+    res.m_present = lhs.m_present & rhs.m_present;
+    for (auto m = res.m_present; m; m &= m - 1) {
+        auto i = __builtin_ctz(m);
+        auto v = std::min(lhs.m_values[i], rhs.m_values[i]);
+        lhs.m_values[i] -= v;
+        res.m_values[i] = v;
+    }
+    return res;
+}
+
+/**
+ * @brief Remove resource types with non-positive capacity
+ */
+inline ResourceVector &removeInvalid(ResourceVector &lhs)
+{
+    for (auto m = lhs.m_present; m; m &= m - 1) {
+        auto i = __builtin_ctz(m);
+        if (lhs.m_values[i] == 0) {
+            lhs.m_present &= ~(ResourceVector::Mask{1} << i);
+        }
+    }
+    return lhs;
+}
+
+} // namespace resources
+
+#endif // SALUS_EXEC_RESOURCEVECTOR_H
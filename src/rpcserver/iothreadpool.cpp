@@ -24,13 +24,16 @@
 
 namespace salus {
 
+/*static*/ ThreadAffinity IOThreadPoolImpl::m_affinity;
+
 IOThreadPoolImpl::IOThreadPoolImpl()
     : m_numThreads(std::max(std::thread::hardware_concurrency() / 2, 1u))
     , m_context(static_cast<int>(m_numThreads))
     , m_workguard(boost::asio::make_work_guard(m_context))
+    , m_placements(placeWorkers(CpuTopology::system(), m_affinity, m_numThreads))
 {
     while (m_threads.size() < m_numThreads) {
-        m_threads.create_thread(std::bind(&IOThreadPoolImpl::workerLoop, this));
+        m_threads.create_thread(std::bind(&IOThreadPoolImpl::workerLoop, this, m_threads.size()));
     }
 }
 
@@ -41,9 +44,11 @@ IOThreadPoolImpl::~IOThreadPoolImpl()
     m_threads.join_all();
 }
 
-void IOThreadPoolImpl::workerLoop()
+void IOThreadPoolImpl::workerLoop(size_t index)
 {
     threading::set_thread_name("salus::IOThreadPoolWorker");
+    // all workers share one io_context, so unlike ThreadPool there are no node local queues to prefer
+    applyPlacement(m_placements[index]);
     m_context.run();
 }
 
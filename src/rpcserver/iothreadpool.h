@@ -20,9 +20,13 @@
 #ifndef SALUS_IOTHREADPOOL_H
 #define SALUS_IOTHREADPOOL_H
 
+#include "execution/threadpool/affinity.h"
+
 #include <boost/asio.hpp>
 #include <boost/thread.hpp>
 
+#include <vector>
+
 namespace salus {
 /**
  * @brief Simple blocking IO thread pool made from boost::asio
@@ -35,6 +39,9 @@ class IOThreadPoolImpl
     boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_workguard;
 
     boost::thread_group m_threads;
+    std::vector<WorkerPlacement> m_placements;
+
+    static ThreadAffinity m_affinity;
 
     /**
      * @brief A wrapper class that is copy-able to pass move-only objects.
@@ -69,6 +76,19 @@ public:
     IOThreadPoolImpl();
     ~IOThreadPoolImpl();
 
+    /**
+     * @brief CPU affinity of workers in pools created afterwards
+     */
+    static void setAffinity(const ThreadAffinity &affinity)
+    {
+        m_affinity = affinity;
+    }
+
+    static const ThreadAffinity &affinity()
+    {
+        return m_affinity;
+    }
+
     /*
     template<typename Func, typename SFINAE = std::enable_if<std::is_copy_constructible_v<Func> ||
     !use_moveonly_trick>> auto post(Func &&f)
@@ -94,7 +114,7 @@ public:
     }
 
 private:
-    void workerLoop();
+    void workerLoop(size_t index);
 };
 
 using IOThreadPool = IOThreadPoolImpl;
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "platform/logging.h"
+#include "simulator/simulator.h"
+#include "simulator/trace.h"
+
+#include <docopt.h>
+
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std::string_literals;
+
+namespace {
+
+namespace flags {
+const static auto trace = "<trace>";
+const static auto scheduler = "--sched";
+const static auto maxHolWaiting = "--max-hol-waiting";
+const static auto disableWorkConservative = "--disable-wc";
+const static auto adaptiveHol = "--adaptive-hol";
+const static auto gpuMemory = "--gpu-memory";
+const static auto noExclusiveIter = "--no-exclusive-iter";
+const static auto laneMemory = "--lane-memory";
+const static auto maxLaneBypass = "--max-lane-bypass";
+const static auto json = "--json";
+const static auto verbose = "--verbose";
+const static auto vModule = "--vmodule";
+const static auto pLogFile = "--perflog";
+} // namespace flags
+
+const static auto kUsage =
+    R"(Usage:
+    salus-sim [options] <trace>
+    salus-sim --help
+
+Replay a workload trace against the Salus schedulers in virtual time.
+
+Options:
+    -h, --help                  Print this help message and exit.
+    -s <policies>, --sched=<policies>
+                                Comma separated policies to compare.
+                                Choices: fair, drf, preempt, pack, rr, fifo.
+                                [default: fair]
+    --disable-wc                Disable work conservation.
+    --max-hol-waiting=<num>     Maximum number of task allowed go before queue head
+                                in scheduling. [default: 50]
+    --adaptive-hol              Adapt the limit of --max-hol-waiting per session.
+    --gpu-memory=<mb>           GPU memory available to sessions in MB, 0 means
+                                platform default. [default: 0]
+    --no-exclusive-iter         Allow iterations of different sessions to run
+                                concurrently.
+    --lane-memory=<mb>          Admit sessions only when a lane of their laneMemory
+                                can be granted out of this many MB, 0 admits them
+                                on arrival. [default: 0]
+    --max-lane-bypass=<num>     Times a waiting session can be passed by younger
+                                ones before it holds back others. [default: 32]
+    --json                      Print the report as JSON.
+    -v <level>, --verbose=<level>
+                                Enable verbose logging level <level>.
+                                Valid range: 0-9. (0 means disable)
+                                [default: 0]
+    --vmodule=<vmodules>        Specify verbose level per module.
+                                [default: ]
+    --perflog=<file>            Enable performance logging and log to <file>,
+                                e.g. to follow adaptive HOL limits over time.
+)"s;
+
+std::vector<std::string> splitPolicies(const std::string &str)
+{
+    std::vector<std::string> policies;
+    std::istringstream iss(str);
+    std::string policy;
+    while (std::getline(iss, policy, ',')) {
+        if (!policy.empty()) {
+            policies.emplace_back(std::move(policy));
+        }
+    }
+    return policies;
+}
+
+void printReport(const salus::sim::Simulator::Report &report)
+{
+    std::cout << "Policy: " << report.policy << "\n"
+              << "    makespan: " << report.makespan / 1000.0 << " ms"
+              << ", ops: " << report.numOps << ", wall time: " << report.wallSeconds << " s"
+              << ", speedup: " << (report.wallSeconds > 0 ? report.makespan / 1e6 / report.wallSeconds : 0) << "x\n";
+    for (auto &sess : report.sessions) {
+        auto avgIter = sess.iterations ? sess.runningTime / 1000.0 / sess.iterations : 0;
+        std::cout << "    " << std::left << std::setw(24) << sess.name
+                  << " jct: " << (sess.finish - sess.arrival) / 1000.0 << " ms"
+                  << " wait: " << (sess.admitted - sess.arrival) / 1000.0 << " ms"
+                  << " iterations: " << sess.iterations << " avg iteration: " << avgIter << " ms";
+        if (sess.sloMet + sess.sloMissed > 0) {
+            std::cout << " slo met: " << sess.sloMet << " missed: " << sess.sloMissed;
+        }
+        std::cout << "\n";
+    }
+}
+
+nlohmann::json toJson(const salus::sim::Simulator::Report &report)
+{
+    auto sessions = nlohmann::json::array();
+    for (auto &sess : report.sessions) {
+        sessions.push_back({
+            {"name", sess.name},
+            {"arrival", sess.arrival},
+            {"admitted", sess.admitted},
+            {"finish", sess.finish},
+            {"iterations", sess.iterations},
+            {"runningTime", sess.runningTime},
+            {"sloMet", sess.sloMet},
+            {"sloMissed", sess.sloMissed},
+        });
+    }
+    return {
+        {"policy", report.policy},
+        {"makespan", report.makespan},
+        {"numOps", report.numOps},
+        {"wallSeconds", report.wallSeconds},
+        {"sessions", std::move(sessions)},
+    };
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+    auto args = docopt::docopt(kUsage, {argv + 1, argv + argc}, /* help = */ true);
+
+    logging::initialize({
+        std::nullopt,
+        static_cast<int>(args[flags::verbose].asLong()),
+        args[flags::vModule].asString(),
+        std::nullopt,
+        args[flags::pLogFile] ? std::make_optional(args[flags::pLogFile].asString()) : std::nullopt,
+    });
+
+    salus::sim::Simulator::Options opts;
+    opts.param.maxHolWaiting = static_cast<uint64_t>(args[flags::maxHolWaiting].asLong());
+    opts.param.workConservative = !args[flags::disableWorkConservative].asBool();
+    opts.param.adaptiveHol = args[flags::adaptiveHol].asBool();
+    opts.gpuMemory = static_cast<size_t>(args[flags::gpuMemory].asLong()) * 1024 * 1024;
+    opts.exclusiveIter = !args[flags::noExclusiveIter].asBool();
+    opts.laneMemory = static_cast<size_t>(args[flags::laneMemory].asLong()) * 1024 * 1024;
+    opts.maxLaneBypass = static_cast<uint64_t>(args[flags::maxLaneBypass].asLong());
+
+    try {
+        auto workload = salus::sim::loadWorkload(args[flags::trace].asString());
+
+        auto reports = nlohmann::json::array();
+        for (auto &policy : splitPolicies(args[flags::scheduler].asString())) {
+            opts.param.scheduler = policy;
+            salus::sim::Simulator sim(opts);
+            auto report = sim.run(workload);
+            if (args[flags::json].asBool()) {
+                reports.push_back(toJson(report));
+            } else {
+                printReport(report);
+            }
+        }
+        if (args[flags::json].asBool()) {
+            std::cout << reports.dump(4) << std::endl;
+        }
+    } catch (const std::exception &ex) {
+        LOG(ERROR) << ex.what();
+        return 1;
+    }
+
+    return 0;
+}
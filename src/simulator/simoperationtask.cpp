@@ -0,0 +1,102 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simulator/simoperationtask.h"
+
+#include "execution/engine/resourcecontext.h"
+#include "platform/logging.h"
+#include "simulator/simulator.h"
+
+#include <sstream>
+
+namespace salus::sim {
+
+SimOperationTask::SimOperationTask(Simulator &sim, size_t session, size_t index, const OpTrace &trace, uint64_t seq)
+    : m_sim(sim)
+    , m_session(session)
+    , m_index(index)
+    , m_trace(trace)
+    , m_seq(seq)
+{
+}
+
+SimOperationTask::~SimOperationTask() = default;
+
+std::string SimOperationTask::DebugString() const
+{
+    std::ostringstream oss;
+    oss << "SimOperationTask(sess=" << m_session << ", op=" << m_index << " " << m_trace.name << ")";
+    return oss.str();
+}
+
+uint64_t SimOperationTask::graphId() const
+{
+    // one graph per session
+    return m_session;
+}
+
+Resources SimOperationTask::estimatedUsage(const DeviceSpec &dev)
+{
+    return {{{ResourceType::MEMORY, dev}, m_trace.memory}};
+}
+
+bool SimOperationTask::hasExactEstimation(const DeviceSpec &)
+{
+    return true;
+}
+
+OperationTask::DeviceTypes SimOperationTask::supportedDeviceTypes() const
+{
+    static DeviceType types[] = {DeviceType::GPU};
+    return types;
+}
+
+int SimOperationTask::failedTimes() const
+{
+    return 0;
+}
+
+bool SimOperationTask::prepare(std::unique_ptr<ResourceContext> &&rctx) noexcept
+{
+    m_rctx = std::move(rctx);
+    return true;
+}
+
+ResourceContext &SimOperationTask::resourceContext() const
+{
+    DCHECK(m_rctx);
+    return *m_rctx;
+}
+
+bool SimOperationTask::isAsync() const
+{
+    return false;
+}
+
+void SimOperationTask::run(Callbacks cbs) noexcept
+{
+    m_sim.taskStarted(*this, std::move(cbs));
+}
+
+void SimOperationTask::cancel()
+{
+    VLOG(2) << "Cancel is a no-op in simulation: " << DebugString();
+}
+
+} // namespace salus::sim
@@ -0,0 +1,98 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_SIM_SIMOPERATIONTASK_H
+#define SALUS_SIM_SIMOPERATIONTASK_H
+
+#include "execution/operationtask.h"
+#include "simulator/trace.h"
+
+#include <memory>
+
+namespace salus::sim {
+
+class Simulator;
+
+/**
+ * @brief An operation replayed from trace. It doesn't run anything, but reports to the simulator
+ * when the thread pool starts it, which then finishes it after its duration in virtual time.
+ */
+class SimOperationTask : public OperationTask
+{
+public:
+    SimOperationTask(Simulator &sim, size_t session, size_t index, const OpTrace &trace, uint64_t seq);
+    ~SimOperationTask() override;
+
+    std::string DebugString() const override;
+
+    uint64_t graphId() const override;
+
+    Resources estimatedUsage(const DeviceSpec &dev) override;
+    bool hasExactEstimation(const DeviceSpec &dev) override;
+
+    DeviceTypes supportedDeviceTypes() const override;
+
+    int failedTimes() const override;
+
+    bool prepare(std::unique_ptr<ResourceContext> &&rctx) noexcept override;
+
+    ResourceContext &resourceContext() const override;
+
+    bool isAsync() const override;
+
+    void run(Callbacks cbs) noexcept override;
+
+    void cancel() override;
+
+    size_t session() const
+    {
+        return m_session;
+    }
+
+    size_t index() const
+    {
+        return m_index;
+    }
+
+    /**
+     * @brief Creation order, used to break ties deterministically
+     */
+    uint64_t seq() const
+    {
+        return m_seq;
+    }
+
+    const OpTrace &trace() const
+    {
+        return m_trace;
+    }
+
+private:
+    Simulator &m_sim;
+    const size_t m_session;
+    const size_t m_index;
+    const OpTrace &m_trace;
+    const uint64_t m_seq;
+
+    std::unique_ptr<ResourceContext> m_rctx;
+};
+
+} // namespace salus::sim
+
+#endif // SALUS_SIM_SIMOPERATIONTASK_H
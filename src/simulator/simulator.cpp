@@ -0,0 +1,478 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simulator/simulator.h"
+
+#include "execution/engine/iterationorder.h"
+#include "execution/engine/resourcecontext.h"
+#include "execution/engine/slothrottle.h"
+#include "execution/scheduler/operationitem.h"
+#include "platform/logging.h"
+#include "simulator/simoperationtask.h"
+#include "utils/threadutils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+
+using std::chrono::duration_cast;
+using std::chrono::microseconds;
+using std::chrono::milliseconds;
+using FpSeconds = std::chrono::duration<double>;
+
+namespace salus::sim {
+
+Simulator::Simulator(Options opts)
+    : m_opts(std::move(opts))
+    , m_pool(ThreadPoolOptions().setNumThreads(1).setWorkerName("SimWorker"))
+    , m_taskExec(m_pool, m_resMonitor, m_opts.param)
+    , m_packer(m_opts.maxLaneBypass)
+{
+    if (m_opts.gpuMemory > 0) {
+        // capped by platform limits
+        m_resMonitor.initializeLimits({{resources::GPU0Memory, m_opts.gpuMemory}});
+    } else {
+        m_resMonitor.initializeLimits();
+    }
+}
+
+Simulator::~Simulator() = default;
+
+void Simulator::setNow(Time now)
+{
+    m_now = now;
+    SchedClock::setVirtualNow(m_epoch + microseconds(now));
+}
+
+int64_t Simulator::toEpochMs(Time time) const
+{
+    return duration_cast<milliseconds>((m_epoch + microseconds(time)).time_since_epoch()).count();
+}
+
+void Simulator::schedule(Time time, Event &&ev)
+{
+    m_events.emplace(std::make_pair(time, m_nextEventSeq++), std::move(ev));
+}
+
+Simulator::Report Simulator::run(const Workload &workload)
+{
+    auto scheduler = SchedulerRegistary::instance().create(m_opts.param.scheduler, m_taskExec);
+    if (!scheduler) {
+        throw std::runtime_error("Unknown scheduler: " + m_opts.param.scheduler);
+    }
+
+    // Continue from where the previous run left, as some policies keep static timestamps
+    m_epoch = SchedClock::isVirtual() ? SchedClock::now() : SchedClock::time_point{};
+    setNow(0);
+
+    m_states.clear();
+    m_states.resize(workload.sessions.size());
+    m_numFinished = 0;
+    m_laneBusy = false;
+    m_laneQueue.clear();
+    m_laneRequests.clear();
+    m_laneFree = m_opts.laneMemory;
+    for (size_t i = 0; i != workload.sessions.size(); ++i) {
+        auto &st = m_states[i];
+        st.trace = &workload.sessions[i];
+        if (m_opts.laneMemory > 0 && st.trace->laneMemory > m_opts.laneMemory) {
+            throw std::runtime_error("Session " + st.trace->name + " needs a lane larger than lane memory");
+        }
+        st.dependents.resize(st.trace->ops.size());
+        for (size_t op = 0; op != st.trace->ops.size(); ++op) {
+            for (auto dep : st.trace->ops[op].deps) {
+                st.dependents[dep].push_back(op);
+            }
+        }
+        st.report.name = st.trace->name;
+        st.report.arrival = st.trace->arrival;
+        schedule(st.trace->arrival, {i, nullptr, {}});
+    }
+
+    Report report;
+    report.policy = scheduler->name();
+    auto wallStart = std::chrono::steady_clock::now();
+
+    while (!m_events.empty()) {
+        setNow(m_events.begin()->first.first);
+        while (!m_events.empty() && m_events.begin()->first.first == m_now) {
+            auto node = m_events.extract(m_events.begin());
+            handle(std::move(node.mapped()));
+        }
+
+        admitIterations();
+
+        // The real scheduling loop spins, so keep going until nothing more can be scheduled at this time.
+        // Throttled best effort sessions get their turn within maxBestEffortSkip rounds, so go on until then.
+        size_t scheduled = 0;
+        uint64_t idleRounds = 0;
+        do {
+            scheduled = scheduleRound(*scheduler);
+            report.numOps += scheduled;
+            idleRounds = scheduled > 0 ? 0 : idleRounds + 1;
+        } while (scheduled > 0 || (m_numThrottled > 0 && idleRounds <= m_opts.param.maxBestEffortSkip));
+    }
+
+    if (m_numFinished != m_states.size()) {
+        throw std::runtime_error("Simulation stuck at " + std::to_string(m_now)
+                                 + "us: pending ops can't be scheduled, possibly they don't fit in memory");
+    }
+
+    // Let the scheduler see the deletion of finished sessions
+    scheduleRound(*scheduler);
+
+    report.makespan = m_now;
+    report.wallSeconds = FpSeconds(std::chrono::steady_clock::now() - wallStart).count();
+    for (auto &st : m_states) {
+        report.sessions.emplace_back(std::move(st.report));
+    }
+    return report;
+}
+
+void Simulator::handle(Event &&ev)
+{
+    if (!ev.task) {
+        arrive(ev.session);
+        return;
+    }
+
+    auto &task = *ev.task;
+    auto idx = task.session();
+    auto op = task.index();
+    if (auto mem = task.trace().memory) {
+        task.resourceContext().dealloc(ResourceType::MEMORY, mem);
+    }
+    ev.cbs.done();
+    // release the op item, and the task with it
+    ev.cbs = {};
+
+    opFinished(idx, op);
+}
+
+void Simulator::arrive(size_t idx)
+{
+    if (m_opts.laneMemory == 0) {
+        admit(idx);
+        return;
+    }
+
+    m_laneQueue.push_back(idx);
+    m_laneRequests.push_back({m_states[idx].trace->laneMemory, 0});
+    admitLanes();
+}
+
+void Simulator::admitLanes()
+{
+    auto granted = m_packer.pass(m_laneRequests, [this](size_t i, bool) {
+        auto lane = m_states[m_laneQueue[i]].trace->laneMemory;
+        if (lane > m_laneFree) {
+            return false;
+        }
+        m_laneFree -= lane;
+        return true;
+    });
+
+    size_t kept = 0;
+    for (size_t i = 0; i != m_laneQueue.size(); ++i) {
+        if (granted[i]) {
+            admit(m_laneQueue[i]);
+            continue;
+        }
+        m_laneQueue[kept] = m_laneQueue[i];
+        m_laneRequests[kept] = m_laneRequests[i];
+        ++kept;
+    }
+    m_laneQueue.resize(kept);
+    m_laneRequests.resize(kept);
+}
+
+void Simulator::admit(size_t idx)
+{
+    auto &st = m_states[idx];
+    st.arrived = true;
+    st.report.admitted = m_now;
+    st.item = std::make_shared<SessionItem>(st.trace->name);
+    st.item->totalRunningTime = st.trace->expectedRunningTime;
+    st.item->weight = st.trace->weight;
+    if (st.trace->latencySensitive) {
+        st.item->priorityClass = PriorityClass::LatencySensitive;
+    }
+    st.item->targetStepLatency = st.trace->targetStepLatency;
+    st.iterQueued = m_now;
+
+    // ExecutionEngine resets the counter when a new session joins the lane
+    for (auto &other : m_states) {
+        if (other.item) {
+            other.item->numFinishedIters = 0;
+        }
+    }
+
+    m_newSessions.emplace_back(st.item);
+    VLOG(1) << "Session " << st.trace->name << " admitted at " << m_now;
+}
+
+void Simulator::admitIterations()
+{
+    if (m_opts.exclusiveIter && m_laneBusy) {
+        return;
+    }
+
+    std::vector<size_t> waiting;
+    for (size_t i = 0; i != m_states.size(); ++i) {
+        auto &st = m_states[i];
+        if (st.arrived && !st.finished && !st.running) {
+            waiting.push_back(i);
+        }
+    }
+    if (waiting.empty()) {
+        return;
+    }
+
+    const auto &policy = m_opts.param.scheduler;
+    if (auto cmp = iterorder::comparatorFor(policy)) {
+        std::stable_sort(waiting.begin(), waiting.end(),
+                         [&](auto a, auto b) { return cmp(*m_states[a].item, *m_states[b].item); });
+    }
+
+    // Latency sensitive iterations first in earliest deadline order, as ExecutionEngine::scheduleOnQueue
+    auto lsDeadline = [this](size_t idx) -> std::optional<Time> {
+        const auto &st = m_states[idx];
+        if (!st.item->isLatencySensitive()) {
+            return std::nullopt;
+        }
+        if (st.item->targetStepLatency == 0) {
+            return std::numeric_limits<Time>::max();
+        }
+        return st.iterQueued + static_cast<Time>(st.item->targetStepLatency) * 1000;
+    };
+    std::stable_sort(waiting.begin(), waiting.end(), [&](auto a, auto b) {
+        auto deadlineA = lsDeadline(a);
+        auto deadlineB = lsDeadline(b);
+        if (!deadlineA) {
+            return false;
+        }
+        return !deadlineB || *deadlineA < *deadlineB;
+    });
+
+    if (iterorder::comparatorFor(policy)) {
+        // already in order
+    } else if (policy == "fifo" || policy == "preempt") {
+        // Only one session is allowed to run, even without exclusive iterations
+        size_t selected = waiting.front();
+        if (policy == "preempt") {
+            auto minRemaining = std::numeric_limits<int64_t>::max();
+            for (size_t i = 0; i != m_states.size(); ++i) {
+                auto &st = m_states[i];
+                if (!st.arrived || st.finished) {
+                    continue;
+                }
+                auto remain = iterorder::remainingTime(*st.item);
+                if (remain <= minRemaining) {
+                    minRemaining = remain;
+                    selected = i;
+                }
+            }
+        } else {
+            for (size_t i = 0; i != m_states.size(); ++i) {
+                if (m_states[i].arrived && !m_states[i].finished) {
+                    selected = i;
+                    break;
+                }
+            }
+        }
+        waiting.clear();
+        if (!m_states[selected].running) {
+            waiting.push_back(selected);
+        }
+    }
+    // pack: in arrival order
+
+    for (auto idx : waiting) {
+        startIteration(idx);
+        if (m_opts.exclusiveIter) {
+            break;
+        }
+    }
+}
+
+void Simulator::startIteration(size_t idx)
+{
+    auto &st = m_states[idx];
+    const auto &ops = st.trace->ops;
+
+    st.running = true;
+    st.iterStart = m_now;
+    // 0 means no step is running
+    st.item->stepQueuedAt = std::max<int64_t>(1, toEpochMs(st.iterQueued));
+    st.opsLeft = ops.size();
+    st.pendingDeps.resize(ops.size());
+    for (size_t op = 0; op != ops.size(); ++op) {
+        st.pendingDeps[op] = ops[op].deps.size();
+    }
+    m_laneBusy = true;
+
+    for (size_t op = 0; op != ops.size(); ++op) {
+        if (st.pendingDeps[op] == 0) {
+            queueOp(idx, op);
+        }
+    }
+}
+
+void Simulator::finishIteration(size_t idx)
+{
+    auto &st = m_states[idx];
+
+    auto iterTime = m_now - st.iterStart;
+    st.report.runningTime += iterTime;
+    st.report.iterations += 1;
+    st.item->usedRunningTime += static_cast<uint64_t>(iterTime / 1000);
+    ++st.item->numFinishedIters;
+
+    auto stepLatency = static_cast<uint64_t>((m_now - st.iterQueued) / 1000);
+    st.item->recordStepLatency(stepLatency);
+    st.item->stepQueuedAt = 0;
+    st.report.sloMet = st.item->numSloMet;
+    st.report.sloMissed = st.item->numSloMissed;
+
+    st.running = false;
+    m_laneBusy = false;
+    st.iter += 1;
+    st.iterQueued = m_now;
+
+    if (st.iter >= st.trace->iterations) {
+        st.finished = true;
+        st.report.finish = m_now;
+        m_numFinished += 1;
+        m_deletedSessions.emplace(st.item);
+        VLOG(1) << "Session " << st.trace->name << " finished at " << m_now;
+
+        if (m_opts.laneMemory > 0) {
+            m_laneFree += st.trace->laneMemory;
+            admitLanes();
+        }
+    }
+}
+
+void Simulator::queueOp(size_t idx, size_t op)
+{
+    auto &st = m_states[idx];
+
+    auto opItem = std::make_shared<OperationItem>();
+    opItem->sess = st.item;
+    opItem->op = std::make_unique<SimOperationTask>(*this, idx, op, st.trace->ops[op], m_nextTaskSeq++);
+    st.item->bgQueue.emplace_back(std::move(opItem));
+}
+
+void Simulator::opFinished(size_t idx, size_t op)
+{
+    auto &st = m_states[idx];
+
+    for (auto next : st.dependents[op]) {
+        if (--st.pendingDeps[next] == 0) {
+            queueOp(idx, next);
+        }
+    }
+
+    if (--st.opsLeft == 0) {
+        finishIteration(idx);
+    }
+}
+
+size_t Simulator::scheduleRound(BaseScheduler &scheduler)
+{
+    SessionChangeSet changeset;
+
+    changeset.numAddedSessions = m_newSessions.size();
+    if (changeset.numAddedSessions) {
+        changeset.addedSessionBegin = m_newSessions.begin();
+        changeset.addedSessionEnd = m_sessions.end();
+        m_sessions.splice(m_sessions.end(), m_newSessions);
+    } else {
+        changeset.addedSessionBegin = m_sessions.end();
+        changeset.addedSessionEnd = m_sessions.end();
+    }
+
+    using std::swap;
+    swap(changeset.deletedSessions, m_deletedSessions);
+    m_sessions.remove_if([&changeset](auto sess) {
+        bool deleted = changeset.deletedSessions.count(sess) > 0;
+        if (deleted && changeset.addedSessionBegin != changeset.addedSessionEnd
+            && *changeset.addedSessionBegin == sess) {
+            ++changeset.addedSessionBegin;
+        }
+        return deleted;
+    });
+
+    scheduler.notifyPreSchedulingIteration(m_sessions, changeset, &m_candidates);
+
+    const bool sloAtRisk = slo::prepareRound(m_sessions, m_candidates, m_opts.param, toEpochMs(m_now));
+
+    size_t scheduled = 0;
+    m_numThrottled = 0;
+    for (auto &item : m_candidates) {
+        if (slo::shouldThrottle(*item, sloAtRisk, m_opts.param)) {
+            ++m_numThrottled;
+            continue;
+        }
+        auto [count, shouldContinue] = scheduler.maybeScheduleFrom(item);
+        scheduled += count;
+        if (!shouldContinue) {
+            break;
+        }
+    }
+
+    collectStarted(scheduled);
+    return scheduled;
+}
+
+void Simulator::taskStarted(SimOperationTask &task, OperationTask::Callbacks &&cbs)
+{
+    {
+        auto g = sstl::with_guard(m_startedMu);
+        m_started.push_back({task.session(), &task, std::move(cbs)});
+    }
+    m_startedCv.notify_one();
+}
+
+void Simulator::collectStarted(size_t num)
+{
+    std::vector<Event> started;
+    {
+        auto l = sstl::with_uguard(m_startedMu);
+        m_startedCv.wait(l, [&]() { return m_started.size() >= num; });
+        started.swap(m_started);
+    }
+
+    // the thread pool may start tasks in any order
+    std::sort(started.begin(), started.end(), [](const auto &a, const auto &b) { return a.task->seq() < b.task->seq(); });
+
+    for (auto &ev : started) {
+        auto &task = *ev.task;
+        if (auto mem = task.trace().memory) {
+            // take from staging area, committed when scope goes out
+            auto scope = task.resourceContext().alloc(ResourceType::MEMORY, mem);
+            CHECK(scope) << "Failed to allocate preallocated memory for " << task;
+        }
+        schedule(m_now + task.trace().duration, std::move(ev));
+    }
+}
+
+} // namespace salus::sim
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_SIM_SIMULATOR_H
+#define SALUS_SIM_SIMULATOR_H
+
+#include "execution/engine/taskexecutor.h"
+#include "execution/operationtask.h"
+#include "execution/scheduler/basescheduler.h"
+#include "execution/scheduler/schedclock.h"
+#include "execution/scheduler/schedulingparam.h"
+#include "execution/threadpool/threadpool.h"
+#include "oplibraries/tensorflow/device/gpu/lane/lanepacker.h"
+#include "resources/resources.h"
+#include "simulator/trace.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace salus::sim {
+
+class SimOperationTask;
+
+/**
+ * @brief Discrete event simulator that replays a workload against the real schedulers.
+ *
+ * Op level scheduling goes through the registered BaseScheduler, TaskExecutor::runTask and
+ * ResourceMonitor, exactly as in the server. Iteration level scheduling follows ExecutionEngine,
+ * using the same orderings from iterationorder.h, and service classes are handled as in
+ * slothrottle.h. Time is virtual and is also installed
+ * into SchedClock, so policies measuring elapsed time see it.
+ */
+class Simulator
+{
+public:
+    struct Options
+    {
+        SchedulingParam param;
+        /**
+         * GPU memory available to sessions, 0 means platform default
+         */
+        size_t gpuMemory = 0;
+        /**
+         * At most one iteration runs at a time, as ExecutionEngine does for expensive iterations on a lane
+         */
+        bool exclusiveIter = true;
+        /**
+         * GPU memory lanes are granted from, as LaneMgr does on session creation. 0 admits sessions on arrival
+         */
+        size_t laneMemory = 0;
+        /**
+         * See LanePacker
+         */
+        uint64_t maxLaneBypass = 32;
+    };
+
+    struct SessionReport
+    {
+        std::string name;
+        Time arrival = 0;
+        // when the lane was granted
+        Time admitted = 0;
+        Time finish = 0;
+        uint64_t iterations = 0;
+        // sum of iteration running time
+        Time runningTime = 0;
+        // iterations finished within and over the target step latency
+        uint64_t sloMet = 0;
+        uint64_t sloMissed = 0;
+    };
+
+    struct Report
+    {
+        std::string policy;
+        Time makespan = 0;
+        double wallSeconds = 0;
+        uint64_t numOps = 0;
+        std::vector<SessionReport> sessions;
+    };
+
+    explicit Simulator(Options opts);
+    ~Simulator();
+
+    /**
+     * @brief Replay the workload until all sessions finish.
+     * @throws std::runtime_error if the scheduler can't make progress, e.g. an op doesn't fit in memory
+     */
+    Report run(const Workload &workload);
+
+    /**
+     * @brief Called by SimOperationTask::run from thread pool
+     */
+    void taskStarted(SimOperationTask &task, OperationTask::Callbacks &&cbs);
+
+private:
+    Options m_opts;
+
+    ThreadPool m_pool;
+    ResourceMonitor m_resMonitor;
+    TaskExecutor m_taskExec;
+
+    struct SessionState
+    {
+        const SessionTrace *trace = nullptr;
+        PSessionItem item;
+        // ops waiting on each op
+        std::vector<std::vector<size_t>> dependents;
+
+        bool arrived = false;
+        bool running = false;
+        bool finished = false;
+        uint64_t iter = 0;
+        // when the current iteration became ready, i.e. queued in ExecutionEngine
+        Time iterQueued = 0;
+        Time iterStart = 0;
+        std::vector<size_t> pendingDeps;
+        size_t opsLeft = 0;
+
+        SessionReport report;
+    };
+    std::vector<SessionState> m_states;
+    size_t m_numFinished = 0;
+    uint64_t m_nextTaskSeq = 0;
+    bool m_laneBusy = false;
+
+    // Lane admission, sessions waiting for lanes in arrival order
+    oplib::tensorflow::LanePacker m_packer;
+    std::vector<size_t> m_laneQueue;
+    std::vector<oplib::tensorflow::LanePacker::Request> m_laneRequests;
+    size_t m_laneFree = 0;
+
+    // Event queue ordered by time then creation order
+    struct Event
+    {
+        size_t session;
+        // null for session arrival
+        SimOperationTask *task = nullptr;
+        OperationTask::Callbacks cbs;
+    };
+    std::map<std::pair<Time, uint64_t>, Event> m_events;
+    uint64_t m_nextEventSeq = 0;
+    Time m_now = 0;
+    SchedClock::time_point m_epoch;
+
+    void schedule(Time time, Event &&ev);
+    void setNow(Time now);
+    // virtual time in ms since epoch, as SessionItem keeps step timestamps
+    int64_t toEpochMs(Time time) const;
+
+    // Tasks started by the thread pool but not yet seen by the simulation thread
+    std::mutex m_startedMu;
+    std::condition_variable m_startedCv;
+    std::vector<Event> m_started;
+
+    // Mirrors the session bookkeeping in TaskExecutor::scheduleLoop
+    SessionList m_sessions;
+    SessionList m_newSessions;
+    SessionSet m_deletedSessions;
+    boost::container::small_vector<PSessionItem, 5> m_candidates;
+    // best effort sessions skipped in the last round
+    size_t m_numThrottled = 0;
+
+    void handle(Event &&ev);
+    void arrive(size_t idx);
+    void admitLanes();
+    void admit(size_t idx);
+    void admitIterations();
+    void startIteration(size_t idx);
+    void finishIteration(size_t idx);
+    void queueOp(size_t idx, size_t op);
+    void opFinished(size_t idx, size_t op);
+
+    size_t scheduleRound(BaseScheduler &scheduler);
+    void collectStarted(size_t num);
+};
+
+} // namespace salus::sim
+
+#endif // SALUS_SIM_SIMULATOR_H
@@ -0,0 +1,104 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simulator/trace.h"
+
+#include <nlohmann/json.hpp>
+
+#include <fstream>
+#include <stdexcept>
+
+namespace salus::sim {
+
+namespace {
+
+OpTrace parseOp(const nlohmann::json &j, size_t index)
+{
+    OpTrace op;
+    op.name = j.value("name", std::to_string(index));
+    op.duration = j.at("duration").get<Time>();
+    op.memory = j.value("memory", size_t{0});
+    if (auto it = j.find("deps"); it != j.end()) {
+        op.deps = it->get<std::vector<size_t>>();
+    } else if (index > 0) {
+        op.deps.push_back(index - 1);
+    }
+
+    if (op.duration < 0) {
+        throw std::runtime_error("Negative duration for op " + op.name);
+    }
+    for (auto dep : op.deps) {
+        if (dep >= index) {
+            throw std::runtime_error("Op " + op.name + " depends on a later op " + std::to_string(dep));
+        }
+    }
+    return op;
+}
+
+SessionTrace parseSession(const nlohmann::json &j, size_t index)
+{
+    SessionTrace sess;
+    sess.name = j.value("name", "sess" + std::to_string(index));
+    sess.arrival = j.value("arrival", Time{0});
+    sess.iterations = j.value("iterations", uint64_t{1});
+    sess.expectedRunningTime = j.value("expectedRunningTime", uint64_t{0});
+    sess.weight = j.value("weight", 1.0);
+    sess.laneMemory = j.value("laneMemory", size_t{0});
+    sess.latencySensitive = j.value("latencySensitive", false);
+    sess.targetStepLatency = j.value("targetStepLatency", uint64_t{0});
+
+    const auto &ops = j.at("ops");
+    sess.ops.reserve(ops.size());
+    for (size_t i = 0; i != ops.size(); ++i) {
+        sess.ops.emplace_back(parseOp(ops.at(i), i));
+    }
+    if (sess.ops.empty()) {
+        throw std::runtime_error("Session " + sess.name + " has no ops");
+    }
+    if (sess.laneMemory == 0) {
+        for (auto &op : sess.ops) {
+            sess.laneMemory += op.memory;
+        }
+    }
+    return sess;
+}
+
+} // namespace
+
+Workload loadWorkload(const std::string &path)
+{
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Can't open trace file " + path);
+    }
+
+    Workload workload;
+    try {
+        auto j = nlohmann::json::parse(in);
+        const auto &sessions = j.at("sessions");
+        for (size_t i = 0; i != sessions.size(); ++i) {
+            workload.sessions.emplace_back(parseSession(sessions.at(i), i));
+        }
+    } catch (const nlohmann::json::exception &ex) {
+        throw std::runtime_error("Malformed trace file " + path + ": " + ex.what());
+    }
+    return workload;
+}
+
+} // namespace salus::sim
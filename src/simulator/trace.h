@@ -0,0 +1,85 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_SIM_TRACE_H
+#define SALUS_SIM_TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace salus::sim {
+
+/**
+ * @brief Virtual time in microseconds
+ */
+using Time = int64_t;
+
+struct OpTrace
+{
+    std::string name;
+    // running time of the op
+    Time duration = 0;
+    // GPU memory held while the op runs
+    size_t memory = 0;
+    // indices of ops in the same iteration that must finish first
+    std::vector<size_t> deps;
+};
+
+struct SessionTrace
+{
+    std::string name;
+    // when the session is created
+    Time arrival = 0;
+    uint64_t iterations = 1;
+    // expected total running time in ms, as TIME:TOTAL in a real session
+    uint64_t expectedRunningTime = 0;
+    double weight = 1.0;
+    // GPU memory of the session's lane, 0 means the sum of memory of all its ops
+    size_t laneMemory = 0;
+    // service class, see PriorityClass
+    bool latencySensitive = false;
+    // target step latency in ms, 0 means no target
+    uint64_t targetStepLatency = 0;
+    // ops of one iteration, in topological order
+    std::vector<OpTrace> ops;
+};
+
+struct Workload
+{
+    std::vector<SessionTrace> sessions;
+};
+
+/**
+ * @brief Load a workload from a JSON trace file.
+ *
+ * The format is
+ * ```
+ * {"sessions": [{"name": "...", "arrival": 0, "iterations": 10, "expectedRunningTime": 0, "weight": 1,
+ *                "laneMemory": 0, "latencySensitive": false, "targetStepLatency": 0, "ops": [{"name": "...", "duration": 100, "memory": 1024, "deps": [0]}, ...]}, ...]}
+ * ```
+ * Times are in microseconds. An op without "deps" depends on the previous op.
+ *
+ * @throws std::runtime_error if the file can't be read or is malformed
+ */
+Workload loadWorkload(const std::string &path);
+
+} // namespace salus::sim
+
+#endif // SALUS_SIM_TRACE_H
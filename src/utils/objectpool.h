@@ -64,7 +64,6 @@ public:
 
     ObjectPool() noexcept
         : m_frees(std::thread::hardware_concurrency(), 0, std::thread::hardware_concurrency())
-        , m_token(m_frees)
     {
     }
 
@@ -77,7 +76,8 @@ public:
     ptr_type acquire(Args && ... args) noexcept
     {
         std::unique_ptr<T> tmp;
-        if (m_frees.try_dequeue(m_token, tmp)) {
+        // No consumer token, a token must not be shared by threads acquiring concurrently
+        if (m_frees.try_dequeue(tmp)) {
             tmp->reset(std::forward<Args>(args)...);
         } else {
             tmp = std::make_unique<T>(std::forward<Args>(args)...);
@@ -96,9 +96,7 @@ public:
 private:
     using value_type = std::unique_ptr<T>;
     using FreeList = moodycamel::ConcurrentQueue<value_type>;
-    using Token = moodycamel::ConsumerToken;
     FreeList m_frees;
-    Token m_token;
 };
 
 } // namespace sstl
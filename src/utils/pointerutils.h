@@ -24,6 +24,7 @@
 #include "utils/macros.h"
 #include "utils/type_traits.h"
 
+#include <atomic>
 #include <deque>
 #include <functional>
 #include <memory>
@@ -157,6 +158,52 @@ auto add_ref(T *ptr)
     return ScopedUnref<T>(ptr);
 }
 
+/**
+ * @brief Intrusive reference count for use with ScopedUnref, same interface as TensorFlow's core::RefCounted.
+ * Starts with one reference, owned by the creator.
+ */
+class RefCounted
+{
+public:
+    RefCounted() = default;
+
+    void Ref() const
+    {
+        DCHECK_GE(m_ref.load(std::memory_order_relaxed), 1);
+        m_ref.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Drop a reference, deletes this if it was the last one
+     * @return whether this was deleted
+     */
+    bool Unref() const
+    {
+        DCHECK_GT(m_ref.load(std::memory_order_relaxed), 0);
+        if (m_ref.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            delete this;
+            return true;
+        }
+        return false;
+    }
+
+    bool RefCountIsOne() const
+    {
+        return m_ref.load(std::memory_order_acquire) == 1;
+    }
+
+protected:
+    virtual ~RefCounted()
+    {
+        DCHECK_EQ(m_ref.load(std::memory_order_relaxed), 0);
+    }
+
+private:
+    mutable std::atomic_int_fast64_t m_ref{1};
+
+    SALUS_DISALLOW_COPY_AND_ASSIGN(RefCounted);
+};
+
 class ScopeGuards
 {
 public:
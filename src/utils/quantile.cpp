@@ -0,0 +1,120 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/quantile.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace sstl {
+
+P2Quantile::P2Quantile(double quantile)
+    : m_p(std::clamp(quantile, 0.0, 1.0))
+{
+    reset();
+}
+
+void P2Quantile::reset()
+{
+    m_count = 0;
+    m_q.fill(0);
+    m_n = {0, 1, 2, 3, 4};
+    m_np = {0, 2 * m_p, 4 * m_p, 2 + 2 * m_p, 4};
+    m_dn = {0, m_p / 2, m_p, (1 + m_p) / 2, 1};
+}
+
+void P2Quantile::add(double x)
+{
+    if (m_count < kMarkers) {
+        m_q[m_count++] = x;
+        if (m_count == kMarkers) {
+            std::sort(m_q.begin(), m_q.end());
+        }
+        return;
+    }
+    ++m_count;
+
+    // find the cell x falls in, extending the extremes if needed
+    size_t k;
+    if (x < m_q[0]) {
+        m_q[0] = x;
+        k = 0;
+    } else if (x >= m_q[4]) {
+        m_q[4] = x;
+        k = 3;
+    } else {
+        k = 0;
+        while (x >= m_q[k + 1]) {
+            ++k;
+        }
+    }
+
+    for (auto i = k + 1; i != kMarkers; ++i) {
+        m_n[i] += 1;
+    }
+    for (size_t i = 0; i != kMarkers; ++i) {
+        m_np[i] += m_dn[i];
+    }
+
+    // move middle markers towards their desired positions
+    for (size_t i = 1; i != kMarkers - 1; ++i) {
+        auto d = m_np[i] - m_n[i];
+        if ((d >= 1 && m_n[i + 1] - m_n[i] > 1) || (d <= -1 && m_n[i - 1] - m_n[i] < -1)) {
+            d = d > 0 ? 1 : -1;
+            auto q = parabolic(i, d);
+            if (m_q[i - 1] < q && q < m_q[i + 1]) {
+                m_q[i] = q;
+            } else {
+                m_q[i] = linear(i, d);
+            }
+            m_n[i] += d;
+        }
+    }
+}
+
+double P2Quantile::parabolic(size_t i, double d) const
+{
+    return m_q[i]
+           + d / (m_n[i + 1] - m_n[i - 1])
+                 * ((m_n[i] - m_n[i - 1] + d) * (m_q[i + 1] - m_q[i]) / (m_n[i + 1] - m_n[i])
+                    + (m_n[i + 1] - m_n[i] - d) * (m_q[i] - m_q[i - 1]) / (m_n[i] - m_n[i - 1]));
+}
+
+double P2Quantile::linear(size_t i, double d) const
+{
+    auto j = d > 0 ? i + 1 : i - 1;
+    return m_q[i] + d * (m_q[j] - m_q[i]) / (m_n[j] - m_n[i]);
+}
+
+double P2Quantile::value() const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+    // the markers only track the quantile once they start moving, until then the samples are all kept
+    if (m_count <= kMarkers) {
+        auto samples = m_q;
+        std::sort(samples.begin(), samples.begin() + m_count);
+        auto rank = static_cast<size_t>(std::ceil(m_p * m_count));
+        return samples[std::clamp<size_t>(rank, 1, m_count) - 1];
+    }
+    return m_q[2];
+}
+
+} // namespace sstl
@@ -0,0 +1,73 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SALUS_SSTL_QUANTILE_H
+#define SALUS_SSTL_QUANTILE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace sstl {
+
+/**
+ * @brief Streaming estimate of a single quantile in constant memory, using the P² algorithm
+ * (Jain and Chlamtac, 1985).
+ *
+ * Up to five samples, the exact nearest-rank quantile of the samples is returned.
+ */
+class P2Quantile
+{
+public:
+    explicit P2Quantile(double quantile = 0.5);
+
+    void add(double x);
+
+    double value() const;
+
+    double quantile() const
+    {
+        return m_p;
+    }
+
+    uint64_t count() const
+    {
+        return m_count;
+    }
+
+    void reset();
+
+private:
+    static constexpr size_t kMarkers = 5;
+
+    double parabolic(size_t i, double d) const;
+    double linear(size_t i, double d) const;
+
+    double m_p;
+    uint64_t m_count = 0;
+    // marker heights, actual positions, desired positions and their increments
+    std::array<double, kMarkers> m_q{};
+    std::array<double, kMarkers> m_n{};
+    std::array<double, kMarkers> m_np{};
+    std::array<double, kMarkers> m_dn{};
+};
+
+} // namespace sstl
+
+#endif // SALUS_SSTL_QUANTILE_H
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "execution/threadpool/affinity.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <sched.h>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+using Cpus = std::vector<int>;
+
+/**
+ * @brief A fake sysfs tree in a temporary directory
+ */
+struct FakeSysfs
+{
+    fs::path root;
+
+    FakeSysfs()
+        : root(fs::temp_directory_path() / ("salus-sysfs-" + std::to_string(std::random_device{}())))
+    {
+        fs::create_directories(root);
+    }
+
+    ~FakeSysfs()
+    {
+        std::error_code ec;
+        fs::remove_all(root, ec);
+    }
+
+    void write(const fs::path &rel, const std::string &content) const
+    {
+        auto path = root / "devices/system/node" / rel;
+        fs::create_directories(path.parent_path());
+        std::ofstream(path) << content << "\n";
+    }
+
+    CpuTopology topology() const
+    {
+        return CpuTopology::fromSysfs(root.string());
+    }
+};
+
+/**
+ * @brief Two nodes of 4 CPUs each, plus a memory only node
+ */
+struct TwoNodes : FakeSysfs
+{
+    TwoNodes()
+    {
+        write("online", "0-2");
+        write("node0/cpulist", "0-3");
+        write("node1/cpulist", "4-7");
+        write("node2/cpulist", "");
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(affinity)
+
+BOOST_AUTO_TEST_CASE(parse_cpu_list)
+{
+    BOOST_TEST(CpuTopology::parseCpuList("") == Cpus{});
+    BOOST_TEST(CpuTopology::parseCpuList("3") == Cpus{3});
+    BOOST_TEST(CpuTopology::parseCpuList("0-3,8, 10-11") == (Cpus{0, 1, 2, 3, 8, 10, 11}));
+
+    BOOST_CHECK_THROW(CpuTopology::parseCpuList("a"), std::runtime_error);
+    BOOST_CHECK_THROW(CpuTopology::parseCpuList("3-1"), std::runtime_error);
+    BOOST_CHECK_THROW(CpuTopology::parseCpuList("1-"), std::runtime_error);
+    BOOST_CHECK_THROW(CpuTopology::parseCpuList("1-2x"), std::runtime_error);
+    BOOST_CHECK_THROW(CpuTopology::parseCpuList("-1"), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(parse_affinity)
+{
+    BOOST_TEST((ThreadAffinity::parse("none").policy == ThreadAffinity::Policy::None));
+    BOOST_TEST((ThreadAffinity::parse("numa").policy == ThreadAffinity::Policy::PerNode));
+
+    auto explicitCpus = ThreadAffinity::parse("cpus:0-1,4");
+    BOOST_TEST((explicitCpus.policy == ThreadAffinity::Policy::Explicit));
+    BOOST_TEST(explicitCpus.cpus == (Cpus{0, 1, 4}));
+    BOOST_TEST(explicitCpus.DebugString() == "cpus:0,1,4");
+
+    BOOST_CHECK_THROW(ThreadAffinity::parse("cpus:"), std::runtime_error);
+    BOOST_CHECK_THROW(ThreadAffinity::parse("spread"), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(topology_from_sysfs, TwoNodes)
+{
+    auto topo = topology();
+    BOOST_TEST_REQUIRE(topo.nodes().size() == 2u);
+    BOOST_TEST(topo.nodes()[0].id == 0);
+    BOOST_TEST(topo.nodes()[1].id == 1);
+    BOOST_TEST(topo.nodes()[1].cpus == (Cpus{4, 5, 6, 7}));
+
+    BOOST_TEST(topo.nodeIndexOf(3) == 0);
+    BOOST_TEST(topo.nodeIndexOf(4) == 1);
+    BOOST_TEST(topo.nodeIndexOf(8) == -1);
+    BOOST_TEST(topo.nodeIndexOf(-1) == -1);
+}
+
+BOOST_FIXTURE_TEST_CASE(sparse_node_ids, FakeSysfs)
+{
+    // node1 is offline and has no entry
+    write("online", "0,2");
+    write("node0/cpulist", "0-1");
+    write("node2/cpulist", "2-3");
+
+    auto topo = topology();
+    BOOST_TEST_REQUIRE(topo.nodes().size() == 2u);
+    BOOST_TEST(topo.nodes()[1].id == 2);
+    BOOST_TEST(topo.nodeIndexOf(2) == 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(no_numa_falls_back_to_one_node, FakeSysfs)
+{
+    auto topo = topology();
+    BOOST_TEST_REQUIRE(topo.nodes().size() == 1u);
+    BOOST_TEST(topo.nodes()[0].cpus.size() == std::max(std::thread::hardware_concurrency(), 1u));
+    BOOST_TEST(topo.nodeIndexOf(0) == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(place_compact, TwoNodes)
+{
+    auto placements = placeWorkers(topology(), ThreadAffinity::parse("compact"), 10);
+    BOOST_TEST_REQUIRE(placements.size() == 10u);
+    for (size_t i = 0; i != placements.size(); ++i) {
+        auto cpu = static_cast<int>(i % 8);
+        BOOST_TEST(placements[i].cpus == Cpus{cpu});
+        BOOST_TEST(placements[i].node == cpu / 4);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE(place_scatter, TwoNodes)
+{
+    auto placements = placeWorkers(topology(), ThreadAffinity::parse("scatter"), 4);
+    BOOST_TEST_REQUIRE(placements.size() == 4u);
+    BOOST_TEST(placements[0].cpus == Cpus{0});
+    BOOST_TEST(placements[1].cpus == Cpus{4});
+    BOOST_TEST(placements[2].cpus == Cpus{1});
+    BOOST_TEST(placements[3].cpus == Cpus{5});
+    BOOST_TEST(placements[3].node == 1);
+}
+
+BOOST_FIXTURE_TEST_CASE(place_per_node, TwoNodes)
+{
+    auto placements = placeWorkers(topology(), ThreadAffinity::parse("numa"), 3);
+    BOOST_TEST_REQUIRE(placements.size() == 3u);
+    BOOST_TEST(placements[0].cpus == (Cpus{0, 1, 2, 3}));
+    BOOST_TEST(placements[1].cpus == (Cpus{4, 5, 6, 7}));
+    BOOST_TEST(placements[2].node == 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(place_explicit_and_none, TwoNodes)
+{
+    auto placements = placeWorkers(topology(), ThreadAffinity::parse("cpus:5,9"), 3);
+    BOOST_TEST(placements[0].cpus == Cpus{5});
+    BOOST_TEST(placements[0].node == 1);
+    // not in the topology
+    BOOST_TEST(placements[1].node == -1);
+    BOOST_TEST(placements[2].cpus == Cpus{5});
+
+    for (const auto &p : placeWorkers(topology(), ThreadAffinity::parse("none"), 3)) {
+        BOOST_TEST(p.cpus.empty());
+        BOOST_TEST(p.node == -1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(apply_placement)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    BOOST_TEST_REQUIRE(sched_getaffinity(0, sizeof(allowed), &allowed) == 0);
+    int cpu = 0;
+    while (!CPU_ISSET(cpu, &allowed)) {
+        ++cpu;
+    }
+
+    // on a separate thread so the test runner itself stays unpinned
+    bool applied = false;
+    int ranOn = -1;
+    std::thread t([&]() {
+        applied = applyPlacement({{cpu}, 0});
+        ranOn = sched_getcpu();
+    });
+    t.join();
+    BOOST_TEST(applied);
+    BOOST_TEST(ranOn == cpu);
+
+    BOOST_TEST(applyPlacement({}));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
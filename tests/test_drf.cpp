@@ -0,0 +1,110 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simulator/simulator.h"
+
+#include <boost/test/unit_test.hpp>
+
+using namespace salus::sim;
+
+namespace {
+
+constexpr size_t MB = size_t{1} << 20;
+
+/**
+ * @brief A session running single op iterations of 10ms, each taking more than half of the GPU memory,
+ * so ops of different sessions can't overlap and the scheduler decides who gets the GPU
+ */
+SessionTrace session(const std::string &name, double weight, uint64_t iterations)
+{
+    SessionTrace sess;
+    sess.name = name;
+    sess.weight = weight;
+    sess.iterations = iterations;
+    sess.ops.push_back({"op", 10 * 1000, 600 * MB, {}});
+    return sess;
+}
+
+Simulator::Report simulate(const Workload &workload)
+{
+    Simulator::Options opts;
+    opts.param.scheduler = "drf";
+    opts.gpuMemory = 1024 * MB;
+    opts.exclusiveIter = false;
+    Simulator sim(opts);
+    return sim.run(workload);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(drf)
+
+BOOST_AUTO_TEST_CASE(equal_weights_share_equally)
+{
+    Workload workload;
+    workload.sessions.push_back(session("a", 1, 200));
+    workload.sessions.push_back(session("b", 1, 200));
+
+    auto report = simulate(workload);
+    BOOST_TEST_REQUIRE(report.sessions.size() == 2u);
+
+    // both get half of the GPU all along, so they finish together at the end
+    const auto makespan = static_cast<double>(report.makespan);
+    BOOST_TEST(makespan == 4000 * 1000, boost::test_tools::tolerance(0.01));
+    for (const auto &sess : report.sessions) {
+        BOOST_TEST(sess.finish / makespan > 0.95);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(weighted_share_converges)
+{
+    Workload workload;
+    workload.sessions.push_back(session("light", 1, 200));
+    workload.sessions.push_back(session("heavy", 2, 200));
+
+    auto report = simulate(workload);
+    BOOST_TEST_REQUIRE(report.sessions.size() == 2u);
+
+    // heavy gets two thirds of the GPU while both are running, so finishes after 2s of its own and 1s of light
+    const auto &light = report.sessions[0];
+    const auto &heavy = report.sessions[1];
+    BOOST_TEST(static_cast<double>(heavy.finish) == 3000 * 1000, boost::test_tools::tolerance(0.05));
+    BOOST_TEST(light.finish == report.makespan);
+}
+
+BOOST_AUTO_TEST_CASE(late_session_does_not_starve_others)
+{
+    Workload workload;
+    workload.sessions.push_back(session("early", 1, 200));
+    auto late = session("late", 1, 50);
+    late.arrival = 1000 * 1000;
+    workload.sessions.push_back(late);
+
+    auto report = simulate(workload);
+    BOOST_TEST_REQUIRE(report.sessions.size() == 2u);
+
+    // late joins at the current virtual time: it neither runs alone to catch up on the first second,
+    // nor waits for early to catch up, so the two alternate from its arrival
+    const auto &early = report.sessions[0];
+    const auto &lateReport = report.sessions[1];
+    BOOST_TEST(static_cast<double>(lateReport.finish) == 2000 * 1000, boost::test_tools::tolerance(0.05));
+    BOOST_TEST(early.finish == report.makespan);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,499 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "oplibraries/tensorflow/device/gpu/lane/lanemgr.h"
+#include "oplibraries/tensorflow/device/gpu/simgpubackend.h"
+#include "resources/limitsprovider.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <future>
+#include <thread>
+
+using namespace salus::oplib::tensorflow;
+
+namespace {
+
+constexpr size_t MB = size_t{1} << 20;
+
+using Lanes = std::vector<std::shared_ptr<LaneHolder>>;
+
+/**
+ * @brief Creates a device for each lane, like CudaGpuBackend does, so lanes can't be resized
+ */
+class FixedLaneBackend : public SimulatedGpuBackend
+{
+    class NoDevice : public LaneDevice
+    {
+    public:
+        ::tensorflow::Device *as_tfdevice() override
+        {
+            return nullptr;
+        }
+    };
+
+public:
+    using SimulatedGpuBackend::SimulatedGpuBackend;
+
+    std::unique_ptr<LaneDevice> createLaneDevice(int, const DeviceInfo &, size_t, salus::MemoryLayout &) override
+    {
+        return std::make_unique<NoDevice>();
+    }
+};
+
+/**
+ * @brief Lane manager on simulated GPUs of 1G each, all of which is given to lanes
+ */
+struct LaneFixture
+{
+    std::unique_ptr<SimulatedGpuBackend> backend;
+    std::optional<LaneMgr> mgr;
+
+    explicit LaneFixture(int numGpus = 1, bool fixedLanes = false)
+        : backend(fixedLanes ? std::make_unique<FixedLaneBackend>(makeOptions(numGpus))
+                             : std::make_unique<SimulatedGpuBackend>(makeOptions(numGpus)))
+    {
+        LimitsProvider::Options opts;
+        opts.gpuReserve = 0;
+        LimitsProvider::instance().configure(opts);
+
+        setenv("SALUS_NUM_GPUS", std::to_string(numGpus).c_str(), 1);
+        mgr.emplace(*backend);
+        unsetenv("SALUS_NUM_GPUS");
+    }
+
+    ~LaneFixture()
+    {
+        mgr.reset();
+    }
+
+    static SimulatedGpuBackend::Options makeOptions(int numGpus)
+    {
+        SimulatedGpuBackend::Options opts;
+        opts.deviceCount = numGpus;
+        opts.memory = 1024 * MB;
+        return opts;
+    }
+
+    static LaneMgr::Layout layout(std::vector<size_t> memory, std::vector<size_t> persistent,
+                                  std::chrono::milliseconds timeout = std::chrono::milliseconds{0})
+    {
+        LaneMgr::Layout l;
+        l.memoryLimits = std::move(memory);
+        l.persistentOccupation = std::move(persistent);
+        l.timeout = timeout;
+        return l;
+    }
+
+    /**
+     * @brief Request lanes, the result is ready once the request is granted or timed out.
+     * Holders must not be released from inside the callback, which runs under the manager's lock,
+     * so keep the future of a request until it is resolved.
+     */
+    std::future<Lanes> request(LaneMgr::Layout l)
+    {
+        auto promise = std::make_shared<std::promise<Lanes>>();
+        auto fut = promise->get_future();
+        mgr->requestLanes(std::move(l), [promise](auto &&lanes) { promise->set_value(std::move(lanes)); });
+        return fut;
+    }
+
+    static bool ready(const std::future<Lanes> &fut, std::chrono::milliseconds wait = std::chrono::milliseconds{0})
+    {
+        return fut.wait_for(wait) == std::future_status::ready;
+    }
+};
+
+struct TwoGpuFixture : LaneFixture
+{
+    TwoGpuFixture()
+        : LaneFixture(2)
+    {
+    }
+};
+
+struct FourGpuFixture : LaneFixture
+{
+    FourGpuFixture()
+        : LaneFixture(4)
+    {
+    }
+};
+
+/**
+ * @brief A lane with 256M spare next to a full one, and 128M free on the GPU
+ */
+struct FragmentedFixture : LaneFixture
+{
+    Lanes small;
+    Lanes full;
+
+    explicit FragmentedFixture(bool fixedLanes = true)
+        : LaneFixture(1, fixedLanes)
+    {
+        auto large = request(layout({512 * MB}, {0})).get();
+        full = request(layout({384 * MB}, {384 * MB})).get();
+        // no room for a new lane, so this goes next to the large holder
+        small = request(layout({256 * MB}, {0})).get();
+        BOOST_TEST_REQUIRE(small.at(0)->id() == large.at(0)->id());
+    }
+};
+
+struct ResizableFragmentedFixture : FragmentedFixture
+{
+    ResizableFragmentedFixture()
+        : FragmentedFixture(false)
+    {
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(lanemgr)
+
+BOOST_FIXTURE_TEST_CASE(grant_and_release, LaneFixture)
+{
+    BOOST_TEST(mgr->numGPUs() == 1u);
+    BOOST_TEST(mgr->totalMemoryForGPU(0) == 1024 * MB);
+
+    auto fut = request(layout({256 * MB}, {64 * MB}));
+    BOOST_TEST_REQUIRE(ready(fut));
+    auto lanes = fut.get();
+    BOOST_TEST_REQUIRE(lanes.size() == 1u);
+    BOOST_TEST(lanes[0]->totalMemory() == 256 * MB);
+    BOOST_TEST(lanes[0]->availableMemory() == 192 * MB);
+    // the simulated backend creates no lane devices
+    BOOST_TEST(lanes[0]->as_tfdevice() == nullptr);
+
+    // the whole GPU is available again once the lane is gone
+    lanes.clear();
+    auto whole = request(layout({1024 * MB}, {1024 * MB}));
+    BOOST_TEST_REQUIRE(ready(whole));
+    BOOST_TEST(whole.get().size() == 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(shared_lane, LaneFixture)
+{
+    auto first = request(layout({1024 * MB}, {128 * MB}));
+    BOOST_TEST_REQUIRE(ready(first));
+    auto lanes1 = first.get();
+
+    // no room for a new lane, but the temporary peak fits next to the existing one
+    auto second = request(layout({512 * MB}, {0}));
+    BOOST_TEST_REQUIRE(ready(second));
+    auto lanes2 = second.get();
+    BOOST_TEST_REQUIRE(lanes2.size() == 1u);
+    BOOST_TEST(lanes2[0]->id() == lanes1[0]->id());
+
+    // persistent memory does not fit next to the other holders
+    auto third = request(layout({512 * MB}, {512 * MB}, std::chrono::milliseconds{20}));
+    BOOST_TEST_REQUIRE(ready(third, std::chrono::seconds(5)));
+    BOOST_TEST(third.get().empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(pending_granted_after_release, LaneFixture)
+{
+    auto first = request(layout({1024 * MB}, {1024 * MB}));
+    BOOST_TEST_REQUIRE(ready(first));
+    auto lanes1 = first.get();
+
+    auto second = request(layout({512 * MB}, {512 * MB}));
+    BOOST_TEST(!ready(second));
+
+    lanes1.clear();
+    BOOST_TEST_REQUIRE(ready(second));
+    auto lanes2 = second.get();
+    BOOST_TEST_REQUIRE(lanes2.size() == 1u);
+    BOOST_TEST(lanes2[0]->totalMemory() == 512 * MB);
+}
+
+BOOST_FIXTURE_TEST_CASE(timeout, LaneFixture)
+{
+    auto first = request(layout({1024 * MB}, {1024 * MB}));
+    BOOST_TEST_REQUIRE(ready(first));
+    auto lanes1 = first.get();
+
+    // nothing else happens on the manager, the request must still time out
+    auto second = request(layout({512 * MB}, {512 * MB}, std::chrono::milliseconds{50}));
+    BOOST_TEST_REQUIRE(ready(second, std::chrono::seconds(5)));
+    BOOST_TEST(second.get().empty());
+
+    // a timed out request is not granted later
+    lanes1.clear();
+    auto third = request(layout({1024 * MB}, {1024 * MB}));
+    BOOST_TEST_REQUIRE(ready(third));
+    BOOST_TEST(third.get().size() == 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(gang_all_or_nothing, TwoGpuFixture)
+{
+    BOOST_TEST_REQUIRE(mgr->numGPUs() == 2u);
+
+    auto single = request(layout({1024 * MB}, {1024 * MB}));
+    BOOST_TEST_REQUIRE(ready(single));
+    auto lanes1 = single.get();
+
+    // only one GPU is free, the gang must not take it
+    auto gang = request(layout({1024 * MB, 1024 * MB}, {1024 * MB, 1024 * MB}));
+    BOOST_TEST(!ready(gang));
+
+    auto other = request(layout({1024 * MB}, {1024 * MB}));
+    BOOST_TEST_REQUIRE(ready(other));
+    auto lanes2 = other.get();
+    BOOST_TEST(!ready(gang));
+
+    lanes1.clear();
+    BOOST_TEST(!ready(gang));
+    lanes2.clear();
+    BOOST_TEST_REQUIRE(ready(gang));
+    auto lanes = gang.get();
+    BOOST_TEST_REQUIRE(lanes.size() == 2u);
+    BOOST_TEST(lanes[0]->id() != lanes[1]->id());
+    BOOST_TEST(lanes[0]->totalMemory() == 1024 * MB);
+    BOOST_TEST(lanes[1]->totalMemory() == 1024 * MB);
+}
+
+BOOST_FIXTURE_TEST_CASE(gang_keeps_layout_order, TwoGpuFixture)
+{
+    auto single = request(layout({512 * MB}, {512 * MB})).get();
+
+    // the larger entry is placed first and only fits on the empty GPU, lanes still come back in layout order
+    auto gang = request(layout({256 * MB, 768 * MB}, {128 * MB, 256 * MB}));
+    BOOST_TEST_REQUIRE(ready(gang));
+    auto lanes = gang.get();
+    BOOST_TEST_REQUIRE(lanes.size() == 2u);
+    BOOST_TEST(lanes[0]->totalMemory() == 256 * MB);
+    BOOST_TEST(lanes[1]->totalMemory() == 768 * MB);
+}
+
+BOOST_FIXTURE_TEST_CASE(gang_timeout_leaves_nothing_held, TwoGpuFixture)
+{
+    auto single = request(layout({768 * MB}, {768 * MB})).get();
+
+    auto gang = request(layout({512 * MB, 512 * MB}, {512 * MB, 512 * MB}, std::chrono::milliseconds{20}));
+    BOOST_TEST_REQUIRE(ready(gang, std::chrono::seconds(5)));
+    BOOST_TEST(gang.get().empty());
+
+    // all of the GPU the gang did fit on is still free
+    auto whole = request(layout({1024 * MB}, {1024 * MB}));
+    BOOST_TEST_REQUIRE(ready(whole));
+    BOOST_TEST(whole.get().size() == 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(concurrent_gangs, FourGpuFixture)
+{
+    constexpr int kThreads = 4;
+    constexpr int kRounds = 200;
+
+    // overlapping gangs whose entries are placed on the GPUs in different orders
+    const std::vector<std::vector<size_t>> shapes{
+        {512 * MB, 256 * MB},
+        {256 * MB, 512 * MB},
+        {768 * MB, 256 * MB, 256 * MB},
+        {256 * MB, 256 * MB, 768 * MB},
+        {512 * MB, 512 * MB, 512 * MB, 512 * MB},
+    };
+
+    // Boost.Test assertions are not thread safe, count failures and check them at the end
+    std::atomic<int> granted{0};
+    std::atomic<int> timedOut{0};
+    std::atomic<int> stuck{0};
+    std::atomic<int> partial{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t != kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int n = 0; n != kRounds; ++n) {
+                const auto &memory = shapes[(t + n) % shapes.size()];
+                // all persistent, so gangs can't share lanes and really compete for the GPUs
+                // some give up quickly, so timeouts race with grants
+                auto fut = request(layout(memory, memory, std::chrono::milliseconds{1 + (n % 4) * 10}));
+                if (!ready(fut, std::chrono::seconds(5))) {
+                    ++stuck;
+                    return;
+                }
+                auto lanes = fut.get();
+                if (lanes.empty()) {
+                    ++timedOut;
+                    continue;
+                }
+                ++granted;
+                if (lanes.size() != memory.size()) {
+                    ++partial;
+                }
+                for (size_t i = 0; i != lanes.size() && i != memory.size(); ++i) {
+                    if (!lanes[i] || lanes[i]->totalMemory() < memory[i]) {
+                        ++partial;
+                    }
+                }
+                // hold the lanes for a while so that gangs of other threads overlap
+                std::this_thread::sleep_for(std::chrono::milliseconds(1 + n % 3));
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    BOOST_TEST(stuck.load() == 0);
+    BOOST_TEST(partial.load() == 0);
+    BOOST_TEST(granted.load() + timedOut.load() == kThreads * kRounds);
+    BOOST_TEST(granted.load() > 0);
+
+    // nothing is held any more, every GPU is free as a whole
+    auto all = request(layout({1024 * MB, 1024 * MB, 1024 * MB, 1024 * MB}, {1024 * MB, 1024 * MB, 1024 * MB, 1024 * MB}));
+    BOOST_TEST_REQUIRE(ready(all));
+    BOOST_TEST(all.get().size() == 4u);
+}
+
+BOOST_FIXTURE_TEST_CASE(defragment_for_oldest, FragmentedFixture)
+{
+    // 384M are free in total, but split between the GPU and the lane
+    auto oldest = request(layout({384 * MB}, {384 * MB}));
+    BOOST_TEST(!ready(oldest));
+
+    // the lane is draining, nothing is placed on it
+    auto shared = request(layout({256 * MB}, {0}));
+    BOOST_TEST(!ready(shared));
+    auto younger = request(layout({512 * MB}, {512 * MB}));
+    BOOST_TEST(!ready(younger));
+
+    // the memory coming back is for the oldest request, even though the younger one is larger and fits too
+    small.clear();
+    BOOST_TEST_REQUIRE(ready(oldest));
+    auto lanes = oldest.get();
+    BOOST_TEST(lanes.at(0)->totalMemory() == 384 * MB);
+    BOOST_TEST(!ready(younger));
+    BOOST_TEST_REQUIRE(ready(shared));
+
+    shared.get();
+    lanes.clear();
+    full.clear();
+    BOOST_TEST(ready(younger));
+}
+
+BOOST_FIXTURE_TEST_CASE(draining_stops_on_timeout, FragmentedFixture)
+{
+    auto oldest = request(layout({384 * MB}, {384 * MB}, std::chrono::milliseconds{50}));
+    auto shared = request(layout({256 * MB}, {0}));
+    BOOST_TEST(!ready(shared));
+
+    BOOST_TEST_REQUIRE(ready(oldest, std::chrono::seconds(5)));
+    BOOST_TEST(oldest.get().empty());
+
+    // the lane takes sessions again without anything else happening on the manager
+    BOOST_TEST_REQUIRE(ready(shared, std::chrono::seconds(5)));
+    BOOST_TEST(shared.get().at(0)->id() == small.at(0)->id());
+}
+
+BOOST_FIXTURE_TEST_CASE(defragment_shrinks_resizable_lane, ResizableFragmentedFixture)
+{
+    BOOST_TEST(small.at(0)->totalMemory() == 512 * MB);
+
+    // the spare of the lane is given back right away, no holder needs to leave
+    auto oldest = request(layout({384 * MB}, {384 * MB}));
+    BOOST_TEST_REQUIRE(ready(oldest));
+    auto lanes = oldest.get();
+    BOOST_TEST(lanes.at(0)->totalMemory() == 384 * MB);
+    BOOST_TEST(small.at(0)->totalMemory() == 256 * MB);
+
+    // the shrunk lane is not draining and still takes sessions that fit
+    auto shared = request(layout({256 * MB}, {0}));
+    BOOST_TEST_REQUIRE(ready(shared));
+    BOOST_TEST(shared.get().at(0)->id() == small.at(0)->id());
+}
+
+BOOST_FIXTURE_TEST_CASE(defragment_needs_enough_free_memory, ResizableFragmentedFixture)
+{
+    // 384M free in total is not enough, lanes are left as they are
+    auto oldest = request(layout({512 * MB}, {512 * MB}, std::chrono::milliseconds{50}));
+    BOOST_TEST(!ready(oldest));
+    BOOST_TEST(small.at(0)->totalMemory() == 512 * MB);
+
+    auto shared = request(layout({256 * MB}, {0}));
+    BOOST_TEST_REQUIRE(ready(shared));
+    shared.get();
+
+    BOOST_TEST_REQUIRE(ready(oldest, std::chrono::seconds(5)));
+    BOOST_TEST(oldest.get().empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(elastic_hold, LaneFixture)
+{
+    auto lanes = request(layout({256 * MB}, {64 * MB})).get();
+    auto &holder = *lanes.at(0);
+
+    auto usage = [](size_t persist, size_t temporary) {
+        ResStats stats;
+        stats.persist = persist;
+        stats.temporary = temporary;
+        return stats;
+    };
+
+    // grows right away after the warmup
+    for (int i = 0; i != 6; ++i) {
+        mgr->updateHold(holder, usage(100 * MB, 500 * MB));
+    }
+    BOOST_TEST(holder.totalMemory() > 600 * MB);
+
+    auto pending = request(layout({512 * MB}, {512 * MB}));
+    BOOST_TEST(!ready(pending));
+
+    // shrinks only after the cooldown, and the memory goes to the pending request
+    for (int i = 6; i != 19; ++i) {
+        mgr->updateHold(holder, usage(50 * MB, 50 * MB));
+    }
+    BOOST_TEST(!ready(pending));
+    mgr->updateHold(holder, usage(50 * MB, 50 * MB));
+    BOOST_TEST(holder.totalMemory() < 128 * MB);
+    BOOST_TEST_REQUIRE(ready(pending));
+    BOOST_TEST(pending.get().size() == 1u);
+}
+
+BOOST_FIXTURE_TEST_CASE(resize_while_granting, LaneFixture)
+{
+    auto lanes = request(layout({256 * MB}, {64 * MB})).get();
+    auto &holder = *lanes.at(0);
+
+    // holds keep growing and shrinking while other requests are planned and committed
+    std::atomic<bool> stop{false};
+    std::thread resizer([&]() {
+        ResStats small;
+        small.persist = 16 * MB;
+        small.temporary = 16 * MB;
+        ResStats large;
+        large.persist = 128 * MB;
+        large.temporary = 512 * MB;
+        for (uint64_t n = 0; !stop; ++n) {
+            mgr->updateHold(holder, n % 40 < 20 ? large : small);
+        }
+    });
+
+    for (int n = 0; n != 2000; ++n) {
+        auto fut = request(layout({256 * MB}, {128 * MB}, std::chrono::milliseconds{5}));
+        BOOST_TEST_REQUIRE(ready(fut, std::chrono::seconds(5)));
+        fut.get();
+    }
+
+    stop = true;
+    resizer.join();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "oplibraries/tensorflow/device/gpu/simgpubackend.h"
+#include "resources/limitsprovider.h"
+#include "resources/resources.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t MB = size_t{1} << 20;
+constexpr size_t GB = size_t{1} << 30;
+
+/**
+ * @brief Fake proc and cgroup trees in a temporary directory
+ */
+struct FakeRoot
+{
+    fs::path root;
+
+    FakeRoot()
+        : root(fs::temp_directory_path() / ("salus-limits-" + std::to_string(std::random_device{}())))
+    {
+        fs::create_directories(root / "proc" / "self");
+        fs::create_directories(root / "cgroup");
+    }
+
+    ~FakeRoot()
+    {
+        std::error_code ec;
+        fs::remove_all(root, ec);
+        // don't leave limits from the fake tree to other tests
+        LimitsProvider::instance().configure({});
+    }
+
+    std::string proc() const
+    {
+        return (root / "proc").string();
+    }
+
+    std::string cgroup() const
+    {
+        return (root / "cgroup").string();
+    }
+
+    void write(const fs::path &rel, const std::string &content) const
+    {
+        auto path = root / rel;
+        fs::create_directories(path.parent_path());
+        std::ofstream(path) << content;
+    }
+
+    LimitsProvider::Options options() const
+    {
+        LimitsProvider::Options opts;
+        opts.procRoot = proc();
+        opts.cgroupRoot = cgroup();
+        return opts;
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(limitsprovider)
+
+BOOST_AUTO_TEST_CASE(parse_size)
+{
+    BOOST_TEST(LimitsProvider::parseSize("4096") == 4096u);
+    BOOST_TEST(LimitsProvider::parseSize("300M") == 300 * MB);
+    BOOST_TEST(LimitsProvider::parseSize("1.5G") == 3 * GB / 2);
+    BOOST_TEST(LimitsProvider::parseSize("11GiB") == 11 * GB);
+    BOOST_TEST(LimitsProvider::parseSize(" 2 KB ") == 2048u);
+
+    BOOST_CHECK_THROW(LimitsProvider::parseSize("abc"), std::runtime_error);
+    BOOST_CHECK_THROW(LimitsProvider::parseSize("5X"), std::runtime_error);
+    BOOST_CHECK_THROW(LimitsProvider::parseSize("-1G"), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE(parse_tag)
+{
+    auto tag = LimitsProvider::parseTag("MEMORY:GPU:1");
+    BOOST_CHECK(tag == resources::GPU1Memory);
+
+    BOOST_CHECK_THROW(LimitsProvider::parseTag("MEMORY:GPU"), std::runtime_error);
+    BOOST_CHECK_THROW(LimitsProvider::parseTag("MEMROY:GPU:0"), std::runtime_error);
+    BOOST_CHECK_THROW(LimitsProvider::parseTag("MEMORY:TPU:0"), std::runtime_error);
+    BOOST_CHECK_THROW(LimitsProvider::parseTag("MEMORY:GPU:-1"), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(meminfo, FakeRoot)
+{
+    BOOST_TEST(!LimitsProvider::readMemTotal(proc()));
+
+    write("proc/meminfo", "MemTotal:       16384 kB\nMemFree:         1024 kB\n");
+    BOOST_TEST(LimitsProvider::readMemTotal(proc()).value_or(0) == 16 * MB);
+}
+
+BOOST_FIXTURE_TEST_CASE(cgroup_v1, FakeRoot)
+{
+    write("proc/self/cgroup", "5:cpu,cpuacct:/docker/abc\n4:memory:/docker/abc\n");
+    BOOST_TEST(!LimitsProvider::readCgroupMemoryLimit(proc(), cgroup()));
+
+    // inside a container only the namespace root is mounted
+    write("cgroup/memory/memory.limit_in_bytes", "4294967296\n");
+    BOOST_TEST(LimitsProvider::readCgroupMemoryLimit(proc(), cgroup()).value_or(0) == 4 * GB);
+
+    // the cgroup of the process comes first
+    write("cgroup/memory/docker/abc/memory.limit_in_bytes", "2147483648\n");
+    BOOST_TEST(LimitsProvider::readCgroupMemoryLimit(proc(), cgroup()).value_or(0) == 2 * GB);
+
+    // page aligned LONG_MAX means unlimited
+    write("cgroup/memory/docker/abc/memory.limit_in_bytes", "9223372036854771712\n");
+    write("cgroup/memory/memory.limit_in_bytes", "9223372036854771712\n");
+    BOOST_TEST(!LimitsProvider::readCgroupMemoryLimit(proc(), cgroup()));
+}
+
+BOOST_FIXTURE_TEST_CASE(cgroup_v2, FakeRoot)
+{
+    write("proc/self/cgroup", "0::/user.slice/session\n");
+    write("cgroup/user.slice/session/memory.max", "max\n");
+    BOOST_TEST(!LimitsProvider::readCgroupMemoryLimit(proc(), cgroup()));
+
+    write("cgroup/user.slice/session/memory.max", "1073741824\n");
+    BOOST_TEST(LimitsProvider::readCgroupMemoryLimit(proc(), cgroup()).value_or(0) == GB);
+}
+
+BOOST_FIXTURE_TEST_CASE(host_memory_capped_by_cgroup, FakeRoot)
+{
+    write("proc/meminfo", "MemTotal:       8388608 kB\n");
+    write("proc/self/cgroup", "0::/\n");
+    write("cgroup/memory.max", "4294967296\n");
+
+    auto opts = options();
+    // more than the cgroup allows
+    opts.overrides = "MEMORY:CPU:0=16G";
+    auto &provider = LimitsProvider::instance();
+    provider.configure(opts);
+
+    auto limits = provider.limits();
+    BOOST_TEST(limits[resources::CPU0Memory] == 4 * GB);
+}
+
+BOOST_FIXTURE_TEST_CASE(resource_file_and_overrides, FakeRoot)
+{
+    write("proc/meminfo", "MemTotal:       8388608 kB\n");
+    write("resources.json", R"({"limits": {"MEMORY:GPU:0": "10G", "GPU_STREAM:GPU:0": 64}, "gpuReserve": "512M"})");
+
+    auto opts = options();
+    opts.resourceFile = (root / "resources.json").string();
+    // command line wins over the file
+    opts.overrides = "GPU_STREAM:GPU:0=32";
+    auto &provider = LimitsProvider::instance();
+    provider.configure(opts);
+
+    auto limits = provider.limits();
+    BOOST_TEST(limits[resources::CPU0Memory] == 8 * GB);
+    BOOST_TEST(limits[resources::GPU0Memory] == 10 * GB);
+    BOOST_TEST(limits[(ResourceTag{ResourceType::GPU_STREAM, salus::devices::GPU0})] == 32u);
+    BOOST_TEST(provider.gpuReserve() == 512 * MB);
+
+    // the configured limit caps what the device has, and is capped by it
+    BOOST_TEST(provider.gpuMemoryLimit(0, 16 * GB) == 10 * GB);
+    BOOST_TEST(provider.gpuMemoryLimit(0, 8 * GB) == 8 * GB - 512 * MB);
+    // no limit configured for GPU 1
+    BOOST_TEST(provider.gpuMemoryLimit(1, 16 * GB) == 16 * GB - 512 * MB);
+}
+
+BOOST_AUTO_TEST_CASE(gpu_memory_from_backend)
+{
+    auto &provider = LimitsProvider::instance();
+    LimitsProvider::Options opts;
+    opts.gpuReserve = 512 * MB;
+    opts.overrides = "MEMORY:GPU:1=4G";
+    provider.configure(opts);
+    // built-in default until a backend reports its devices
+    BOOST_TEST(provider.limits()[resources::GPU0Memory] == 14 * GB);
+
+    salus::oplib::tensorflow::SimulatedGpuBackend::Options simOpts;
+    simOpts.deviceCount = 2;
+    simOpts.memory = 8 * GB;
+    salus::oplib::tensorflow::SimulatedGpuBackend backend(simOpts);
+    backend.discoverLimits();
+
+    auto limits = provider.limits();
+    BOOST_TEST(limits[resources::GPU0Memory] == 8 * GB - 512 * MB);
+    BOOST_TEST(limits[resources::GPU1Memory] == 4 * GB);
+
+    // and that is what allocations are admitted against
+    AllocationRegulator reg;
+    auto ticket = reg.registerJob();
+    BOOST_TEST(ticket.beginAllocation({{resources::GPU0Memory, 8 * GB - 512 * MB}}));
+    BOOST_TEST(!ticket.beginAllocation({{resources::GPU0Memory, 1}}));
+    ticket.finishJob();
+
+    // configuring again forgets discovered devices
+    provider.configure({});
+    BOOST_TEST(provider.limits()[resources::GPU0Memory] == 14 * GB);
+}
+
+BOOST_FIXTURE_TEST_CASE(malformed_config, FakeRoot)
+{
+    auto &provider = LimitsProvider::instance();
+
+    auto opts = options();
+    opts.resourceFile = (root / "missing.json").string();
+    BOOST_CHECK_THROW(provider.configure(opts), std::runtime_error);
+
+    write("bad.json", R"({"limits": {"MEMORY:GPU:0": "lots"}})");
+    opts.resourceFile = (root / "bad.json").string();
+    BOOST_CHECK_THROW(provider.configure(opts), std::runtime_error);
+
+    opts = options();
+    opts.overrides = "MEMORY:GPU:0";
+    BOOST_CHECK_THROW(provider.configure(opts), std::runtime_error);
+
+    opts.overrides = "MEMORY:GPU:0=0";
+    BOOST_CHECK_THROW(provider.configure(opts), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
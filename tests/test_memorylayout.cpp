@@ -0,0 +1,177 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resources/memorylayout.h"
+
+#include <boost/test/unit_test.hpp>
+
+using salus::MemoryLayout;
+
+namespace {
+
+constexpr size_t KB = size_t{1} << 10;
+constexpr uintptr_t kBase = 0x7f0000000000;
+
+/**
+ * @brief A 1MB region, cut into 16 blocks of 64KB allocated back to back from the base
+ */
+struct FullLayout
+{
+    MemoryLayout layout{1024 * KB};
+
+    FullLayout()
+    {
+        for (size_t i = 0; i != 16; ++i) {
+            layout.allocated(block(i), 64 * KB);
+        }
+    }
+
+    static uintptr_t block(size_t i)
+    {
+        return kBase + i * 64 * KB;
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(memorylayout)
+
+BOOST_AUTO_TEST_CASE(empty)
+{
+    MemoryLayout layout(1024 * KB);
+    BOOST_TEST(layout.usedBytes() == 0u);
+    BOOST_TEST(layout.freeBytes() == 1024 * KB);
+    BOOST_TEST(layout.largestFreeBlock() == 1024 * KB);
+    BOOST_TEST(layout.fragmentation() == 0.0);
+    BOOST_TEST(layout.canFit(1024 * KB, 1024 * KB));
+    BOOST_TEST(!layout.canFit(1024 * KB + 1, 1024 * KB + 1));
+}
+
+BOOST_AUTO_TEST_CASE(sizes_round_up_to_granularity)
+{
+    MemoryLayout layout(1024 * KB, 256);
+    layout.allocated(kBase, 1);
+    layout.allocated(kBase + 256, 300);
+    BOOST_TEST(layout.usedBytes() == 768u);
+    BOOST_TEST(layout.largestFreeBlock() == 1024 * KB - 768);
+
+    // 1 byte more than the free block once rounded
+    BOOST_TEST(!layout.canFit(1024 * KB - 768 + 1, 1024 * KB - 768 + 1));
+
+    layout.deallocated(kBase);
+    BOOST_TEST(layout.usedBytes() == 512u);
+}
+
+BOOST_FIXTURE_TEST_CASE(holes_fragment_free_space, FullLayout)
+{
+    BOOST_TEST(layout.freeBytes() == 0u);
+    BOOST_TEST(layout.largestFreeBlock() == 0u);
+    BOOST_TEST(layout.fragmentation() == 0.0);
+
+    // free every other block: half of the region is free, but only in 64KB pieces
+    for (size_t i = 0; i < 16; i += 2) {
+        layout.deallocated(block(i));
+    }
+    BOOST_TEST(layout.freeBytes() == 512 * KB);
+    BOOST_TEST(layout.largestFreeBlock() == 64 * KB);
+    BOOST_TEST(layout.fragmentation() == 1.0 - 1.0 / 8, boost::test_tools::tolerance(1e-9));
+
+    BOOST_TEST(layout.canFit(64 * KB, 512 * KB));
+    BOOST_TEST(!layout.canFit(128 * KB, 128 * KB));
+    BOOST_TEST(!layout.canFit(64 * KB, 576 * KB));
+}
+
+BOOST_FIXTURE_TEST_CASE(free_blocks_coalesce, FullLayout)
+{
+    layout.deallocated(block(4));
+    layout.deallocated(block(6));
+    BOOST_TEST(layout.largestFreeBlock() == 64 * KB);
+
+    // joins both neighbours
+    layout.deallocated(block(5));
+    BOOST_TEST(layout.largestFreeBlock() == 192 * KB);
+    BOOST_TEST(layout.fragmentation() == 0.0);
+
+    // joins the previous one at the end of the region
+    layout.deallocated(block(15));
+    layout.deallocated(block(14));
+    BOOST_TEST(layout.largestFreeBlock() == 192 * KB);
+    layout.deallocated(block(13));
+    layout.deallocated(block(12));
+    layout.deallocated(block(11));
+    layout.deallocated(block(10));
+    layout.deallocated(block(9));
+    layout.deallocated(block(8));
+    layout.deallocated(block(7));
+    BOOST_TEST(layout.largestFreeBlock() == 768 * KB);
+
+    for (size_t i = 0; i != 4; ++i) {
+        layout.deallocated(block(i));
+    }
+    BOOST_TEST(layout.largestFreeBlock() == 1024 * KB);
+    BOOST_TEST(layout.usedBytes() == 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(reuse_of_freed_space, FullLayout)
+{
+    for (size_t i = 4; i != 8; ++i) {
+        layout.deallocated(block(i));
+    }
+    BOOST_TEST(layout.largestFreeBlock() == 256 * KB);
+
+    // a smaller allocation in the middle of the hole splits it
+    layout.allocated(block(5), 64 * KB);
+    BOOST_TEST(layout.largestFreeBlock() == 128 * KB);
+    BOOST_TEST(layout.freeBytes() == 192 * KB);
+    BOOST_TEST(layout.fragmentation() == 1.0 / 3, boost::test_tools::tolerance(1e-9));
+}
+
+BOOST_AUTO_TEST_CASE(rebase_below_first_allocation)
+{
+    MemoryLayout layout(1024 * KB);
+    // the first allocation seen is not at the start of the region
+    layout.allocated(kBase + 256 * KB, 64 * KB);
+    BOOST_TEST(layout.largestFreeBlock() == 960 * KB);
+
+    layout.allocated(kBase, 64 * KB);
+    BOOST_TEST(layout.usedBytes() == 128 * KB);
+    BOOST_TEST(layout.largestFreeBlock() == 704 * KB);
+    BOOST_TEST(layout.fragmentation() == 1.0 - 704.0 / 896, boost::test_tools::tolerance(1e-9));
+
+    layout.deallocated(kBase + 256 * KB);
+    BOOST_TEST(layout.largestFreeBlock() == 960 * KB);
+}
+
+BOOST_AUTO_TEST_CASE(unknown_and_duplicate_events)
+{
+    MemoryLayout layout(1024 * KB);
+    layout.allocated(kBase, 64 * KB);
+    layout.allocated(kBase, 64 * KB);
+    BOOST_TEST(layout.usedBytes() == 64 * KB);
+
+    layout.deallocated(kBase + 64 * KB);
+    BOOST_TEST(layout.usedBytes() == 64 * KB);
+
+    layout.deallocated(kBase);
+    layout.deallocated(kBase);
+    BOOST_TEST(layout.usedBytes() == 0u);
+    BOOST_TEST(layout.largestFreeBlock() == 1024 * KB);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,251 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resources/memorymgr.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <condition_variable>
+#include <cstring>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// enough chunks for one of every default class, and then some
+constexpr size_t kReserveChunks = 64;
+
+/**
+ * @brief Configures the slab allocator with a small reservation once, before anything is allocated.
+ * MemoryMgr is a singleton that can't be configured after use, so all tests share this.
+ */
+struct SlabConfig
+{
+    SlabConfig()
+    {
+        static bool configured = [] {
+            MemoryMgr::Options opts;
+            opts.slab = true;
+            opts.hugePages = MemoryMgr::HugePages::Off;
+            opts.reserveBytes = kReserveChunks * MemoryMgr::kChunkSize;
+            MemoryMgr::instance().configure(opts);
+            return true;
+        }();
+        BOOST_TEST_REQUIRE(configured);
+        BOOST_TEST_REQUIRE(MemoryMgr::instance().stats().slab);
+    }
+
+    static MemoryMgr &mgr()
+    {
+        return MemoryMgr::instance();
+    }
+
+    static uint64_t outstanding()
+    {
+        uint64_t n = 0;
+        for (const auto &cls : mgr().stats().classes) {
+            n += cls.outstanding;
+        }
+        return n;
+    }
+
+    /**
+     * @brief Run f on a new thread and wait for the thread to exit, which flushes its cache
+     */
+    template<typename F>
+    static void onThread(F f)
+    {
+        std::thread(std::move(f)).join();
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(memorymgr)
+
+BOOST_AUTO_TEST_CASE(invalid_options)
+{
+    // validated before anything else, so this doesn't change the configuration
+    MemoryMgr::Options opts;
+    opts.sizeClasses = {16, 40};
+    BOOST_CHECK_THROW(MemoryMgr::instance().configure(opts), std::runtime_error);
+    opts.sizeClasses = {32, 16};
+    BOOST_CHECK_THROW(MemoryMgr::instance().configure(opts), std::runtime_error);
+    opts.sizeClasses = {MemoryMgr::kChunkSize};
+    BOOST_CHECK_THROW(MemoryMgr::instance().configure(opts), std::runtime_error);
+
+    BOOST_TEST((MemoryMgr::parseHugePages("hugetlb") == MemoryMgr::HugePages::HugeTLB));
+    BOOST_CHECK_THROW(MemoryMgr::parseHugePages("always"), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(alignment_of_every_class, SlabConfig)
+{
+    auto before = mgr().stats();
+    onThread([&]() {
+        for (const auto &cls : before.classes) {
+            for (int alignment : {16, 32, 64}) {
+                auto a = static_cast<char *>(mgr().allocate(alignment, cls.size));
+                auto b = static_cast<char *>(mgr().allocate(alignment, cls.size));
+                BOOST_TEST_INFO("size " << cls.size << ", alignment " << alignment);
+                BOOST_TEST_REQUIRE((a && b));
+                BOOST_TEST(reinterpret_cast<uintptr_t>(a) % alignment == 0u);
+                BOOST_TEST(reinterpret_cast<uintptr_t>(b) % alignment == 0u);
+                // objects don't overlap
+                BOOST_TEST(static_cast<size_t>(a > b ? a - b : b - a) >= cls.size);
+                std::memset(a, 0xa5, cls.size);
+                std::memset(b, 0x5a, cls.size);
+                BOOST_TEST(static_cast<unsigned char>(a[cls.size - 1]) == 0xa5u);
+                mgr().deallocate(a);
+                mgr().deallocate(b);
+            }
+        }
+    });
+    auto after = mgr().stats();
+    // all served from slabs
+    BOOST_TEST(after.systemAllocations == before.systemAllocations);
+    BOOST_TEST(outstanding() == 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(cross_thread_free, SlabConfig)
+{
+    constexpr size_t kObjects = 10000;
+
+    std::vector<void *> ptrs;
+    onThread([&]() {
+        for (size_t i = 0; i != kObjects; ++i) {
+            ptrs.push_back(mgr().allocate(16, 64 + i % 512));
+        }
+    });
+    BOOST_TEST(outstanding() >= kObjects);
+
+    // freed on a thread that never allocated
+    onThread([&]() {
+        for (auto ptr : ptrs) {
+            mgr().deallocate(ptr);
+        }
+    });
+    BOOST_TEST(outstanding() == 0u);
+
+    // and reused
+    auto mapped = mgr().stats().mappedBytes;
+    onThread([&]() {
+        for (size_t i = 0; i != kObjects; ++i) {
+            ptrs[i] = mgr().allocate(16, 64 + i % 512);
+        }
+        for (auto ptr : ptrs) {
+            mgr().deallocate(ptr);
+        }
+    });
+    BOOST_TEST(mgr().stats().mappedBytes == mapped);
+    BOOST_TEST(outstanding() == 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(cache_flushed_at_thread_exit, SlabConfig)
+{
+    std::promise<void> cached;
+    std::promise<void> exit;
+    std::thread t([&]() {
+        std::vector<void *> ptrs;
+        for (int i = 0; i != 100; ++i) {
+            ptrs.push_back(mgr().allocate(16, 32));
+        }
+        for (auto ptr : ptrs) {
+            mgr().deallocate(ptr);
+        }
+        cached.set_value();
+        exit.get_future().wait();
+    });
+
+    cached.get_future().wait();
+    // freed objects sit in the thread's cache
+    BOOST_TEST(outstanding() > 0u);
+
+    exit.set_value();
+    t.join();
+    BOOST_TEST(outstanding() == 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(concurrent_stress, SlabConfig)
+{
+    constexpr int kThreads = 4;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t != kThreads; ++t) {
+        threads.emplace_back([t]() {
+            std::vector<void *> live;
+            for (int i = 0; i != 20000; ++i) {
+                if (live.size() < 500 || (i + t) % 3 != 0) {
+                    auto size = static_cast<size_t>(16 + (i * 37 + t * 101) % 4096);
+                    auto ptr = static_cast<char *>(mgr().allocate(16, size));
+                    ptr[0] = static_cast<char>(i);
+                    live.push_back(ptr);
+                } else {
+                    mgr().deallocate(live.back());
+                    live.pop_back();
+                }
+            }
+            for (auto ptr : live) {
+                mgr().deallocate(ptr);
+            }
+        });
+    }
+    for (auto &t : threads) {
+        t.join();
+    }
+    BOOST_TEST(outstanding() == 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(fallback_when_reservation_used_up, SlabConfig)
+{
+    const auto largest = mgr().stats().classes.back().size;
+    const auto systemBefore = mgr().stats().systemAllocations;
+
+    std::vector<void *> ptrs;
+    onThread([&]() {
+        // more objects of the largest class than the whole reservation holds
+        const auto maxObjects = kReserveChunks * (MemoryMgr::kChunkSize / largest) + 1;
+        for (size_t i = 0; i != maxObjects && mgr().stats().systemAllocations == systemBefore; ++i) {
+            auto ptr = mgr().allocate(64, largest);
+            BOOST_TEST_REQUIRE(ptr != nullptr);
+            BOOST_TEST(reinterpret_cast<uintptr_t>(ptr) % 64 == 0u);
+            ptrs.push_back(ptr);
+        }
+    });
+    BOOST_TEST(mgr().stats().systemAllocations == systemBefore + 1);
+    BOOST_TEST(mgr().stats().mappedBytes <= kReserveChunks * MemoryMgr::kChunkSize);
+
+    // system allocations are given back to the system, the rest to the slabs
+    onThread([&]() {
+        for (auto ptr : ptrs) {
+            mgr().deallocate(ptr);
+        }
+    });
+    BOOST_TEST(outstanding() == 0u);
+}
+
+BOOST_FIXTURE_TEST_CASE(configure_after_use_throws, SlabConfig)
+{
+    onThread([]() { mgr().deallocate(mgr().allocate(16, 16)); });
+    BOOST_CHECK_THROW(mgr().configure({}), std::runtime_error);
+    BOOST_TEST(mgr().stats().slab);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
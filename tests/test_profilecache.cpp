@@ -0,0 +1,168 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resources/profilecache.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <random>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr size_t MB = size_t{1} << 20;
+constexpr uint64_t kGraph = 0x9f86d081884c7d65;
+
+ResStats stats(size_t persist, size_t temporary)
+{
+    ResStats s;
+    s.persist = persist;
+    s.temporary = temporary;
+    s.count = 100;
+    s.largest = temporary / 2;
+    return s;
+}
+
+/**
+ * @brief A cache file in a temporary directory, the cache is disabled again afterwards
+ */
+struct CacheFile
+{
+    fs::path dir;
+    std::string path;
+
+    CacheFile()
+        : dir(fs::temp_directory_path() / ("salus-profiles-" + std::to_string(std::random_device{}())))
+        , path((dir / "profiles.json").string())
+    {
+        fs::create_directories(dir);
+    }
+
+    ~CacheFile()
+    {
+        ProfileCache::instance().configure("");
+        std::error_code ec;
+        fs::remove_all(dir, ec);
+    }
+
+    void write(const std::string &content) const
+    {
+        std::ofstream(path) << content;
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(profilecache)
+
+BOOST_FIXTURE_TEST_CASE(round_trip, CacheFile)
+{
+    auto &cache = ProfileCache::instance();
+    cache.configure(path);
+    BOOST_TEST(cache.enabled());
+    BOOST_TEST(cache.size() == 0u);
+    BOOST_TEST(!cache.lookup(kGraph));
+
+    cache.record(kGraph, stats(256 * MB, 512 * MB), 20);
+    // not saved yet, within the save interval
+    cache.save();
+    BOOST_TEST(!fs::exists(path));
+    cache.save(true);
+    BOOST_TEST(fs::exists(path));
+
+    // as in a later run
+    cache.configure(path);
+    BOOST_TEST(cache.size() == 1u);
+    auto hit = cache.lookup(kGraph);
+    BOOST_TEST_REQUIRE(hit.has_value());
+    BOOST_TEST(hit->persist == 256 * MB);
+    BOOST_TEST(hit->temporary == 512 * MB);
+    BOOST_TEST(hit->count == 100u);
+    BOOST_TEST(hit->largest == 256 * MB);
+    BOOST_TEST(!cache.lookup(kGraph + 1));
+}
+
+BOOST_FIXTURE_TEST_CASE(disabled_without_path, CacheFile)
+{
+    auto &cache = ProfileCache::instance();
+    cache.configure("");
+    BOOST_TEST(!cache.enabled());
+    cache.record(kGraph, stats(256 * MB, 512 * MB), 20);
+    BOOST_TEST(!cache.lookup(kGraph));
+}
+
+BOOST_FIXTURE_TEST_CASE(malformed_file, CacheFile)
+{
+    auto &cache = ProfileCache::instance();
+
+    write("{\"version\": 1, \"entries\": {\"9f86d081884c7d65\": {\"temporary\": 1024");
+    BOOST_CHECK_THROW(cache.configure(path), std::runtime_error);
+
+    write(R"({"version": 2, "entries": {}})");
+    BOOST_CHECK_THROW(cache.configure(path), std::runtime_error);
+
+    write(R"({"version": 1, "entries": {"not-hex": {"temporary": 1, "persist": 1}}})");
+    BOOST_CHECK_THROW(cache.configure(path), std::runtime_error);
+
+    write(R"({"version": 1, "entries": {"9f86d081884c7d65": {"persist": 1}}})");
+    BOOST_CHECK_THROW(cache.configure(path), std::runtime_error);
+}
+
+BOOST_FIXTURE_TEST_CASE(longer_run_kept, CacheFile)
+{
+    auto &cache = ProfileCache::instance();
+    cache.configure(path);
+
+    cache.record(kGraph, stats(256 * MB, 512 * MB), 50);
+    // the first iterations of another run tell less than the entry already has
+    cache.record(kGraph, stats(16 * MB, 16 * MB), 1);
+    cache.record(kGraph, stats(16 * MB, 16 * MB), 2);
+
+    auto hit = cache.lookup(kGraph);
+    BOOST_TEST_REQUIRE(hit.has_value());
+    BOOST_TEST(hit->temporary == 512 * MB);
+
+    cache.record(kGraph, stats(256 * MB, 768 * MB), 60);
+    BOOST_TEST(cache.lookup(kGraph)->temporary == 768 * MB);
+}
+
+BOOST_FIXTURE_TEST_CASE(newer_run_refreshes, CacheFile)
+{
+    auto &cache = ProfileCache::instance();
+    cache.configure(path);
+    cache.record(kGraph, stats(256 * MB, 512 * MB), 1000);
+
+    // same graph with a smaller batch, the whole run reports as it goes
+    for (uint64_t iter = 1; iter != ProfileCache::kRefreshIterations; ++iter) {
+        cache.record(kGraph, stats(128 * MB, 128 * MB), iter);
+        BOOST_TEST(cache.lookup(kGraph)->temporary == 512 * MB);
+    }
+    cache.record(kGraph, stats(128 * MB, 128 * MB), ProfileCache::kRefreshIterations);
+    BOOST_TEST(cache.lookup(kGraph)->temporary == 128 * MB);
+
+    // and is what the next run gets
+    cache.save(true);
+    cache.configure(path);
+    BOOST_TEST(cache.lookup(kGraph)->temporary == 128 * MB);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
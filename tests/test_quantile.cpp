@@ -0,0 +1,148 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resources/iteralloctracker.h"
+#include "utils/quantile.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+namespace {
+
+constexpr size_t MB = size_t{1} << 20;
+
+double exactQuantile(std::vector<double> samples, double p)
+{
+    auto rank = static_cast<size_t>(std::ceil(p * samples.size()));
+    auto nth = samples.begin() + std::clamp<size_t>(rank, 1, samples.size()) - 1;
+    std::nth_element(samples.begin(), nth, samples.end());
+    return *nth;
+}
+
+template<typename Dist>
+void checkAccuracy(Dist dist, double p, double relTolerance)
+{
+    std::mt19937 gen(42);
+    sstl::P2Quantile est(p);
+    std::vector<double> samples;
+    for (int i = 0; i != 10000; ++i) {
+        auto x = dist(gen);
+        samples.push_back(x);
+        est.add(x);
+    }
+    auto exact = exactQuantile(samples, p);
+    BOOST_TEST_INFO("p=" << p << ", exact=" << exact << ", estimated=" << est.value());
+    BOOST_TEST(std::abs(est.value() - exact) <= relTolerance * exact);
+}
+
+/**
+ * @brief Sets the estimation quantile for trackers created in a test, and restores the default afterwards
+ */
+struct QuantileSetting
+{
+    double saved = salus::IterAllocTracker::estimationQuantile();
+
+    explicit QuantileSetting(double q)
+    {
+        salus::IterAllocTracker::setEstimationQuantile(q);
+    }
+
+    ~QuantileSetting()
+    {
+        salus::IterAllocTracker::setEstimationQuantile(saved);
+    }
+};
+
+/**
+ * @brief Run iterations whose temporary usage is mostly 100MB, but 400MB every tenth iteration,
+ * like a job with varying sequence lengths
+ */
+size_t estimateVaryingJob()
+{
+    AllocationRegulator reg({{resources::GPU0Memory, 1024 * MB}});
+    auto ticket = reg.registerJob();
+
+    salus::IterAllocTracker tracker(resources::GPU0Memory);
+    for (int i = 0; i != 100; ++i) {
+        BOOST_TEST_REQUIRE(tracker.beginIter(ticket, {}, 0));
+        tracker.update(i % 10 == 9 ? 400 * MB : 100 * MB);
+        tracker.update(0);
+        tracker.endIter();
+    }
+    ticket.finishJob();
+    return tracker.estimation().temporary;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(quantile)
+
+BOOST_AUTO_TEST_CASE(exact_on_few_samples)
+{
+    sstl::P2Quantile est(0.95);
+    BOOST_TEST(est.value() == 0.0);
+
+    for (auto x : {3.0, 1.0, 5.0, 2.0, 4.0}) {
+        est.add(x);
+    }
+    BOOST_TEST(est.count() == 5u);
+    BOOST_TEST(est.value() == 5.0);
+
+    est.reset();
+    est.add(7);
+    BOOST_TEST(est.count() == 1u);
+    BOOST_TEST(est.value() == 7.0);
+}
+
+BOOST_AUTO_TEST_CASE(accuracy_uniform)
+{
+    for (auto p : {0.5, 0.9, 0.95, 0.99}) {
+        checkAccuracy(std::uniform_real_distribution<double>(100, 200), p, 0.01);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(accuracy_long_tail)
+{
+    for (auto p : {0.5, 0.9, 0.95, 0.99}) {
+        checkAccuracy(std::lognormal_distribution<double>(0, 1), p, 0.05);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tracker_covers_peaks)
+{
+    QuantileSetting q(0.95);
+    // the estimator interpolates between the two sizes, but stays close to the peak
+    auto est = estimateVaryingJob();
+    BOOST_TEST(est > 360 * MB);
+    BOOST_TEST(est <= 400 * MB);
+}
+
+BOOST_AUTO_TEST_CASE(tracker_running_average)
+{
+    QuantileSetting q(0);
+    auto est = estimateVaryingJob();
+    BOOST_TEST(est > 100 * MB);
+    BOOST_TEST(est < 400 * MB);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
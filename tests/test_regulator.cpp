@@ -0,0 +1,208 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "resources/resources.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr size_t MB = size_t{1} << 20;
+
+Resources gpu(size_t bytes)
+{
+    return {{resources::GPU0Memory, bytes}};
+}
+
+/**
+ * @brief A regulator over 1GB of GPU memory, where requests of at least half of it get in line
+ */
+struct RegulatorFixture
+{
+    AllocationRegulator reg{gpu(1024 * MB)};
+
+    explicit RegulatorFixture(std::chrono::milliseconds aging = 0ms, std::chrono::milliseconds timeout = 5000ms)
+    {
+        AllocationRegulator::QueueOptions opts;
+        opts.enabled = true;
+        opts.minFraction = 0.5;
+        opts.aging = aging;
+        opts.timeout = timeout;
+        reg.setQueueOptions(opts);
+    }
+};
+
+struct AgingFixture : RegulatorFixture
+{
+    AgingFixture()
+        : RegulatorFixture(200ms)
+    {
+    }
+};
+
+struct TimeoutFixture : RegulatorFixture
+{
+    TimeoutFixture()
+        : RegulatorFixture(0ms, 50ms)
+    {
+    }
+};
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(regulator)
+
+BOOST_AUTO_TEST_CASE(no_queue_lets_small_requests_pass)
+{
+    AllocationRegulator reg{gpu(1024 * MB)};
+    auto holder = reg.registerJob();
+    auto large = reg.registerJob();
+    auto small = reg.registerJob();
+
+    BOOST_TEST(holder.beginAllocation(gpu(600 * MB)));
+    BOOST_TEST(!large.beginAllocation(gpu(800 * MB)));
+    BOOST_TEST(small.beginAllocation(gpu(100 * MB)));
+}
+
+BOOST_FIXTURE_TEST_CASE(fifo_serves_large_request_first, RegulatorFixture)
+{
+    auto holder = reg.registerJob();
+    auto large = reg.registerJob();
+    auto small = reg.registerJob();
+
+    BOOST_TEST(holder.beginAllocation(gpu(600 * MB)));
+    BOOST_TEST(!large.beginAllocation(gpu(800 * MB)));
+    // what is free is earmarked for the large request
+    BOOST_TEST(!small.beginAllocation(gpu(100 * MB)));
+
+    holder.endAllocation(gpu(600 * MB));
+    BOOST_TEST(!small.beginAllocation(gpu(300 * MB)));
+    BOOST_TEST(large.beginAllocation(gpu(800 * MB)));
+    // out of line, only the leftover is available
+    BOOST_TEST(small.beginAllocation(gpu(200 * MB)));
+}
+
+BOOST_FIXTURE_TEST_CASE(fifo_keeps_order_between_waiters, RegulatorFixture)
+{
+    auto holder = reg.registerJob();
+    auto first = reg.registerJob();
+    auto second = reg.registerJob();
+
+    BOOST_TEST(holder.beginAllocation(gpu(1024 * MB)));
+    BOOST_TEST(!first.beginAllocation(gpu(600 * MB)));
+    BOOST_TEST(!second.beginAllocation(gpu(600 * MB)));
+
+    holder.endAllocation(gpu(1024 * MB));
+    BOOST_TEST(!second.beginAllocation(gpu(600 * MB)));
+    BOOST_TEST(first.beginAllocation(gpu(600 * MB)));
+    BOOST_TEST(!second.beginAllocation(gpu(600 * MB)));
+
+    first.endAllocation(gpu(600 * MB));
+    BOOST_TEST(second.beginAllocation(gpu(600 * MB)));
+}
+
+BOOST_FIXTURE_TEST_CASE(aging_grows_earmark, AgingFixture)
+{
+    auto holder = reg.registerJob();
+    auto large = reg.registerJob();
+    auto small = reg.registerJob();
+
+    BOOST_TEST(holder.beginAllocation(gpu(600 * MB)));
+    BOOST_TEST(!large.beginAllocation(gpu(800 * MB)));
+    // a fresh waiter earmarks almost nothing
+    BOOST_TEST(small.beginAllocation(gpu(100 * MB)));
+    small.endAllocation(gpu(100 * MB));
+
+    std::this_thread::sleep_for(250ms);
+    BOOST_TEST(!small.beginAllocation(gpu(100 * MB)));
+}
+
+BOOST_FIXTURE_TEST_CASE(abandoned_waiter_expires, TimeoutFixture)
+{
+    auto holder = reg.registerJob();
+    auto large = reg.registerJob();
+    auto small = reg.registerJob();
+
+    BOOST_TEST(holder.beginAllocation(gpu(600 * MB)));
+    BOOST_TEST(!large.beginAllocation(gpu(800 * MB)));
+    BOOST_TEST(!small.beginAllocation(gpu(100 * MB)));
+
+    std::this_thread::sleep_for(100ms);
+    BOOST_TEST(small.beginAllocation(gpu(100 * MB)));
+}
+
+BOOST_FIXTURE_TEST_CASE(finished_job_leaves_line, RegulatorFixture)
+{
+    auto holder = reg.registerJob();
+    auto large = reg.registerJob();
+    auto small = reg.registerJob();
+
+    BOOST_TEST(holder.beginAllocation(gpu(600 * MB)));
+    BOOST_TEST(!large.beginAllocation(gpu(800 * MB)));
+    large.finishJob();
+    BOOST_TEST(small.beginAllocation(gpu(100 * MB)));
+}
+
+BOOST_FIXTURE_TEST_CASE(large_job_not_starved, AgingFixture)
+{
+    constexpr int kSmallJobs = 4;
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> threads;
+    for (int i = 0; i != kSmallJobs; ++i) {
+        threads.emplace_back([this, &done]() {
+            auto t = reg.registerJob();
+            while (!done) {
+                if (t.beginAllocation(gpu(200 * MB))) {
+                    std::this_thread::sleep_for(1ms);
+                    t.endAllocation(gpu(200 * MB));
+                }
+                std::this_thread::yield();
+            }
+            t.finishJob();
+        });
+    }
+
+    auto large = reg.registerJob();
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    bool granted = false;
+    while (!granted && std::chrono::steady_clock::now() < deadline) {
+        granted = large.beginAllocation(gpu(600 * MB));
+        std::this_thread::sleep_for(1ms);
+    }
+    BOOST_TEST(granted);
+    large.finishJob();
+
+    done = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+
+    // everything is given back
+    auto check = reg.registerJob();
+    BOOST_TEST(check.beginAllocation(gpu(1024 * MB)));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "execution/scheduler/sessionitem.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+constexpr size_t MB = size_t{1} << 20;
+
+/**
+ * @brief Run one iteration of graphId, which allocates and frees temporary bytes
+ */
+void runIteration(SessionItem &item, AllocationRegulator::Ticket ticket, uint64_t graphId, size_t temporary)
+{
+    BOOST_TEST_REQUIRE(item.beginIteration(ticket, {}, graphId));
+    item.notifyAlloc(graphId, ticket.as_int, resources::GPU0Memory, temporary);
+    item.notifyDealloc(graphId, ticket.as_int, resources::GPU0Memory, temporary, true);
+    item.endIteration(graphId);
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(sessionitem)
+
+BOOST_AUTO_TEST_CASE(iteration_end_estimation_covers_all_graphs)
+{
+    AllocationRegulator reg({{resources::GPU0Memory, 1024 * MB}});
+    auto ticket = reg.registerJob();
+
+    SessionItem item("session");
+    std::vector<ResStats> seen;
+    item.setIterationEndCallback([&seen](const ResStats &est) { seen.push_back(est); });
+
+    // the session alternates between a large and a small graph
+    for (int i = 0; i != 3; ++i) {
+        runIteration(item, ticket, 1, 512 * MB);
+        runIteration(item, ticket, 2, 64 * MB);
+    }
+
+    BOOST_TEST_REQUIRE(seen.size() == 6u);
+    for (const auto &est : seen) {
+        BOOST_TEST(est.temporary == 512 * MB);
+    }
+
+    ticket.finishJob();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "oplibraries/tensorflow/device/gpu/simgpubackend.h"
+#include "oplibraries/tensorflow/device/gpu/smeventpoller.h"
+#include "oplibraries/tensorflow/v3/smblocker.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+extern "C" void salus_kernel_launch_callback(unsigned int gridDimX, unsigned int gridDimY, unsigned int gridDimZ,
+                                             unsigned int blockDimX, unsigned int blockDimY, unsigned int blockDimZ,
+                                             unsigned int sharedMemBytes, void *);
+
+using salus::oplib::tensorflow::GpuBackend;
+using salus::oplib::tensorflow::SimulatedGpuBackend;
+using salus::oplib::tensorflow::SMBlocker;
+using salus::oplib::tensorflow::SMEventPoller;
+using namespace std::chrono_literals;
+
+namespace {
+
+constexpr uint64_t kGraphId = 1;
+constexpr int kNumKernels = 8;
+// kernel taking the whole GPU
+constexpr int kFullKernel = kNumKernels;
+constexpr unsigned int kSMs = 80;
+constexpr int kThreads = 4;
+
+/**
+ * @brief SMBlocker is a singleton sized by the backend set first, so all tests share one simulated GPU
+ * and the same set of kernels, kernel i using 10 * (i + 1) SMs.
+ */
+SMBlocker &blocker()
+{
+    static auto &b = []() -> SMBlocker & {
+        SimulatedGpuBackend::Options opts;
+        opts.smCount = kSMs;
+        GpuBackend::setInstance(std::make_unique<SimulatedGpuBackend>(opts));
+        SMBlocker::setScaleFactorSM(1.0);
+
+        auto &blocker = SMBlocker::instance();
+        for (int i = 0; i != kNumKernels; ++i) {
+            salus_kernel_launch_callback(10 * (i + 1), 1, 1, 256, 1, 1, 0, nullptr);
+            blocker.saveCurrentThreadResults(kGraphId, i);
+        }
+        salus_kernel_launch_callback(kSMs, 1, 1, 256, 1, 1, 0, nullptr);
+        blocker.saveCurrentThreadResults(kGraphId, kFullKernel);
+        return blocker;
+    }();
+    return b;
+}
+
+/**
+ * @brief Whether every SM is back, by taking the kernel that uses the whole GPU
+ */
+bool allSMsReleased(SMBlocker &b)
+{
+    if (!b.tryTake(kGraphId, kFullKernel, 0)) {
+        return false;
+    }
+    b.release(b.currentThreadSMHolding());
+    return true;
+}
+
+/**
+ * @brief Launch kernels from several threads, with SMEventPoller releasing the SMs once the modeled kernel
+ * finishes, as SalusGPUDevice does. Returns the number of failed events.
+ */
+uint64_t launchThroughPoller(double errorRate, uint64_t launches)
+{
+    auto &b = blocker();
+
+    SimulatedGpuBackend::Options opts;
+    opts.smCount = kSMs;
+    opts.eventErrorRate = errorRate;
+    opts.seed = 42;
+    SimulatedGpuBackend backend(opts);
+
+    std::atomic<int> drained{0};
+    {
+        SMEventPoller poller(backend, 0);
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t != kThreads; ++t) {
+            threads.emplace_back([&, t]() {
+                auto stream = backend.createStream(0);
+                for (auto i = static_cast<uint64_t>(t); i < launches; i += kThreads) {
+                    auto kernel = static_cast<int>(i % kNumKernels);
+                    while (!b.tryTake(kGraphId, kernel, 10)) {
+                        std::this_thread::yield();
+                    }
+                    stream->launch(10us);
+                    poller.thenReleaseSM(stream.get(), b.currentThreadSMHolding());
+                }
+                poller.thenExecute(stream.get(), [&drained]() { ++drained; });
+            });
+        }
+        for (auto &th : threads) {
+            th.join();
+        }
+        while (drained.load() != kThreads) {
+            std::this_thread::sleep_for(100us);
+        }
+    }
+    return backend.stats().eventsFailed;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(smblocker)
+
+BOOST_AUTO_TEST_CASE(take_respects_capacity)
+{
+    auto &b = blocker();
+
+    BOOST_TEST_REQUIRE(b.tryTake(kGraphId, kFullKernel, 10));
+    auto held = b.currentThreadSMHolding();
+    BOOST_TEST(held == kSMs);
+    // nothing left, even for the smallest kernel
+    BOOST_TEST(!b.tryTake(kGraphId, 0, 0));
+    b.release(held);
+
+    BOOST_TEST(allSMsReleased(b));
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_take_release)
+{
+    auto &b = blocker();
+
+    std::atomic<uint64_t> inUse{0};
+    std::atomic<int> overCommitted{0};
+    std::atomic<int> wrongHolding{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t != kThreads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (int i = 0; i != 5000; ++i) {
+                auto kernel = (i + t) % kNumKernels;
+                if (!b.tryTake(kGraphId, kernel, 10)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                auto held = b.currentThreadSMHolding();
+                if (held != 10u * (kernel + 1)) {
+                    ++wrongHolding;
+                }
+                if (inUse += held; inUse.load() > kSMs) {
+                    ++overCommitted;
+                }
+                inUse -= held;
+                b.release(held);
+            }
+        });
+    }
+    for (auto &th : threads) {
+        th.join();
+    }
+
+    BOOST_TEST(wrongHolding.load() == 0);
+    BOOST_TEST(overCommitted.load() == 0);
+    BOOST_TEST(allSMsReleased(b));
+}
+
+BOOST_AUTO_TEST_CASE(poller_releases_sms)
+{
+    auto failed = launchThroughPoller(0.0, 2000);
+    BOOST_TEST(failed == 0u);
+    BOOST_TEST(allSMsReleased(blocker()));
+}
+
+BOOST_AUTO_TEST_CASE(poller_releases_sms_on_event_errors)
+{
+    // failed events must still release their SMs and run queued actions
+    auto failed = launchThroughPoller(0.05, 2000);
+    BOOST_TEST(failed > 0u);
+    BOOST_TEST(allSMsReleased(blocker()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,277 @@
+/*
+ * Copyright 2019 Peifeng Yu <peifeng@umich.edu>
+ * 
+ * This file is part of Salus
+ * (see https://github.com/SymbioticLab/Salus).
+ * 
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ * 
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ * 
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "execution/threadpool/threadpool.h"
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// More than a worker queue holds
+constexpr size_t kBurst = 5000;
+
+/**
+ * @brief Wait until pred holds, or give up after timeout
+ */
+template<typename Pred>
+bool waitUntil(Pred pred, std::chrono::milliseconds timeout = 10s)
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pred()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+    return true;
+}
+
+/**
+ * @brief Keeps workers busy until opened, so that submitted tasks pile up in the queues
+ */
+struct Gate
+{
+    std::mutex mu;
+    std::condition_variable cv;
+    bool isOpen = false;
+    std::atomic<size_t> waiting{0};
+
+    void wait()
+    {
+        ++waiting;
+        std::unique_lock<std::mutex> lock(mu);
+        cv.wait(lock, [this]() { return isOpen; });
+    }
+
+    void open()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            isOpen = true;
+        }
+        cv.notify_all();
+    }
+
+    /**
+     * @brief Occupy every worker of pool with waiting on this gate
+     */
+    void hold(ThreadPool &pool)
+    {
+        for (size_t i = 0; i != pool.numThreads(); ++i) {
+            pool.run([this]() { wait(); });
+        }
+        BOOST_TEST_REQUIRE(waitUntil([&]() { return waiting.load() == pool.numThreads(); }));
+    }
+};
+
+/**
+ * @brief Run numBlockers tasks that wait, in a blocking region, for a gate only opened by a task
+ * queued once all workers are blocked. Returns how many waits timed out.
+ */
+size_t runBlockingTasks(ThreadPool &pool, size_t numBlockers, std::chrono::milliseconds timeout)
+{
+    std::mutex mu;
+    std::condition_variable cv;
+    bool open = false;
+    std::atomic<size_t> entered{0};
+    std::atomic<size_t> finished{0};
+    std::atomic<size_t> timedOut{0};
+
+    for (size_t j = 0; j != numBlockers; ++j) {
+        pool.run([&]() {
+            {
+                ThreadPool::ScopedBlockingRegion blocking;
+                ++entered;
+                std::unique_lock<std::mutex> lock(mu);
+                if (!cv.wait_for(lock, timeout, [&]() { return open; })) {
+                    ++timedOut;
+                }
+            }
+            ++finished;
+        });
+    }
+    BOOST_TEST_REQUIRE(waitUntil([&]() { return entered.load() >= std::min(numBlockers, pool.numThreads()); }));
+    pool.run([&]() {
+        {
+            std::unique_lock<std::mutex> lock(mu);
+            open = true;
+        }
+        cv.notify_all();
+        ++finished;
+    });
+    BOOST_TEST_REQUIRE(waitUntil([&]() { return finished.load() == numBlockers + 1; }, 4 * timeout));
+    return timedOut;
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_SUITE(threadpool)
+
+BOOST_AUTO_TEST_CASE(burst_spills_to_overflow)
+{
+    constexpr size_t kProducers = 4;
+
+    ThreadPool pool(ThreadPoolOptions{}.setNumThreads(2));
+    Gate gate;
+    gate.hold(pool);
+
+    std::atomic<size_t> executed{0};
+    std::atomic<size_t> rejected{0};
+    std::vector<std::thread> producers;
+    for (size_t p = 0; p != kProducers; ++p) {
+        producers.emplace_back([&]() {
+            for (size_t j = 0; j != kBurst; ++j) {
+                if (pool.tryRun([&executed]() { ++executed; })) {
+                    ++rejected;
+                }
+            }
+        });
+    }
+    for (auto &t : producers) {
+        t.join();
+    }
+
+    BOOST_TEST(rejected.load() == 0u);
+    auto stats = pool.stats();
+    BOOST_TEST(stats.overflows > 0u);
+    BOOST_TEST(stats.overflowPending == stats.overflows);
+    BOOST_TEST(executed.load() == 0u);
+
+    gate.open();
+    BOOST_TEST(waitUntil([&]() { return executed.load() == kProducers * kBurst; }));
+    BOOST_TEST(pool.stats().overflowPending == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(burst_from_inside_worker)
+{
+    ThreadPool pool(ThreadPoolOptions{}.setNumThreads(2));
+
+    std::atomic<size_t> executed{0};
+    pool.run([&]() {
+        for (size_t j = 0; j != kBurst; ++j) {
+            pool.run([&executed]() { ++executed; });
+        }
+    });
+    BOOST_TEST(waitUntil([&]() { return executed.load() == kBurst; }));
+}
+
+BOOST_AUTO_TEST_CASE(high_priority_overflow_runs_first)
+{
+    ThreadPool pool(ThreadPoolOptions{}.setNumThreads(1).setHighPriorityBurst(0));
+    Gate gate;
+    gate.hold(pool);
+
+    // only touched by the single worker
+    std::vector<TaskPriority> order;
+    order.reserve(2 * kBurst);
+    for (auto priority : {TaskPriority::Normal, TaskPriority::High}) {
+        for (size_t j = 0; j != kBurst; ++j) {
+            pool.run([&order, priority]() { order.push_back(priority); }, priority);
+        }
+    }
+    BOOST_TEST(pool.stats().overflowPending > 0u);
+
+    std::atomic<bool> done{false};
+    pool.run([&done]() { done = true; });
+    gate.open();
+    BOOST_TEST_REQUIRE(waitUntil([&]() { return done.load(); }));
+
+    BOOST_TEST_REQUIRE(order.size() == 2 * kBurst);
+    for (size_t i = 0; i != order.size(); ++i) {
+        BOOST_TEST_INFO("task " << i);
+        BOOST_TEST((order[i] == (i < kBurst ? TaskPriority::High : TaskPriority::Normal)));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(overflow_drained_before_exit)
+{
+    std::atomic<size_t> executed{0};
+    {
+        ThreadPool pool(ThreadPoolOptions{}.setNumThreads(2));
+        Gate gate;
+        gate.hold(pool);
+        for (size_t j = 0; j != kBurst; ++j) {
+            pool.run([&executed]() { ++executed; });
+        }
+        BOOST_TEST(pool.stats().overflowPending > 0u);
+        gate.open();
+    }
+    BOOST_TEST(executed.load() == kBurst);
+}
+
+BOOST_AUTO_TEST_CASE(spares_cover_blocked_workers)
+{
+    constexpr size_t kThreads = 4;
+    ThreadPool pool(ThreadPoolOptions{}.setNumThreads(kThreads));
+
+    // more blockers than workers, so spares block as well
+    BOOST_TEST(runBlockingTasks(pool, kThreads + kThreads / 2, 5s) == 0u);
+
+    auto stats = pool.stats();
+    BOOST_TEST(stats.blockingRegions == kThreads + kThreads / 2);
+    BOOST_TEST(stats.spareThreads > 0u);
+    BOOST_TEST(stats.spareThreads <= kThreads);
+
+    // parked spares are reused
+    BOOST_TEST(runBlockingTasks(pool, kThreads, 5s) == 0u);
+    BOOST_TEST(pool.stats().spareThreads == stats.spareThreads);
+}
+
+BOOST_AUTO_TEST_CASE(no_spares_deadlock)
+{
+    constexpr size_t kThreads = 2;
+    ThreadPool pool(ThreadPoolOptions{}.setNumThreads(kThreads).setMaxSpareThreads(0));
+
+    // without compensation, the gate is only opened after a wait times out and frees a worker
+    BOOST_TEST(runBlockingTasks(pool, kThreads, 200ms) > 0u);
+    BOOST_TEST(pool.stats().spareThreads == 0u);
+}
+
+BOOST_AUTO_TEST_CASE(spares_capped)
+{
+    constexpr size_t kThreads = 2;
+    ThreadPool pool(ThreadPoolOptions{}.setNumThreads(kThreads).setMaxSpareThreads(1));
+
+    // one spare runs the gate task while both workers block
+    BOOST_TEST(runBlockingTasks(pool, kThreads, 5s) == 0u);
+    BOOST_TEST(pool.stats().spareThreads == 1u);
+}
+
+BOOST_AUTO_TEST_CASE(blocking_region_outside_pool)
+{
+    ThreadPool pool(ThreadPoolOptions{}.setNumThreads(2));
+    {
+        ThreadPool::ScopedBlockingRegion blocking;
+    }
+    auto stats = pool.stats();
+    BOOST_TEST(stats.blockingRegions == 0u);
+    BOOST_TEST(stats.spareThreads == 0u);
+}
+
+BOOST_AUTO_TEST_SUITE_END()